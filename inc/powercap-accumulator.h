@@ -0,0 +1,137 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Accumulate a zone's energy counter into a monotonic 64-bit total that is corrected for counter wraparound.
+ * Unless otherwise stated, all functions return 0 on success or a negative value on error.
+ *
+ * A zone's energy_uj counter wraps at max_energy_range_uj, which may take only minutes on large packages.
+ * If more time passes between updates than the counter takes to wrap at its maximum power (max_power_range_uw), the
+ * number of missed wraps can't be known for certain.
+ * Such samples are flagged as ambiguous, and the number of wraps is estimated from the last unambiguous average power.
+ *
+ * Only one thread may update an accumulator, but any number of threads may concurrently read it - reads are lock-free
+ * and never block the updater.
+ *
+ * Views are per-client virtual counters on top of a shared accumulator, each with its own baseline.
+ * Unlike powercap_zone_reset_energy_uj(...), resetting a view doesn't write to sysfs or affect any other client.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#ifndef _POWERCAP_ACCUMULATOR_H_
+#define _POWERCAP_ACCUMULATOR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "powercap.h"
+
+/**
+ * Accumulator state.
+ * Fields should only be accessed through the functions below.
+ */
+typedef struct powercap_accumulator {
+  /* Odd while an update is in progress (wraps around, so it doesn't indicate whether there's a baseline) */
+  uint32_t seq;
+  /* Set by the first update */
+  int started;
+  uint64_t total_uj;
+  uint64_t time_ns;
+  uint64_t num_ambiguous;
+  uint64_t last_uj;
+  /* 0 if unknown */
+  uint64_t max_energy_range_uj;
+  /* 0 if unknown */
+  uint64_t max_power_uw;
+  /* Average power over the last unambiguous interval, used to estimate missed wraps */
+  double last_power_uw;
+  const powercap_zone* zone;
+} powercap_accumulator;
+
+/**
+ * Initialize an accumulator with a counter's wraparound value and maximum power, either of which may be 0 if unknown.
+ * Without a max power, missed wraps can't be detected.
+ * Without a max energy range, a counter that goes backward is assumed to have restarted from 0 and is ambiguous.
+ */
+int powercap_accumulator_init(powercap_accumulator* acc, uint64_t max_energy_range_uj, uint64_t max_power_range_uw);
+
+/**
+ * Initialize an accumulator for a zone, reading its max_energy_range_uj and max_power_range_uw files if they exist.
+ * The zone must remain open for use with powercap_accumulator_update_zone(...).
+ */
+int powercap_accumulator_init_zone(powercap_accumulator* acc, const powercap_zone* zone);
+
+/**
+ * Update with a raw energy_uj value read at a CLOCK_MONOTONIC time in nanoseconds.
+ * The first update only establishes a baseline.
+ * Returns 0 on success, 1 if the number of missed wraps was ambiguous, or a negative value if time went backward.
+ */
+int powercap_accumulator_update(powercap_accumulator* acc, uint64_t energy_uj, uint64_t time_ns);
+
+/**
+ * Read the zone's energy_uj file and update with the current time.
+ * Returns like powercap_accumulator_update(...), or a negative value if the read fails.
+ */
+int powercap_accumulator_update_zone(powercap_accumulator* acc);
+
+/**
+ * Get the total energy in microjoules since the first update.
+ */
+uint64_t powercap_accumulator_get_total_uj(const powercap_accumulator* acc);
+
+/**
+ * Get the total energy in microjoules and the CLOCK_MONOTONIC time in nanoseconds of the update that produced it, as a
+ * consistent pair.
+ * Either pointer may be NULL.
+ */
+int powercap_accumulator_get(const powercap_accumulator* acc, uint64_t* total_uj, uint64_t* time_ns);
+
+/**
+ * Get the number of updates where the number of missed wraps was ambiguous.
+ */
+uint64_t powercap_accumulator_get_num_ambiguous(const powercap_accumulator* acc);
+
+/**
+ * A virtual counter with its own baseline.
+ * A view is owned by one client (it's not safe to use the same view from multiple threads), but any number of views of
+ * an accumulator may be used concurrently with each other and with the accumulator's updater.
+ * Fields should only be accessed through the functions below.
+ */
+typedef struct powercap_accumulator_view {
+  const powercap_accumulator* acc;
+  uint64_t baseline_uj;
+  uint64_t baseline_ns;
+} powercap_accumulator_view;
+
+/**
+ * Initialize a view of an accumulator, with a baseline at the accumulator's latest update.
+ * The accumulator must outlive the view.
+ * Fails with EAGAIN if the accumulator hasn't been updated yet.
+ */
+int powercap_accumulator_view_init(powercap_accumulator_view* view, const powercap_accumulator* acc);
+
+/**
+ * Move the view's baseline to the accumulator's latest update.
+ */
+int powercap_accumulator_view_reset(powercap_accumulator_view* view);
+
+/**
+ * Get the energy in microjoules and the time in nanoseconds since the view's baseline, as of the accumulator's latest
+ * update.
+ * Either pointer may be NULL.
+ */
+int powercap_accumulator_view_read(const powercap_accumulator_view* view, uint64_t* energy_uj, uint64_t* elapsed_ns);
+
+/**
+ * Like powercap_accumulator_view_read(...), then move the baseline to the values that were read, so that consecutive
+ * calls measure consecutive intervals without gaps.
+ */
+int powercap_accumulator_view_lap(powercap_accumulator_view* view, uint64_t* energy_uj, uint64_t* elapsed_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Measure energy over short intervals with reads aligned to energy counter updates.
+ * Unless otherwise stated, all functions return 0 on success or a negative value on error.
+ *
+ * Energy counters like RAPL's update periodically (roughly every millisecond), not continuously.
+ * Two arbitrary reads of a counter that updates every 1 ms are each off by up to one update, which is a large error
+ * for an interval of only a few milliseconds.
+ * Aligned reads spin on the counter until its value changes, then timestamp that moment, so that both the energy and
+ * the duration of a measurement span whole counter updates.
+ * The cost is CPU time spent spinning - up to one update period per aligned read - which is reported to the caller.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#ifndef _POWERCAP_ALIGNED_H_
+#define _POWERCAP_ALIGNED_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "powercap.h"
+
+/**
+ * An aligned counter reading.
+ */
+typedef struct powercap_aligned_read {
+  /* The counter's new value */
+  uint64_t energy_uj;
+  /* CLOCK_MONOTONIC time in nanoseconds at which the update was observed */
+  uint64_t time_ns;
+  /* Time spent spinning in nanoseconds */
+  uint64_t spin_ns;
+  /* Number of counter reads */
+  uint32_t polls;
+} powercap_aligned_read;
+
+/**
+ * A measurement between two aligned reads of a zone's energy counter.
+ */
+typedef struct powercap_aligned_meter {
+  /* Borrowed energy_uj file descriptor */
+  int fd;
+  /* Cached max_energy_range_uj value, used to correct for counter wraparound (0 if unknown) */
+  uint64_t max_energy_range_uj;
+  /* The longest time to spin for a counter update */
+  uint64_t max_spin_ns;
+  /* Set by powercap_aligned_meter_begin(...) */
+  powercap_aligned_read start;
+  int start_aligned;
+} powercap_aligned_meter;
+
+/**
+ * Spin until the counter's value changes, or until "max_spin_ns" elapses.
+ * Returns 0 if an update was observed, 1 if the spin timed out (the result then holds the last value read and the time
+ * it was read), or a negative value in case of error.
+ */
+int powercap_aligned_read_zone(const powercap_zone* zone, uint64_t max_spin_ns, powercap_aligned_read* result);
+
+/**
+ * Initialize a meter for a zone, reading and caching the zone's max_energy_range_uj value.
+ * The zone must remain open for the lifetime of the meter.
+ * A "max_spin_ns" of a few update periods (e.g., 5000000 for RAPL) tolerates an occasional late update.
+ */
+int powercap_aligned_meter_init(powercap_aligned_meter* meter, const powercap_zone* zone, uint64_t max_spin_ns);
+
+/**
+ * Begin a measurement with an aligned read.
+ * Returns 0 if aligned, 1 if the spin timed out, or a negative value in case of error.
+ */
+int powercap_aligned_meter_begin(powercap_aligned_meter* meter);
+
+/**
+ * End a measurement with an aligned read, getting the energy and duration since it began.
+ * If not NULL, "spin_ns" is set to the total time spent spinning in the begin and end reads.
+ * Returns 0 if both reads were aligned, 1 if either spin timed out, or a negative value in case of error.
+ */
+int powercap_aligned_meter_end(powercap_aligned_meter* meter, uint64_t* energy_uj, uint64_t* duration_ns,
+                               uint64_t* spin_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
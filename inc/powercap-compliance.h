@@ -0,0 +1,168 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Verify that power limits are respected, i.e., that the average power over each constraint's time window doesn't
+ * exceed its power limit.
+ * Unless otherwise stated, all functions return 0 on success or a negative value on error.
+ *
+ * Each target is a constraint and the energy counter of its zone.
+ * A constraint's power limit and time window are read from its files when the verifier is created (and when
+ * refreshed), and a sliding window of the counter's energy is kept at no finer than the expected sample period, so
+ * memory is O(time window / sample period) per target.
+ * Each sample updates every target's window average incrementally, and a violation lasts from the first sample whose
+ * window average exceeds the limit until the first one that doesn't.
+ * A verifier is fed raw energy_uj values - typically batches drained from a sampler - and is not thread-safe.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#ifndef _POWERCAP_COMPLIANCE_H_
+#define _POWERCAP_COMPLIANCE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "powercap.h"
+#include "powercap-rapl.h"
+
+/**
+ * Verifier configuration.
+ */
+typedef struct powercap_compliance_config {
+  /* The expected time between samples, which determines the resolution (and size) of each target's window */
+  uint64_t sample_period_us;
+  /* Allowed relative excess, e.g., 0.05 to only report averages more than 5% above the limit */
+  double tolerance;
+  /* Completed violations kept until read - the oldest are discarded when full */
+  uint32_t max_violations;
+} powercap_compliance_config;
+
+/**
+ * A constraint to verify.
+ * The constraint must remain open until the verifier is destroyed.
+ */
+typedef struct powercap_compliance_target {
+  const powercap_constraint* constraint;
+  /* The index of the energy counter for the constraint's zone in each sample */
+  uint32_t counter;
+} powercap_compliance_target;
+
+/**
+ * A period during which a target's window average exceeded its limit.
+ */
+typedef struct powercap_compliance_violation {
+  uint32_t target;
+  uint64_t power_limit_uw;
+  uint64_t time_window_us;
+  /* CLOCK_MONOTONIC time of the first sample in violation, in nanoseconds */
+  uint64_t start_ns;
+  /* Time from the first sample in violation to the last one */
+  uint64_t duration_ns;
+  /* The highest window average */
+  double peak_w;
+  /* Energy consumed above the limit, i.e., the window average's excess integrated over the violation */
+  double excess_uj;
+} powercap_compliance_violation;
+
+/**
+ * A target's current state.
+ */
+typedef struct powercap_compliance_status {
+  uint64_t power_limit_uw;
+  uint64_t time_window_us;
+  /* The window average, only valid if a full window has been observed */
+  double average_w;
+  int has_average;
+  /* Whether the target is in violation, in which case "current" is the ongoing violation */
+  int violating;
+  powercap_compliance_violation current;
+  /* Violations started */
+  uint64_t violations;
+  /* Time in violation */
+  uint64_t violation_ns;
+  /* Time with a full window, i.e., that was verified */
+  uint64_t verified_ns;
+} powercap_compliance_status;
+
+/**
+ * Opaque verifier handle.
+ */
+typedef struct powercap_compliance powercap_compliance;
+
+/**
+ * Create a verifier for "ntargets" targets, where samples have "ncounters" counters.
+ * The "max_energy_range_uj" array has each counter's wraparound value (0 if unknown), or may be NULL if all are unknown.
+ * Fails if a constraint's power limit or time window can't be read, or if the time window is 0.
+ * Returns NULL and sets errno on failure.
+ */
+powercap_compliance* powercap_compliance_create(const powercap_compliance_target* targets, uint32_t ntargets,
+                                                uint32_t ncounters, const uint64_t* max_energy_range_uj,
+                                                const powercap_compliance_config* cfg);
+
+/**
+ * Create a verifier for every constraint with a power limit and time window in all domains of RAPL instances, with
+ * counters ordered like powercap_rapl_snapshot_init(...).
+ * Targets are ordered by domain, then long term, short term, and other constraints.
+ * The instances must remain initialized until the verifier is destroyed.
+ * Returns NULL and sets errno on failure, including ENODATA if there are no such constraints.
+ */
+powercap_compliance* powercap_compliance_create_rapl(const powercap_rapl_pkg* pkgs, uint32_t count,
+                                                     const powercap_compliance_config* cfg);
+
+/**
+ * Free the verifier.
+ */
+void powercap_compliance_destroy(powercap_compliance* compliance);
+
+/**
+ * Get the number of targets.
+ */
+uint32_t powercap_compliance_get_num_targets(const powercap_compliance* compliance);
+
+/**
+ * Get a target.
+ * Returns NULL and sets errno on failure.
+ */
+const powercap_compliance_target* powercap_compliance_get_target(const powercap_compliance* compliance,
+                                                                 uint32_t target);
+
+/**
+ * Read every target's power limit and time window again, e.g., after they were changed.
+ * A target whose time window changed ends any violation and restarts its window.
+ */
+int powercap_compliance_refresh(powercap_compliance* compliance);
+
+/**
+ * Add a sample of all counters' raw energy_uj values ("ncounters" elements) read at a CLOCK_MONOTONIC time in
+ * nanoseconds.
+ * Fails with EINVAL if time went backward, and ignores samples at the same time as the previous one.
+ */
+int powercap_compliance_add(powercap_compliance* compliance, uint64_t time_ns, const uint64_t* energy_uj);
+
+/**
+ * Add a batch of "n" samples, where counter c of sample i is at energy_uj[c * stride + i], like the samples from
+ * powercap_sampler_read(...).
+ */
+int powercap_compliance_add_samples(powercap_compliance* compliance, const uint64_t* time_ns,
+                                    const uint64_t* energy_uj, uint32_t n, uint32_t stride);
+
+/**
+ * Get a target's current state.
+ */
+int powercap_compliance_get_status(const powercap_compliance* compliance, uint32_t target,
+                                   powercap_compliance_status* status);
+
+/**
+ * Dequeue up to "max" of the oldest completed violations, in the order they ended.
+ * Returns the number of violations read, or a negative value in case of error.
+ */
+int powercap_compliance_read_violations(powercap_compliance* compliance, powercap_compliance_violation* violations,
+                                        uint32_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
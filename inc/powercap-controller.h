@@ -0,0 +1,162 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Closed-loop power control: adjust power limits so that measured power tracks a target, e.g., to hold a node at a
+ * wattage more precisely than hardware power caps alone.
+ * Unless otherwise stated, all functions return 0 on success or a negative value on error.
+ *
+ * A controller runs one or more loops at a fixed period.
+ * Each loop measures the total power of a set of counters (one zone, or all of a node's packages) from a snapshot of
+ * energy counters, and a PID controller computes the total power limit for a set of constraints, each of which is set
+ * to an equal share.
+ * Limits are clamped to each constraint's min_power_uw and max_power_uw (if they exist) and the loop's bounds, and the
+ * share that a constraint can't take is redistributed to the others, so the output is bounded by the sums of the
+ * constraints' bounds.
+ * The integral term stops accumulating while the output is clamped (anti-windup), and limits that haven't changed aren't
+ * written.
+ * Control starts from the constraints' current limits, so starting a controller doesn't cause a step change.
+ *
+ * Iterations don't allocate or take locks, and the controller thread can be pinned to a CPU and run with a real-time
+ * scheduling policy; the statistics report each iteration's latency from its scheduled start.
+ * Processes that need hard latency bounds should also lock their memory, e.g., with mlockall(2).
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#ifndef _POWERCAP_CONTROLLER_H_
+#define _POWERCAP_CONTROLLER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "powercap.h"
+#include "powercap-snapshot.h"
+
+/**
+ * Controller configuration.
+ */
+typedef struct powercap_controller_config {
+  uint64_t period_us;
+  /* Limits within this of the last written value aren't written (0 only skips unchanged values) */
+  uint64_t write_threshold_uw;
+  /* SCHED_FIFO priority for the controller thread, or 0 for the default scheduling policy */
+  int rt_priority;
+  /* CPU to pin the controller thread to, or -1 to not pin it */
+  int cpu;
+} powercap_controller_config;
+
+/**
+ * A control loop.
+ * The constraints' power_limit_uw files must be open for reading and writing, and must remain open until the
+ * controller is destroyed.
+ */
+typedef struct powercap_controller_loop {
+  /* Indexes of the counters whose power is summed */
+  const uint32_t* counters;
+  uint32_t ncounters;
+  /* Constraints whose power limits are set */
+  const powercap_constraint* constraints;
+  uint32_t nconstraints;
+  uint64_t target_uw;
+  /* Gains, in Watts of total limit per Watt of error (kp), per Watt-second (ki), and per Watt per second (kd) */
+  double kp;
+  double ki;
+  double kd;
+  /* Bounds for each constraint's power limit, in addition to its min_power_uw and max_power_uw (0 for none) */
+  uint64_t min_limit_uw;
+  uint64_t max_limit_uw;
+} powercap_controller_loop;
+
+/**
+ * A loop's state after its latest iteration.
+ */
+typedef struct powercap_controller_status {
+  uint64_t target_uw;
+  /* Measured power */
+  double power_w;
+  /* Total of the constraints' power limits */
+  double output_w;
+  /* Whether the output is clamped */
+  int saturated;
+} powercap_controller_status;
+
+/**
+ * Controller statistics.
+ */
+typedef struct powercap_controller_stats {
+  uint64_t iterations;
+  /* Periods skipped because an iteration (or waking up) took too long */
+  uint64_t missed;
+  uint64_t writes;
+  /* Writes skipped because the limit didn't change */
+  uint64_t skipped_writes;
+  uint64_t read_errors;
+  uint64_t write_errors;
+  /* Time from each iteration's scheduled start until it's done (only for the controller thread) */
+  uint64_t max_latency_ns;
+  uint64_t total_latency_ns;
+} powercap_controller_stats;
+
+/**
+ * Opaque controller handle.
+ */
+typedef struct powercap_controller powercap_controller;
+
+/**
+ * Create a controller for "nloops" loops, whose counter indexes refer to the counters in "counters".
+ * The counters' zones must remain open until the controller is destroyed, but the snapshot itself may be destroyed.
+ * Fails if a constraint's power limit can't be read, or if a constraint's limit has no upper bound (neither
+ * max_power_uw nor "max_limit_uw").
+ * Returns NULL and sets errno on failure.
+ */
+powercap_controller* powercap_controller_create(const powercap_snapshot* counters,
+                                                const powercap_controller_loop* loops, uint32_t nloops,
+                                                const powercap_controller_config* cfg);
+
+/**
+ * Stop the controller if it's running and free it.
+ * Power limits are left at their last written values.
+ */
+int powercap_controller_destroy(powercap_controller* controller);
+
+/**
+ * Start the controller thread.
+ * If the real-time priority or CPU can't be set (e.g., for lack of privileges), the thread runs without them.
+ */
+int powercap_controller_start(powercap_controller* controller);
+
+/**
+ * Stop the controller thread.
+ */
+int powercap_controller_stop(powercap_controller* controller);
+
+/**
+ * Run one iteration in the caller's thread, e.g., from an existing periodic loop, when the controller thread isn't
+ * running.
+ * The first iteration after creating (or stopping) the controller only reads the counters and current power limits.
+ */
+int powercap_controller_update(powercap_controller* controller);
+
+/**
+ * Set a loop's target power, which is safe while the controller thread is running.
+ */
+int powercap_controller_set_target(powercap_controller* controller, uint32_t loop, uint64_t target_uw);
+
+/**
+ * Get a loop's state, which is safe while the controller thread is running.
+ */
+int powercap_controller_get_status(const powercap_controller* controller, uint32_t loop,
+                                   powercap_controller_status* status);
+
+/**
+ * Get the controller's statistics, which is safe while the controller thread is running.
+ */
+int powercap_controller_get_stats(const powercap_controller* controller, powercap_controller_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
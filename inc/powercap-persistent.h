@@ -0,0 +1,90 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Energy accumulators whose state survives process restarts, kept in a small memory-mapped file.
+ * Unless otherwise stated, all functions return 0 on success or a negative value on error.
+ *
+ * Every update writes the accumulator's state to a shared file mapping, so it's persisted by the kernel's page cache
+ * without any system calls or fsync on the hot path.
+ * The state file records which zone it belongs to, and state saved for a different zone is discarded.
+ * When the file is opened again, the saved state is reconciled with the zone's live energy counter: energy consumed
+ * while no process was running is added to the total if it can be determined unambiguously (the counter wrapped at most
+ * once, or missed wraps can be ruled out), otherwise the gap is flagged.
+ * Energy consumed across a reboot is always a gap, since counters restart with the system.
+ *
+ * Only one process may have a file open at a time.
+ * Use powercap_persistent_sync(...) to also protect against a system crash or power loss, e.g., periodically.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#ifndef _POWERCAP_PERSISTENT_H_
+#define _POWERCAP_PERSISTENT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "powercap.h"
+#include "powercap-accumulator.h"
+
+/**
+ * The result of opening a persistent accumulator.
+ */
+typedef enum powercap_persistent_status {
+  /* No valid saved state, so the accumulator starts at 0 */
+  POWERCAP_PERSISTENT_NEW,
+  /* Saved state was reconciled with the live counter */
+  POWERCAP_PERSISTENT_RESUMED,
+  /* Saved state was found, but the energy since it was saved is unknown (e.g., after a reboot) and isn't included */
+  POWERCAP_PERSISTENT_GAP
+} powercap_persistent_status;
+
+/**
+ * Opaque persistent accumulator handle.
+ */
+typedef struct powercap_persistent powercap_persistent;
+
+/**
+ * Open (or create) the state file at "path" for a zone, and reconcile any saved state with the zone's energy counter.
+ * The zone must remain open until the persistent accumulator is closed.
+ * If not NULL, "status" is set to the result of reconciliation.
+ * Returns NULL and sets errno on failure - EWOULDBLOCK if another process has the file open.
+ */
+powercap_persistent* powercap_persistent_open(const char* path, const powercap_zone* zone,
+                                              powercap_persistent_status* status);
+
+/**
+ * Read the zone's energy_uj file, update the accumulator, and save its state.
+ * Returns like powercap_accumulator_update_zone(...).
+ */
+int powercap_persistent_update(powercap_persistent* persistent);
+
+/**
+ * Get the accumulator, for reading like any other (e.g., with views).
+ * Only update it with powercap_persistent_update(...), otherwise the state isn't saved.
+ */
+const powercap_accumulator* powercap_persistent_get_accumulator(const powercap_persistent* persistent);
+
+/**
+ * Get the number of gaps in the accumulator's total since the state file was created.
+ */
+uint64_t powercap_persistent_get_num_gaps(const powercap_persistent* persistent);
+
+/**
+ * Write the state to storage, blocking until done.
+ */
+int powercap_persistent_sync(powercap_persistent* persistent);
+
+/**
+ * Unmap and close the state file.
+ * The state is not synced to storage, but remains in the page cache for the next open.
+ */
+int powercap_persistent_close(powercap_persistent* persistent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Derive a power stream from energy counter readings, optionally filtered.
+ * Unless otherwise stated, all functions return 0 on success or a negative value on error.
+ *
+ * Most zones don't have a power_uw file, so power must be computed from energy_uj deltas.
+ * Energy counters only update periodically (roughly every millisecond for RAPL), so power computed over short intervals
+ * is noisy - the filters trade some responsiveness for a smoother signal.
+ * Updates are O(1) and never allocate.
+ * A stream is not thread-safe.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#ifndef _POWERCAP_POWER_STREAM_H_
+#define _POWERCAP_POWER_STREAM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "powercap.h"
+#include "powercap-snapshot.h"
+
+/**
+ * Power filters.
+ */
+typedef enum powercap_power_filter {
+  /* Average power since the previous update */
+  POWERCAP_POWER_FILTER_RAW,
+  /* Exponentially weighted moving average, where a sample's weight halves every "half_life_us" */
+  POWERCAP_POWER_FILTER_EWMA,
+  /* One-dimensional Kalman filter that models power as a random walk */
+  POWERCAP_POWER_FILTER_KALMAN
+} powercap_power_filter;
+
+/**
+ * Power stream configuration.
+ */
+typedef struct powercap_power_stream_config {
+  powercap_power_filter filter;
+  /* EWMA only */
+  uint64_t half_life_us;
+  /* Kalman only: how much the true power's variance grows per second (W^2/s) */
+  double process_noise;
+  /* Kalman only: the variance of raw power measurements (W^2) */
+  double measurement_noise;
+} powercap_power_stream_config;
+
+/**
+ * Power stream state.
+ * Fields should only be accessed through the functions below.
+ */
+typedef struct powercap_power_stream {
+  powercap_power_stream_config cfg;
+  /* 0 if unknown */
+  uint64_t max_energy_range_uj;
+  uint64_t last_uj;
+  uint64_t last_ns;
+  /* Filtered power estimate */
+  double power_w;
+  /* Kalman only: estimate variance */
+  double variance;
+  /* 0 before the first update, 1 after the baseline, 2 once there's a power estimate */
+  int state;
+} powercap_power_stream;
+
+/**
+ * Initialize a stream for a counter that wraps at "max_energy_range_uj" (0 if unknown).
+ */
+int powercap_power_stream_init(powercap_power_stream* stream, const powercap_power_stream_config* cfg,
+                               uint64_t max_energy_range_uj);
+
+/**
+ * Initialize a stream for a zone, reading its max_energy_range_uj file if it exists.
+ */
+int powercap_power_stream_init_zone(powercap_power_stream* stream, const powercap_power_stream_config* cfg,
+                                    const powercap_zone* zone);
+
+/**
+ * Discard all readings, keeping the configuration.
+ */
+int powercap_power_stream_reset(powercap_power_stream* stream);
+
+/**
+ * Update with a raw energy_uj value read at a CLOCK_MONOTONIC time in nanoseconds.
+ * If not NULL, "power_w" is set to the current power estimate (0 before there is one).
+ * The first update only establishes a baseline, and an update at the same time as the previous one is ignored.
+ * Returns 0 if there's a power estimate, 1 if not yet, or a negative value if time went backward.
+ */
+int powercap_power_stream_update(powercap_power_stream* stream, uint64_t energy_uj, uint64_t time_ns,
+                                 double* power_w);
+
+/**
+ * Update "count" streams, one per counter, from a snapshot with "count" counters.
+ * The "power_w" array must have "count" elements, which are set to each stream's power estimate.
+ * Unsupported counters are skipped and their power is 0.
+ * Returns 0 if every supported counter has a power estimate, 1 if not yet, or a negative value in case of error.
+ */
+int powercap_power_stream_update_snapshot(powercap_power_stream* streams, const powercap_snapshot* snap,
+                                          double* power_w);
+
+/**
+ * Get the current power estimate in Watts, or 0 if there isn't one yet.
+ */
+double powercap_power_stream_get_power_w(const powercap_power_stream* stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * A sampling profiler that attributes energy to the calling process's call stacks.
+ * Unless otherwise stated, all functions return 0 on success or a negative value on error.
+ *
+ * A SIGPROF timer fires at a fixed rate of the process's CPU time, and the signal handler records the interrupted
+ * thread's call stack into a lock-free buffer - it doesn't read any counters or allocate.
+ * A separate profiler thread periodically reads the energy counters with a single snapshot read, attributes the
+ * process's share of the energy consumed since its last read (its CPU time relative to the time of all online CPUs) to
+ * the stacks sampled in that interval, and aggregates energy and sample counts per unique stack.
+ * Results are written as folded stacks, the input format for flame graph tools.
+ *
+ * Only one profiler may run in a process at a time, and it uses the process's ITIMER_PROF timer and SIGPROF handler.
+ * Symbols are resolved with dladdr(3), so only exported symbols have names (link executables with -rdynamic to export
+ * theirs) - other frames are reported as the object's file name and offset.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#ifndef _POWERCAP_PROFILER_H_
+#define _POWERCAP_PROFILER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include "powercap-snapshot.h"
+
+/* Maximum number of frames recorded per stack */
+#define POWERCAP_PROFILER_MAX_FRAMES 128
+
+/**
+ * Profiler configuration.
+ */
+typedef struct powercap_profiler_config {
+  /* Stack samples per second of the process's CPU time */
+  uint32_t frequency_hz;
+  /* How often energy is read and attributed to the stacks sampled since the last read */
+  uint64_t interval_us;
+  /* Frames recorded per stack, at most POWERCAP_PROFILER_MAX_FRAMES - deeper stacks are truncated at the root */
+  uint32_t max_frames;
+  /* Stack samples buffered between intervals, rounded up to a power of 2 - samples are dropped when it's full */
+  uint32_t capacity;
+} powercap_profiler_config;
+
+/**
+ * What the values in folded stacks represent.
+ */
+typedef enum powercap_profiler_weight {
+  /* Attributed energy in microjoules */
+  POWERCAP_PROFILER_WEIGHT_ENERGY,
+  /* Number of samples, i.e., CPU time */
+  POWERCAP_PROFILER_WEIGHT_SAMPLES
+} powercap_profiler_weight;
+
+/**
+ * Profiler statistics.
+ */
+typedef struct powercap_profiler_stats {
+  /* Stack samples attributed */
+  uint64_t samples;
+  /* Stack samples discarded because the buffer was full */
+  uint64_t dropped;
+  /* Unique stacks */
+  uint64_t stacks;
+  /* Energy consumed by all counters while profiling */
+  uint64_t total_energy_uj;
+  /* Energy attributed to the process's stacks */
+  double attributed_energy_uj;
+} powercap_profiler_stats;
+
+/**
+ * Opaque profiler handle.
+ */
+typedef struct powercap_profiler powercap_profiler;
+
+/**
+ * Create a profiler that attributes the sum of the counters in a snapshot, which is copied (the snapshot may be
+ * destroyed afterward).
+ * Counters should not overlap - e.g., for RAPL, use only package zones, not their subzones.
+ * The zones that the snapshot's counters came from must remain open until the profiler is destroyed.
+ * Returns NULL and sets errno on failure.
+ */
+powercap_profiler* powercap_profiler_create(const powercap_snapshot* counters, const powercap_profiler_config* cfg);
+
+/**
+ * Stop the profiler if it's running and free all resources.
+ */
+int powercap_profiler_destroy(powercap_profiler* profiler);
+
+/**
+ * Install the SIGPROF handler, start the timer, and start the profiler thread (with SIGPROF blocked).
+ * Fails with EBUSY if another profiler is running.
+ * The timer isn't disarmed by execve(2), but the handler is reset to terminate the process, so stop the profiler before
+ * replacing the process image.
+ * Results accumulate across runs.
+ */
+int powercap_profiler_start(powercap_profiler* profiler);
+
+/**
+ * Stop the timer, restore the previous SIGPROF handler, and attribute the final interval.
+ */
+int powercap_profiler_stop(powercap_profiler* profiler);
+
+/**
+ * Get the profiler's statistics, which are updated at the end of each interval.
+ */
+int powercap_profiler_get_stats(const powercap_profiler* profiler, powercap_profiler_stats* stats);
+
+/**
+ * Write one line per unique stack to a stream: frames from the root to the leaf separated by semicolons, followed by a
+ * space and the stack's weight (rounded to an integer, where stacks with a weight of 0 are omitted).
+ * Fails with EBUSY if the profiler is running.
+ */
+int powercap_profiler_write_folded(const powercap_profiler* profiler, FILE* stream, powercap_profiler_weight weight);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
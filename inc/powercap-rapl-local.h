@@ -0,0 +1,77 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Socket-local sampling of RAPL energy counters.
+ * Reading a package's energy counter from a CPU on another socket requires the kernel to interrupt a CPU on that
+ * socket, which adds latency to both the reader and the interrupted CPU.
+ * This interface starts one reader thread per top-level RAPL instance, pinned to a CPU in that instance's package (and
+ * die, if the instance is per-die), which periodically reads all of the instance's energy counters.
+ * Other threads get the latest values without blocking and without any sysfs I/O.
+ * Unless otherwise stated, all functions return 0 on success or a negative value on error.
+ *
+ * CPUs are found with powercap_rapl_get_topology(...).
+ * By default, each reader is pinned to the lowest-numbered CPU in its package that the process is allowed to run on.
+ * A reader that can't be placed on a local CPU runs unpinned.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#ifndef _POWERCAP_RAPL_LOCAL_H_
+#define _POWERCAP_RAPL_LOCAL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "powercap-rapl.h"
+#include "powercap-snapshot.h"
+
+/**
+ * Opaque handle for a set of reader threads.
+ */
+typedef struct powercap_rapl_local powercap_rapl_local;
+
+/**
+ * Start a reader thread for each of "count" instances, which take their first reading immediately and then read every
+ * "period_us" microseconds.
+ * The optional "cpus" array has "count" elements and specifies the CPU for each reader, where a negative value selects
+ * a CPU automatically.
+ * The instances must not be destroyed before the readers are stopped.
+ * Returns NULL and sets errno on failure.
+ */
+powercap_rapl_local* powercap_rapl_local_start(const powercap_rapl_pkg* pkgs, uint32_t count, uint64_t period_us,
+                                               const int* cpus);
+
+/**
+ * Stop and join all reader threads, then free the handle.
+ */
+int powercap_rapl_local_stop(powercap_rapl_local* local);
+
+/**
+ * Get the CPU that an instance's reader is pinned to.
+ * Returns the CPU on success, -1 if the reader is unpinned, or a different negative value in case of error.
+ */
+int powercap_rapl_local_get_cpu(const powercap_rapl_local* local, uint32_t id);
+
+/**
+ * Get the latest energy values for all domains of an instance, in domain order.
+ * The "energy_uj" array must have at least powercap_rapl_get_num_domains(...) elements.
+ * Domains without an energy counter are reported as 0.
+ * The optional "time_ns" is set to the CLOCK_MONOTONIC time in nanoseconds at which the values were read.
+ * Sets errno to EAGAIN if the reader hasn't finished its first reading.
+ */
+int powercap_rapl_local_read(const powercap_rapl_local* local, uint32_t id, uint64_t* energy_uj, uint64_t* time_ns);
+
+/**
+ * Copy the latest values for all instances into a snapshot created with powercap_rapl_snapshot_init(...), using the
+ * same instances that the readers were started with.
+ * Sets errno to EAGAIN if any reader hasn't finished its first reading.
+ */
+int powercap_rapl_local_snapshot(const powercap_rapl_local* local, powercap_snapshot* snap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
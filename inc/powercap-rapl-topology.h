@@ -0,0 +1,67 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Map top-level RAPL instances to the CPUs and NUMA node they cover.
+ * Unless otherwise stated, all functions return 0 on success or a negative value on error.
+ *
+ * An instance's package (and die, if any) is parsed from its top-level zone name, e.g., "package-0" or
+ * "package-0-die-1", and matched against the "physical_package_id" and "die_id" files in each online CPU's sysfs
+ * topology directory.
+ * CPU topology is read once and cached for all instances - discard the cache after CPU hotplug events by calling
+ * powercap_rapl_topology_set_root(...).
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#ifndef _POWERCAP_RAPL_TOPOLOGY_H_
+#define _POWERCAP_RAPL_TOPOLOGY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "powercap-rapl.h"
+
+/**
+ * Maximum number of CPUs in a topology's CPU mask.
+ */
+#define POWERCAP_RAPL_MAX_CPUS 4096
+
+/**
+ * The CPUs and NUMA node covered by a top-level RAPL instance.
+ */
+typedef struct powercap_rapl_topology {
+  /* Bit (cpu % 64) of word (cpu / 64) is set for each online CPU in the instance */
+  uint64_t cpumask[POWERCAP_RAPL_MAX_CPUS / 64];
+  uint32_t ncpus;
+  int32_t package_id;
+  /* -1 if the instance covers its whole package */
+  int32_t die_id;
+  /* -1 if unknown or if the instance's CPUs span multiple NUMA nodes */
+  int32_t numa_node;
+} powercap_rapl_topology;
+
+/**
+ * Set the sysfs root used for CPU topology, where NULL restores the default ("/sys"), and discard cached topology.
+ * Useful for testing against a fake sysfs tree, which must contain "devices/system/cpu".
+ */
+int powercap_rapl_topology_set_root(const char* root);
+
+/**
+ * Get the topology of a top-level RAPL instance.
+ * Sets errno to EINVAL if the instance's name isn't recognized, or ENOENT if no online CPUs match it.
+ */
+int powercap_rapl_get_topology(const powercap_rapl_pkg* pkg, powercap_rapl_topology* topo);
+
+/**
+ * Check if a CPU is in a topology's CPU mask.
+ * Returns 1 if set, 0 if not set, a negative value in case of error.
+ */
+int powercap_rapl_topology_has_cpu(const powercap_rapl_topology* topo, uint32_t cpu);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,7 +2,8 @@
  * SPDX-License-Identifier: BSD-3-Clause
  *
  * A simple interface for configuring RAPL through a powercap control type.
- * Note that not all RAPL zones support short_term constraints.
+ * Note that not all RAPL zones support short_term or peak_power constraints.
+ * Both the "intel-rapl" (MSR) and "intel-rapl-mmio" (MMIO) control types are supported within a single instance.
  * Unless otherwise stated, all functions return 0 on success or a negative value on error.
  *
  * Setter functions do not verify that written values are accepted by RAPL.
@@ -20,6 +21,7 @@
  * one-to-one with a physical socket.
  * Intel's backward compatibility _appears_ to be in a zone's name, but even this is not explicitly guaranteed - it is
  * the user's responsibility to interpret what a top-level RAPL instance actually is.
+ * See powercap-rapl-topology.h to find the CPUs and NUMA node that a top-level instance covers.
  *
  * @author Connor Imes
  * @date 2016-05-12
@@ -34,6 +36,7 @@ extern "C" {
 #include <stdint.h>
 #include <unistd.h>
 #include "powercap.h"
+#include "powercap-snapshot.h"
 
 #if !defined(POWERCAP_DEPRECATED)
 #if defined(POWERCAP_ALLOW_DEPRECATED)
@@ -47,6 +50,39 @@ extern "C" {
 #endif
 #endif
 
+/**
+ * Maximum size of a zone name, including the terminating null character.
+ */
+#define POWERCAP_RAPL_NAME_MAX 64
+
+/**
+ * Zone enumeration.
+ * Zones with names that aren't recognized are reported as POWERCAP_RAPL_ZONE_OTHER.
+ */
+typedef enum powercap_rapl_zone {
+  POWERCAP_RAPL_ZONE_PACKAGE,
+  POWERCAP_RAPL_ZONE_CORE,
+  POWERCAP_RAPL_ZONE_UNCORE,
+  POWERCAP_RAPL_ZONE_DRAM,
+  POWERCAP_RAPL_ZONE_PSYS,
+  POWERCAP_RAPL_ZONE_OTHER
+} powercap_rapl_zone;
+
+/**
+ * Interface (control type) enumeration.
+ * POWERCAP_RAPL_INTERFACE_MSR is the "intel-rapl" control type and POWERCAP_RAPL_INTERFACE_MMIO is "intel-rapl-mmio".
+ * On some systems, the power limits that firmware actually honors are only exposed through the MMIO interface.
+ */
+typedef enum powercap_rapl_interface {
+  POWERCAP_RAPL_INTERFACE_MSR,
+  POWERCAP_RAPL_INTERFACE_MMIO
+} powercap_rapl_interface;
+
+/**
+ * Number of values in powercap_rapl_interface.
+ */
+#define POWERCAP_RAPL_NUM_INTERFACES 2
+
 /**
  * Files for each zone.
  */
@@ -54,36 +90,50 @@ typedef struct powercap_rapl_zone_files {
   powercap_zone zone;
   powercap_constraint constraint_long;
   powercap_constraint constraint_short;
+  powercap_constraint constraint_peak;
+  /* Constraints with unrecognized or duplicate names, in sysfs order (managed by the library) */
+  powercap_constraint* constraint_other;
+  uint32_t nconstraint_other;
 } powercap_rapl_zone_files;
 
 /**
- * All files for a top-level RAPL instance.
+ * A zone discovered in a top-level RAPL instance.
  */
-typedef struct powercap_rapl_pkg {
-  powercap_rapl_zone_files pkg;
-  powercap_rapl_zone_files core;
-  powercap_rapl_zone_files uncore;
-  powercap_rapl_zone_files dram;
-  powercap_rapl_zone_files psys;
-} powercap_rapl_pkg;
+typedef struct powercap_rapl_domain {
+  /* Files for each interface, indexed by powercap_rapl_interface */
+  powercap_rapl_zone_files files[POWERCAP_RAPL_NUM_INTERFACES];
+  powercap_rapl_zone type;
+  /* The zone's indices in each interface's sysfs tree, where only the first "depth" values are used */
+  uint32_t zones[POWERCAP_RAPL_NUM_INTERFACES][2];
+  /* A depth of 0 means the zone was not found for that interface */
+  uint32_t depth[POWERCAP_RAPL_NUM_INTERFACES];
+  /* The zone's name, as read during initialization */
+  char name[POWERCAP_RAPL_NAME_MAX];
+} powercap_rapl_domain;
 
 /**
- * Zone enumeration.
+ * All files for a top-level RAPL instance.
+ * The domains array is managed by the library.
+ * The first domain is always the top-level (parent) zone, followed by its subzones in sysfs order.
+ * Instances are enumerated using the "intel-rapl" control type, or "intel-rapl-mmio" if "intel-rapl" doesn't exist.
+ * Zones in the other control type are then matched to domains by name, where unmatched subzones are appended.
  */
-typedef enum powercap_rapl_zone {
-  POWERCAP_RAPL_ZONE_PACKAGE,
-  POWERCAP_RAPL_ZONE_CORE,
-  POWERCAP_RAPL_ZONE_UNCORE,
-  POWERCAP_RAPL_ZONE_DRAM,
-  POWERCAP_RAPL_ZONE_PSYS
-} powercap_rapl_zone;
+typedef struct powercap_rapl_pkg {
+  powercap_rapl_domain* domains;
+  uint32_t ndomains;
+} powercap_rapl_pkg;
 
 /**
- * Long/short term constraint enumeration.
+ * Constraint enumeration.
+ * The peak_power constraint (sometimes called PL4) is only exposed by newer kernels and hardware.
+ * Constraints with unrecognized names are addressed as (POWERCAP_RAPL_CONSTRAINT_OTHER + n), where n is less than the
+ * value returned by powercap_rapl_get_num_other_constraints(...).
  */
 typedef enum powercap_rapl_constraint {
   POWERCAP_RAPL_CONSTRAINT_LONG,
-  POWERCAP_RAPL_CONSTRAINT_SHORT
+  POWERCAP_RAPL_CONSTRAINT_SHORT,
+  POWERCAP_RAPL_CONSTRAINT_PEAK,
+  POWERCAP_RAPL_CONSTRAINT_OTHER
 } powercap_rapl_constraint;
 
 /**
@@ -131,16 +181,65 @@ int powercap_rapl_init(uint32_t id, powercap_rapl_pkg* pkg, int read_only);
  */
 int powercap_rapl_destroy(powercap_rapl_pkg* pkg);
 
+/**
+ * Discover and initialize all top-level RAPL instances with a single pass over the sysfs tree.
+ * On success, "pkgs" is set to a contiguous array of "count" initialized instances, ordered by their identifiers.
+ * The array is allocated by the library and must be released with powercap_rapl_destroy_all(...).
+ * If "parallel" is non-zero, each instance is initialized in its own thread.
+ * Read-only access can be requested, which may prevent the need for elevated privileges.
+ */
+int powercap_rapl_init_all(powercap_rapl_pkg** pkgs, uint32_t* count, int read_only, int parallel);
+
+/**
+ * Clean up all instances and free the array allocated by powercap_rapl_init_all(...).
+ */
+int powercap_rapl_destroy_all(powercap_rapl_pkg* pkgs, uint32_t count);
+
+/**
+ * Get the number of domains (the top-level zone and its subzones) in a top-level RAPL instance.
+ * Returns 0 if the instance is not initialized.
+ */
+uint32_t powercap_rapl_get_num_domains(const powercap_rapl_pkg* pkg);
+
+/**
+ * Get a domain by its index, where index 0 is always the top-level zone.
+ * Returns NULL and sets errno if the index is out of range.
+ */
+const powercap_rapl_domain* powercap_rapl_get_domain(const powercap_rapl_pkg* pkg, uint32_t idx);
+
+/**
+ * Check if a zone is available through an interface.
+ * Returns 1 if supported, 0 if unsupported, a negative value in case of error.
+ */
+int powercap_rapl_is_interface_supported(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_rapl_interface iface);
+
+/**
+ * Get a zone's files for a particular interface.
+ * Use this with the powercap.h functions to choose which interface to use for an operation, e.g., to read energy
+ * from one interface and to write power limits to another.
+ * Returns NULL and sets errno if the zone is not available through the interface or in case of error.
+ */
+const powercap_rapl_zone_files* powercap_rapl_get_zone_files(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_rapl_interface iface);
+
 /**
  * Check if a zone is supported.
  * The uncore power zone is usually only available on client-side hardware.
  * The DRAM power zone is usually only available on server-side hardware.
  * Some systems may expose zones like DRAM without actually supporting power caps for them.
  * The PSys power zone may be available on Skylake processors and later.
+ * If multiple zones have the same type, functions that take a powercap_rapl_zone operate on the first one found.
+ * Use the domains array to access the others, including all POWERCAP_RAPL_ZONE_OTHER zones.
+ * Functions that don't take a powercap_rapl_interface use the first interface that supports the requested file.
  * Returns 1 if supported, 0 if unsupported, a negative value in case of error.
  */
 int powercap_rapl_is_zone_supported(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone);
 
+/**
+ * Get the number of constraints with unrecognized names for a zone.
+ * Returns 0 if there are none or in case of error, in which case errno is also set.
+ */
+uint32_t powercap_rapl_get_num_other_constraints(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone);
+
 /**
  * Check if a constraint is supported for a zone.
  * Returns 1 if supported, 0 if unsupported, a negative value in case of error.
@@ -254,6 +353,15 @@ int powercap_rapl_set_time_window_us(const powercap_rapl_pkg* pkg, powercap_rapl
  */
 ssize_t powercap_rapl_get_constraint_name(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_rapl_constraint constraint, char* buf, size_t size);
 
+/**
+ * Initialize a snapshot with one counter for every domain of every instance.
+ * Counters are ordered by instance, then by domain index, so a domain's counter index is its domain index plus the sum
+ * of powercap_rapl_get_num_domains(...) for all preceding instances.
+ * Each counter uses the first interface that supports the energy_uj file.
+ * The instances must not be destroyed before the snapshot.
+ */
+int powercap_rapl_snapshot_init(powercap_snapshot* snap, const powercap_rapl_pkg* pkgs, uint32_t count);
+
 #ifdef __cplusplus
 }
 #endif
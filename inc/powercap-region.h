@@ -0,0 +1,127 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Attribute energy to named regions of code, like request phases or batch job steps.
+ * Unless otherwise stated, all functions return 0 on success or a negative value on error.
+ *
+ * Regions are bound to a shared set of accumulators that some other thread keeps up to date (e.g., by passing sampler
+ * batches to powercap_region_update(...)), so markers never read sysfs: beginning or ending a region reads each
+ * accumulator and the monotonic clock without locking, then ending it adds the region's energy, time, and count to its
+ * totals with atomic operations.
+ * Each thread has its own stack of open regions, so regions may be nested (a region's totals include its children).
+ *
+ * Energy is only as fresh as the accumulators' last update, so regions shorter than the update period are only
+ * meaningful in aggregate.
+ * Concurrent regions in different threads share the same counters, so their energy overlaps.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#ifndef _POWERCAP_REGION_H_
+#define _POWERCAP_REGION_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include "powercap-accumulator.h"
+
+/* Maximum number of counters in a registry */
+#define POWERCAP_REGION_MAX_COUNTERS 32
+/* Maximum depth of each thread's stack of open regions */
+#define POWERCAP_REGION_MAX_DEPTH 32
+/* Maximum length of a region's name, including the terminating null byte */
+#define POWERCAP_REGION_NAME_MAX 64
+
+/**
+ * A region's totals.
+ */
+typedef struct powercap_region_stats {
+  /* Number of times the region ended */
+  uint64_t count;
+  /* Total time in nanoseconds between beginning and ending the region */
+  uint64_t time_ns;
+} powercap_region_stats;
+
+/**
+ * Opaque region registry handle.
+ */
+typedef struct powercap_region_registry powercap_region_registry;
+
+/**
+ * Create a registry with room for "max_regions" regions, bound to "ncounters" accumulators.
+ * The accumulators must remain valid until the registry is destroyed.
+ * Returns NULL and sets errno on failure.
+ */
+powercap_region_registry* powercap_region_registry_create(powercap_accumulator* accs, uint32_t ncounters,
+                                                          uint32_t max_regions);
+
+/**
+ * Free the registry.
+ * No thread may have any of its regions open.
+ */
+void powercap_region_registry_destroy(powercap_region_registry* registry);
+
+/**
+ * Get the id of a region with the given name, registering it if it doesn't exist yet.
+ * Registration takes a lock, so look up ids ahead of time rather than before each marker.
+ * Returns the id, or a negative value in case of error - ENOSPC if the registry is full.
+ */
+int powercap_region_register(powercap_region_registry* registry, const char* name);
+
+/**
+ * Update the registry's accumulators with a batch of samples from powercap_sampler_read(...) or
+ * powercap_sampler_service(...), where the sampler's first "ncounters" counters are the registry's counters, in order.
+ * "nsamples" is the number of samples read and "max" is the "max" value that was passed to the sampler.
+ * Only one thread may update the accumulators, e.g., the sampler's consumer thread.
+ * Returns the number of ambiguous accumulator updates, or a negative value in case of error.
+ */
+int powercap_region_update(powercap_region_registry* registry, const uint64_t* time_ns, const uint64_t* energy_uj,
+                           uint32_t nsamples, uint32_t max);
+
+/**
+ * Get the number of registered regions, whose ids are 0 to (n - 1).
+ */
+uint32_t powercap_region_get_num_regions(const powercap_region_registry* registry);
+
+/**
+ * Get a region's name.
+ * Returns NULL and sets errno on failure.
+ */
+const char* powercap_region_get_name(const powercap_region_registry* registry, uint32_t region);
+
+/**
+ * Begin a region in the calling thread, nested in the thread's currently open region, if any.
+ * Fails with ENOSPC if the thread already has POWERCAP_REGION_MAX_DEPTH open regions.
+ */
+int powercap_region_begin(powercap_region_registry* registry, uint32_t region);
+
+/**
+ * End the calling thread's innermost open region, which must be "region" in the same registry.
+ * Fails with EINVAL (and leaves the region open) otherwise.
+ */
+int powercap_region_end(powercap_region_registry* registry, uint32_t region);
+
+/**
+ * Get a region's totals.
+ * If not NULL, the "energy_uj" array must have an element for each of the registry's counters.
+ * Totals are read counter by counter while other threads may be ending the region, so they may be slightly
+ * inconsistent with each other.
+ */
+int powercap_region_get_stats(const powercap_region_registry* registry, uint32_t region,
+                              powercap_region_stats* stats, uint64_t* energy_uj);
+
+/**
+ * Write all regions' totals to a stream as CSV, with a header line followed by one line per region:
+ * name,count,time_ns,energy_uj_0,...,energy_uj_<ncounters-1>
+ * Names that contain commas, double quotes, or line breaks are quoted as described in RFC 4180.
+ */
+int powercap_region_dump(const powercap_region_registry* registry, FILE* stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
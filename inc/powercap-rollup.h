@@ -0,0 +1,104 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Multi-resolution in-memory history of energy and power, e.g., 10 seconds at 1 ms, 1 hour at 1 s, and 7 days at
+ * 1 minute.
+ * Unless otherwise stated, all functions return 0 on success or a negative value on error.
+ *
+ * A rollup has a fixed number of tiers, each a circular buffer of fixed-duration buckets that hold every counter's
+ * energy and min/max power during that time.
+ * Each sample updates every tier incrementally, so no tier is computed from another, and memory is fixed when the
+ * rollup is created.
+ * A rollup is fed raw energy_uj values - typically batches drained from a sampler - and is not thread-safe.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#ifndef _POWERCAP_ROLLUP_H_
+#define _POWERCAP_ROLLUP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define POWERCAP_ROLLUP_MAX_TIERS 8
+
+/**
+ * A tier's configuration.
+ */
+typedef struct powercap_rollup_tier {
+  /* Bucket duration */
+  uint64_t resolution_us;
+  /* Number of buckets, so the tier covers (resolution_us * length) */
+  uint32_t length;
+} powercap_rollup_tier;
+
+/**
+ * The result of a query.
+ */
+typedef struct powercap_rollup_result {
+  /* The tier the result came from */
+  uint32_t tier;
+  /* CLOCK_MONOTONIC start time in nanoseconds of the first bucket in the result */
+  uint64_t start_ns;
+  /* CLOCK_MONOTONIC end time in nanoseconds of the last bucket in the result */
+  uint64_t end_ns;
+  /* Energy consumed during the covered time */
+  uint64_t energy_uj;
+  /* Time in nanoseconds that samples actually covered, which may be less than (end_ns - start_ns) */
+  uint64_t covered_ns;
+  /* Power statistics over the intervals between samples */
+  double min_w;
+  double max_w;
+  double mean_w;
+} powercap_rollup_result;
+
+/**
+ * Opaque rollup handle.
+ */
+typedef struct powercap_rollup powercap_rollup;
+
+/**
+ * Create a rollup for "ncounters" counters with "ntiers" tiers, ordered from finest to coarsest resolution.
+ * The "max_energy_range_uj" array has each counter's wraparound value (0 if unknown), or may be NULL if all are unknown.
+ * Returns NULL and sets errno on failure.
+ */
+powercap_rollup* powercap_rollup_create(const powercap_rollup_tier* tiers, uint32_t ntiers, uint32_t ncounters,
+                                        const uint64_t* max_energy_range_uj);
+
+/**
+ * Free the rollup.
+ */
+void powercap_rollup_destroy(powercap_rollup* rollup);
+
+/**
+ * Add a sample of all counters' raw energy_uj values ("ncounters" elements) read at a CLOCK_MONOTONIC time in
+ * nanoseconds.
+ * The first sample only establishes a baseline - the energy between each pair of samples is attributed to the bucket
+ * containing the later sample.
+ * Fails with EINVAL if time went backward, and ignores samples at the same time as the previous one.
+ */
+int powercap_rollup_add(powercap_rollup* rollup, uint64_t time_ns, const uint64_t* energy_uj);
+
+/**
+ * Add a batch of "n" samples, where counter c of sample i is at energy_uj[c * stride + i], like the samples from
+ * powercap_sampler_read(...).
+ */
+int powercap_rollup_add_samples(powercap_rollup* rollup, const uint64_t* time_ns, const uint64_t* energy_uj,
+                                uint32_t n, uint32_t stride);
+
+/**
+ * Summarize a counter from "start_ns" (inclusive) to "end_ns" (exclusive), rounded out to bucket boundaries.
+ * The result comes from the finest tier that still holds "start_ns" (or the coarsest tier if none do).
+ * Fails with ENODATA if there are no samples in the range.
+ */
+int powercap_rollup_query(const powercap_rollup* rollup, uint32_t counter, uint64_t start_ns, uint64_t end_ns,
+                          powercap_rollup_result* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,309 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * A background thread that periodically reads a set of energy counters into a lock-free ring buffer.
+ * Unless otherwise stated, all functions return 0 on success or a negative value on error.
+ *
+ * The ring buffer has a single producer (the sampler thread) and a single consumer, which drains samples in batches.
+ * Samples are stored as a structure of arrays: one array of timestamps and one array of values per counter.
+ * Values are raw energy_uj readings - use the snapshot kernels or an accumulator to correct for wraparound.
+ * All memory is allocated when the sampler is created - starting, sampling, and reading never allocate.
+ *
+ * Alternatively, a sampler can run without a thread inside an existing event loop: start it with
+ * powercap_sampler_start_polled(...), wait for the file descriptor from powercap_sampler_get_fd(...) to be readable
+ * (e.g., with poll or epoll), then call powercap_sampler_service(...).
+ *
+ * Predicates on each counter's power (or its rate of change) are evaluated incrementally as samples are taken, and
+ * events are queued when they start or stop holding - see powercap_sampler_set_predicates(...).
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#ifndef _POWERCAP_SAMPLER_H_
+#define _POWERCAP_SAMPLER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "powercap-rapl.h"
+#include "powercap-snapshot.h"
+
+/**
+ * What to do with a new sample when the ring buffer is full.
+ */
+typedef enum powercap_sampler_overflow {
+  /* Discard the new sample */
+  POWERCAP_SAMPLER_OVERFLOW_DROP_NEWEST,
+  /* Discard the oldest unread sample to make room */
+  POWERCAP_SAMPLER_OVERFLOW_DROP_OLDEST
+} powercap_sampler_overflow;
+
+/**
+ * Sampler configuration.
+ */
+typedef struct powercap_sampler_config {
+  uint64_t period_us;
+  /* Ring buffer size in samples, rounded up to a power of 2 */
+  uint32_t capacity;
+  powercap_sampler_overflow overflow;
+} powercap_sampler_config;
+
+/**
+ * Adaptive sampling configuration.
+ * Each counter is read every 1 to N sampler periods: a counter's period is reset to the sampler period when its power
+ * changes by more than "change_threshold" (relative to its previous power), and doubles (up to "max_period_us") after
+ * "stable_reads" consecutive reads without such a change.
+ * Samples still have a value for every counter - a counter that isn't due repeats its previous value.
+ */
+typedef struct powercap_sampler_adaptive {
+  uint64_t max_period_us;
+  /* e.g., 0.1 for a 10% change in power */
+  double change_threshold;
+  uint32_t stable_reads;
+} powercap_sampler_adaptive;
+
+/**
+ * Sampler statistics.
+ */
+typedef struct powercap_sampler_stats {
+  /* Samples written to the ring buffer */
+  uint64_t samples;
+  /* Samples discarded because the ring buffer was full */
+  uint64_t dropped;
+  /* Failed counter reads, where the counter's previous value was used instead */
+  uint64_t read_errors;
+  /* Counter reads saved by adaptive sampling */
+  uint64_t skipped;
+  /* Predicate events queued */
+  uint64_t events;
+  /* Predicate events discarded because the event queue was full */
+  uint64_t dropped_events;
+} powercap_sampler_stats;
+
+/**
+ * Per-counter statistics.
+ */
+typedef struct powercap_sampler_counter_stats {
+  /* Counter reads, including failed reads */
+  uint64_t reads;
+  /* Counter reads saved by adaptive sampling */
+  uint64_t skipped;
+  /* The counter's current sampling period */
+  uint64_t period_us;
+} powercap_sampler_counter_stats;
+
+/**
+ * The sampler's own cost, accumulated over all the time it has been running.
+ */
+typedef struct powercap_sampler_overhead {
+  /* Time the sampler has been running, in nanoseconds */
+  uint64_t elapsed_ns;
+  /* CPU time of the sampler thread, or of taking samples in powercap_sampler_service(...) in polled mode */
+  uint64_t cpu_ns;
+  /* System calls issued to wait for, take, and account for samples */
+  uint64_t syscalls;
+  /* Bytes read from counter files */
+  uint64_t bytes_read;
+  /* Times the sampler was woken up to take a sample */
+  uint64_t wakeups;
+  double wakeups_per_s;
+  /*
+   * Estimated energy consumed by the sampler itself: the energy of the attributed counters, scaled by the sampler's
+   * share of the system's CPU time (cpu_ns / (elapsed_ns * online CPUs)).
+   * For samplers created with powercap_sampler_create_rapl(...), only package zones are attributed; otherwise, all
+   * counters are, which overestimates if some counters are included in others (e.g., a zone and its subzones).
+   */
+  double energy_uj;
+} powercap_sampler_overhead;
+
+/**
+ * What a predicate compares to its threshold.
+ */
+typedef enum powercap_sampler_predicate_type {
+  /* Power in watts is at or above the threshold */
+  POWERCAP_SAMPLER_PREDICATE_POWER_ABOVE,
+  /* Power in watts is at or below the threshold */
+  POWERCAP_SAMPLER_PREDICATE_POWER_BELOW,
+  /* The change in power between consecutive reads, in watts per second, is at or above the threshold */
+  POWERCAP_SAMPLER_PREDICATE_SLOPE_ABOVE,
+  /* The change in power between consecutive reads, in watts per second, is at or below the threshold */
+  POWERCAP_SAMPLER_PREDICATE_SLOPE_BELOW
+} powercap_sampler_predicate_type;
+
+/**
+ * A condition on a counter's power, e.g., "package power above 100 W for 50 ms" or "DRAM power rising faster than
+ * 1000 W/s".
+ * Once the condition holds, it continues to hold until the value is past the threshold by more than "hysteresis"
+ * (e.g., below 95 W for a 100 W threshold and 5 W hysteresis), which avoids repeated events from a noisy value.
+ * The predicate becomes active when the condition has held for "duration_us" (0 for immediately), and inactive as soon
+ * as the condition stops holding.
+ */
+typedef struct powercap_sampler_predicate {
+  powercap_sampler_predicate_type type;
+  uint32_t counter;
+  double threshold;
+  double hysteresis;
+  uint64_t duration_us;
+} powercap_sampler_predicate;
+
+/**
+ * A change in a predicate's state.
+ */
+typedef struct powercap_sampler_event {
+  /* CLOCK_MONOTONIC time of the sample that caused the event, in nanoseconds */
+  uint64_t time_ns;
+  /* The power or slope that caused the event */
+  double value;
+  /* The predicate's index */
+  uint32_t predicate;
+  /* 1 when the predicate becomes active, 0 when it becomes inactive */
+  int active;
+} powercap_sampler_event;
+
+/**
+ * Called for each event by powercap_sampler_dispatch_events(...).
+ */
+typedef void (*powercap_sampler_event_cb)(const powercap_sampler_event* event, void* arg);
+
+/**
+ * Opaque sampler handle.
+ */
+typedef struct powercap_sampler powercap_sampler;
+
+/**
+ * Create a sampler for the counters in a snapshot, which is copied (the snapshot may be destroyed afterward).
+ * The zones that the snapshot's counters came from must remain open until the sampler is destroyed.
+ * Returns NULL and sets errno on failure.
+ */
+powercap_sampler* powercap_sampler_create(const powercap_snapshot* counters, const powercap_sampler_config* cfg);
+
+/**
+ * Create a sampler that owns all top-level RAPL instances, with counters ordered like powercap_rapl_snapshot_init(...).
+ * Returns NULL and sets errno on failure.
+ */
+powercap_sampler* powercap_sampler_create_rapl(const powercap_sampler_config* cfg, int read_only);
+
+/**
+ * Stop the sampler if it's running and free all resources, including any RAPL instances it owns.
+ */
+int powercap_sampler_destroy(powercap_sampler* sampler);
+
+/**
+ * Enable adaptive per-counter sampling rates, or disable it if "adaptive" is NULL (the default).
+ * The sampler must not be running.
+ */
+int powercap_sampler_set_adaptive(powercap_sampler* sampler, const powercap_sampler_adaptive* adaptive);
+
+/**
+ * Start the sampler thread, which takes its first sample immediately.
+ */
+int powercap_sampler_start(powercap_sampler* sampler);
+
+/**
+ * Start sampling without a thread: the caller services the sampler when its file descriptor becomes readable.
+ * The first sample is due one period after starting.
+ */
+int powercap_sampler_start_polled(powercap_sampler* sampler);
+
+/**
+ * Stop and join the sampler thread, or stop polled sampling.
+ * Unread samples remain available, and the sampler may be started again in either mode.
+ */
+int powercap_sampler_stop(powercap_sampler* sampler);
+
+/**
+ * Get the number of counters in each sample.
+ */
+uint32_t powercap_sampler_get_num_counters(const powercap_sampler* sampler);
+
+/**
+ * Get the RAPL instances owned by a sampler created with powercap_sampler_create_rapl(...).
+ * Returns NULL and sets errno if the sampler doesn't own any instances.
+ */
+const powercap_rapl_pkg* powercap_sampler_get_rapl_pkgs(const powercap_sampler* sampler, uint32_t* count);
+
+/**
+ * Drain up to "max" of the oldest unread samples.
+ * The "time_ns" array must have "max" elements for CLOCK_MONOTONIC sample times in nanoseconds.
+ * The "energy_uj" array must have (max * num_counters) elements, where counter c of sample i is at (c * max + i).
+ * Only the consumer thread may call this function.
+ * Returns the number of samples read, or a negative value in case of error.
+ */
+int powercap_sampler_read(powercap_sampler* sampler, uint64_t* time_ns, uint64_t* energy_uj, uint32_t max);
+
+/**
+ * Get a file descriptor that becomes readable (POLLIN/EPOLLIN) when a sample is due in polled mode.
+ * The descriptor is owned by the sampler and remains valid until it's destroyed - do not read from or close it.
+ * Returns the file descriptor, or a negative value in case of error.
+ */
+int powercap_sampler_get_fd(const powercap_sampler* sampler);
+
+/**
+ * In polled mode, take a sample if one is due, then drain up to "max" of the oldest unread samples like
+ * powercap_sampler_read(...).
+ * Never blocks - if the file descriptor was not readable, only previously unread samples are returned.
+ * If more than one period elapsed since the last call, only one sample is taken.
+ * Returns the number of samples read, or a negative value in case of error (including if not started in polled mode).
+ */
+int powercap_sampler_service(powercap_sampler* sampler, uint64_t* time_ns, uint64_t* energy_uj, uint32_t max);
+
+/**
+ * Get the sampler's statistics.
+ */
+int powercap_sampler_get_stats(const powercap_sampler* sampler, powercap_sampler_stats* stats);
+
+/**
+ * Get a counter's statistics, including its effective sampling period.
+ */
+int powercap_sampler_get_counter_stats(const powercap_sampler* sampler, uint32_t counter,
+                                       powercap_sampler_counter_stats* stats);
+
+/**
+ * Get the sampler's own CPU, system call, I/O, wakeup, and energy costs, e.g., to publish alongside its data or to tune
+ * its period.
+ * May be called from any thread.
+ */
+int powercap_sampler_get_overhead(const powercap_sampler* sampler, powercap_sampler_overhead* overhead);
+
+/**
+ * Replace the sampler's predicates with "count" predicates (remove them if "count" is 0), with a queue of up to
+ * "event_capacity" events (rounded up to a power of 2), where events are discarded when it's full.
+ * Predicates are evaluated after each sample on the counters that were read in it - the cost per sample is linear in
+ * the number of predicates, and evaluating them and queueing events never allocates.
+ * Power is derived from consecutive reads, so predicates are first evaluated on a counter's second read, and slopes on
+ * its third. Predicates are reset to inactive whenever the sampler starts.
+ * The sampler must not be running.
+ */
+int powercap_sampler_set_predicates(powercap_sampler* sampler, const powercap_sampler_predicate* predicates,
+                                    uint32_t count, uint32_t event_capacity);
+
+/**
+ * Get a file descriptor (an eventfd) that becomes readable (POLLIN/EPOLLIN) when events are queued.
+ * The descriptor is owned by the sampler and remains valid until its predicates are replaced or it's destroyed - do
+ * not read from or close it.
+ * Returns the file descriptor, or a negative value in case of error (including if there are no predicates).
+ */
+int powercap_sampler_get_event_fd(const powercap_sampler* sampler);
+
+/**
+ * Dequeue up to "max" of the oldest events, without blocking.
+ * The file descriptor from powercap_sampler_get_event_fd(...) remains readable while events are queued.
+ * Only one thread may consume events.
+ * Returns the number of events read, or a negative value in case of error.
+ */
+int powercap_sampler_read_events(powercap_sampler* sampler, powercap_sampler_event* events, uint32_t max);
+
+/**
+ * Dequeue all queued events and call "callback" for each, in order, in the calling thread.
+ * Only one thread may consume events.
+ * Returns the number of events dispatched, or a negative value in case of error.
+ */
+int powercap_sampler_dispatch_events(powercap_sampler* sampler, powercap_sampler_event_cb callback, void* arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Read many zones' energy counters at once into a structure-of-arrays buffer, and compute energy deltas and average
+ * power for all counters with a single call.
+ * Unless otherwise stated, all functions return 0 on success or a negative value on error.
+ *
+ * A snapshot does not own zone file descriptors - zones must remain open for the lifetime of the snapshot.
+ * A typical sampling loop initializes two snapshots with the same zones, then alternates reading into one and computing
+ * deltas against the other.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#ifndef _POWERCAP_SNAPSHOT_H_
+#define _POWERCAP_SNAPSHOT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "powercap.h"
+
+/**
+ * Energy counter values for a set of zones, stored as a structure of arrays.
+ * All arrays have "count" elements and are allocated by the library in a single block, with each array aligned to a
+ * cache line.
+ */
+typedef struct powercap_snapshot {
+  /* Borrowed energy_uj file descriptors, where 0 means the counter is not supported and is never read */
+  int* fds;
+  /* Cached max_energy_range_uj values, used to correct for counter wraparound (0 if unknown) */
+  uint64_t* max_energy_range_uj;
+  /* Raw energy_uj values from the last read */
+  uint64_t* energy_uj;
+  /* CLOCK_MONOTONIC time in nanoseconds at which each energy_uj value was read */
+  uint64_t* time_ns;
+  uint32_t count;
+} powercap_snapshot;
+
+/**
+ * Timing of a group read, in which all of a snapshot's counters are read back-to-back.
+ */
+typedef struct powercap_snapshot_group {
+  /* CLOCK_MONOTONIC time in nanoseconds before the first read */
+  uint64_t begin_ns;
+  /* CLOCK_MONOTONIC time in nanoseconds after the last read */
+  uint64_t end_ns;
+  /* Time between the first and last successful reads - values from groups that exceed a skew budget can be discarded */
+  uint64_t skew_ns;
+} powercap_snapshot_group;
+
+/**
+ * Allocate a snapshot for "count" counters, all of which are initially unsupported.
+ */
+int powercap_snapshot_init(powercap_snapshot* snap, uint32_t count);
+
+/**
+ * Free the snapshot's arrays (file descriptors are not closed).
+ */
+int powercap_snapshot_destroy(powercap_snapshot* snap);
+
+/**
+ * Assign a zone to a counter index, reading and caching the zone's max_energy_range_uj value.
+ * A zone without an energy_uj file leaves the counter unsupported.
+ */
+int powercap_snapshot_set_zone(powercap_snapshot* snap, uint32_t idx, const powercap_zone* zone);
+
+/**
+ * Read all supported counters and their timestamps.
+ * All counters are read even if some fail, in which case the failed counters keep their previous values and the first
+ * error is returned.
+ */
+int powercap_snapshot_read(powercap_snapshot* snap);
+
+/**
+ * Read all supported counters like powercap_snapshot_read(...), bracketed by timestamps, and measure the skew between
+ * the group's members.
+ * Counters whose reads fail don't contribute to the measured skew.
+ */
+int powercap_snapshot_read_group(powercap_snapshot* snap, powercap_snapshot_group* group);
+
+/**
+ * Get each counter's read time relative to the start of a group read ("offset_ns" must have "count" elements).
+ * Counters not read in that group (unsupported, or a failed read) have an offset of 0.
+ */
+int powercap_snapshot_get_offsets(const powercap_snapshot* snap, const powercap_snapshot_group* group,
+                                  uint64_t* offset_ns);
+
+/**
+ * Compute the energy consumed and the average power for every counter between two snapshots of the same zones.
+ * The "delta_uj" and "power_w" arrays must have at least "count" elements.
+ * A counter that wrapped is corrected using the later snapshot's max_energy_range_uj value.
+ * Only a single wraparound can be detected between snapshots, so callers must read at least once per wrap period.
+ * Power is 0 for counters whose timestamps did not advance, including unsupported counters.
+ */
+int powercap_snapshot_delta(const powercap_snapshot* prev, const powercap_snapshot* cur, uint64_t* delta_uj,
+                            double* power_w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Measure how power responds to a step change in a power limit, e.g., to tune a power capping controller.
+ * Unless otherwise stated, all functions return 0 on success or a negative value on error.
+ *
+ * A step response experiment measures the zone's baseline power, writes the new limit, samples energy at a high rate
+ * until power settles (or a timeout), then restores the original limit.
+ * All times are measured from the start of the write:
+ *
+ *   dead time      until power moves 10% of the way from the initial to the final power
+ *   rise time      from 10% to 90% of the way
+ *   overshoot      the largest excursion past the final power
+ *   settling time  until power stays within the settling band around the final power
+ *
+ * Power only responds if the limit is binding, e.g., when lowering a limit below the power a workload consumes.
+ * Sampling stops early once power has responded and settled, otherwise it continues until the timeout.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#ifndef _POWERCAP_STEP_H_
+#define _POWERCAP_STEP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "powercap.h"
+#include "powercap-power-stream.h"
+
+/**
+ * Step response configuration.
+ */
+typedef struct powercap_step_config {
+  /* The power limit to step to */
+  uint64_t power_limit_uw;
+  /* Time between energy samples */
+  uint64_t period_us;
+  /* Time to measure the initial power before the step */
+  uint64_t baseline_us;
+  /* Time to wait for power to settle after the step */
+  uint64_t timeout_us;
+  /* Power is settled once it stays within the band for this long */
+  uint64_t settle_us;
+  /* Half-width of the settling band, relative to the step size (e.g., 0.05 for 5%) */
+  double settle_band;
+  /* Smaller changes in power are considered no response, and the settling band is at least relative to this */
+  double min_step_w;
+  /* Filter for power derived from energy samples */
+  powercap_power_stream_config filter;
+} powercap_step_config;
+
+/**
+ * Step response metrics.
+ */
+typedef struct powercap_step_result {
+  /* The power limit before the step, which is restored afterward */
+  uint64_t original_limit_uw;
+  /* Time for the power limit write to complete */
+  uint64_t write_ns;
+  /* Average power before the step */
+  double initial_w;
+  /* Average power over the last "settle_us" of the response */
+  double final_w;
+  /* Whether power changed by at least "min_step_w" - if not, the dead time, rise time, and overshoot are 0 */
+  int responded;
+  uint64_t dead_time_ns;
+  uint64_t rise_time_ns;
+  /* Largest excursion past the final power, in watts and relative to the step size */
+  double overshoot_w;
+  double overshoot;
+  /* Whether power settled before the timeout - if not, the settling time is 0 */
+  int settled;
+  uint64_t settling_time_ns;
+  /* Power samples after the step */
+  uint32_t samples;
+} powercap_step_result;
+
+/**
+ * Apply a step change to a constraint's power limit and measure the response of a zone's power.
+ * The constraint's power limit is restored afterward, even if measurement fails.
+ * Blocks for up to (baseline_us + timeout_us).
+ */
+int powercap_step_response(const powercap_zone* zone, const powercap_constraint* constraint,
+                           const powercap_step_config* cfg, powercap_step_result* result);
+
+/**
+ * Compute step response metrics from "n" power samples taken after a step that started at "step_ns", where
+ * "result->initial_w" is the power before the step.
+ * The final power is the average over the last "cfg->settle_us" of samples.
+ * Only "settle_us", "settle_band", and "min_step_w" are used from the configuration.
+ */
+int powercap_step_analyze(const powercap_step_config* cfg, uint64_t step_ns, const uint64_t* time_ns,
+                          const double* power_w, uint32_t n, powercap_step_result* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
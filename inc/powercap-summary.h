@@ -0,0 +1,145 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Streaming summary statistics with bounded memory: count, min, max, mean, variance, and quantiles.
+ * Unless otherwise stated, all functions return 0 on success or a negative value on error.
+ *
+ * Mean and variance are computed with Welford's algorithm.
+ * Quantiles come from a DDSketch, a histogram with logarithmically-sized buckets that guarantees a relative error for
+ * every quantile, e.g., with a relative accuracy of 0.01, the estimated p99 is within 1% of a value that really is at
+ * the 99th percentile.
+ * The number of buckets is fixed - if values span more than the buckets can cover, the lowest buckets are collapsed,
+ * which only loses accuracy for the lowest quantiles.
+ *
+ * Summaries never allocate, and summaries with the same relative accuracy can be merged, e.g., to combine packages or
+ * time windows.
+ * A sliding window summarizes only recent values with a ring of per-interval summaries (in caller-provided memory) that
+ * are merged when queried, so it slides one interval at a time.
+ * Summaries and windows are not thread-safe.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#ifndef _POWERCAP_SUMMARY_H_
+#define _POWERCAP_SUMMARY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "powercap-power-stream.h"
+
+/* With a relative accuracy of 0.01, covers about 9 orders of magnitude before collapsing */
+#define POWERCAP_SUMMARY_NUM_BUCKETS 1024
+
+/**
+ * Summary state.
+ * Fields should only be accessed through the functions below.
+ */
+typedef struct powercap_summary {
+  uint64_t count;
+  double min;
+  double max;
+  double mean;
+  /* Sum of squared differences from the mean */
+  double m2;
+  double relative_accuracy;
+  double log_gamma;
+  /* Values that are <= 0 */
+  uint64_t zero_count;
+  /* Bucket key of buckets[0] */
+  int32_t offset;
+  uint64_t buckets[POWERCAP_SUMMARY_NUM_BUCKETS];
+} powercap_summary;
+
+/**
+ * Initialize an empty summary with a relative accuracy for quantiles in (0, 1), e.g., 0.01.
+ */
+int powercap_summary_init(powercap_summary* summary, double relative_accuracy);
+
+/**
+ * Discard all values, keeping the relative accuracy.
+ */
+int powercap_summary_reset(powercap_summary* summary);
+
+/**
+ * Add a value.
+ */
+int powercap_summary_add(powercap_summary* summary, double value);
+
+/**
+ * Add all values from "src" to "dst", which must have the same relative accuracy.
+ */
+int powercap_summary_merge(powercap_summary* dst, const powercap_summary* src);
+
+/**
+ * Get the number of values.
+ */
+uint64_t powercap_summary_get_count(const powercap_summary* summary);
+
+/**
+ * Get the minimum, maximum, and mean values, and the (population) variance.
+ * All are 0 for an empty summary.
+ */
+double powercap_summary_get_min(const powercap_summary* summary);
+double powercap_summary_get_max(const powercap_summary* summary);
+double powercap_summary_get_mean(const powercap_summary* summary);
+double powercap_summary_get_variance(const powercap_summary* summary);
+
+/**
+ * Estimate the value at quantile "q" in [0, 1], e.g., 0.99 for p99.
+ * Takes constant time (proportional to POWERCAP_SUMMARY_NUM_BUCKETS).
+ * Fails with EINVAL if the summary is empty.
+ */
+int powercap_summary_get_quantile(const powercap_summary* summary, double q, double* value);
+
+/**
+ * Add the power of "ncounters" counters from a batch of "n" samples, like those from powercap_sampler_read(...).
+ * Counter c of sample i is at energy_uj[c * stride + i], and all counters of sample i were read at time_ns[i].
+ * Each counter's power is derived by its stream, and each power estimate is added to the counter's summary.
+ * The streams and summaries arrays must have "ncounters" elements.
+ */
+int powercap_summary_add_samples(powercap_summary* summaries, powercap_power_stream* streams, uint32_t ncounters,
+                                 const uint64_t* time_ns, const uint64_t* energy_uj, uint32_t n, uint32_t stride);
+
+/**
+ * Sliding window state.
+ * Fields should only be accessed through the functions below.
+ */
+typedef struct powercap_summary_window {
+  powercap_summary* intervals;
+  uint32_t nintervals;
+  /* Index of the interval that values are added to */
+  uint32_t current;
+  uint64_t interval_ns;
+  /* Start time of the current interval */
+  uint64_t start_ns;
+  int started;
+} powercap_summary_window;
+
+/**
+ * Initialize an empty window of "nintervals" intervals of "interval_ns" each, using the "intervals" array for storage.
+ * The window covers the current (partial) interval and the "nintervals - 1" before it.
+ * The array must remain valid until the window is no longer used.
+ */
+int powercap_summary_window_init(powercap_summary_window* window, powercap_summary* intervals, uint32_t nintervals,
+                                 uint64_t interval_ns, double relative_accuracy);
+
+/**
+ * Add a value at time "time_ns", first discarding intervals that are no longer in the window.
+ * The first value starts the first interval, and values earlier than the current interval are added to it.
+ */
+int powercap_summary_window_add(powercap_summary_window* window, uint64_t time_ns, double value);
+
+/**
+ * Merge the intervals that are still in the window at time "now_ns" into "summary", which is reset first.
+ * Takes time proportional to the number of intervals.
+ */
+int powercap_summary_window_get(const powercap_summary_window* window, uint64_t now_ns, powercap_summary* summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
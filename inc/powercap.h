@@ -160,6 +160,8 @@ int powercap_zone_get_energy_uj(const powercap_zone* zone, uint64_t* val);
 
 /**
  * Reset the zone's energy_uj value to 0.
+ * This affects every user of the zone, and many drivers don't support it - see powercap_accumulator_view in
+ * powercap-accumulator.h for a per-client alternative.
  */
 int powercap_zone_reset_energy_uj(const powercap_zone* zone);
 
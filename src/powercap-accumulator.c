@@ -0,0 +1,220 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Wraparound-safe energy accumulation.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#include <errno.h>
+#include <string.h>
+#include "powercap.h"
+#include "powercap-accumulator.h"
+#include "powercap-common.h"
+
+int powercap_accumulator_init(powercap_accumulator* acc, uint64_t max_energy_range_uj, uint64_t max_power_range_uw) {
+  if (acc == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  memset(acc, 0, sizeof(*acc));
+  acc->max_energy_range_uj = max_energy_range_uj;
+  acc->max_power_uw = max_power_range_uw;
+  return 0;
+}
+
+int powercap_accumulator_init_zone(powercap_accumulator* acc, const powercap_zone* zone) {
+  uint64_t range = 0;
+  uint64_t power = 0;
+  int ret;
+  if (acc == NULL || zone == NULL || zone->energy_uj <= 0) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (zone->max_energy_range_uj > 0 && (ret = read_u64(zone->max_energy_range_uj, &range))) {
+    return ret;
+  }
+  // some zones expose the file but can't read it - treat it as unknown
+  if (zone->max_power_range_uw > 0 && read_u64(zone->max_power_range_uw, &power)) {
+    LOG(WARN, "powercap-accumulator: Failed to read max_power_range_uw, missed wraps won't be detected\n");
+    power = 0;
+  }
+  powercap_accumulator_init(acc, range, power);
+  acc->zone = zone;
+  return 0;
+}
+
+/* Set *delta to the energy consumed since the last update, return 1 if ambiguous */
+static int compute_delta(const powercap_accumulator* acc, uint64_t energy_uj, uint64_t dt_ns, uint64_t* delta) {
+  const double range = (double) acc->max_energy_range_uj;
+  double max_wraps;
+  double est_wraps;
+  uint64_t wraps;
+  if (energy_uj >= acc->last_uj) {
+    *delta = energy_uj - acc->last_uj;
+  } else if (acc->max_energy_range_uj > 0) {
+    *delta = acc->max_energy_range_uj - acc->last_uj + energy_uj;
+  } else {
+    // can't know how far the counter went before wrapping
+    *delta = energy_uj;
+    return 1;
+  }
+  if (acc->max_energy_range_uj == 0 || acc->max_power_uw == 0) {
+    return 0;
+  }
+  // uW * ns / 1e9 = uJ; floating point avoids overflow for long intervals
+  max_wraps = ((double) acc->max_power_uw * (double) dt_ns / 1e9 - (double) *delta) / range;
+  if (max_wraps < 1) {
+    return 0;
+  }
+  // choose the number of wraps that best matches the last known power (casts truncate the positive values)
+  est_wraps = (acc->last_power_uw * (double) dt_ns / 1e9 - (double) *delta) / range + 0.5;
+  wraps = est_wraps < 1 ? 0 : (uint64_t) est_wraps;
+  if (wraps > (uint64_t) max_wraps) {
+    wraps = (uint64_t) max_wraps;
+  }
+  *delta += wraps * acc->max_energy_range_uj;
+  return 1;
+}
+
+int powercap_accumulator_update(powercap_accumulator* acc, uint64_t energy_uj, uint64_t time_ns) {
+  uint64_t delta;
+  uint64_t dt_ns;
+  uint32_t seq;
+  int ambiguous;
+  if (acc == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  seq = __atomic_load_n(&acc->seq, __ATOMIC_RELAXED);
+  if (!acc->started) {
+    // baseline
+    acc->last_uj = energy_uj;
+    __atomic_store_n(&acc->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&acc->time_ns, time_ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&acc->seq, seq + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&acc->started, 1, __ATOMIC_RELEASE);
+    return 0;
+  }
+  if (time_ns < acc->time_ns) {
+    errno = EINVAL;
+    return -errno;
+  }
+  dt_ns = time_ns - acc->time_ns;
+  ambiguous = compute_delta(acc, energy_uj, dt_ns, &delta);
+  if (!ambiguous && dt_ns > 0) {
+    acc->last_power_uw = (double) delta * 1e9 / (double) dt_ns;
+  }
+  acc->last_uj = energy_uj;
+  __atomic_store_n(&acc->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&acc->total_uj, acc->total_uj + delta, __ATOMIC_RELAXED);
+  __atomic_store_n(&acc->time_ns, time_ns, __ATOMIC_RELAXED);
+  if (ambiguous) {
+    __atomic_store_n(&acc->num_ambiguous, acc->num_ambiguous + 1, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&acc->seq, seq + 2, __ATOMIC_RELEASE);
+  return ambiguous;
+}
+
+int powercap_accumulator_update_zone(powercap_accumulator* acc) {
+  uint64_t energy_uj;
+  int ret;
+  if (acc == NULL || acc->zone == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if ((ret = read_u64(acc->zone->energy_uj, &energy_uj))) {
+    return ret;
+  }
+  return powercap_accumulator_update(acc, energy_uj, get_time_ns());
+}
+
+uint64_t powercap_accumulator_get_total_uj(const powercap_accumulator* acc) {
+  return acc == NULL ? 0 : __atomic_load_n(&acc->total_uj, __ATOMIC_ACQUIRE);
+}
+
+int powercap_accumulator_get(const powercap_accumulator* acc, uint64_t* total_uj, uint64_t* time_ns) {
+  uint64_t total;
+  uint64_t t;
+  uint32_t seq;
+  if (acc == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  do {
+    while ((seq = __atomic_load_n(&acc->seq, __ATOMIC_ACQUIRE)) & 1);
+    total = __atomic_load_n(&acc->total_uj, __ATOMIC_RELAXED);
+    t = __atomic_load_n(&acc->time_ns, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while (__atomic_load_n(&acc->seq, __ATOMIC_RELAXED) != seq);
+  if (total_uj != NULL) {
+    *total_uj = total;
+  }
+  if (time_ns != NULL) {
+    *time_ns = t;
+  }
+  return 0;
+}
+
+uint64_t powercap_accumulator_get_num_ambiguous(const powercap_accumulator* acc) {
+  return acc == NULL ? 0 : __atomic_load_n(&acc->num_ambiguous, __ATOMIC_RELAXED);
+}
+
+int powercap_accumulator_view_init(powercap_accumulator_view* view, const powercap_accumulator* acc) {
+  if (view == NULL || acc == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (!__atomic_load_n(&acc->started, __ATOMIC_ACQUIRE)) {
+    errno = EAGAIN;
+    return -errno;
+  }
+  view->acc = acc;
+  return powercap_accumulator_get(acc, &view->baseline_uj, &view->baseline_ns);
+}
+
+int powercap_accumulator_view_reset(powercap_accumulator_view* view) {
+  if (view == NULL || view->acc == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  return powercap_accumulator_get(view->acc, &view->baseline_uj, &view->baseline_ns);
+}
+
+/* Get the energy and time since the baseline, and the accumulator values they came from */
+static void view_get(const powercap_accumulator_view* view, uint64_t* energy_uj, uint64_t* elapsed_ns, uint64_t* total,
+                     uint64_t* t) {
+  powercap_accumulator_get(view->acc, total, t);
+  if (energy_uj != NULL) {
+    *energy_uj = *total - view->baseline_uj;
+  }
+  if (elapsed_ns != NULL) {
+    *elapsed_ns = *t - view->baseline_ns;
+  }
+}
+
+int powercap_accumulator_view_read(const powercap_accumulator_view* view, uint64_t* energy_uj, uint64_t* elapsed_ns) {
+  uint64_t total;
+  uint64_t t;
+  if (view == NULL || view->acc == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  view_get(view, energy_uj, elapsed_ns, &total, &t);
+  return 0;
+}
+
+int powercap_accumulator_view_lap(powercap_accumulator_view* view, uint64_t* energy_uj, uint64_t* elapsed_ns) {
+  uint64_t total;
+  uint64_t t;
+  if (view == NULL || view->acc == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  view_get(view, energy_uj, elapsed_ns, &total, &t);
+  view->baseline_uj = total;
+  view->baseline_ns = t;
+  return 0;
+}
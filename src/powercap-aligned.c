@@ -0,0 +1,100 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Energy measurements aligned to counter updates.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include "powercap.h"
+#include "powercap-aligned.h"
+#include "powercap-common.h"
+
+static int aligned_read(int fd, uint64_t max_spin_ns, powercap_aligned_read* result) {
+  uint64_t first;
+  uint64_t val;
+  uint64_t start;
+  uint64_t now;
+  uint32_t polls = 1;
+  int ret;
+  start = get_time_ns();
+  if ((ret = read_u64(fd, &first))) {
+    return ret;
+  }
+  for (;;) {
+    // the update happened between the previous read and this one, so the start of this read splits the difference
+    now = get_time_ns();
+    if ((ret = read_u64(fd, &val))) {
+      return ret;
+    }
+    polls++;
+    if (val != first || now - start >= max_spin_ns) {
+      break;
+    }
+  }
+  result->energy_uj = val;
+  result->time_ns = now;
+  result->spin_ns = now - start;
+  result->polls = polls;
+  return val == first;
+}
+
+int powercap_aligned_read_zone(const powercap_zone* zone, uint64_t max_spin_ns, powercap_aligned_read* result) {
+  if (zone == NULL || zone->energy_uj <= 0 || result == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  return aligned_read(zone->energy_uj, max_spin_ns, result);
+}
+
+int powercap_aligned_meter_init(powercap_aligned_meter* meter, const powercap_zone* zone, uint64_t max_spin_ns) {
+  if (meter == NULL || zone == NULL || zone->energy_uj <= 0) {
+    errno = EINVAL;
+    return -errno;
+  }
+  memset(meter, 0, sizeof(*meter));
+  meter->fd = zone->energy_uj;
+  meter->max_spin_ns = max_spin_ns;
+  if (zone->max_energy_range_uj > 0 && powercap_zone_get_max_energy_range_uj(zone, &meter->max_energy_range_uj)) {
+    LOG(WARN, "powercap-aligned: Failed to read max_energy_range_uj, wraparound will not be corrected\n");
+    meter->max_energy_range_uj = 0;
+  }
+  return 0;
+}
+
+int powercap_aligned_meter_begin(powercap_aligned_meter* meter) {
+  int ret;
+  if (meter == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if ((ret = aligned_read(meter->fd, meter->max_spin_ns, &meter->start)) >= 0) {
+    meter->start_aligned = !ret;
+  }
+  return ret;
+}
+
+int powercap_aligned_meter_end(powercap_aligned_meter* meter, uint64_t* energy_uj, uint64_t* duration_ns,
+                               uint64_t* spin_ns) {
+  powercap_aligned_read end = { 0 };
+  int ret;
+  if (meter == NULL || energy_uj == NULL || duration_ns == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if ((ret = aligned_read(meter->fd, meter->max_spin_ns, &end)) < 0) {
+    return ret;
+  }
+  *energy_uj = end.energy_uj - meter->start.energy_uj;
+  if (end.energy_uj < meter->start.energy_uj) {
+    *energy_uj += meter->max_energy_range_uj;
+  }
+  *duration_ns = end.time_ns - meter->start.time_ns;
+  if (spin_ns != NULL) {
+    *spin_ns = meter->start.spin_ns + end.spin_ns;
+  }
+  return ret || !meter->start_aligned;
+}
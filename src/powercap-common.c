@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 /* Main powercap header only used for enums */
@@ -21,10 +22,13 @@
 
 #define MAX_U64_SIZE 24
 
-#ifdef USE_VIRTUAL_DEVICES
-  #define POWERCAP_PATH "/sys/devices/virtual/powercap"
-#else
-  #define POWERCAP_PATH "/sys/class/powercap"
+/* Tests may override the path to use a fake sysfs tree */
+#ifndef POWERCAP_PATH
+  #ifdef USE_VIRTUAL_DEVICES
+    #define POWERCAP_PATH "/sys/devices/virtual/powercap"
+  #else
+    #define POWERCAP_PATH "/sys/class/powercap"
+  #endif
 #endif
 
 /* These enums MUST align with powercap_control_type_file in powercap.h */
@@ -83,12 +87,15 @@ ssize_t read_string(int fd, char* buf, size_t size) {
   return read_string_safe(fd, buf, size);
 }
 
-int read_u64(int fd, uint64_t* val) {
+int read_u64_nread(int fd, uint64_t* val, size_t* nread) {
   char buf[MAX_U64_SIZE];
   char* end;
+  ssize_t ret;
+  *nread = 0;
   if (!val) {
     errno = EINVAL;
-  } else if (read_string_safe(fd, buf, sizeof(buf)) > 0) {
+  } else if ((ret = read_string_safe(fd, buf, sizeof(buf))) > 0) {
+    *nread = (size_t) ret;
     errno = 0;
     *val = strtoull(buf, &end, 0);
     if (buf != end && errno != ERANGE) {
@@ -98,6 +105,17 @@ int read_u64(int fd, uint64_t* val) {
   return -errno;
 }
 
+int read_u64(int fd, uint64_t* val) {
+  size_t nread;
+  return read_u64_nread(fd, val, &nread);
+}
+
+uint64_t get_time_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
 int write_u64(int fd, uint64_t val) {
   char buf[MAX_U64_SIZE];
   ssize_t written;
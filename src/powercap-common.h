@@ -61,9 +61,15 @@ ssize_t read_string(int fd, char* buf, size_t size);
 /* Return 0 on success, negative error code on failure */
 int read_u64(int fd, uint64_t* val);
 
+/* Like read_u64, but also set nread to the number of bytes read (even if parsing fails) */
+int read_u64_nread(int fd, uint64_t* val, size_t* nread);
+
 /* Return 0 on success, negative error code on failure */
 int write_u64(int fd, uint64_t val);
 
+/* Return the CLOCK_MONOTONIC time in nanoseconds */
+uint64_t get_time_ns(void);
+
 /* Simple names only, trying to look outside the powercap directory is not allowed */
 int is_valid_control_type(const char* control_type);
 
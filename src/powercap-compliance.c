@@ -0,0 +1,414 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Power limit compliance verification.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "powercap.h"
+#include "powercap-compliance.h"
+#include "powercap-rapl.h"
+
+/* A point in a target's window: a time and its counter's accumulated energy */
+typedef struct window_point {
+  uint64_t time_ns;
+  uint64_t total_uj;
+} window_point;
+
+typedef struct compliance_target {
+  powercap_compliance_target target;
+  uint64_t limit_uw;
+  uint64_t window_ns;
+  /* The average's threshold for a violation, including the tolerance */
+  double threshold_w;
+  /* Circular buffer of points, spaced at least a sample period apart */
+  window_point* points;
+  uint32_t capacity;
+  uint32_t first;
+  uint32_t npoints;
+  powercap_compliance_status status;
+} compliance_target;
+
+struct powercap_compliance {
+  compliance_target* targets;
+  uint32_t ntargets;
+  uint32_t ncounters;
+  uint64_t period_ns;
+  double tolerance;
+  /* Per-counter arrays, allocated in a single block starting with max_energy_range_uj */
+  uint64_t* max_energy_range_uj;
+  uint64_t* last_uj;
+  uint64_t* total_uj;
+  /* Scratch space for the sample being added */
+  uint64_t* sample_uj;
+  uint64_t last_ns;
+  int started;
+  /* Circular buffer of completed violations */
+  powercap_compliance_violation* violations;
+  uint32_t max_violations;
+  uint32_t first_violation;
+  uint32_t nviolations;
+};
+
+static void push_violation(powercap_compliance* c, const powercap_compliance_violation* v) {
+  if (c->nviolations == c->max_violations) {
+    // discard the oldest
+    c->first_violation = (c->first_violation + 1) % c->max_violations;
+    c->nviolations--;
+  }
+  c->violations[(c->first_violation + c->nviolations) % c->max_violations] = *v;
+  c->nviolations++;
+}
+
+static void end_violation(powercap_compliance* c, compliance_target* t) {
+  if (t->status.violating) {
+    push_violation(c, &t->status.current);
+    t->status.violating = 0;
+  }
+}
+
+/* Read the target's limit and time window, and reset its window if the time window changed */
+static int target_read(powercap_compliance* c, compliance_target* t) {
+  window_point* points;
+  uint64_t limit_uw;
+  uint64_t window_us;
+  uint64_t capacity;
+  int ret;
+  if ((ret = powercap_constraint_get_power_limit_uw(t->target.constraint, &limit_uw)) ||
+      (ret = powercap_constraint_get_time_window_us(t->target.constraint, &window_us))) {
+    return ret;
+  }
+  if (window_us == 0 || window_us > UINT64_MAX / 1000) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (window_us * 1000 != t->window_ns) {
+    // points are at least a period apart, and span at most a window plus a period
+    capacity = window_us * 1000 / c->period_ns + 2;
+    if (capacity > UINT32_MAX) {
+      errno = EINVAL;
+      return -errno;
+    }
+    if ((points = realloc(t->points, (size_t) capacity * sizeof(window_point))) == NULL) {
+      return -errno;
+    }
+    end_violation(c, t);
+    t->points = points;
+    t->capacity = (uint32_t) capacity;
+    t->first = 0;
+    t->npoints = 0;
+    t->window_ns = window_us * 1000;
+    t->status.time_window_us = window_us;
+    t->status.has_average = 0;
+  }
+  t->limit_uw = limit_uw;
+  t->status.power_limit_uw = limit_uw;
+  // uW -> W
+  t->threshold_w = (double) limit_uw / 1000000.0 * (1.0 + c->tolerance);
+  return 0;
+}
+
+powercap_compliance* powercap_compliance_create(const powercap_compliance_target* targets, uint32_t ntargets,
+                                                uint32_t ncounters, const uint64_t* max_energy_range_uj,
+                                                const powercap_compliance_config* cfg) {
+  powercap_compliance* c;
+  uint32_t i;
+  int err;
+  if (targets == NULL || ntargets == 0 || ncounters == 0 || cfg == NULL || cfg->sample_period_us == 0 ||
+      cfg->sample_period_us > UINT64_MAX / 1000 || !(cfg->tolerance >= 0) || cfg->max_violations == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  for (i = 0; i < ntargets; i++) {
+    if (targets[i].constraint == NULL || targets[i].counter >= ncounters) {
+      errno = EINVAL;
+      return NULL;
+    }
+  }
+  if ((c = calloc(1, sizeof(powercap_compliance))) == NULL) {
+    return NULL;
+  }
+  c->ncounters = ncounters;
+  c->period_ns = cfg->sample_period_us * 1000;
+  c->tolerance = cfg->tolerance;
+  c->max_violations = cfg->max_violations;
+  if ((c->max_energy_range_uj = calloc((size_t) ncounters * 4, sizeof(uint64_t))) == NULL ||
+      (c->violations = calloc(cfg->max_violations, sizeof(powercap_compliance_violation))) == NULL ||
+      (c->targets = calloc(ntargets, sizeof(compliance_target))) == NULL) {
+    err = errno;
+    powercap_compliance_destroy(c);
+    errno = err;
+    return NULL;
+  }
+  c->last_uj = c->max_energy_range_uj + ncounters;
+  c->total_uj = c->last_uj + ncounters;
+  c->sample_uj = c->total_uj + ncounters;
+  if (max_energy_range_uj != NULL) {
+    memcpy(c->max_energy_range_uj, max_energy_range_uj, ncounters * sizeof(uint64_t));
+  }
+  for (i = 0; i < ntargets; i++) {
+    c->targets[i].target = targets[i];
+    c->ntargets++;
+    if ((err = target_read(c, &c->targets[i]))) {
+      powercap_compliance_destroy(c);
+      errno = -err;
+      return NULL;
+    }
+  }
+  return c;
+}
+
+static void add_rapl_target(powercap_compliance_target* targets, uint32_t* n, const powercap_constraint* pc,
+                            uint32_t counter) {
+  if (pc->power_limit_uw > 0 && pc->time_window_us > 0) {
+    if (targets != NULL) {
+      targets[*n].constraint = pc;
+      targets[*n].counter = counter;
+    }
+    (*n)++;
+  }
+}
+
+/* Get the RAPL targets and counters' wraparound values, or just count them if "targets" is NULL */
+static uint32_t get_rapl_targets(const powercap_rapl_pkg* pkgs, uint32_t count, powercap_compliance_target* targets,
+                                 uint64_t* max_energy_range_uj, uint32_t* ncounters) {
+  const powercap_rapl_zone_files* files;
+  const powercap_rapl_domain* d;
+  uint32_t n = 0;
+  uint32_t counter = 0;
+  uint32_t i;
+  uint32_t j;
+  uint32_t k;
+  uint32_t o;
+  for (i = 0; i < count; i++) {
+    for (j = 0; j < pkgs[i].ndomains; j++, counter++) {
+      d = &pkgs[i].domains[j];
+      // the same interface as powercap_rapl_snapshot_init uses for the counter
+      for (k = 0; k < POWERCAP_RAPL_NUM_INTERFACES && d->files[k].zone.energy_uj <= 0; k++);
+      if (k == POWERCAP_RAPL_NUM_INTERFACES) {
+        continue;
+      }
+      files = &d->files[k];
+      if (max_energy_range_uj != NULL && powercap_zone_get_max_energy_range_uj(&files->zone,
+                                                                               &max_energy_range_uj[counter])) {
+        max_energy_range_uj[counter] = 0;
+      }
+      add_rapl_target(targets, &n, &files->constraint_long, counter);
+      add_rapl_target(targets, &n, &files->constraint_short, counter);
+      for (o = 0; o < files->nconstraint_other; o++) {
+        add_rapl_target(targets, &n, &files->constraint_other[o], counter);
+      }
+    }
+  }
+  *ncounters = counter;
+  return n;
+}
+
+powercap_compliance* powercap_compliance_create_rapl(const powercap_rapl_pkg* pkgs, uint32_t count,
+                                                     const powercap_compliance_config* cfg) {
+  powercap_compliance_target* targets;
+  powercap_compliance* c;
+  uint64_t* max_energy_range_uj;
+  uint32_t ncounters;
+  uint32_t n;
+  int err;
+  if (pkgs == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if ((n = get_rapl_targets(pkgs, count, NULL, NULL, &ncounters)) == 0) {
+    errno = ENODATA;
+    return NULL;
+  }
+  if ((targets = malloc(n * sizeof(powercap_compliance_target))) == NULL) {
+    return NULL;
+  }
+  if ((max_energy_range_uj = calloc(ncounters, sizeof(uint64_t))) == NULL) {
+    free(targets);
+    return NULL;
+  }
+  get_rapl_targets(pkgs, count, targets, max_energy_range_uj, &ncounters);
+  c = powercap_compliance_create(targets, n, ncounters, max_energy_range_uj, cfg);
+  err = errno;
+  free(max_energy_range_uj);
+  free(targets);
+  errno = err;
+  return c;
+}
+
+void powercap_compliance_destroy(powercap_compliance* compliance) {
+  uint32_t i;
+  if (compliance != NULL) {
+    for (i = 0; i < compliance->ntargets; i++) {
+      free(compliance->targets[i].points);
+    }
+    free(compliance->targets);
+    free(compliance->violations);
+    free(compliance->max_energy_range_uj);
+    free(compliance);
+  }
+}
+
+uint32_t powercap_compliance_get_num_targets(const powercap_compliance* compliance) {
+  return compliance == NULL ? 0 : compliance->ntargets;
+}
+
+const powercap_compliance_target* powercap_compliance_get_target(const powercap_compliance* compliance,
+                                                                 uint32_t target) {
+  if (compliance == NULL || target >= compliance->ntargets) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return &compliance->targets[target].target;
+}
+
+int powercap_compliance_refresh(powercap_compliance* compliance) {
+  uint32_t i;
+  int ret;
+  if (compliance == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  for (i = 0; i < compliance->ntargets; i++) {
+    if ((ret = target_read(compliance, &compliance->targets[i]))) {
+      return ret;
+    }
+  }
+  return 0;
+}
+
+static void target_add(powercap_compliance* c, uint32_t idx, uint64_t time_ns, uint64_t dt_ns) {
+  compliance_target* t = &c->targets[idx];
+  powercap_compliance_status* s = &t->status;
+  const uint64_t total_uj = c->total_uj[t->target.counter];
+  const window_point* start;
+  window_point* p;
+  double average;
+  // the window starts at the latest point no later than a window ago
+  while (t->npoints > 1 && t->points[(t->first + 1) % t->capacity].time_ns + t->window_ns <= time_ns) {
+    t->first = (t->first + 1) % t->capacity;
+    t->npoints--;
+  }
+  if (t->npoints > 0 && (start = &t->points[t->first])->time_ns + t->window_ns <= time_ns) {
+    // uJ/ns = 1000 W
+    average = (double) (total_uj - start->total_uj) * 1000.0 / (double) (time_ns - start->time_ns);
+    if (s->has_average) {
+      s->verified_ns += dt_ns;
+    }
+    s->average_w = average;
+    s->has_average = 1;
+    if (average > t->threshold_w) {
+      if (!s->violating) {
+        s->violating = 1;
+        s->violations++;
+        memset(&s->current, 0, sizeof(s->current));
+        s->current.target = idx;
+        s->current.power_limit_uw = t->limit_uw;
+        s->current.time_window_us = s->time_window_us;
+        s->current.start_ns = time_ns;
+        s->current.peak_w = average;
+      } else {
+        s->violation_ns += dt_ns;
+        s->current.duration_ns = time_ns - s->current.start_ns;
+        // W * ns = 1000 uJ
+        s->current.excess_uj += (average - (double) t->limit_uw / 1000000.0) * (double) dt_ns / 1000.0;
+        if (average > s->current.peak_w) {
+          s->current.peak_w = average;
+        }
+      }
+    } else {
+      end_violation(c, t);
+    }
+  }
+  // keep a point at most once per period
+  if (t->npoints == 0 || t->points[(t->first + t->npoints - 1) % t->capacity].time_ns + c->period_ns <= time_ns) {
+    if (t->npoints == t->capacity) {
+      // only if samples were closer than a period, in which case the window may be shortened
+      t->first = (t->first + 1) % t->capacity;
+      t->npoints--;
+    }
+    p = &t->points[(t->first + t->npoints) % t->capacity];
+    p->time_ns = time_ns;
+    p->total_uj = total_uj;
+    t->npoints++;
+  }
+}
+
+int powercap_compliance_add(powercap_compliance* compliance, uint64_t time_ns, const uint64_t* energy_uj) {
+  uint64_t dt_ns = 0;
+  uint32_t i;
+  if (compliance == NULL || energy_uj == NULL || (compliance->started && time_ns < compliance->last_ns)) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (compliance->started && time_ns == compliance->last_ns) {
+    return 0;
+  }
+  if (compliance->started) {
+    dt_ns = time_ns - compliance->last_ns;
+    for (i = 0; i < compliance->ncounters; i++) {
+      compliance->total_uj[i] += energy_uj[i] - compliance->last_uj[i];
+      if (energy_uj[i] < compliance->last_uj[i]) {
+        compliance->total_uj[i] += compliance->max_energy_range_uj[i];
+      }
+    }
+  }
+  memcpy(compliance->last_uj, energy_uj, compliance->ncounters * sizeof(uint64_t));
+  compliance->last_ns = time_ns;
+  compliance->started = 1;
+  for (i = 0; i < compliance->ntargets; i++) {
+    target_add(compliance, i, time_ns, dt_ns);
+  }
+  return 0;
+}
+
+int powercap_compliance_add_samples(powercap_compliance* compliance, const uint64_t* time_ns,
+                                    const uint64_t* energy_uj, uint32_t n, uint32_t stride) {
+  uint32_t c;
+  uint32_t i;
+  int ret;
+  if (compliance == NULL || time_ns == NULL || energy_uj == NULL || stride < n) {
+    errno = EINVAL;
+    return -errno;
+  }
+  for (i = 0; i < n; i++) {
+    for (c = 0; c < compliance->ncounters; c++) {
+      compliance->sample_uj[c] = energy_uj[(size_t) c * stride + i];
+    }
+    if ((ret = powercap_compliance_add(compliance, time_ns[i], compliance->sample_uj))) {
+      return ret;
+    }
+  }
+  return 0;
+}
+
+int powercap_compliance_get_status(const powercap_compliance* compliance, uint32_t target,
+                                   powercap_compliance_status* status) {
+  if (compliance == NULL || target >= compliance->ntargets || status == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  *status = compliance->targets[target].status;
+  return 0;
+}
+
+int powercap_compliance_read_violations(powercap_compliance* compliance, powercap_compliance_violation* violations,
+                                        uint32_t max) {
+  uint32_t n;
+  uint32_t i;
+  if (compliance == NULL || violations == NULL || max == 0) {
+    errno = EINVAL;
+    return -errno;
+  }
+  n = compliance->nviolations < max ? compliance->nviolations : max;
+  for (i = 0; i < n; i++) {
+    violations[i] = compliance->violations[(compliance->first_violation + i) % compliance->max_violations];
+  }
+  compliance->first_violation = (compliance->first_violation + n) % compliance->max_violations;
+  compliance->nviolations -= n;
+  return (int) n;
+}
@@ -0,0 +1,565 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Closed-loop power control.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include "powercap.h"
+#include "powercap-common.h"
+#include "powercap-controller.h"
+#include "powercap-periodic.h"
+#include "powercap-snapshot.h"
+
+typedef struct controller_actuator {
+  powercap_constraint constraint;
+  double min_w;
+  double max_w;
+  uint64_t last_uw;
+} controller_actuator;
+
+typedef struct controller_loop {
+  uint32_t* counters;
+  uint32_t ncounters;
+  controller_actuator* actuators;
+  uint32_t nactuators;
+  double kp;
+  double ki;
+  double kd;
+  /* Bounds of the total output */
+  double min_w;
+  double max_w;
+  /* Set by any thread */
+  uint64_t target_uw;
+  /* Includes the output when control started, so the integral term alone is the steady-state output */
+  double integral_w;
+  double last_power_w;
+  int has_power;
+  /* Published through a seqlock: the sequence number is odd while an update is in progress */
+  uint32_t seq;
+  powercap_controller_status status;
+} controller_loop;
+
+struct powercap_controller {
+  controller_loop* loops;
+  uint32_t nloops;
+  /* Alternately read into, so the previous read is always the other one */
+  powercap_snapshot snaps[2];
+  uint32_t cur;
+  int primed;
+  /* Scratch space for each iteration's deltas */
+  uint64_t* delta_uj;
+  double* power_w;
+  uint64_t period_ns;
+  uint64_t write_threshold_uw;
+  int rt_priority;
+  int cpu;
+  periodic timer;
+  pthread_t thread;
+  uint64_t start_ns;
+  int running;
+  /* Only written by the thread running iterations */
+  powercap_controller_stats stats;
+};
+
+static void stat_add(uint64_t* stat, uint64_t n) {
+  __atomic_store_n(stat, *stat + n, __ATOMIC_RELAXED);
+}
+
+static double clamp(double val, double min, double max) {
+  return val < min ? min : (val > max ? max : val);
+}
+
+static void publish_status(controller_loop* l, uint64_t target_uw, double power_w, double output_w, int saturated) {
+  const uint32_t seq = __atomic_load_n(&l->seq, __ATOMIC_RELAXED);
+  __atomic_store_n(&l->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&l->status.target_uw, target_uw, __ATOMIC_RELAXED);
+  __atomic_store(&l->status.power_w, &power_w, __ATOMIC_RELAXED);
+  __atomic_store(&l->status.output_w, &output_w, __ATOMIC_RELAXED);
+  __atomic_store_n(&l->status.saturated, saturated, __ATOMIC_RELAXED);
+  __atomic_store_n(&l->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Read the counters and current limits, and start each loop's output from its current limits */
+static int controller_prime(powercap_controller* c) {
+  controller_loop* l;
+  controller_actuator* a;
+  double output_w;
+  uint32_t i;
+  uint32_t j;
+  int ret;
+  if ((ret = powercap_snapshot_read(&c->snaps[c->cur]))) {
+    return ret;
+  }
+  for (i = 0; i < c->nloops; i++) {
+    l = &c->loops[i];
+    output_w = 0;
+    for (j = 0; j < l->nactuators; j++) {
+      a = &l->actuators[j];
+      if ((ret = powercap_constraint_get_power_limit_uw(&a->constraint, &a->last_uw))) {
+        return ret;
+      }
+      output_w += (double) a->last_uw / 1000000.0;
+    }
+    l->integral_w = clamp(output_w, l->min_w, l->max_w);
+    l->has_power = 0;
+    publish_status(l, __atomic_load_n(&l->target_uw, __ATOMIC_RELAXED), 0, output_w, 0);
+  }
+  c->primed = 1;
+  return 0;
+}
+
+/* Get the sum of the actuators' limits if each is set to "share_w", clamped to its bounds */
+static double clamped_sum(const controller_loop* l, double share_w) {
+  double sum_w = 0;
+  uint32_t i;
+  for (i = 0; i < l->nactuators; i++) {
+    sum_w += clamp(share_w, l->actuators[i].min_w, l->actuators[i].max_w);
+  }
+  return sum_w;
+}
+
+/* Find the share whose clamped limits sum to the output, which is within the sums of the actuators' bounds */
+static double find_share(const controller_loop* l, double output_w) {
+  double lo = l->actuators[0].min_w;
+  double hi = l->actuators[0].max_w;
+  double mid;
+  uint32_t i;
+  // usually no actuator is at a bound, so an equal split works
+  mid = output_w / l->nactuators;
+  for (i = 0; i < l->nactuators && mid >= l->actuators[i].min_w && mid <= l->actuators[i].max_w; i++);
+  if (i == l->nactuators) {
+    return mid;
+  }
+  for (i = 1; i < l->nactuators; i++) {
+    lo = l->actuators[i].min_w < lo ? l->actuators[i].min_w : lo;
+    hi = l->actuators[i].max_w > hi ? l->actuators[i].max_w : hi;
+  }
+  // the clamped sum increases with the share, so bisect - 64 halvings exhaust a double's precision
+  for (i = 0; i < 64; i++) {
+    mid = (lo + hi) / 2;
+    if (clamped_sum(l, mid) < output_w) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return hi;
+}
+
+/*
+ * Split the output between the constraints, skipping unchanged limits.
+ * Sets *applied_w to the sum of the limits in effect and returns the first write error.
+ */
+static int actuate(powercap_controller* c, controller_loop* l, double output_w, double* applied_w) {
+  const double share_w = find_share(l, output_w);
+  controller_actuator* a;
+  double limit_uw;
+  uint64_t uw;
+  uint64_t diff;
+  uint32_t i;
+  int err = 0;
+  int ret;
+  *applied_w = 0;
+  for (i = 0; i < l->nactuators; i++) {
+    a = &l->actuators[i];
+    limit_uw = clamp(share_w, a->min_w, a->max_w) * 1000000.0 + 0.5;
+    uw = (uint64_t) limit_uw;
+    diff = uw > a->last_uw ? uw - a->last_uw : a->last_uw - uw;
+    if (diff <= c->write_threshold_uw) {
+      stat_add(&c->stats.skipped_writes, 1);
+    } else if ((ret = powercap_constraint_set_power_limit_uw(&a->constraint, uw))) {
+      // try again next iteration
+      stat_add(&c->stats.write_errors, 1);
+      if (!err) {
+        err = ret;
+      }
+    } else {
+      a->last_uw = uw;
+      stat_add(&c->stats.writes, 1);
+    }
+    *applied_w += (double) a->last_uw / 1000000.0;
+  }
+  return err;
+}
+
+static int control(powercap_controller* c, controller_loop* l, const powercap_snapshot* prev,
+                   const powercap_snapshot* next) {
+  const uint32_t c0 = l->counters[0];
+  const uint64_t target_uw = __atomic_load_n(&l->target_uw, __ATOMIC_RELAXED);
+  double dt_s = 0;
+  double power_w = 0;
+  double error_w;
+  double integral_w;
+  double output_w;
+  double applied_w;
+  int saturated = 0;
+  int ret;
+  uint32_t i;
+  for (i = 0; i < l->ncounters; i++) {
+    power_w += c->power_w[l->counters[i]];
+  }
+  if (next->time_ns[c0] > prev->time_ns[c0]) {
+    dt_s = (double) (next->time_ns[c0] - prev->time_ns[c0]) / 1000000000.0;
+  }
+  error_w = (double) target_uw / 1000000.0 - power_w;
+  integral_w = l->integral_w + l->ki * error_w * dt_s;
+  output_w = l->kp * error_w + integral_w;
+  if (l->has_power && dt_s > 0) {
+    // on the measurement rather than the error, so target changes don't cause a spike
+    output_w -= l->kd * (power_w - l->last_power_w) / dt_s;
+  }
+  // anti-windup: don't integrate further into saturation
+  if (output_w > l->max_w) {
+    output_w = l->max_w;
+    saturated = 1;
+    if (error_w > 0) {
+      integral_w = l->integral_w;
+    }
+  } else if (output_w < l->min_w) {
+    output_w = l->min_w;
+    saturated = 1;
+    if (error_w < 0) {
+      integral_w = l->integral_w;
+    }
+  }
+  l->integral_w = clamp(integral_w, l->min_w, l->max_w);
+  l->last_power_w = power_w;
+  l->has_power = 1;
+  ret = actuate(c, l, output_w, &applied_w);
+  publish_status(l, target_uw, power_w, applied_w, saturated);
+  return ret;
+}
+
+static int controller_iterate(powercap_controller* c) {
+  const powercap_snapshot* prev = &c->snaps[c->cur];
+  powercap_snapshot* next = &c->snaps[c->cur ^ 1];
+  uint32_t i;
+  int err = 0;
+  int ret;
+  // counters that fail to read keep their previous values (and times), so their next power spans the gap
+  memcpy(next->energy_uj, prev->energy_uj, prev->count * sizeof(uint64_t));
+  memcpy(next->time_ns, prev->time_ns, prev->count * sizeof(uint64_t));
+  ret = powercap_snapshot_read(next);
+  c->cur ^= 1;
+  if (ret) {
+    stat_add(&c->stats.read_errors, 1);
+    return ret;
+  }
+  powercap_snapshot_delta(prev, next, c->delta_uj, c->power_w);
+  for (i = 0; i < c->nloops; i++) {
+    if ((ret = control(c, &c->loops[i], prev, next)) && !err) {
+      err = ret;
+    }
+  }
+  stat_add(&c->stats.iterations, 1);
+  return err;
+}
+
+static void* controller_thread(void* arg) {
+  powercap_controller* c = (powercap_controller*) arg;
+  uint64_t scheduled_ns = c->start_ns;
+  uint64_t expirations;
+  uint64_t now_ns;
+  uint64_t latency_ns;
+  while (periodic_wait(&c->timer, &expirations) == 0) {
+    scheduled_ns += expirations * c->period_ns;
+    stat_add(&c->stats.missed, expirations - 1);
+    controller_iterate(c);
+    now_ns = get_time_ns();
+    latency_ns = now_ns > scheduled_ns ? now_ns - scheduled_ns : 0;
+    stat_add(&c->stats.total_latency_ns, latency_ns);
+    if (latency_ns > c->stats.max_latency_ns) {
+      __atomic_store_n(&c->stats.max_latency_ns, latency_ns, __ATOMIC_RELAXED);
+    }
+  }
+  return NULL;
+}
+
+static void loop_destroy(controller_loop* l) {
+  free(l->counters);
+  free(l->actuators);
+}
+
+static int actuator_init(controller_actuator* a, const powercap_constraint* constraint,
+                         const powercap_controller_loop* loop) {
+  uint64_t min_uw = loop->min_limit_uw;
+  uint64_t max_uw = loop->max_limit_uw;
+  uint64_t val;
+  int ret;
+  if (constraint->power_limit_uw <= 0) {
+    errno = EINVAL;
+    return -errno;
+  }
+  a->constraint = *constraint;
+  if ((ret = powercap_constraint_get_power_limit_uw(constraint, &a->last_uw))) {
+    return ret;
+  }
+  if (constraint->min_power_uw > 0) {
+    if ((ret = powercap_constraint_get_min_power_uw(constraint, &val))) {
+      return ret;
+    }
+    min_uw = val > min_uw ? val : min_uw;
+  }
+  if (constraint->max_power_uw > 0) {
+    if ((ret = powercap_constraint_get_max_power_uw(constraint, &val))) {
+      return ret;
+    }
+    max_uw = max_uw == 0 || val < max_uw ? val : max_uw;
+  }
+  if (max_uw == 0 || min_uw > max_uw) {
+    errno = EINVAL;
+    return -errno;
+  }
+  a->min_w = (double) min_uw / 1000000.0;
+  a->max_w = (double) max_uw / 1000000.0;
+  return 0;
+}
+
+static int loop_init(controller_loop* l, const powercap_controller_loop* loop, uint32_t ncounters) {
+  uint32_t i;
+  int ret;
+  if (loop->counters == NULL || loop->ncounters == 0 || loop->constraints == NULL || loop->nconstraints == 0 ||
+      !(loop->kp >= 0) || !(loop->ki >= 0) || !(loop->kd >= 0)) {
+    errno = EINVAL;
+    return -errno;
+  }
+  for (i = 0; i < loop->ncounters; i++) {
+    if (loop->counters[i] >= ncounters) {
+      errno = EINVAL;
+      return -errno;
+    }
+  }
+  if ((l->counters = malloc(loop->ncounters * sizeof(uint32_t))) == NULL ||
+      (l->actuators = calloc(loop->nconstraints, sizeof(controller_actuator))) == NULL) {
+    return -errno;
+  }
+  memcpy(l->counters, loop->counters, loop->ncounters * sizeof(uint32_t));
+  l->ncounters = loop->ncounters;
+  l->nactuators = loop->nconstraints;
+  for (i = 0; i < l->nactuators; i++) {
+    if ((ret = actuator_init(&l->actuators[i], &loop->constraints[i], loop))) {
+      return ret;
+    }
+    l->min_w += l->actuators[i].min_w;
+    l->max_w += l->actuators[i].max_w;
+  }
+  l->kp = loop->kp;
+  l->ki = loop->ki;
+  l->kd = loop->kd;
+  l->target_uw = loop->target_uw;
+  l->status.target_uw = loop->target_uw;
+  return 0;
+}
+
+powercap_controller* powercap_controller_create(const powercap_snapshot* counters,
+                                                const powercap_controller_loop* loops, uint32_t nloops,
+                                                const powercap_controller_config* cfg) {
+  powercap_controller* c;
+  uint32_t i;
+  int err;
+  if (counters == NULL || counters->count == 0 || loops == NULL || nloops == 0 || cfg == NULL ||
+      cfg->period_us == 0 || cfg->rt_priority < 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if ((c = calloc(1, sizeof(powercap_controller))) == NULL) {
+    return NULL;
+  }
+  c->period_ns = cfg->period_us * 1000;
+  c->write_threshold_uw = cfg->write_threshold_uw;
+  c->rt_priority = cfg->rt_priority;
+  c->cpu = cfg->cpu;
+  c->timer.timer_fd = -1;
+  if ((c->loops = calloc(nloops, sizeof(controller_loop))) == NULL ||
+      (c->delta_uj = malloc(counters->count * sizeof(uint64_t))) == NULL ||
+      (c->power_w = malloc(counters->count * sizeof(double))) == NULL) {
+    goto fail;
+  }
+  for (i = 0; i < nloops; i++) {
+    c->nloops++;
+    if (loop_init(&c->loops[i], &loops[i], counters->count)) {
+      goto fail;
+    }
+  }
+  for (i = 0; i < 2; i++) {
+    if ((err = powercap_snapshot_init(&c->snaps[i], counters->count))) {
+      errno = -err;
+      goto fail;
+    }
+    memcpy(c->snaps[i].fds, counters->fds, counters->count * sizeof(int));
+    memcpy(c->snaps[i].max_energy_range_uj, counters->max_energy_range_uj, counters->count * sizeof(uint64_t));
+  }
+  if ((err = periodic_init(&c->timer))) {
+    c->timer.timer_fd = -1;
+    errno = -err;
+    goto fail;
+  }
+  return c;
+
+fail:
+  err = errno;
+  powercap_controller_destroy(c);
+  errno = err;
+  return NULL;
+}
+
+int powercap_controller_destroy(powercap_controller* controller) {
+  int ret = 0;
+  uint32_t i;
+  if (controller == NULL) {
+    return 0;
+  }
+  if (controller->running) {
+    ret = powercap_controller_stop(controller);
+  }
+  for (i = 0; i < controller->nloops; i++) {
+    loop_destroy(&controller->loops[i]);
+  }
+  free(controller->loops);
+  free(controller->delta_uj);
+  free(controller->power_w);
+  powercap_snapshot_destroy(&controller->snaps[0]);
+  powercap_snapshot_destroy(&controller->snaps[1]);
+  if (controller->timer.timer_fd >= 0) {
+    periodic_destroy(&controller->timer);
+  }
+  free(controller);
+  return ret;
+}
+
+/* Create the thread with the configured CPU and real-time priority, if possible */
+static int controller_thread_create(powercap_controller* c) {
+  struct sched_param param;
+  pthread_attr_t attr;
+  cpu_set_t cpus;
+  int ret;
+  if ((ret = pthread_attr_init(&attr))) {
+    return ret;
+  }
+  if (c->cpu >= 0) {
+    CPU_ZERO(&cpus);
+    CPU_SET((size_t) c->cpu, &cpus);
+    ret = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+  }
+  if (!ret && c->rt_priority > 0) {
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = c->rt_priority;
+    if (!(ret = pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED)) &&
+        !(ret = pthread_attr_setschedpolicy(&attr, SCHED_FIFO))) {
+      ret = pthread_attr_setschedparam(&attr, &param);
+    }
+  }
+  if (!ret && (ret = pthread_create(&c->thread, &attr, controller_thread, c)) == 0) {
+    pthread_attr_destroy(&attr);
+    return 0;
+  }
+  pthread_attr_destroy(&attr);
+  if (c->cpu >= 0 || c->rt_priority > 0) {
+    LOG(WARN, "powercap-controller: Failed to set controller thread CPU or priority: %s\n", strerror(ret));
+  }
+  return pthread_create(&c->thread, NULL, controller_thread, c);
+}
+
+int powercap_controller_start(powercap_controller* controller) {
+  int ret;
+  if (controller == NULL || controller->running) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if ((ret = controller_prime(controller))) {
+    return ret;
+  }
+  controller->start_ns = get_time_ns();
+  if ((ret = periodic_start(&controller->timer, controller->period_ns))) {
+    return ret;
+  }
+  if ((ret = controller_thread_create(controller))) {
+    LOG(ERROR, "powercap-controller: Failed to start controller thread: %s\n", strerror(ret));
+    periodic_stop(&controller->timer);
+    errno = ret;
+    return -errno;
+  }
+  controller->running = 1;
+  return 0;
+}
+
+int powercap_controller_stop(powercap_controller* controller) {
+  int ret;
+  if (controller == NULL || !controller->running) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if ((ret = periodic_stop(&controller->timer))) {
+    return ret;
+  }
+  pthread_join(controller->thread, NULL);
+  controller->running = 0;
+  // limits may be changed by others while stopped
+  controller->primed = 0;
+  return 0;
+}
+
+int powercap_controller_update(powercap_controller* controller) {
+  if (controller == NULL || controller->running) {
+    errno = EINVAL;
+    return -errno;
+  }
+  return controller->primed ? controller_iterate(controller) : controller_prime(controller);
+}
+
+int powercap_controller_set_target(powercap_controller* controller, uint32_t loop, uint64_t target_uw) {
+  if (controller == NULL || loop >= controller->nloops) {
+    errno = EINVAL;
+    return -errno;
+  }
+  __atomic_store_n(&controller->loops[loop].target_uw, target_uw, __ATOMIC_RELAXED);
+  return 0;
+}
+
+int powercap_controller_get_status(const powercap_controller* controller, uint32_t loop,
+                                   powercap_controller_status* status) {
+  const controller_loop* l;
+  uint32_t seq;
+  if (controller == NULL || loop >= controller->nloops || status == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  l = &controller->loops[loop];
+  do {
+    while ((seq = __atomic_load_n(&l->seq, __ATOMIC_ACQUIRE)) & 1);
+    status->target_uw = __atomic_load_n(&l->status.target_uw, __ATOMIC_RELAXED);
+    __atomic_load(&l->status.power_w, &status->power_w, __ATOMIC_RELAXED);
+    __atomic_load(&l->status.output_w, &status->output_w, __ATOMIC_RELAXED);
+    status->saturated = __atomic_load_n(&l->status.saturated, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while (__atomic_load_n(&l->seq, __ATOMIC_RELAXED) != seq);
+  return 0;
+}
+
+int powercap_controller_get_stats(const powercap_controller* controller, powercap_controller_stats* stats) {
+  const powercap_controller_stats* s;
+  if (controller == NULL || stats == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  s = &controller->stats;
+  stats->iterations = __atomic_load_n(&s->iterations, __ATOMIC_RELAXED);
+  stats->missed = __atomic_load_n(&s->missed, __ATOMIC_RELAXED);
+  stats->writes = __atomic_load_n(&s->writes, __ATOMIC_RELAXED);
+  stats->skipped_writes = __atomic_load_n(&s->skipped_writes, __ATOMIC_RELAXED);
+  stats->read_errors = __atomic_load_n(&s->read_errors, __ATOMIC_RELAXED);
+  stats->write_errors = __atomic_load_n(&s->write_errors, __ATOMIC_RELAXED);
+  stats->max_latency_ns = __atomic_load_n(&s->max_latency_ns, __ATOMIC_RELAXED);
+  stats->total_latency_ns = __atomic_load_n(&s->total_latency_ns, __ATOMIC_RELAXED);
+  return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Periodic wakeups for sampling threads.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "powercap-periodic.h"
+
+int periodic_init(periodic* p) {
+  if ((p->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)) < 0) {
+    return -errno;
+  }
+  if ((p->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+    close(p->timer_fd);
+    return -errno;
+  }
+  return 0;
+}
+
+void periodic_destroy(periodic* p) {
+  close(p->timer_fd);
+  close(p->stop_fd);
+}
+
+int periodic_start(periodic* p, uint64_t period_ns) {
+  struct itimerspec its;
+  uint64_t val;
+  // clear a previous stop request, if any
+  if (read(p->stop_fd, &val, sizeof(val)) < 0 && errno != EAGAIN) {
+    return -errno;
+  }
+  its.it_interval.tv_sec = (time_t) (period_ns / 1000000000);
+  its.it_interval.tv_nsec = (long) (period_ns % 1000000000);
+  its.it_value = its.it_interval;
+  if (timerfd_settime(p->timer_fd, 0, &its, NULL)) {
+    return -errno;
+  }
+  return 0;
+}
+
+int periodic_expirations(periodic* p, uint64_t* expirations) {
+  if (read(p->timer_fd, expirations, sizeof(*expirations)) != (ssize_t) sizeof(*expirations)) {
+    if (errno != EAGAIN) {
+      return -errno;
+    }
+    *expirations = 0;
+  }
+  return 0;
+}
+
+int periodic_wait(periodic* p, uint64_t* expirations) {
+  struct pollfd fds[2];
+  uint64_t val;
+  fds[0].fd = p->stop_fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = p->timer_fd;
+  fds[1].events = POLLIN;
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -errno;
+    }
+    if (fds[0].revents & POLLIN) {
+      return 1;
+    }
+    if (fds[1].revents & POLLIN) {
+      if (read(p->timer_fd, &val, sizeof(val)) != (ssize_t) sizeof(val)) {
+        if (errno == EAGAIN || errno == EINTR) {
+          continue;
+        }
+        return -errno;
+      }
+      if (expirations != NULL) {
+        *expirations = val;
+      }
+      return 0;
+    }
+  }
+}
+
+int periodic_stop(periodic* p) {
+  const struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+  const uint64_t val = 1;
+  if (timerfd_settime(p->timer_fd, 0, &its, NULL)) {
+    return -errno;
+  }
+  if (write(p->stop_fd, &val, sizeof(val)) != (ssize_t) sizeof(val)) {
+    return -errno;
+  }
+  return 0;
+}
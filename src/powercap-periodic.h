@@ -0,0 +1,62 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Periodic wakeups for sampling threads, using a CLOCK_MONOTONIC timerfd and an eventfd to request a stop.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#ifndef _POWERCAP_PERIODIC_H_
+#define _POWERCAP_PERIODIC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#pragma GCC visibility push(hidden)
+
+typedef struct periodic {
+  int timer_fd;
+  int stop_fd;
+} periodic;
+
+/* Return 0 on success, negative error code on failure */
+int periodic_init(periodic* p);
+
+/* Close file descriptors */
+void periodic_destroy(periodic* p);
+
+/*
+ * Clear any previous stop request and arm the timer, with the first expiration one period from now.
+ * Return 0 on success, negative error code on failure.
+ */
+int periodic_start(periodic* p, uint64_t period_ns);
+
+/*
+ * Get the number of periods that elapsed since the last wait or check, without blocking (may be 0).
+ * Return 0 on success, negative error code on failure.
+ */
+int periodic_expirations(periodic* p, uint64_t* expirations);
+
+/*
+ * Block until the timer expires or a stop is requested.
+ * If not NULL, expirations is set to the number of periods that elapsed since the last wait (more than 1 if missed).
+ * Return 0 on expiration, 1 if stopped, negative error code on failure.
+ */
+int periodic_wait(periodic* p, uint64_t* expirations);
+
+/*
+ * Disarm the timer and request that a waiting (or the next) call to periodic_wait returns.
+ * Return 0 on success, negative error code on failure.
+ */
+int periodic_stop(periodic* p);
+
+#pragma GCC visibility pop
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
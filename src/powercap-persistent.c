@@ -0,0 +1,256 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Persistent energy accumulators.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "powercap.h"
+#include "powercap-accumulator.h"
+#include "powercap-common.h"
+#include "powercap-persistent.h"
+
+#define BOOT_ID_PATH "/proc/sys/kernel/random/boot_id"
+#define STATE_MAGIC "PWRCAPAC"
+/* Increment if the layout of persistent_state changes */
+#define STATE_VERSION 2
+#define BOOT_ID_SIZE 40
+#define ZONE_NAME_SIZE 64
+
+/* The accumulator's state, in a layout that doesn't depend on powercap_accumulator */
+typedef struct persistent_record {
+  uint64_t total_uj;
+  uint64_t last_uj;
+  uint64_t time_ns;
+  uint64_t num_ambiguous;
+  double last_power_uw;
+  /* Nonzero once there's a baseline */
+  uint32_t started;
+  /* Nonzero while the record is being written, so it's left set if the process crashes in between */
+  uint32_t dirty;
+} persistent_record;
+
+/* The state file's contents */
+typedef struct persistent_state {
+  char magic[8];
+  uint32_t version;
+  uint32_t size;
+  char boot_id[BOOT_ID_SIZE];
+  /* The zone's name and counter range identify which counter the record belongs to */
+  char zone_name[ZONE_NAME_SIZE];
+  uint64_t max_energy_range_uj;
+  uint64_t num_gaps;
+  persistent_record rec;
+} persistent_state;
+
+struct powercap_persistent {
+  int fd;
+  persistent_state* state;
+  powercap_accumulator acc;
+};
+
+/* An empty boot id means it's unknown */
+static void read_boot_id(char* boot_id) {
+  int fd;
+  memset(boot_id, 0, BOOT_ID_SIZE);
+  if ((fd = open(BOOT_ID_PATH, O_RDONLY | O_CLOEXEC)) >= 0) {
+    if (read_string_safe(fd, boot_id, BOOT_ID_SIZE) < 0) {
+      boot_id[0] = '\0';
+    }
+    close(fd);
+  }
+}
+
+/* An empty name means the zone doesn't have one */
+static void read_zone_name(const powercap_zone* zone, char* name) {
+  memset(name, 0, ZONE_NAME_SIZE);
+  if (zone->name > 0 && read_string_safe(zone->name, name, ZONE_NAME_SIZE) < 0) {
+    name[0] = '\0';
+  }
+}
+
+static int state_is_valid(const persistent_state* state, const char* zone_name, const powercap_accumulator* acc) {
+  if (memcmp(state->magic, STATE_MAGIC, sizeof(state->magic)) || state->version != STATE_VERSION ||
+      state->size != sizeof(persistent_state) || !state->rec.started) {
+    return 0;
+  }
+  if (strncmp(state->zone_name, zone_name, ZONE_NAME_SIZE) ||
+      state->max_energy_range_uj != acc->max_energy_range_uj) {
+    LOG(WARN, "powercap-persistent: Saved state is for a different zone, discarding it\n");
+    return 0;
+  }
+  return 1;
+}
+
+/* Write the accumulator to the record */
+static void save(persistent_record* rec, const powercap_accumulator* acc) {
+  __atomic_store_n(&rec->dirty, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  rec->total_uj = acc->total_uj;
+  rec->last_uj = acc->last_uj;
+  rec->time_ns = acc->time_ns;
+  rec->num_ambiguous = acc->num_ambiguous;
+  rec->last_power_uw = acc->last_power_uw;
+  rec->started = (uint32_t) acc->started;
+  __atomic_store_n(&rec->dirty, 0, __ATOMIC_RELEASE);
+}
+
+/* Rebuild the accumulator from the record, returns a powercap_persistent_status or a negative error code */
+static int reconcile(persistent_state* state, powercap_accumulator* acc, const char* boot_id) {
+  const persistent_record* rec = &state->rec;
+  uint64_t energy_uj;
+  int ret;
+  if ((ret = read_u64(acc->zone->energy_uj, &energy_uj))) {
+    return ret;
+  }
+  // limits were just read from the zone, in case they changed (e.g., after a firmware update)
+  acc->total_uj = rec->total_uj;
+  acc->num_ambiguous = rec->num_ambiguous;
+  if (!rec->dirty && boot_id[0] != '\0' && strncmp(boot_id, state->boot_id, BOOT_ID_SIZE) == 0) {
+    // same boot, so the counter and the monotonic clock are continuous with the saved state
+    acc->last_uj = rec->last_uj;
+    acc->time_ns = rec->time_ns;
+    acc->last_power_uw = rec->last_power_uw;
+    acc->started = 1;
+    if ((ret = powercap_accumulator_update(acc, energy_uj, get_time_ns())) == 0) {
+      return POWERCAP_PERSISTENT_RESUMED;
+    }
+    if (ret == 1) {
+      // the estimate was added to the total, but it's still a gap
+      state->num_gaps++;
+      return POWERCAP_PERSISTENT_GAP;
+    }
+    acc->started = 0;
+  }
+  // start a new baseline, keeping the total
+  LOG(INFO, "powercap-persistent: Energy since the state was saved is unknown\n");
+  powercap_accumulator_update(acc, energy_uj, get_time_ns());
+  state->num_gaps++;
+  memcpy(state->boot_id, boot_id, BOOT_ID_SIZE);
+  return POWERCAP_PERSISTENT_GAP;
+}
+
+powercap_persistent* powercap_persistent_open(const char* path, const powercap_zone* zone,
+                                              powercap_persistent_status* status) {
+  powercap_persistent* p;
+  struct stat sb;
+  char boot_id[BOOT_ID_SIZE];
+  char zone_name[ZONE_NAME_SIZE];
+  int st;
+  int err;
+  if (path == NULL || zone == NULL || zone->energy_uj <= 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if ((p = malloc(sizeof(powercap_persistent))) == NULL) {
+    return NULL;
+  }
+  if ((p->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+    err = errno;
+    free(p);
+    errno = err;
+    return NULL;
+  }
+  if (flock(p->fd, LOCK_EX | LOCK_NB) || fstat(p->fd, &sb) ||
+      (sb.st_size != (off_t) sizeof(persistent_state) && ftruncate(p->fd, (off_t) sizeof(persistent_state))) ||
+      (p->state = mmap(NULL, sizeof(persistent_state), PROT_READ | PROT_WRITE, MAP_SHARED, p->fd, 0)) == MAP_FAILED) {
+    err = errno;
+    close(p->fd);
+    free(p);
+    errno = err;
+    return NULL;
+  }
+  if ((err = powercap_accumulator_init_zone(&p->acc, zone))) {
+    powercap_persistent_close(p);
+    errno = -err;
+    return NULL;
+  }
+  read_boot_id(boot_id);
+  read_zone_name(zone, zone_name);
+  if (sb.st_size == (off_t) sizeof(persistent_state) && state_is_valid(p->state, zone_name, &p->acc)) {
+    if ((st = reconcile(p->state, &p->acc, boot_id)) < 0) {
+      powercap_persistent_close(p);
+      errno = -st;
+      return NULL;
+    }
+    save(&p->state->rec, &p->acc);
+  } else {
+    memset(p->state, 0, sizeof(persistent_state));
+    if ((err = powercap_accumulator_update_zone(&p->acc)) < 0) {
+      powercap_persistent_close(p);
+      errno = -err;
+      return NULL;
+    }
+    save(&p->state->rec, &p->acc);
+    memcpy(p->state->boot_id, boot_id, BOOT_ID_SIZE);
+    memcpy(p->state->zone_name, zone_name, ZONE_NAME_SIZE);
+    p->state->max_energy_range_uj = p->acc.max_energy_range_uj;
+    p->state->version = STATE_VERSION;
+    p->state->size = sizeof(persistent_state);
+    // the magic makes the state valid, so it's last
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(p->state->magic, STATE_MAGIC, sizeof(p->state->magic));
+    st = POWERCAP_PERSISTENT_NEW;
+  }
+  if (status != NULL) {
+    *status = (powercap_persistent_status) st;
+  }
+  return p;
+}
+
+int powercap_persistent_update(powercap_persistent* persistent) {
+  int ret;
+  if (persistent == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if ((ret = powercap_accumulator_update_zone(&persistent->acc)) >= 0) {
+    save(&persistent->state->rec, &persistent->acc);
+  }
+  return ret;
+}
+
+const powercap_accumulator* powercap_persistent_get_accumulator(const powercap_persistent* persistent) {
+  return persistent == NULL ? NULL : &persistent->acc;
+}
+
+uint64_t powercap_persistent_get_num_gaps(const powercap_persistent* persistent) {
+  return persistent == NULL ? 0 : persistent->state->num_gaps;
+}
+
+int powercap_persistent_sync(powercap_persistent* persistent) {
+  if (persistent == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (msync(persistent->state, sizeof(persistent_state), MS_SYNC)) {
+    return -errno;
+  }
+  return 0;
+}
+
+int powercap_persistent_close(powercap_persistent* persistent) {
+  int ret = 0;
+  if (persistent == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (munmap(persistent->state, sizeof(persistent_state))) {
+    ret = -errno;
+  }
+  // also releases the lock
+  if (close(persistent->fd) && !ret) {
+    ret = -errno;
+  }
+  free(persistent);
+  return ret;
+}
@@ -0,0 +1,147 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Derived power streams.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include "powercap.h"
+#include "powercap-common.h"
+#include "powercap-power-stream.h"
+#include "powercap-snapshot.h"
+
+static int check_config(const powercap_power_stream_config* cfg) {
+  switch (cfg->filter) {
+  case POWERCAP_POWER_FILTER_RAW:
+    return 0;
+  case POWERCAP_POWER_FILTER_EWMA:
+    return cfg->half_life_us > 0 ? 0 : -EINVAL;
+  case POWERCAP_POWER_FILTER_KALMAN:
+    // comparisons with NaN are false, so NaN is rejected
+    return cfg->process_noise >= 0 && cfg->measurement_noise > 0 ? 0 : -EINVAL;
+  default:
+    return -EINVAL;
+  }
+}
+
+int powercap_power_stream_init(powercap_power_stream* stream, const powercap_power_stream_config* cfg,
+                               uint64_t max_energy_range_uj) {
+  if (stream == NULL || cfg == NULL || check_config(cfg)) {
+    errno = EINVAL;
+    return -errno;
+  }
+  memset(stream, 0, sizeof(*stream));
+  stream->cfg = *cfg;
+  stream->max_energy_range_uj = max_energy_range_uj;
+  return 0;
+}
+
+int powercap_power_stream_init_zone(powercap_power_stream* stream, const powercap_power_stream_config* cfg,
+                                    const powercap_zone* zone) {
+  uint64_t range = 0;
+  int ret;
+  if (zone == NULL || zone->energy_uj <= 0) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (zone->max_energy_range_uj > 0 && (ret = read_u64(zone->max_energy_range_uj, &range))) {
+    return ret;
+  }
+  return powercap_power_stream_init(stream, cfg, range);
+}
+
+int powercap_power_stream_reset(powercap_power_stream* stream) {
+  if (stream == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  stream->state = 0;
+  stream->power_w = 0;
+  stream->variance = 0;
+  return 0;
+}
+
+static void filter(powercap_power_stream* stream, double raw_w, uint64_t dt_ns) {
+  double alpha;
+  double gain;
+  if (stream->state < 2 || stream->cfg.filter == POWERCAP_POWER_FILTER_RAW) {
+    // the first measurement initializes every filter
+    stream->power_w = raw_w;
+    stream->variance = stream->cfg.measurement_noise;
+    stream->state = 2;
+    return;
+  }
+  if (stream->cfg.filter == POWERCAP_POWER_FILTER_EWMA) {
+    // weight by elapsed time, so irregular update intervals decay consistently
+    alpha = 1.0 - exp2(-(double) dt_ns / ((double) stream->cfg.half_life_us * 1000.0));
+    stream->power_w += alpha * (raw_w - stream->power_w);
+  } else {
+    // predict, then correct
+    stream->variance += stream->cfg.process_noise * (double) dt_ns / 1e9;
+    gain = stream->variance / (stream->variance + stream->cfg.measurement_noise);
+    stream->power_w += gain * (raw_w - stream->power_w);
+    stream->variance *= 1.0 - gain;
+  }
+}
+
+int powercap_power_stream_update(powercap_power_stream* stream, uint64_t energy_uj, uint64_t time_ns,
+                                 double* power_w) {
+  uint64_t delta;
+  uint64_t dt_ns;
+  if (stream == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (stream->state == 0) {
+    stream->state = 1;
+    stream->last_uj = energy_uj;
+    stream->last_ns = time_ns;
+  } else if (time_ns < stream->last_ns) {
+    errno = EINVAL;
+    return -errno;
+  } else if (time_ns > stream->last_ns) {
+    delta = energy_uj - stream->last_uj;
+    if (energy_uj < stream->last_uj) {
+      delta += stream->max_energy_range_uj;
+    }
+    dt_ns = time_ns - stream->last_ns;
+    // uJ/ns = 1000 W
+    filter(stream, (double) delta * 1000.0 / (double) dt_ns, dt_ns);
+    stream->last_uj = energy_uj;
+    stream->last_ns = time_ns;
+  }
+  if (power_w != NULL) {
+    *power_w = stream->power_w;
+  }
+  return stream->state < 2;
+}
+
+int powercap_power_stream_update_snapshot(powercap_power_stream* streams, const powercap_snapshot* snap,
+                                          double* power_w) {
+  uint32_t i;
+  int ret = 0;
+  int err;
+  if (streams == NULL || snap == NULL || power_w == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  for (i = 0; i < snap->count; i++) {
+    if (snap->fds[i] <= 0) {
+      power_w[i] = 0;
+      continue;
+    }
+    if ((err = powercap_power_stream_update(&streams[i], snap->energy_uj[i], snap->time_ns[i], &power_w[i])) < 0) {
+      return err;
+    }
+    ret |= err;
+  }
+  return ret;
+}
+
+double powercap_power_stream_get_power_w(const powercap_power_stream* stream) {
+  return stream == NULL ? 0 : stream->power_w;
+}
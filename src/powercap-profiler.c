@@ -0,0 +1,606 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Sampling energy profiler.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#ifdef HAVE_EXECINFO_H
+#include <execinfo.h>
+#endif
+#include "powercap-common.h"
+#include "powercap-periodic.h"
+#include "powercap-profiler.h"
+#include "powercap-snapshot.h"
+
+#define CACHE_LINE_SIZE 64
+/* Sample counts must fit in an int */
+#define MAX_CAPACITY ((uint32_t) 1 << 30)
+/* Frames above the interrupted one: the signal handler and the kernel's signal trampoline */
+#define SIGNAL_FRAMES 2
+#define MIN_TABLE_SIZE 1024
+
+/* A unique stack, whose frames are in the frame pool (leaf first) */
+typedef struct stack_entry {
+  uint64_t hash;
+  size_t offset;
+  uint32_t nframes;
+  uint64_t samples;
+  double energy_uj;
+} stack_entry;
+
+struct powercap_profiler {
+  /* Claimed by signal handlers (multiple producers) */
+  uint64_t head __attribute__((aligned(CACHE_LINE_SIZE)));
+  uint64_t dropped;
+  /* Written only by the consumer */
+  uint64_t tail __attribute__((aligned(CACHE_LINE_SIZE)));
+  /* Sample buffer: a slot is writable when its sequence number is its position, and readable when it's position + 1 */
+  uint64_t* seq;
+  uint32_t* nframes;
+  void** pcs;
+  uint32_t capacity;
+  uint32_t max_frames;
+  uint64_t interval_ns;
+  uint32_t frequency_hz;
+  long ncpus;
+  /* Energy accounting, only used by the consumer */
+  powercap_snapshot prev;
+  powercap_snapshot cur;
+  uint64_t* delta_uj;
+  double* power_w;
+  uint64_t prev_cpu_ns;
+  uint64_t prev_wall_ns;
+  /* Aggregated stacks, only used by the consumer */
+  stack_entry* entries;
+  uint32_t nentries;
+  uint32_t entries_size;
+  void** frames;
+  size_t frames_used;
+  size_t frames_size;
+  /* Open addressing hash table of (entry index + 1), where 0 is empty */
+  uint32_t* table;
+  uint32_t table_size;
+  /* Entry index of each sample drained in an interval */
+  uint32_t* pending;
+  /* Written only by the consumer */
+  powercap_profiler_stats stats;
+  periodic timer;
+  pthread_t thread;
+  struct sigaction old_action;
+  int running;
+};
+
+/* The running profiler, if any, and the number of signal handlers that might be using it */
+static powercap_profiler* active;
+static int claimed;
+static int handlers;
+
+static uint64_t get_process_cpu_ns(void) {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts)) {
+    return 0;
+  }
+  return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+/* The interrupted program counter, or NULL if unknown on this architecture */
+static void* get_pc(const void* ucontext) {
+  const ucontext_t* uc = (const ucontext_t*) ucontext;
+#if defined(__x86_64__) && defined(REG_RIP)
+  return (void*) uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__i386__) && defined(REG_EIP)
+  return (void*) uc->uc_mcontext.gregs[REG_EIP];
+#elif defined(__aarch64__)
+  return (void*) uc->uc_mcontext.pc;
+#else
+  (void) uc;
+  return NULL;
+#endif
+}
+
+/* Record a stack, leaf first - must be async-signal-safe */
+static void profiler_record(powercap_profiler* p, const void* ucontext) {
+  void* pc = get_pc(ucontext);
+  uint64_t pos = __atomic_load_n(&p->head, __ATOMIC_RELAXED);
+  uint64_t seq;
+  int64_t diff;
+  uint32_t slot;
+  uint32_t n = 0;
+#ifdef HAVE_EXECINFO_H
+  void* buf[POWERCAP_PROFILER_MAX_FRAMES + SIGNAL_FRAMES + 2];
+  int len;
+  int i;
+#endif
+  for (;;) {
+    slot = (uint32_t) (pos & (p->capacity - 1));
+    seq = __atomic_load_n(&p->seq[slot], __ATOMIC_ACQUIRE);
+    diff = (int64_t) (seq - pos);
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&p->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // full
+      __atomic_fetch_add(&p->dropped, 1, __ATOMIC_RELAXED);
+      return;
+    } else {
+      pos = __atomic_load_n(&p->head, __ATOMIC_RELAXED);
+    }
+  }
+#ifdef HAVE_EXECINFO_H
+  len = backtrace(buf, (int) (p->max_frames + SIGNAL_FRAMES + 2));
+  // skip the signal handling frames, which end at the interrupted frame
+  for (i = 0; i < len && buf[i] != pc; i++);
+  if (i == len) {
+    i = len > SIGNAL_FRAMES ? SIGNAL_FRAMES : 0;
+  }
+  for (; i < len && n < p->max_frames; i++, n++) {
+    p->pcs[(size_t) slot * p->max_frames + n] = buf[i];
+  }
+#endif
+  if (n == 0) {
+    p->pcs[(size_t) slot * p->max_frames] = pc;
+    n = 1;
+  }
+  p->nframes[slot] = n;
+  __atomic_store_n(&p->seq[slot], pos + 1, __ATOMIC_RELEASE);
+}
+
+static void profiler_handler(int sig, siginfo_t* info, void* ucontext) {
+  const int err = errno;
+  powercap_profiler* p;
+  (void) sig;
+  (void) info;
+  // sequentially consistent with stopping, so either stopping sees this handler or this handler sees it's stopped
+  __atomic_fetch_add(&handlers, 1, __ATOMIC_SEQ_CST);
+  if ((p = __atomic_load_n(&active, __ATOMIC_SEQ_CST)) != NULL) {
+    profiler_record(p, ucontext);
+  }
+  __atomic_fetch_sub(&handlers, 1, __ATOMIC_RELEASE);
+  errno = err;
+}
+
+static uint64_t hash_frames(void* const* frames, uint32_t n) {
+  // FNV-1a
+  uint64_t h = 14695981039346656037ULL;
+  uintptr_t v;
+  uint32_t i;
+  size_t b;
+  for (i = 0; i < n; i++) {
+    v = (uintptr_t) frames[i];
+    for (b = 0; b < sizeof(v); b++, v >>= 8) {
+      h = (h ^ (v & 0xff)) * 1099511628211ULL;
+    }
+  }
+  return h;
+}
+
+static int table_grow(powercap_profiler* p) {
+  const uint32_t size = p->table_size == 0 ? MIN_TABLE_SIZE : p->table_size * 2;
+  uint32_t* table;
+  uint32_t i;
+  uint32_t k;
+  if (size < p->table_size || (table = calloc(size, sizeof(uint32_t))) == NULL) {
+    return -ENOMEM;
+  }
+  for (i = 0; i < p->nentries; i++) {
+    for (k = (uint32_t) (p->entries[i].hash & (size - 1)); table[k]; k = (k + 1) & (size - 1));
+    table[k] = i + 1;
+  }
+  free(p->table);
+  p->table = table;
+  p->table_size = size;
+  return 0;
+}
+
+/* Return the entry index, or a negative error code */
+static int64_t find_or_insert(powercap_profiler* p, void* const* frames, uint32_t n) {
+  const uint64_t h = hash_frames(frames, n);
+  const stack_entry* e;
+  stack_entry* entries;
+  void** pool;
+  size_t size;
+  uint32_t k;
+  if ((p->nentries + 1) * 2 > p->table_size && table_grow(p)) {
+    return -ENOMEM;
+  }
+  for (k = (uint32_t) (h & (p->table_size - 1)); p->table[k]; k = (k + 1) & (p->table_size - 1)) {
+    e = &p->entries[p->table[k] - 1];
+    if (e->hash == h && e->nframes == n && !memcmp(&p->frames[e->offset], frames, n * sizeof(void*))) {
+      return p->table[k] - 1;
+    }
+  }
+  if (p->nentries == p->entries_size) {
+    size = p->entries_size == 0 ? MIN_TABLE_SIZE : (size_t) p->entries_size * 2;
+    if (size > UINT32_MAX / 2 || (entries = realloc(p->entries, size * sizeof(stack_entry))) == NULL) {
+      return -ENOMEM;
+    }
+    p->entries = entries;
+    p->entries_size = (uint32_t) size;
+  }
+  if (p->frames_used + n > p->frames_size) {
+    size = p->frames_size == 0 ? (size_t) MIN_TABLE_SIZE * p->max_frames : p->frames_size * 2;
+    if ((pool = realloc(p->frames, size * sizeof(void*))) == NULL) {
+      return -ENOMEM;
+    }
+    p->frames = pool;
+    p->frames_size = size;
+  }
+  memcpy(&p->frames[p->frames_used], frames, n * sizeof(void*));
+  p->entries[p->nentries].hash = h;
+  p->entries[p->nentries].offset = p->frames_used;
+  p->entries[p->nentries].nframes = n;
+  p->entries[p->nentries].samples = 0;
+  p->entries[p->nentries].energy_uj = 0;
+  p->frames_used += n;
+  p->table[k] = ++p->nentries;
+  return p->nentries - 1;
+}
+
+/* Attribute the energy since the last read to the stacks sampled since then */
+static void profiler_attribute(powercap_profiler* p) {
+  const uint64_t wall_ns = get_time_ns();
+  const uint64_t cpu_ns = get_process_cpu_ns();
+  uint64_t energy_uj = 0;
+  uint64_t seq;
+  int64_t idx;
+  double share = 0;
+  double attributed;
+  uint32_t slot;
+  uint32_t n = 0;
+  uint32_t dropped = 0;
+  uint32_t drained;
+  uint32_t i;
+  // failed reads keep their previous values, i.e., no energy is attributed for them this interval
+  powercap_snapshot_read(&p->cur);
+  powercap_snapshot_delta(&p->prev, &p->cur, p->delta_uj, p->power_w);
+  for (i = 0; i < p->cur.count; i++) {
+    energy_uj += p->delta_uj[i];
+  }
+  memcpy(p->prev.energy_uj, p->cur.energy_uj, p->cur.count * sizeof(uint64_t));
+  memcpy(p->prev.time_ns, p->cur.time_ns, p->cur.count * sizeof(uint64_t));
+  if (wall_ns > p->prev_wall_ns) {
+    share = (double) (cpu_ns - p->prev_cpu_ns) / ((double) (wall_ns - p->prev_wall_ns) * (double) p->ncpus);
+    if (share > 1) {
+      share = 1;
+    }
+  }
+  p->prev_wall_ns = wall_ns;
+  p->prev_cpu_ns = cpu_ns;
+
+  // drain the sample buffer - at most one buffer's worth, so handlers that keep refilling it can't starve this thread
+  for (drained = 0; drained < p->capacity; drained++) {
+    slot = (uint32_t) (p->tail & (p->capacity - 1));
+    seq = __atomic_load_n(&p->seq[slot], __ATOMIC_ACQUIRE);
+    if (seq != p->tail + 1) {
+      // empty, or a handler is still writing the slot
+      break;
+    }
+    if ((idx = find_or_insert(p, &p->pcs[(size_t) slot * p->max_frames], p->nframes[slot])) < 0) {
+      dropped++;
+    } else {
+      p->pending[n++] = (uint32_t) idx;
+    }
+    __atomic_store_n(&p->seq[slot], p->tail + p->capacity, __ATOMIC_RELEASE);
+    p->tail++;
+  }
+  attributed = n > 0 ? (double) energy_uj * share : 0;
+  for (i = 0; i < n; i++) {
+    p->entries[p->pending[i]].samples++;
+    p->entries[p->pending[i]].energy_uj += attributed / n;
+  }
+  if (dropped > 0) {
+    __atomic_fetch_add(&p->dropped, dropped, __ATOMIC_RELAXED);
+  }
+  attributed += p->stats.attributed_energy_uj;
+  __atomic_store_n(&p->stats.samples, p->stats.samples + n, __ATOMIC_RELAXED);
+  __atomic_store_n(&p->stats.stacks, p->nentries, __ATOMIC_RELAXED);
+  __atomic_store_n(&p->stats.total_energy_uj, p->stats.total_energy_uj + energy_uj, __ATOMIC_RELAXED);
+  __atomic_store(&p->stats.attributed_energy_uj, &attributed, __ATOMIC_RELAXED);
+}
+
+static void* profiler_thread(void* arg) {
+  powercap_profiler* p = (powercap_profiler*) arg;
+  while (periodic_wait(&p->timer, NULL) == 0) {
+    profiler_attribute(p);
+  }
+  return NULL;
+}
+
+static uint32_t round_up_pow2(uint32_t n) {
+  uint32_t p = 1;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+static void profiler_free(powercap_profiler* p) {
+  powercap_snapshot_destroy(&p->prev);
+  powercap_snapshot_destroy(&p->cur);
+  free(p->delta_uj);
+  free(p->seq);
+  free(p->entries);
+  free(p->frames);
+  free(p->table);
+  free(p);
+}
+
+powercap_profiler* powercap_profiler_create(const powercap_snapshot* counters, const powercap_profiler_config* cfg) {
+  powercap_profiler* p;
+  uint32_t capacity;
+  uint32_t i;
+  int err;
+  if (counters == NULL || counters->count == 0 || cfg == NULL || cfg->frequency_hz == 0 ||
+      cfg->frequency_hz > 1000000 || cfg->interval_us == 0 || cfg->max_frames == 0 ||
+      cfg->max_frames > POWERCAP_PROFILER_MAX_FRAMES || cfg->capacity == 0 || cfg->capacity > MAX_CAPACITY) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if ((err = posix_memalign((void**) &p, CACHE_LINE_SIZE, sizeof(powercap_profiler)))) {
+    errno = err;
+    return NULL;
+  }
+  memset(p, 0, sizeof(*p));
+  capacity = round_up_pow2(cfg->capacity);
+  p->capacity = capacity;
+  p->max_frames = cfg->max_frames;
+  p->interval_ns = cfg->interval_us * 1000;
+  p->frequency_hz = cfg->frequency_hz;
+  if ((p->ncpus = sysconf(_SC_NPROCESSORS_ONLN)) < 1) {
+    p->ncpus = 1;
+  }
+  // one block for the sample buffer: seq, pending, nframes, then pcs
+  if ((p->seq = malloc(capacity * (sizeof(uint64_t) + 2 * sizeof(uint32_t) + p->max_frames * sizeof(void*)))) == NULL) {
+    free(p);
+    return NULL;
+  }
+  p->pending = (uint32_t*) (void*) (p->seq + capacity);
+  p->nframes = p->pending + capacity;
+  p->pcs = (void**) (void*) (p->nframes + capacity);
+  for (i = 0; i < capacity; i++) {
+    p->seq[i] = i;
+  }
+  if ((err = powercap_snapshot_init(&p->prev, counters->count)) ||
+      (err = powercap_snapshot_init(&p->cur, counters->count))) {
+    profiler_free(p);
+    errno = -err;
+    return NULL;
+  }
+  memcpy(p->cur.fds, counters->fds, counters->count * sizeof(int));
+  memcpy(p->cur.max_energy_range_uj, counters->max_energy_range_uj, counters->count * sizeof(uint64_t));
+  memcpy(p->prev.max_energy_range_uj, counters->max_energy_range_uj, counters->count * sizeof(uint64_t));
+  if ((p->delta_uj = malloc(counters->count * (sizeof(uint64_t) + sizeof(double)))) == NULL) {
+    err = errno;
+    profiler_free(p);
+    errno = err;
+    return NULL;
+  }
+  p->power_w = (double*) (void*) (p->delta_uj + counters->count);
+  if ((err = periodic_init(&p->timer))) {
+    profiler_free(p);
+    errno = -err;
+    return NULL;
+  }
+  return p;
+}
+
+int powercap_profiler_destroy(powercap_profiler* profiler) {
+  int ret = 0;
+  if (profiler == NULL) {
+    return 0;
+  }
+  if (profiler->running) {
+    ret = powercap_profiler_stop(profiler);
+  }
+  periodic_destroy(&profiler->timer);
+  profiler_free(profiler);
+  return ret;
+}
+
+static int set_timer(uint32_t frequency_hz) {
+  struct itimerval it = { { 0, 0 }, { 0, 0 } };
+  uint64_t period_us;
+  if (frequency_hz > 0) {
+    period_us = 1000000 / frequency_hz;
+    it.it_interval.tv_sec = (time_t) (period_us / 1000000);
+    it.it_interval.tv_usec = (suseconds_t) (period_us % 1000000);
+    it.it_value = it.it_interval;
+  }
+  return setitimer(ITIMER_PROF, &it, NULL) ? -errno : 0;
+}
+
+/* Start the profiler thread with SIGPROF blocked, so its own CPU time doesn't deliver samples to it */
+static int start_thread(powercap_profiler* p) {
+  sigset_t set;
+  sigset_t old_set;
+  int ret;
+  sigemptyset(&set);
+  sigaddset(&set, SIGPROF);
+  if ((ret = pthread_sigmask(SIG_BLOCK, &set, &old_set)) == 0) {
+    ret = pthread_create(&p->thread, NULL, profiler_thread, p);
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+  }
+  return ret;
+}
+
+static void restore_handler(const powercap_profiler* p) {
+  struct sigaction sa;
+  // ignoring discards any signal that's still pending, which the previous action (e.g., the default) might not
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = SIG_IGN;
+  sigaction(SIGPROF, &sa, NULL);
+  sigaction(SIGPROF, &p->old_action, NULL);
+}
+
+int powercap_profiler_start(powercap_profiler* profiler) {
+  struct sigaction sa;
+  int expected = 0;
+  int ret;
+#ifdef HAVE_EXECINFO_H
+  void* buf[1];
+#endif
+  if (profiler == NULL || profiler->running) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (!__atomic_compare_exchange_n(&claimed, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    errno = EBUSY;
+    return -errno;
+  }
+#ifdef HAVE_EXECINFO_H
+  // the first call may load the unwinder, which isn't safe in a signal handler
+  backtrace(buf, 1);
+#endif
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = profiler_handler;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGPROF, &sa, &profiler->old_action)) {
+    ret = -errno;
+    __atomic_store_n(&claimed, 0, __ATOMIC_RELEASE);
+    return ret;
+  }
+  // the first interval starts now
+  powercap_snapshot_read(&profiler->cur);
+  memcpy(profiler->prev.energy_uj, profiler->cur.energy_uj, profiler->cur.count * sizeof(uint64_t));
+  memcpy(profiler->prev.time_ns, profiler->cur.time_ns, profiler->cur.count * sizeof(uint64_t));
+  profiler->prev_wall_ns = get_time_ns();
+  profiler->prev_cpu_ns = get_process_cpu_ns();
+  if ((ret = periodic_start(&profiler->timer, profiler->interval_ns))) {
+    restore_handler(profiler);
+    __atomic_store_n(&claimed, 0, __ATOMIC_RELEASE);
+    return ret;
+  }
+  if ((ret = start_thread(profiler))) {
+    LOG(ERROR, "powercap-profiler: Failed to start profiler thread: %s\n", strerror(ret));
+    periodic_stop(&profiler->timer);
+    restore_handler(profiler);
+    __atomic_store_n(&claimed, 0, __ATOMIC_RELEASE);
+    errno = ret;
+    return -errno;
+  }
+  __atomic_store_n(&active, profiler, __ATOMIC_RELEASE);
+  if ((ret = set_timer(profiler->frequency_hz))) {
+    __atomic_store_n(&active, NULL, __ATOMIC_RELEASE);
+    periodic_stop(&profiler->timer);
+    pthread_join(profiler->thread, NULL);
+    restore_handler(profiler);
+    __atomic_store_n(&claimed, 0, __ATOMIC_RELEASE);
+    return ret;
+  }
+  profiler->running = 1;
+  return 0;
+}
+
+int powercap_profiler_stop(powercap_profiler* profiler) {
+  int ret;
+  if (profiler == NULL || !profiler->running) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if ((ret = set_timer(0))) {
+    return ret;
+  }
+  __atomic_store_n(&active, NULL, __ATOMIC_SEQ_CST);
+  // wait for handlers that might still be writing to the sample buffer
+  while (__atomic_load_n(&handlers, __ATOMIC_SEQ_CST) > 0) {
+    sched_yield();
+  }
+  restore_handler(profiler);
+  if ((ret = periodic_stop(&profiler->timer))) {
+    // the thread can't be stopped, so don't free its resources
+    LOG(ERROR, "powercap-profiler: Failed to stop profiler thread\n");
+    return ret;
+  }
+  pthread_join(profiler->thread, NULL);
+  profiler_attribute(profiler);
+  profiler->running = 0;
+  __atomic_store_n(&claimed, 0, __ATOMIC_RELEASE);
+  return 0;
+}
+
+int powercap_profiler_get_stats(const powercap_profiler* profiler, powercap_profiler_stats* stats) {
+  if (profiler == NULL || stats == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  stats->samples = __atomic_load_n(&profiler->stats.samples, __ATOMIC_RELAXED);
+  stats->dropped = __atomic_load_n(&profiler->dropped, __ATOMIC_RELAXED);
+  stats->stacks = __atomic_load_n(&profiler->stats.stacks, __ATOMIC_RELAXED);
+  stats->total_energy_uj = __atomic_load_n(&profiler->stats.total_energy_uj, __ATOMIC_RELAXED);
+  __atomic_load(&profiler->stats.attributed_energy_uj, &stats->attributed_energy_uj, __ATOMIC_RELAXED);
+  return 0;
+}
+
+static int write_frame(FILE* stream, void* pc, int leaf) {
+  // return addresses point after the call instruction, which may be in the next function
+  const void* addr = leaf ? pc : (const char*) pc - 1;
+  const char* name;
+  Dl_info info;
+  if (pc == NULL) {
+    return fputs("[unknown]", stream);
+  }
+  if (dladdr(addr, &info) == 0) {
+    return fprintf(stream, "0x%"PRIxPTR, (uintptr_t) addr);
+  }
+  if (info.dli_sname != NULL) {
+    return fputs(info.dli_sname, stream);
+  }
+  if (info.dli_fname != NULL && info.dli_fname[0] != '\0') {
+    name = strrchr(info.dli_fname, '/');
+    return fprintf(stream, "%s+0x%"PRIxPTR, name == NULL ? info.dli_fname : name + 1,
+                   (uintptr_t) addr - (uintptr_t) info.dli_fbase);
+  }
+  return fprintf(stream, "0x%"PRIxPTR, (uintptr_t) addr);
+}
+
+int powercap_profiler_write_folded(const powercap_profiler* profiler, FILE* stream, powercap_profiler_weight weight) {
+  const stack_entry* e;
+  uint64_t value;
+  uint32_t i;
+  uint32_t j;
+  if (profiler == NULL || stream == NULL ||
+      (weight != POWERCAP_PROFILER_WEIGHT_ENERGY && weight != POWERCAP_PROFILER_WEIGHT_SAMPLES)) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (profiler->running) {
+    errno = EBUSY;
+    return -errno;
+  }
+  for (i = 0; i < profiler->nentries; i++) {
+    e = &profiler->entries[i];
+    value = weight == POWERCAP_PROFILER_WEIGHT_SAMPLES ? e->samples : (uint64_t) (e->energy_uj + 0.5);
+    if (value == 0) {
+      continue;
+    }
+    // root first
+    for (j = e->nframes; j > 0; j--) {
+      if (write_frame(stream, profiler->frames[e->offset + j - 1], j == 1) < 0 ||
+          (j > 1 && fputc(';', stream) == EOF)) {
+        return -errno;
+      }
+    }
+    if (fprintf(stream, " %"PRIu64"\n", value) < 0) {
+      return -errno;
+    }
+  }
+  return 0;
+}
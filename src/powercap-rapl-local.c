@@ -0,0 +1,301 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Socket-local sampling of RAPL energy counters.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include "powercap-common.h"
+#include "powercap-periodic.h"
+#include "powercap-rapl.h"
+#include "powercap-rapl-local.h"
+#include "powercap-rapl-topology.h"
+#include "powercap-snapshot.h"
+
+#define CACHE_LINE_SIZE 64
+
+/*
+ * Each reader publishes through a seqlock: the sequence number is odd while an update is in progress.
+ * Readers are cache-line aligned so that threads on different sockets never write to the same line.
+ */
+typedef struct local_reader {
+  uint32_t seq;
+  uint64_t time_ns;
+  uint64_t* energy_uj;
+  /* Only used by the reader thread, so sysfs I/O happens outside the seqlock's write section */
+  uint64_t* scratch;
+  int* fds;
+  uint32_t n;
+  int cpu;
+  int started;
+  periodic timer;
+  pthread_t thread;
+} __attribute__((aligned(CACHE_LINE_SIZE))) local_reader;
+
+struct powercap_rapl_local {
+  uint64_t period_ns;
+  local_reader* readers;
+  uint32_t count;
+};
+
+static void reader_update(local_reader* r) {
+  uint32_t seq = __atomic_load_n(&r->seq, __ATOMIC_RELAXED);
+  uint32_t i;
+  for (i = 0; i < r->n; i++) {
+    // failed reads keep the previous value
+    if (r->fds[i] > 0 && read_u64(r->fds[i], &r->scratch[i])) {
+      r->scratch[i] = __atomic_load_n(&r->energy_uj[i], __ATOMIC_RELAXED);
+    }
+  }
+  __atomic_store_n(&r->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  for (i = 0; i < r->n; i++) {
+    __atomic_store_n(&r->energy_uj[i], r->scratch[i], __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&r->time_ns, get_time_ns(), __ATOMIC_RELAXED);
+  __atomic_store_n(&r->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static int reader_copy(const local_reader* r, uint64_t* energy_uj, uint64_t* time_ns) {
+  uint32_t seq;
+  uint64_t t;
+  uint32_t i;
+  do {
+    while ((seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE)) & 1);
+    for (i = 0; i < r->n; i++) {
+      energy_uj[i] = __atomic_load_n(&r->energy_uj[i], __ATOMIC_RELAXED);
+    }
+    t = __atomic_load_n(&r->time_ns, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) != seq);
+  if (t == 0) {
+    errno = EAGAIN;
+    return -errno;
+  }
+  if (time_ns != NULL) {
+    *time_ns = t;
+  }
+  return 0;
+}
+
+static void* reader_thread(void* arg) {
+  local_reader* r = (local_reader*) arg;
+  // missed periods are skipped rather than read back-to-back
+  do {
+    reader_update(r);
+  } while (periodic_wait(&r->timer, NULL) == 0);
+  return NULL;
+}
+
+static int reader_init(local_reader* r, const powercap_rapl_pkg* pkg) {
+  const powercap_rapl_domain* d;
+  uint32_t i;
+  uint32_t k;
+  char* buf;
+  int ret;
+  r->n = pkg->ndomains;
+  r->cpu = -1;
+  r->timer.timer_fd = -1;
+  if (r->n == 0) {
+    return periodic_init(&r->timer);
+  }
+  // the published values get their own cache lines
+  if ((errno = posix_memalign((void**) &buf, CACHE_LINE_SIZE, r->n * (2 * sizeof(uint64_t) + sizeof(int))))) {
+    return -errno;
+  }
+  memset(buf, 0, r->n * (2 * sizeof(uint64_t) + sizeof(int)));
+  r->energy_uj = (uint64_t*) (void*) buf;
+  r->scratch = (uint64_t*) (void*) (buf + r->n * sizeof(uint64_t));
+  r->fds = (int*) (void*) (buf + 2 * r->n * sizeof(uint64_t));
+  for (i = 0; i < r->n; i++) {
+    d = &pkg->domains[i];
+    for (k = 0; k < POWERCAP_RAPL_NUM_INTERFACES && d->files[k].zone.energy_uj <= 0; k++);
+    r->fds[i] = k < POWERCAP_RAPL_NUM_INTERFACES ? d->files[k].zone.energy_uj : 0;
+  }
+  if ((ret = periodic_init(&r->timer))) {
+    r->timer.timer_fd = -1;
+  }
+  return ret;
+}
+
+static int select_cpu(const powercap_rapl_pkg* pkg, const cpu_set_t* allowed) {
+  powercap_rapl_topology topo;
+  uint32_t cpu;
+  if (powercap_rapl_get_topology(pkg, &topo)) {
+    LOG(WARN, "powercap-rapl-local: Failed to get topology for instance, reader will not be pinned\n");
+    return -1;
+  }
+  for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, allowed) && powercap_rapl_topology_has_cpu(&topo, cpu) > 0) {
+      return (int) cpu;
+    }
+  }
+  LOG(WARN, "powercap-rapl-local: No allowed CPUs for %s, reader will not be pinned\n", pkg->domains[0].name);
+  return -1;
+}
+
+static int reader_start(local_reader* r, uint64_t period_ns) {
+  pthread_attr_t attr;
+  cpu_set_t cpus;
+  int ret;
+  if ((ret = periodic_start(&r->timer, period_ns))) {
+    return -ret;
+  }
+  if ((ret = pthread_attr_init(&attr))) {
+    return ret;
+  }
+  if (r->cpu >= 0) {
+    CPU_ZERO(&cpus);
+    CPU_SET((size_t) r->cpu, &cpus);
+    if ((ret = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus)) == 0 &&
+        (ret = pthread_create(&r->thread, &attr, reader_thread, r)) == 0) {
+      pthread_attr_destroy(&attr);
+      r->started = 1;
+      return 0;
+    }
+    LOG(WARN, "powercap-rapl-local: Failed to pin reader to CPU %d: %s\n", r->cpu, strerror(ret));
+    r->cpu = -1;
+  }
+  pthread_attr_destroy(&attr);
+  if ((ret = pthread_create(&r->thread, NULL, reader_thread, r)) == 0) {
+    r->started = 1;
+  }
+  return ret;
+}
+
+static void local_destroy(powercap_rapl_local* local) {
+  uint32_t i;
+  if (local->readers != NULL) {
+    for (i = 0; i < local->count; i++) {
+      free(local->readers[i].energy_uj);
+      if (local->readers[i].timer.timer_fd >= 0) {
+        periodic_destroy(&local->readers[i].timer);
+      }
+    }
+    free(local->readers);
+  }
+  free(local);
+}
+
+powercap_rapl_local* powercap_rapl_local_start(const powercap_rapl_pkg* pkgs, uint32_t count, uint64_t period_us,
+                                               const int* cpus) {
+  powercap_rapl_local* local;
+  cpu_set_t allowed;
+  uint32_t i;
+  int err;
+  if (pkgs == NULL || count == 0 || period_us == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if ((local = calloc(1, sizeof(powercap_rapl_local))) == NULL) {
+    return NULL;
+  }
+  local->period_ns = period_us * 1000;
+  if ((err = posix_memalign((void**) &local->readers, CACHE_LINE_SIZE, count * sizeof(local_reader)))) {
+    local_destroy(local);
+    errno = err;
+    return NULL;
+  }
+  memset(local->readers, 0, count * sizeof(local_reader));
+  for (i = 0; i < count; i++) {
+    local->readers[i].timer.timer_fd = -1;
+  }
+  local->count = count;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+    memset(&allowed, 0xff, sizeof(allowed));
+  }
+  for (i = 0; i < count; i++) {
+    if (reader_init(&local->readers[i], &pkgs[i])) {
+      err = errno;
+      local_destroy(local);
+      errno = err;
+      return NULL;
+    }
+    local->readers[i].cpu = (cpus != NULL && cpus[i] >= 0) ? cpus[i] : select_cpu(&pkgs[i], &allowed);
+  }
+  for (i = 0; i < count; i++) {
+    if ((err = reader_start(&local->readers[i], local->period_ns))) {
+      LOG(ERROR, "powercap-rapl-local: Failed to start reader thread: %s\n", strerror(err));
+      powercap_rapl_local_stop(local);
+      errno = err;
+      return NULL;
+    }
+  }
+  return local;
+}
+
+int powercap_rapl_local_stop(powercap_rapl_local* local) {
+  uint32_t i;
+  if (local == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  for (i = 0; i < local->count; i++) {
+    if (local->readers[i].started) {
+      periodic_stop(&local->readers[i].timer);
+    }
+  }
+  for (i = 0; i < local->count; i++) {
+    if (local->readers[i].started) {
+      pthread_join(local->readers[i].thread, NULL);
+    }
+  }
+  local_destroy(local);
+  return 0;
+}
+
+int powercap_rapl_local_get_cpu(const powercap_rapl_local* local, uint32_t id) {
+  if (local == NULL || id >= local->count) {
+    errno = EINVAL;
+    return -errno;
+  }
+  return local->readers[id].cpu;
+}
+
+int powercap_rapl_local_read(const powercap_rapl_local* local, uint32_t id, uint64_t* energy_uj, uint64_t* time_ns) {
+  if (local == NULL || id >= local->count || (energy_uj == NULL && local->readers[id].n > 0)) {
+    errno = EINVAL;
+    return -errno;
+  }
+  return reader_copy(&local->readers[id], energy_uj, time_ns);
+}
+
+int powercap_rapl_local_snapshot(const powercap_rapl_local* local, powercap_snapshot* snap) {
+  uint64_t t;
+  uint32_t n = 0;
+  uint32_t i;
+  uint32_t j;
+  int ret = 0;
+  if (local == NULL || snap == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  for (i = 0; i < local->count; i++) {
+    n += local->readers[i].n;
+  }
+  if (n != snap->count) {
+    errno = EINVAL;
+    return -errno;
+  }
+  for (i = 0, n = 0; i < local->count; n += local->readers[i].n, i++) {
+    if (reader_copy(&local->readers[i], &snap->energy_uj[n], &t)) {
+      ret = -errno;
+      continue;
+    }
+    for (j = 0; j < local->readers[i].n; j++) {
+      snap->time_ns[n + j] = t;
+    }
+  }
+  if (ret) {
+    errno = -ret;
+  }
+  return ret;
+}
@@ -7,24 +7,35 @@
  * @date 2016-05-12
  */
 #include <assert.h>
+#include <dirent.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "powercap.h"
 #include "powercap-common.h"
 #include "powercap-rapl.h"
+#include "powercap-snapshot.h"
 #include "powercap-sysfs.h"
 
 #ifndef MAX_NAME_SIZE
   #define MAX_NAME_SIZE 64
 #endif
 
-#define CONTROL_TYPE "intel-rapl"
+#define CONTROL_TYPE_MSR "intel-rapl"
+#define CONTROL_TYPE_MMIO "intel-rapl-mmio"
+
+/* These MUST align with powercap_rapl_interface in powercap-rapl.h */
+static const char* const CONTROL_TYPES[POWERCAP_RAPL_NUM_INTERFACES] = {
+  CONTROL_TYPE_MSR,
+  CONTROL_TYPE_MMIO
+};
 
 #define CONSTRAINT_NAME_LONG "long_term"
 #define CONSTRAINT_NAME_SHORT "short_term"
+#define CONSTRAINT_NAME_PEAK "peak_power"
 
 #define ZONE_NAME_PREFIX_PKG "package"
 #define ZONE_NAME_CORE "core"
@@ -32,113 +43,255 @@
 #define ZONE_NAME_DRAM "dram"
 #define ZONE_NAME_PSYS "psys"
 
-static powercap_constraint* get_constraint_by_rapl_name(powercap_rapl_zone_files* fds, const uint32_t* zones, uint32_t depth, uint32_t constraint) {
+#define CONSTRAINT_FILE_PREFIX "constraint_"
+#define CONSTRAINT_FILE_SUFFIX "_power_limit_uw"
+
+/* Indices found in a zone's directory are tracked in bitmasks */
+#define MAX_DIR_INDEX 64
+
+/* Subzones and constraints found in a zone's directory */
+typedef struct zone_dir {
+  uint64_t subzones;
+  uint64_t constraints;
+} zone_dir;
+
+/* Top-level zones in a control type */
+typedef struct top_zones {
+  uint32_t* ids;
+  char (*names)[POWERCAP_RAPL_NAME_MAX];
+  uint32_t n;
+} top_zones;
+
+typedef struct init_args {
+  powercap_rapl_pkg* pkg;
+  const top_zones* tz;
+  powercap_rapl_interface primary;
+  uint32_t id;
+  int ro;
+  int threaded;
+  int ret;
+  int err;
+} init_args;
+
+static powercap_constraint* add_constraint_other(powercap_rapl_zone_files* fds) {
   assert(fds != NULL);
-  char name[MAX_NAME_SIZE];
-  if (powercap_sysfs_constraint_get_name(CONTROL_TYPE, zones, depth, constraint, name, sizeof(name)) < 0) {
+  powercap_constraint* pc = realloc(fds->constraint_other, (fds->nconstraint_other + 1) * sizeof(powercap_constraint));
+  if (pc == NULL) {
     return NULL;
   }
+  fds->constraint_other = pc;
+  pc = &fds->constraint_other[fds->nconstraint_other++];
+  memset(pc, 0, sizeof(powercap_constraint));
+  return pc;
+}
+
+static uint32_t count_bits(uint64_t mask) {
+  uint32_t n = 0;
+  for (; mask; mask &= mask - 1) {
+    n++;
+  }
+  return n;
+}
+
+// parse an index from the start of a string, requiring the remainder of the string to match the suffix
+static int parse_dir_index(const char* str, int base, const char* suffix, uint32_t* idx) {
+  char* end;
+  unsigned long val;
+  if (*str < '0' || *str > '9') {
+    return -1;
+  }
+  errno = 0;
+  val = strtoul(str, &end, base);
+  if (errno || strcmp(end, suffix)) {
+    return -1;
+  }
+  if (val >= MAX_DIR_INDEX) {
+    LOG(WARN, "powercap-rapl: Ignoring index that is too large: %lu\n", val);
+    return -1;
+  }
+  *idx = (uint32_t) val;
+  return 0;
+}
+
+// find subzones and constraints with a single pass over a zone's directory, rather than probing for each one
+static int scan_zone_dir(const char* ct, const uint32_t* zones, uint32_t depth, zone_dir* zd) {
+  assert(zd != NULL);
+  char path[PATH_MAX];
+  char prefix[PATH_MAX];
+  size_t plen;
+  int w;
+  uint32_t i;
+  uint32_t idx;
+  DIR* dir;
+  struct dirent* ent;
+  zd->subzones = 0;
+  zd->constraints = 0;
+  if ((w = snprintf_base_path(path, sizeof(path), ct, zones, depth)) < 0) {
+    return w;
+  }
+  if ((size_t) w >= sizeof(path)) {
+    errno = ENOBUFS;
+    return -errno;
+  }
+  // subzone directories are named like the control type followed by all their zone indices, e.g., "intel-rapl:0:1"
+  plen = (size_t) snprintf(prefix, sizeof(prefix), "%s:", ct);
+  for (i = 0; i < depth && plen < sizeof(prefix); i++) {
+    plen += (size_t) snprintf(prefix + plen, sizeof(prefix) - plen, "%x:", zones[i]);
+  }
+  if (plen >= sizeof(prefix)) {
+    errno = ENOBUFS;
+    return -errno;
+  }
+  if ((dir = opendir(path)) == NULL) {
+    return -errno;
+  }
+  while ((ent = readdir(dir)) != NULL) {
+    if (!strncmp(ent->d_name, prefix, plen)) {
+      if (!parse_dir_index(ent->d_name + plen, 16, "", &idx)) {
+        zd->subzones |= (uint64_t) 1 << idx;
+      }
+    } else if (!strncmp(ent->d_name, CONSTRAINT_FILE_PREFIX, sizeof(CONSTRAINT_FILE_PREFIX) - 1)) {
+      // "power_limit_uw" is picked arbitrarily, but it is a required file
+      if (!parse_dir_index(ent->d_name + sizeof(CONSTRAINT_FILE_PREFIX) - 1, 10, CONSTRAINT_FILE_SUFFIX, &idx)) {
+        zd->constraints |= (uint64_t) 1 << idx;
+      }
+    }
+  }
+  closedir(dir);
+  return 0;
+}
+
+static powercap_constraint* get_constraint_by_rapl_name(powercap_rapl_zone_files* fds, const char* name) {
+  assert(fds != NULL);
+  assert(name != NULL);
+  powercap_constraint* pc = NULL;
   if (!strncmp(name, CONSTRAINT_NAME_LONG, sizeof(CONSTRAINT_NAME_LONG))) {
-    return &fds->constraint_long;
+    pc = &fds->constraint_long;
   } else if (!strncmp(name, CONSTRAINT_NAME_SHORT, sizeof(CONSTRAINT_NAME_SHORT))) {
-    return &fds->constraint_short;
+    pc = &fds->constraint_short;
+  } else if (!strncmp(name, CONSTRAINT_NAME_PEAK, sizeof(CONSTRAINT_NAME_PEAK))) {
+    pc = &fds->constraint_peak;
   } else {
-    LOG(ERROR, "powercap-rapl: Unrecognized constraint name: %s\n", name);
-    errno = EINVAL;
+    LOG(INFO, "powercap-rapl: Unrecognized constraint name: %s\n", name);
   }
-  return NULL;
+  // "power_limit_uw" is picked arbitrarily, but it is a required file
+  if (pc != NULL && pc->power_limit_uw) {
+    LOG(WARN, "powercap-rapl: Duplicate constraint name: %s\n", name);
+    pc = NULL;
+  }
+  return pc == NULL ? add_constraint_other(fds) : pc;
 }
 
-static int open_all(const uint32_t* zones, uint32_t depth, powercap_rapl_zone_files* fds, int ro) {
+// open a constraint's files first, then read its name from the open descriptor to decide where it belongs
+static int open_constraint(powercap_rapl_zone_files* fds, const char* ct, const uint32_t* zones, uint32_t depth, uint32_t constraint, int ro) {
   assert(fds != NULL);
   char buf[PATH_MAX] = { 0 };
+  char name[MAX_NAME_SIZE] = { 0 };
+  powercap_constraint tmp = { 0 };
   powercap_constraint* pc;
-  uint32_t i = 0;
-  if (powercap_zone_open(&fds->zone, buf, sizeof(buf), CONTROL_TYPE, zones, depth, ro)) {
+  int err_save;
+  if (powercap_constraint_open(&tmp, buf, sizeof(buf), ct, zones, depth, constraint, ro)) {
+    LOG(ERROR, "powercap-rapl: %s: %s\n", buf, strerror(errno));
+    goto fail;
+  }
+  // constraints without a name are treated like those with unrecognized names
+  if ((tmp.name > 0 && read_string(tmp.name, name, sizeof(name)) < 0) ||
+      (pc = get_constraint_by_rapl_name(fds, name)) == NULL) {
+    goto fail;
+  }
+  *pc = tmp;
+  return 0;
+fail:
+  err_save = errno;
+  powercap_constraint_close(&tmp);
+  errno = err_save;
+  return -errno;
+}
+
+static int open_all(const char* ct, const uint32_t* zones, uint32_t depth, const zone_dir* zd, powercap_rapl_zone_files* fds, char* name, size_t size, int ro) {
+  assert(zd != NULL);
+  assert(fds != NULL);
+  char buf[PATH_MAX] = { 0 };
+  uint32_t i;
+  int ret;
+  if (powercap_zone_open(&fds->zone, buf, sizeof(buf), ct, zones, depth, ro)) {
     LOG(ERROR, "powercap-rapl: %s: %s\n", buf, strerror(errno));
     return -errno;
   }
-  // constraint 0 is supposed to be long_term and constraint 1 (if exists) should be short_term
-  // note: never actually seen this problem, but not 100% sure it can't happen, so check anyway...
-  while (!powercap_sysfs_constraint_exists(CONTROL_TYPE, zones, depth, i)) {
-    if ((pc = get_constraint_by_rapl_name(fds, zones, depth, i)) == NULL) {
+  if (name != NULL) {
+    // the name is required to identify the zone
+    if (!fds->zone.name) {
+      // buf holds the path of the last file tried, which is the name file
+      LOG(ERROR, "powercap-rapl: %s: %s\n", buf, strerror(ENOENT));
+      errno = ENOENT;
       return -errno;
     }
-    // "power_limit_uw" is picked arbitrarily, but it is a required file
-    if (pc->power_limit_uw) {
-      if (depth == 1) {
-        LOG(ERROR, "powercap-rapl: Duplicate constraint detected at zone: %"PRIu32"\n", zones[0]);
-      } else {
-        LOG(ERROR, "powercap-rapl: Duplicate constraint detected at zone: %"PRIu32":%"PRIu32"\n", zones[0], zones[1]);
-      }
-      errno = EINVAL;
+    if (read_string(fds->zone.name, name, size) < 0) {
       return -errno;
     }
-    buf[0] = '\0';
-    if (powercap_constraint_open(pc, buf, sizeof(buf), CONTROL_TYPE, zones, depth, i, ro)) {
-      LOG(ERROR, "powercap-rapl: %s: %s\n", buf, strerror(errno));
-      return -errno;
+  }
+  // constraint 0 is supposed to be long_term and constraint 1 (if exists) should be short_term, but don't assume it
+  for (i = 0; i < MAX_DIR_INDEX; i++) {
+    if (((zd->constraints >> i) & 1) && (ret = open_constraint(fds, ct, zones, depth, i, ro))) {
+      return ret;
     }
-    i++;
   }
-  // powercap_sysfs_constraint_exists returns error code when constraint does not exist - make sure it's not our fault
-  assert(errno != EINVAL);
-  assert(errno != ENOBUFS);
   return 0;
 }
 
-static const powercap_rapl_zone_files* get_files(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone) {
-  assert(pkg != NULL);
-  switch (zone) {
-    case POWERCAP_RAPL_ZONE_PACKAGE:
-      return &pkg->pkg;
-    case POWERCAP_RAPL_ZONE_CORE:
-      return &pkg->core;
-    case POWERCAP_RAPL_ZONE_UNCORE:
-      return &pkg->uncore;
-    case POWERCAP_RAPL_ZONE_DRAM:
-      return &pkg->dram;
-    case POWERCAP_RAPL_ZONE_PSYS:
-      return &pkg->psys;
-    default:
-      // somebody passed a bad zone type
-      LOG(ERROR, "powercap-rapl: Bad powercap_rapl_zone: %d\n", zone);
-      errno = EINVAL;
-      return NULL;
-  }
-}
+// returned for zones and constraints that aren't present, so they appear to have no supported files
+static const powercap_rapl_domain NO_DOMAIN;
+static const powercap_constraint NO_CONSTRAINT;
 
-static const powercap_zone* get_zone_files(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone) {
-  assert(pkg != NULL);
-  const powercap_rapl_zone_files* fds = get_files(pkg, zone);
-  return fds == NULL ? NULL : &fds->zone;
+static int is_valid_interface(powercap_rapl_interface iface) {
+  // int cast silences clang compiler
+  return (int) iface >= 0 && (int) iface < POWERCAP_RAPL_NUM_INTERFACES;
 }
 
-static const powercap_constraint* get_constraint_files(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_rapl_constraint constraint) {
+static const powercap_rapl_domain* get_domain(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone) {
   assert(pkg != NULL);
-  const powercap_rapl_zone_files* fds = get_files(pkg, zone);
-  if (fds == NULL) {
+  uint32_t i;
+  // check zone in case users pass bad int value instead of enum; int cast silences clang compiler
+  if ((int) zone < 0 || (int) zone > POWERCAP_RAPL_ZONE_OTHER) {
+    // somebody passed a bad zone type
+    LOG(ERROR, "powercap-rapl: Bad powercap_rapl_zone: %d\n", zone);
+    errno = EINVAL;
     return NULL;
   }
+  for (i = 0; i < pkg->ndomains; i++) {
+    if (pkg->domains[i].type == zone) {
+      return &pkg->domains[i];
+    }
+  }
+  return &NO_DOMAIN;
+}
+
+static const powercap_constraint* get_constraint(const powercap_rapl_zone_files* fds, powercap_rapl_constraint constraint) {
+  assert(fds != NULL);
   switch (constraint) {
     case POWERCAP_RAPL_CONSTRAINT_LONG:
       return &fds->constraint_long;
     case POWERCAP_RAPL_CONSTRAINT_SHORT:
       return &fds->constraint_short;
+    case POWERCAP_RAPL_CONSTRAINT_PEAK:
+      return &fds->constraint_peak;
     default:
-      // somebody passed a bad constraint type
-      LOG(ERROR, "powercap-rapl: Bad powercap_rapl_constraint: %d\n", constraint);
-      errno = EINVAL;
-      return NULL;
+      // int cast silences clang compiler
+      if ((int) constraint < POWERCAP_RAPL_CONSTRAINT_OTHER) {
+        // somebody passed a bad constraint type
+        LOG(ERROR, "powercap-rapl: Bad powercap_rapl_constraint: %d\n", constraint);
+        errno = EINVAL;
+        return NULL;
+      }
+      if ((uint32_t) constraint - POWERCAP_RAPL_CONSTRAINT_OTHER < fds->nconstraint_other) {
+        return &fds->constraint_other[(uint32_t) constraint - POWERCAP_RAPL_CONSTRAINT_OTHER];
+      }
+      return &NO_CONSTRAINT;
   }
 }
 
-static int get_zone_fd(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_zone_file file) {
-  assert(pkg != NULL);
-  const powercap_zone* fds = get_zone_files(pkg, zone);
-  if (fds == NULL) {
-    return -errno;
-  }
+static int get_zone_fd(const powercap_zone* fds, powercap_zone_file file) {
+  assert(fds != NULL);
   switch (file) {
     case POWERCAP_ZONE_FILE_MAX_ENERGY_RANGE_UJ:
       return fds->max_energy_range_uj;
@@ -159,12 +312,8 @@ static int get_zone_fd(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, po
   }
 }
 
-static int get_constraint_fd(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_rapl_constraint constraint, powercap_constraint_file file) {
-  assert(pkg != NULL);
-  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint);
-  if (fds == NULL) {
-    return -errno;
-  }
+static int get_constraint_fd(const powercap_constraint* fds, powercap_constraint_file file) {
+  assert(fds != NULL);
   switch (file) {
     case POWERCAP_CONSTRAINT_FILE_POWER_LIMIT_UW:
       return fds->power_limit_uw;
@@ -187,51 +336,304 @@ static int get_constraint_fd(const powercap_rapl_pkg* pkg, powercap_rapl_zone zo
   }
 }
 
-static powercap_rapl_zone_files* get_files_by_name(powercap_rapl_pkg* pkg, const uint32_t* zones, uint32_t depth) {
+// use the first interface that supports the file, falling back on the first interface
+static const powercap_zone* get_zone_files(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_zone_file file) {
+  assert(pkg != NULL);
+  int fd;
+  uint32_t i;
+  const powercap_rapl_domain* d = get_domain(pkg, zone);
+  if (d == NULL) {
+    return NULL;
+  }
+  for (i = 0; i < POWERCAP_RAPL_NUM_INTERFACES; i++) {
+    if ((fd = get_zone_fd(&d->files[i].zone, file)) < 0) {
+      return NULL;
+    } else if (fd > 0) {
+      return &d->files[i].zone;
+    }
+  }
+  return &d->files[0].zone;
+}
+
+// use the first interface that supports the file, falling back on the first interface
+static const powercap_constraint* get_constraint_files(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_rapl_constraint constraint, powercap_constraint_file file) {
   assert(pkg != NULL);
-  char name[MAX_NAME_SIZE];
-  if (powercap_sysfs_zone_get_name(CONTROL_TYPE, zones, depth, name, sizeof(name)) < 0) {
+  const powercap_constraint* pc;
+  const powercap_constraint* first = NULL;
+  int fd;
+  uint32_t i;
+  const powercap_rapl_domain* d = get_domain(pkg, zone);
+  if (d == NULL) {
     return NULL;
   }
+  for (i = 0; i < POWERCAP_RAPL_NUM_INTERFACES; i++) {
+    if ((pc = get_constraint(&d->files[i], constraint)) == NULL || (fd = get_constraint_fd(pc, file)) < 0) {
+      return NULL;
+    } else if (fd > 0) {
+      return pc;
+    } else if (first == NULL) {
+      first = pc;
+    }
+  }
+  return first;
+}
+
+static powercap_rapl_zone get_zone_type(const char* name) {
+  assert(name != NULL);
   if (!strncmp(name, ZONE_NAME_PREFIX_PKG, sizeof(ZONE_NAME_PREFIX_PKG) - 1)) {
-    return &pkg->pkg;
+    return POWERCAP_RAPL_ZONE_PACKAGE;
   } else if (!strncmp(name, ZONE_NAME_CORE, sizeof(ZONE_NAME_CORE))) {
-    return &pkg->core;
+    return POWERCAP_RAPL_ZONE_CORE;
   } else if (!strncmp(name, ZONE_NAME_UNCORE, sizeof(ZONE_NAME_UNCORE))) {
-    return &pkg->uncore;
+    return POWERCAP_RAPL_ZONE_UNCORE;
   } else if (!strncmp(name, ZONE_NAME_DRAM, sizeof(ZONE_NAME_DRAM))) {
-    return &pkg->dram;
+    return POWERCAP_RAPL_ZONE_DRAM;
   } else if (!strncmp(name, ZONE_NAME_PSYS, sizeof(ZONE_NAME_PSYS))) {
-    return &pkg->psys;
-  } else {
-    LOG(ERROR, "powercap-rapl: Unrecognized zone name: %s\n", name);
-    errno = EINVAL;
+    return POWERCAP_RAPL_ZONE_PSYS;
+  }
+  LOG(INFO, "powercap-rapl: Unrecognized zone name: %s\n", name);
+  return POWERCAP_RAPL_ZONE_OTHER;
+}
+
+// if read_name is set, the name is read and the domain type is set
+static int domain_open(powercap_rapl_domain* d, powercap_rapl_interface iface, const uint32_t* zones, uint32_t depth, const zone_dir* zd, int read_name, int ro) {
+  assert(d != NULL);
+  assert(depth <= 2);
+  int ret;
+  d->zones[iface][0] = zones[0];
+  d->zones[iface][1] = depth > 1 ? zones[1] : 0;
+  d->depth[iface] = depth;
+  if ((ret = open_all(CONTROL_TYPES[iface], zones, depth, zd, &d->files[iface], read_name ? d->name : NULL, sizeof(d->name), ro))) {
+    return ret;
+  }
+  if (read_name) {
+    d->type = get_zone_type(d->name);
+  }
+  return 0;
+}
+
+// the interface used to enumerate top-level instances
+static powercap_rapl_interface get_primary_interface(void) {
+  if (powercap_sysfs_control_type_exists(CONTROL_TYPE_MSR) && !powercap_sysfs_control_type_exists(CONTROL_TYPE_MMIO)) {
+    return POWERCAP_RAPL_INTERFACE_MMIO;
+  }
+  return POWERCAP_RAPL_INTERFACE_MSR;
+}
+
+static void top_zones_destroy(top_zones* tz) {
+  assert(tz != NULL);
+  free(tz->ids);
+  free(tz->names);
+  memset(tz, 0, sizeof(top_zones));
+}
+
+// read the names of top-level zones, which are used to match zones across control types
+static int top_zones_init(top_zones* tz, powercap_rapl_interface iface) {
+  assert(tz != NULL);
+  zone_dir zd;
+  uint32_t i;
+  int err_save;
+  memset(tz, 0, sizeof(top_zones));
+  if (powercap_sysfs_control_type_exists(CONTROL_TYPES[iface])) {
+    // not an error, there's just nothing to find
+    return 0;
+  }
+  if (scan_zone_dir(CONTROL_TYPES[iface], NULL, 0, &zd)) {
+    return -errno;
+  }
+  if (!zd.subzones) {
+    return 0;
+  }
+  if ((tz->ids = malloc(count_bits(zd.subzones) * sizeof(uint32_t))) == NULL ||
+      (tz->names = malloc(count_bits(zd.subzones) * sizeof(*tz->names))) == NULL) {
+    goto fail;
+  }
+  for (i = 0; i < MAX_DIR_INDEX; i++) {
+    if ((zd.subzones >> i) & 1) {
+      tz->ids[tz->n] = i;
+      if (powercap_sysfs_zone_get_name(CONTROL_TYPES[iface], &i, 1, tz->names[tz->n], sizeof(tz->names[tz->n])) < 0) {
+        goto fail;
+      }
+      tz->n++;
+    }
+  }
+  return 0;
+fail:
+  err_save = errno;
+  top_zones_destroy(tz);
+  errno = err_save;
+  return -errno;
+}
+
+// find a subzone by name that hasn't been opened for the interface yet, or append a new domain
+static powercap_rapl_domain* get_or_add_domain(powercap_rapl_pkg* pkg, powercap_rapl_interface iface, const char* name) {
+  assert(pkg != NULL);
+  powercap_rapl_domain* d;
+  uint32_t i;
+  for (i = 1; i < pkg->ndomains; i++) {
+    if (!pkg->domains[i].depth[iface] && !strncmp(pkg->domains[i].name, name, sizeof(pkg->domains[i].name))) {
+      return &pkg->domains[i];
+    }
+  }
+  if ((d = realloc(pkg->domains, (pkg->ndomains + 1) * sizeof(powercap_rapl_domain))) == NULL) {
+    return NULL;
+  }
+  pkg->domains = d;
+  d = &pkg->domains[pkg->ndomains++];
+  memset(d, 0, sizeof(powercap_rapl_domain));
+  snprintf(d->name, sizeof(d->name), "%s", name);
+  d->type = get_zone_type(d->name);
+  return d;
+}
+
+// add files from a secondary interface to an instance, matching zones by name
+static int merge_interface(powercap_rapl_pkg* pkg, powercap_rapl_interface iface, const top_zones* tz, int ro) {
+  assert(pkg != NULL);
+  assert(pkg->ndomains > 0);
+  assert(tz != NULL);
+  char name[POWERCAP_RAPL_NAME_MAX];
+  uint32_t zones[2] = { 0, 0 };
+  powercap_rapl_domain* d;
+  zone_dir zd;
+  zone_dir szd;
+  uint32_t i;
+  int ret;
+  // find the top-level zone with the same name as our parent zone
+  for (i = 0; i < tz->n && strncmp(tz->names[i], pkg->domains[0].name, sizeof(tz->names[i])); i++);
+  if (i == tz->n) {
+    // no match, which is not an error
+    return 0;
+  }
+  zones[0] = tz->ids[i];
+  if ((ret = scan_zone_dir(CONTROL_TYPES[iface], zones, 1, &zd)) ||
+      (ret = domain_open(&pkg->domains[0], iface, zones, 1, &zd, 0, ro))) {
+    return ret;
+  }
+  for (i = 0; i < MAX_DIR_INDEX; i++) {
+    if (!((zd.subzones >> i) & 1)) {
+      continue;
+    }
+    zones[1] = i;
+    if (powercap_sysfs_zone_get_name(CONTROL_TYPES[iface], zones, 2, name, sizeof(name)) < 0 ||
+        (d = get_or_add_domain(pkg, iface, name)) == NULL) {
+      return -errno;
+    }
+    if ((ret = scan_zone_dir(CONTROL_TYPES[iface], zones, 2, &szd)) ||
+        (ret = domain_open(d, iface, zones, 2, &szd, 0, ro))) {
+      return ret;
+    }
+  }
+  return 0;
+}
+
+// tz is indexed by interface, where the primary interface's entry is unused
+static int init_instance(uint32_t id, powercap_rapl_pkg* pkg, powercap_rapl_interface primary, const top_zones* tz, int ro) {
+  assert(pkg != NULL);
+  assert(tz != NULL);
+  int ret;
+  int err_save;
+  uint32_t zones[2] = { id, 0 };
+  uint32_t i;
+  uint32_t n;
+  zone_dir zd;
+  zone_dir szd;
+  memset(pkg, 0, sizeof(powercap_rapl_pkg));
+  if ((ret = scan_zone_dir(CONTROL_TYPES[primary], zones, 1, &zd))) {
+    return ret;
+  }
+  // calloc forces all fds to 0 so we don't try to operate on invalid descriptors
+  if ((pkg->domains = calloc(count_bits(zd.subzones) + 1, sizeof(powercap_rapl_domain))) == NULL) {
+    return -errno;
+  }
+  pkg->ndomains = count_bits(zd.subzones) + 1;
+  // first populate parent zone, then subordinate power zones
+  ret = domain_open(&pkg->domains[0], primary, zones, 1, &zd, 1, ro);
+  for (i = 0, n = 1; i < MAX_DIR_INDEX && !ret; i++) {
+    if ((zd.subzones >> i) & 1) {
+      zones[1] = i;
+      if (!(ret = scan_zone_dir(CONTROL_TYPES[primary], zones, 2, &szd))) {
+        ret = domain_open(&pkg->domains[n++], primary, zones, 2, &szd, 1, ro);
+      }
+    }
+  }
+  // then find the same zones in the other interface(s)
+  for (i = 0; i < POWERCAP_RAPL_NUM_INTERFACES && !ret; i++) {
+    if (i != primary && tz[i].n) {
+      ret = merge_interface(pkg, (powercap_rapl_interface) i, &tz[i], ro);
+    }
+  }
+  if (ret) {
+    err_save = errno;
+    powercap_rapl_destroy(pkg);
+    errno = err_save;
+  }
+  return ret;
+}
+
+static int top_zones_init_secondary(top_zones* tz, powercap_rapl_interface primary) {
+  assert(tz != NULL);
+  uint32_t i;
+  int err_save;
+  memset(tz, 0, POWERCAP_RAPL_NUM_INTERFACES * sizeof(top_zones));
+  for (i = 0; i < POWERCAP_RAPL_NUM_INTERFACES; i++) {
+    if (i != primary && top_zones_init(&tz[i], (powercap_rapl_interface) i)) {
+      err_save = errno;
+      while (i-- > 0) {
+        top_zones_destroy(&tz[i]);
+      }
+      errno = err_save;
+      return -errno;
+    }
+  }
+  return 0;
+}
+
+static void top_zones_destroy_secondary(top_zones* tz) {
+  assert(tz != NULL);
+  uint32_t i;
+  for (i = 0; i < POWERCAP_RAPL_NUM_INTERFACES; i++) {
+    top_zones_destroy(&tz[i]);
+  }
+}
+
+static void* init_instance_thread(void* arg) {
+  init_args* args = (init_args*) arg;
+  if ((args->ret = init_instance(args->id, args->pkg, args->primary, args->tz, args->ro))) {
+    args->err = errno;
   }
   return NULL;
 }
 
 int powercap_rapl_control_is_supported(void) {
-  int ret = powercap_sysfs_control_type_exists(CONTROL_TYPE);
+  int ret = powercap_sysfs_control_type_exists(CONTROL_TYPES[get_primary_interface()]);
   return ret ? (errno == ENOSYS ? 0 : ret) : 1;
 }
 
 int powercap_rapl_control_is_enabled(void) {
   uint32_t enabled;
-  int ret = powercap_sysfs_control_type_get_enabled(CONTROL_TYPE, &enabled);
+  int ret = powercap_sysfs_control_type_get_enabled(CONTROL_TYPES[get_primary_interface()], &enabled);
   return ret ? ret : (enabled ? 1 : 0);
 }
 
 int powercap_rapl_control_set_enabled(int val) {
-  return powercap_sysfs_control_type_set_enabled(CONTROL_TYPE, (uint32_t) val);
+  int ret = 0;
+  uint32_t i;
+  for (i = 0; i < POWERCAP_RAPL_NUM_INTERFACES && !ret; i++) {
+    if (!powercap_sysfs_control_type_exists(CONTROL_TYPES[i])) {
+      ret = powercap_sysfs_control_type_set_enabled(CONTROL_TYPES[i], (uint32_t) val);
+    }
+  }
+  return ret;
 }
 
 uint32_t powercap_rapl_get_num_instances(void) {
+  const char* ct = CONTROL_TYPES[get_primary_interface()];
   uint32_t n = 0;
-  while (!powercap_sysfs_zone_exists(CONTROL_TYPE, &n, 1)) {
+  while (!powercap_sysfs_zone_exists(ct, &n, 1)) {
     n++;
   }
   if (!n) {
-    LOG(ERROR, "powercap-rapl: No top-level "CONTROL_TYPE" zones found - is its kernel module loaded?\n");
+    LOG(ERROR, "powercap-rapl: No top-level %s zones found - is its kernel module loaded?\n", ct);
     errno = ENOENT;
   }
   return n;
@@ -242,41 +644,98 @@ uint32_t powercap_rapl_get_num_packages(void) {
 }
 
 int powercap_rapl_init(uint32_t id, powercap_rapl_pkg* pkg, int read_only) {
+  top_zones tz[POWERCAP_RAPL_NUM_INTERFACES];
+  powercap_rapl_interface primary = get_primary_interface();
   int ret;
   int err_save;
-  uint32_t zones[2] = { id, 0 };
-  powercap_rapl_zone_files* files;
   if (pkg == NULL) {
     errno = EINVAL;
     return -errno;
   }
-  // first need the parent zone
-  if ((files = get_files_by_name(pkg, zones, 1)) == NULL) {
+  if (top_zones_init_secondary(tz, primary)) {
     return -errno;
   }
-  // force all fds to 0 so we don't try to operate on invalid descriptors
-  memset(pkg, 0, sizeof(powercap_rapl_pkg));
-  // first populate parent zone
-  if (!(ret = open_all(zones, 1, files, read_only))) {
-    // get subordinate power zones
-    while(!powercap_sysfs_zone_exists(CONTROL_TYPE, zones, 2) && !ret) {
-      if ((files = get_files_by_name(pkg, zones, 2)) == NULL) {
-        ret = -errno;
-      } else if (files->zone.name) {
-        // zone has already been opened ("name" is picked arbitrarily, but it is a required file)
-        LOG(ERROR, "powercap-rapl: Duplicate zone type detected at %"PRIu32":%"PRIu32"\n", zones[0], zones[1]);
-        errno = EBUSY;
-        ret = -errno;
+  ret = init_instance(id, pkg, primary, tz, read_only);
+  err_save = errno;
+  top_zones_destroy_secondary(tz);
+  errno = err_save;
+  return ret;
+}
+
+int powercap_rapl_init_all(powercap_rapl_pkg** pkgs, uint32_t* count, int read_only, int parallel) {
+  top_zones tz[POWERCAP_RAPL_NUM_INTERFACES];
+  powercap_rapl_interface primary = get_primary_interface();
+  pthread_t* threads = NULL;
+  init_args* args = NULL;
+  powercap_rapl_pkg* p = NULL;
+  zone_dir zd;
+  uint32_t n;
+  uint32_t i;
+  uint32_t j;
+  int ret = 0;
+  int err_save;
+  if (pkgs == NULL || count == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (scan_zone_dir(CONTROL_TYPES[primary], NULL, 0, &zd)) {
+    LOG(ERROR, "powercap-rapl: No %s control type found - is its kernel module loaded?\n", CONTROL_TYPES[primary]);
+    return -errno;
+  }
+  if ((n = count_bits(zd.subzones)) == 0) {
+    LOG(ERROR, "powercap-rapl: No top-level %s zones found - is its kernel module loaded?\n", CONTROL_TYPES[primary]);
+    errno = ENOENT;
+    return -errno;
+  }
+  if (top_zones_init_secondary(tz, primary)) {
+    return -errno;
+  }
+  if ((p = calloc(n, sizeof(powercap_rapl_pkg))) == NULL || (args = calloc(n, sizeof(init_args))) == NULL ||
+      (parallel && (threads = calloc(n, sizeof(pthread_t))) == NULL)) {
+    ret = -errno;
+    goto cleanup;
+  }
+  for (i = 0, j = 0; i < MAX_DIR_INDEX; i++) {
+    if ((zd.subzones >> i) & 1) {
+      args[j].pkg = &p[j];
+      args[j].tz = tz;
+      args[j].primary = primary;
+      args[j].id = i;
+      args[j].ro = read_only;
+      // fall back on initializing in this thread if a new one can't be started
+      if (threads != NULL && !pthread_create(&threads[j], NULL, init_instance_thread, &args[j])) {
+        args[j].threaded = 1;
       } else {
-        ret = open_all(zones, 2, files, read_only);
-        zones[1]++;
+        init_instance_thread(&args[j]);
       }
+      j++;
     }
   }
-  if (ret) {
-    err_save = errno;
-    powercap_rapl_destroy(pkg);
-    errno = err_save;
+  for (i = 0; i < n; i++) {
+    if (args[i].threaded) {
+      pthread_join(threads[i], NULL);
+    }
+  }
+  for (i = 0; i < n && !ret; i++) {
+    if (args[i].ret) {
+      ret = args[i].ret;
+      errno = args[i].err;
+    }
+  }
+cleanup:
+  err_save = errno;
+  if (ret && p != NULL) {
+    // instances that failed to initialize already cleaned up after themselves
+    powercap_rapl_destroy_all(p, n);
+    p = NULL;
+  }
+  free(threads);
+  free(args);
+  top_zones_destroy_secondary(tz);
+  errno = err_save;
+  if (!ret) {
+    *pkgs = p;
+    *count = n;
   }
   return ret;
 }
@@ -284,24 +743,99 @@ int powercap_rapl_init(uint32_t id, powercap_rapl_pkg* pkg, int read_only) {
 static int fds_destroy_all(powercap_rapl_zone_files* files) {
   assert(files != NULL);
   int ret = 0;
+  uint32_t i;
   ret |= powercap_zone_close(&files->zone);
   ret |= powercap_constraint_close(&files->constraint_long);
   ret |= powercap_constraint_close(&files->constraint_short);
+  ret |= powercap_constraint_close(&files->constraint_peak);
+  for (i = 0; i < files->nconstraint_other; i++) {
+    ret |= powercap_constraint_close(&files->constraint_other[i]);
+  }
+  free(files->constraint_other);
+  files->constraint_other = NULL;
+  files->nconstraint_other = 0;
   return ret;
 }
 
 int powercap_rapl_destroy(powercap_rapl_pkg* pkg) {
   int ret = 0;
+  uint32_t i;
+  uint32_t j;
   if (pkg != NULL) {
-    ret |= fds_destroy_all(&pkg->pkg);
-    ret |= fds_destroy_all(&pkg->core);
-    ret |= fds_destroy_all(&pkg->uncore);
-    ret |= fds_destroy_all(&pkg->dram);
-    ret |= fds_destroy_all(&pkg->psys);
+    for (i = 0; i < pkg->ndomains; i++) {
+      for (j = 0; j < POWERCAP_RAPL_NUM_INTERFACES; j++) {
+        ret |= fds_destroy_all(&pkg->domains[i].files[j]);
+      }
+    }
+    free(pkg->domains);
+    pkg->domains = NULL;
+    pkg->ndomains = 0;
   }
   return ret;
 }
 
+int powercap_rapl_destroy_all(powercap_rapl_pkg* pkgs, uint32_t count) {
+  int ret = 0;
+  uint32_t i;
+  if (pkgs != NULL) {
+    for (i = 0; i < count; i++) {
+      ret |= powercap_rapl_destroy(&pkgs[i]);
+    }
+    free(pkgs);
+  }
+  return ret;
+}
+
+uint32_t powercap_rapl_get_num_domains(const powercap_rapl_pkg* pkg) {
+  return pkg == NULL ? 0 : pkg->ndomains;
+}
+
+const powercap_rapl_domain* powercap_rapl_get_domain(const powercap_rapl_pkg* pkg, uint32_t idx) {
+  if (pkg == NULL || idx >= pkg->ndomains) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return &pkg->domains[idx];
+}
+
+int powercap_rapl_is_interface_supported(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_rapl_interface iface) {
+  const powercap_rapl_domain* d;
+  if (pkg == NULL || !is_valid_interface(iface) || (d = get_domain(pkg, zone)) == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  return d->depth[iface] ? 1 : 0;
+}
+
+const powercap_rapl_zone_files* powercap_rapl_get_zone_files(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_rapl_interface iface) {
+  const powercap_rapl_domain* d;
+  if (pkg == NULL || !is_valid_interface(iface) || (d = get_domain(pkg, zone)) == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if (!d->depth[iface]) {
+    errno = ENOENT;
+    return NULL;
+  }
+  return &d->files[iface];
+}
+
+uint32_t powercap_rapl_get_num_other_constraints(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone) {
+  const powercap_rapl_domain* d;
+  uint32_t n = 0;
+  uint32_t i;
+  if (pkg == NULL || (d = get_domain(pkg, zone)) == NULL) {
+    errno = EINVAL;
+    return 0;
+  }
+  for (i = 0; i < POWERCAP_RAPL_NUM_INTERFACES; i++) {
+    if (d->files[i].nconstraint_other > n) {
+      n = d->files[i].nconstraint_other;
+    }
+  }
+  return n;
+}
+
 int powercap_rapl_is_zone_supported(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone) {
   // POWERCAP_ZONE_FILE_NAME is picked arbitrarily, but it is a required file
   return powercap_rapl_is_zone_file_supported(pkg, zone, POWERCAP_ZONE_FILE_NAME);
@@ -314,7 +848,8 @@ int powercap_rapl_is_constraint_supported(const powercap_rapl_pkg* pkg, powercap
 
 int powercap_rapl_is_zone_file_supported(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_zone_file file) {
   int fd;
-  if (pkg == NULL || (fd = get_zone_fd(pkg, zone, file)) < 0) {
+  const powercap_zone* fds;
+  if (pkg == NULL || (fds = get_zone_files(pkg, zone, file)) == NULL || (fd = get_zone_fd(fds, file)) < 0) {
     errno = EINVAL;
     return -errno;
   }
@@ -323,7 +858,9 @@ int powercap_rapl_is_zone_file_supported(const powercap_rapl_pkg* pkg, powercap_
 
 int powercap_rapl_is_constraint_file_supported(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_rapl_constraint constraint, powercap_constraint_file file) {
   int fd;
-  if (pkg == NULL || (fd = get_constraint_fd(pkg, zone, constraint, file)) < 0) {
+  const powercap_constraint* fds;
+  if (pkg == NULL || (fds = get_constraint_files(pkg, zone, constraint, file)) == NULL ||
+      (fd = get_constraint_fd(fds, file)) < 0) {
     errno = EINVAL;
     return -errno;
   }
@@ -331,14 +868,14 @@ int powercap_rapl_is_constraint_file_supported(const powercap_rapl_pkg* pkg, pow
 }
 
 ssize_t powercap_rapl_get_name(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, char* buf, size_t size) {
-  const powercap_zone* fds = get_zone_files(pkg, zone);
+  const powercap_zone* fds = get_zone_files(pkg, zone, POWERCAP_ZONE_FILE_NAME);
   return fds == NULL ? -errno : powercap_zone_get_name(fds, buf, size);
 }
 
 int powercap_rapl_is_enabled(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone) {
   int enabled = -1;
   int ret;
-  const powercap_zone* fds = get_zone_files(pkg, zone);
+  const powercap_zone* fds = get_zone_files(pkg, zone, POWERCAP_ZONE_FILE_ENABLED);
   if (fds == NULL) {
     enabled = -errno;
   } else if ((ret = powercap_zone_get_enabled(fds, &enabled))) {
@@ -348,76 +885,106 @@ int powercap_rapl_is_enabled(const powercap_rapl_pkg* pkg, powercap_rapl_zone zo
 }
 
 int powercap_rapl_set_enabled(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, int enabled) {
-  const powercap_zone* fds = get_zone_files(pkg, zone);
+  const powercap_zone* fds = get_zone_files(pkg, zone, POWERCAP_ZONE_FILE_ENABLED);
   return fds == NULL ? -errno : powercap_zone_set_enabled(fds, enabled);
 }
 
 int powercap_rapl_get_max_energy_range_uj(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, uint64_t* val) {
-  const powercap_zone* fds = get_zone_files(pkg, zone);
+  const powercap_zone* fds = get_zone_files(pkg, zone, POWERCAP_ZONE_FILE_MAX_ENERGY_RANGE_UJ);
   return fds == NULL ? -errno : powercap_zone_get_max_energy_range_uj(fds, val);
 }
 
 int powercap_rapl_get_energy_uj(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, uint64_t* val) {
-  const powercap_zone* fds = get_zone_files(pkg, zone);
+  const powercap_zone* fds = get_zone_files(pkg, zone, POWERCAP_ZONE_FILE_ENERGY_UJ);
   return fds == NULL ? -errno : powercap_zone_get_energy_uj(fds, val);
 }
 
 int powercap_rapl_reset_energy_uj(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone) {
-  const powercap_zone* fds = get_zone_files(pkg, zone);
+  const powercap_zone* fds = get_zone_files(pkg, zone, POWERCAP_ZONE_FILE_ENERGY_UJ);
   return fds == NULL ? -errno : powercap_zone_reset_energy_uj(fds);
 }
 
 int powercap_rapl_get_max_power_range_uw(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, uint64_t* val) {
-  const powercap_zone* fds = get_zone_files(pkg, zone);
+  const powercap_zone* fds = get_zone_files(pkg, zone, POWERCAP_ZONE_FILE_MAX_POWER_RANGE_UW);
   return fds == NULL ? -errno : powercap_zone_get_max_power_range_uw(fds, val);
 }
 
 int powercap_rapl_get_power_uw(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, uint64_t* val) {
-  const powercap_zone* fds = get_zone_files(pkg, zone);
+  const powercap_zone* fds = get_zone_files(pkg, zone, POWERCAP_ZONE_FILE_POWER_UW);
   return fds == NULL ? -errno : powercap_zone_get_power_uw(fds, val);
 }
 
 int powercap_rapl_get_max_power_uw(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_rapl_constraint constraint, uint64_t* val) {
-  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint);
+  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint, POWERCAP_CONSTRAINT_FILE_MAX_POWER_UW);
   return fds == NULL ? -errno : powercap_constraint_get_max_power_uw(fds, val);
 }
 
 int powercap_rapl_get_min_power_uw(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_rapl_constraint constraint, uint64_t* val) {
-  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint);
+  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint, POWERCAP_CONSTRAINT_FILE_MIN_POWER_UW);
   return fds == NULL ? -errno : powercap_constraint_get_min_power_uw(fds, val);
 }
 
 int powercap_rapl_get_power_limit_uw(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_rapl_constraint constraint, uint64_t* val) {
-  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint);
+  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint, POWERCAP_CONSTRAINT_FILE_POWER_LIMIT_UW);
   return fds == NULL ? -errno : powercap_constraint_get_power_limit_uw(fds, val);
 }
 
 int powercap_rapl_set_power_limit_uw(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_rapl_constraint constraint, uint64_t val) {
-  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint);
+  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint, POWERCAP_CONSTRAINT_FILE_POWER_LIMIT_UW);
   return fds == NULL ? -errno : powercap_constraint_set_power_limit_uw(fds, val);
 }
 
 int powercap_rapl_get_max_time_window_us(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_rapl_constraint constraint, uint64_t* val) {
-  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint);
+  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint, POWERCAP_CONSTRAINT_FILE_MAX_TIME_WINDOW_US);
   return fds == NULL ? -errno : powercap_constraint_get_max_time_window_us(fds, val);
 }
 
 int powercap_rapl_get_min_time_window_us(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_rapl_constraint constraint, uint64_t* val) {
-  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint);
+  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint, POWERCAP_CONSTRAINT_FILE_MIN_TIME_WINDOW_US);
   return fds == NULL ? -errno : powercap_constraint_get_min_time_window_us(fds, val);
 }
 
 int powercap_rapl_get_time_window_us(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_rapl_constraint constraint, uint64_t* val) {
-  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint);
+  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint, POWERCAP_CONSTRAINT_FILE_TIME_WINDOW_US);
   return fds == NULL ? -errno : powercap_constraint_get_time_window_us(fds, val);
 }
 
 int powercap_rapl_set_time_window_us(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_rapl_constraint constraint, uint64_t val) {
-  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint);
+  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint, POWERCAP_CONSTRAINT_FILE_TIME_WINDOW_US);
   return fds == NULL ? -errno : powercap_constraint_set_time_window_us(fds, val);
 }
 
 ssize_t powercap_rapl_get_constraint_name(const powercap_rapl_pkg* pkg, powercap_rapl_zone zone, powercap_rapl_constraint constraint, char* buf, size_t size) {
-  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint);
+  const powercap_constraint* fds = get_constraint_files(pkg, zone, constraint, POWERCAP_CONSTRAINT_FILE_NAME);
   return fds == NULL ? -errno : powercap_constraint_get_name(fds, buf, size);
 }
+
+int powercap_rapl_snapshot_init(powercap_snapshot* snap, const powercap_rapl_pkg* pkgs, uint32_t count) {
+  const powercap_rapl_domain* d;
+  uint32_t n = 0;
+  uint32_t i;
+  uint32_t j;
+  uint32_t k;
+  int ret;
+  if (snap == NULL || pkgs == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  for (i = 0; i < count; i++) {
+    n += pkgs[i].ndomains;
+  }
+  if ((ret = powercap_snapshot_init(snap, n))) {
+    return ret;
+  }
+  for (i = 0, n = 0; i < count; i++) {
+    for (j = 0; j < pkgs[i].ndomains; j++, n++) {
+      d = &pkgs[i].domains[j];
+      for (k = 0; k < POWERCAP_RAPL_NUM_INTERFACES && d->files[k].zone.energy_uj <= 0; k++);
+      if (k < POWERCAP_RAPL_NUM_INTERFACES && (ret = powercap_snapshot_set_zone(snap, n, &d->files[k].zone))) {
+        powercap_snapshot_destroy(snap);
+        return ret;
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,308 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Per-region energy attribution.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "powercap-accumulator.h"
+#include "powercap-common.h"
+#include "powercap-region.h"
+
+typedef struct region_frame {
+  const powercap_region_registry* registry;
+  uint32_t region;
+  uint64_t start_ns;
+  uint64_t start_uj[POWERCAP_REGION_MAX_COUNTERS];
+} region_frame;
+
+/* A thread's open regions, allocated when the thread first begins a region and freed when it exits */
+typedef struct region_stack {
+  uint32_t depth;
+  region_frame frames[POWERCAP_REGION_MAX_DEPTH];
+} region_stack;
+
+struct powercap_region_registry {
+  powercap_accumulator* accs;
+  uint32_t ncounters;
+  uint32_t max_regions;
+  /* Only increases, and only while holding the lock */
+  uint32_t nregions;
+  pthread_mutex_t lock;
+  char (*names)[POWERCAP_REGION_NAME_MAX];
+  powercap_region_stats* stats;
+  /* Counter c of region r is at [r * ncounters + c] */
+  uint64_t* energy_uj;
+};
+
+static __thread region_stack* tls_stack;
+static pthread_key_t stack_key;
+static pthread_once_t stack_key_once = PTHREAD_ONCE_INIT;
+static int stack_key_err;
+
+static void stack_free(void* arg) {
+  free(arg);
+  tls_stack = NULL;
+}
+
+static void stack_key_create(void) {
+  stack_key_err = pthread_key_create(&stack_key, stack_free);
+}
+
+static region_stack* get_stack(void) {
+  region_stack* stack;
+  int err;
+  if (tls_stack != NULL) {
+    return tls_stack;
+  }
+  if ((err = pthread_once(&stack_key_once, stack_key_create)) || (err = stack_key_err)) {
+    errno = err;
+    return NULL;
+  }
+  if ((stack = malloc(sizeof(region_stack))) == NULL) {
+    return NULL;
+  }
+  stack->depth = 0;
+  if ((err = pthread_setspecific(stack_key, stack))) {
+    free(stack);
+    errno = err;
+    return NULL;
+  }
+  tls_stack = stack;
+  return stack;
+}
+
+powercap_region_registry* powercap_region_registry_create(powercap_accumulator* accs, uint32_t ncounters,
+                                                          uint32_t max_regions) {
+  powercap_region_registry* r;
+  int err;
+  if (accs == NULL || ncounters == 0 || ncounters > POWERCAP_REGION_MAX_COUNTERS || max_regions == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if ((r = calloc(1, sizeof(powercap_region_registry))) == NULL) {
+    return NULL;
+  }
+  if ((err = pthread_mutex_init(&r->lock, NULL))) {
+    free(r);
+    errno = err;
+    return NULL;
+  }
+  r->accs = accs;
+  r->ncounters = ncounters;
+  r->max_regions = max_regions;
+  if ((r->names = calloc(max_regions, sizeof(*r->names))) == NULL ||
+      (r->stats = calloc(max_regions, sizeof(powercap_region_stats))) == NULL ||
+      (r->energy_uj = calloc((size_t) max_regions * ncounters, sizeof(uint64_t))) == NULL) {
+    err = errno;
+    powercap_region_registry_destroy(r);
+    errno = err;
+    return NULL;
+  }
+  return r;
+}
+
+void powercap_region_registry_destroy(powercap_region_registry* registry) {
+  if (registry != NULL) {
+    pthread_mutex_destroy(&registry->lock);
+    free(registry->names);
+    free(registry->stats);
+    free(registry->energy_uj);
+    free(registry);
+  }
+}
+
+int powercap_region_register(powercap_region_registry* registry, const char* name) {
+  uint32_t i;
+  int ret;
+  if (registry == NULL || name == NULL || name[0] == '\0' || strlen(name) >= POWERCAP_REGION_NAME_MAX) {
+    errno = EINVAL;
+    return -errno;
+  }
+  pthread_mutex_lock(&registry->lock);
+  for (i = 0; i < registry->nregions && strcmp(registry->names[i], name); i++);
+  if (i < registry->nregions) {
+    ret = (int) i;
+  } else if (i == registry->max_regions) {
+    errno = ENOSPC;
+    ret = -errno;
+  } else {
+    strcpy(registry->names[i], name);
+    // markers may use the id as soon as it's published
+    __atomic_store_n(&registry->nregions, i + 1, __ATOMIC_RELEASE);
+    ret = (int) i;
+  }
+  pthread_mutex_unlock(&registry->lock);
+  return ret;
+}
+
+int powercap_region_update(powercap_region_registry* registry, const uint64_t* time_ns, const uint64_t* energy_uj,
+                           uint32_t nsamples, uint32_t max) {
+  uint32_t i;
+  uint32_t c;
+  int ambiguous = 0;
+  int ret;
+  if (registry == NULL || time_ns == NULL || energy_uj == NULL || nsamples > max) {
+    errno = EINVAL;
+    return -errno;
+  }
+  // sample by sample, so all accumulators advance together
+  for (i = 0; i < nsamples; i++) {
+    for (c = 0; c < registry->ncounters; c++) {
+      if ((ret = powercap_accumulator_update(&registry->accs[c], energy_uj[(size_t) c * max + i], time_ns[i])) < 0) {
+        return ret;
+      }
+      ambiguous += ret;
+    }
+  }
+  return ambiguous;
+}
+
+uint32_t powercap_region_get_num_regions(const powercap_region_registry* registry) {
+  return registry == NULL ? 0 : __atomic_load_n(&registry->nregions, __ATOMIC_ACQUIRE);
+}
+
+const char* powercap_region_get_name(const powercap_region_registry* registry, uint32_t region) {
+  if (registry == NULL || region >= powercap_region_get_num_regions(registry)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return registry->names[region];
+}
+
+int powercap_region_begin(powercap_region_registry* registry, uint32_t region) {
+  region_stack* stack;
+  region_frame* frame;
+  uint32_t c;
+  if (registry == NULL || region >= powercap_region_get_num_regions(registry)) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if ((stack = get_stack()) == NULL) {
+    return -errno;
+  }
+  if (stack->depth == POWERCAP_REGION_MAX_DEPTH) {
+    errno = ENOSPC;
+    return -errno;
+  }
+  frame = &stack->frames[stack->depth++];
+  frame->registry = registry;
+  frame->region = region;
+  for (c = 0; c < registry->ncounters; c++) {
+    powercap_accumulator_get(&registry->accs[c], &frame->start_uj[c], NULL);
+  }
+  frame->start_ns = get_time_ns();
+  return 0;
+}
+
+int powercap_region_end(powercap_region_registry* registry, uint32_t region) {
+  const region_frame* frame;
+  uint64_t* energy_uj;
+  uint64_t total_uj;
+  uint64_t now;
+  uint32_t c;
+  if (tls_stack == NULL || tls_stack->depth == 0) {
+    errno = EINVAL;
+    return -errno;
+  }
+  frame = &tls_stack->frames[tls_stack->depth - 1];
+  if (frame->registry != registry || frame->region != region) {
+    errno = EINVAL;
+    return -errno;
+  }
+  now = get_time_ns();
+  energy_uj = &registry->energy_uj[(size_t) region * registry->ncounters];
+  for (c = 0; c < registry->ncounters; c++) {
+    powercap_accumulator_get(&registry->accs[c], &total_uj, NULL);
+    __atomic_fetch_add(&energy_uj[c], total_uj - frame->start_uj[c], __ATOMIC_RELAXED);
+  }
+  __atomic_fetch_add(&registry->stats[region].time_ns, now - frame->start_ns, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&registry->stats[region].count, 1, __ATOMIC_RELAXED);
+  tls_stack->depth--;
+  return 0;
+}
+
+int powercap_region_get_stats(const powercap_region_registry* registry, uint32_t region,
+                              powercap_region_stats* stats, uint64_t* energy_uj) {
+  uint32_t c;
+  if (registry == NULL || region >= powercap_region_get_num_regions(registry)) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (stats != NULL) {
+    stats->count = __atomic_load_n(&registry->stats[region].count, __ATOMIC_RELAXED);
+    stats->time_ns = __atomic_load_n(&registry->stats[region].time_ns, __ATOMIC_RELAXED);
+  }
+  if (energy_uj != NULL) {
+    for (c = 0; c < registry->ncounters; c++) {
+      energy_uj[c] = __atomic_load_n(&registry->energy_uj[(size_t) region * registry->ncounters + c],
+                                     __ATOMIC_RELAXED);
+    }
+  }
+  return 0;
+}
+
+/* Write a CSV field, quoted if necessary */
+static int write_csv_field(FILE* stream, const char* field) {
+  const char* c;
+  if (strpbrk(field, ",\"\r\n") == NULL) {
+    return fputs(field, stream) < 0 ? -1 : 0;
+  }
+  if (fputc('"', stream) == EOF) {
+    return -1;
+  }
+  for (c = field; *c != '\0'; c++) {
+    // double quotes are escaped by doubling them
+    if ((*c == '"' && fputc('"', stream) == EOF) || fputc(*c, stream) == EOF) {
+      return -1;
+    }
+  }
+  return fputc('"', stream) == EOF ? -1 : 0;
+}
+
+int powercap_region_dump(const powercap_region_registry* registry, FILE* stream) {
+  powercap_region_stats stats;
+  uint64_t energy_uj[POWERCAP_REGION_MAX_COUNTERS];
+  uint32_t nregions;
+  uint32_t i;
+  uint32_t c;
+  if (registry == NULL || stream == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (fprintf(stream, "name,count,time_ns") < 0) {
+    return -errno;
+  }
+  for (c = 0; c < registry->ncounters; c++) {
+    if (fprintf(stream, ",energy_uj_%"PRIu32, c) < 0) {
+      return -errno;
+    }
+  }
+  if (fprintf(stream, "\n") < 0) {
+    return -errno;
+  }
+  nregions = powercap_region_get_num_regions(registry);
+  for (i = 0; i < nregions; i++) {
+    powercap_region_get_stats(registry, i, &stats, energy_uj);
+    if (write_csv_field(stream, registry->names[i]) ||
+        fprintf(stream, ",%"PRIu64",%"PRIu64, stats.count, stats.time_ns) < 0) {
+      return -errno;
+    }
+    for (c = 0; c < registry->ncounters; c++) {
+      if (fprintf(stream, ",%"PRIu64, energy_uj[c]) < 0) {
+        return -errno;
+      }
+    }
+    if (fprintf(stream, "\n") < 0) {
+      return -errno;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,255 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Multi-resolution energy and power history.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "powercap-rollup.h"
+
+/* Bucket id of a slot that has never been used */
+#define EMPTY UINT64_MAX
+
+typedef struct rollup_tier {
+  uint64_t res_ns;
+  uint32_t length;
+  /* Bucket id held by each slot (time_ns / res_ns) */
+  uint64_t* id;
+  /* Counter c of slot s is at [c * length + s] */
+  uint64_t* energy_uj;
+  uint64_t* covered_ns;
+  double* min_w;
+  double* max_w;
+} rollup_tier;
+
+struct powercap_rollup {
+  rollup_tier tiers[POWERCAP_ROLLUP_MAX_TIERS];
+  uint32_t ntiers;
+  uint32_t ncounters;
+  /* Per-counter arrays, allocated in a single block starting with max_energy_range_uj */
+  uint64_t* max_energy_range_uj;
+  uint64_t* last_uj;
+  /* Scratch space for the sample being added */
+  uint64_t* sample_uj;
+  uint64_t* delta_uj;
+  double* power_w;
+  uint64_t last_ns;
+  int started;
+};
+
+static int tier_init(rollup_tier* t, const powercap_rollup_tier* cfg, uint32_t ncounters) {
+  size_t n = (size_t) cfg->length * ncounters;
+  uint32_t i;
+  if (cfg->resolution_us == 0 || cfg->resolution_us > UINT64_MAX / 1000 || cfg->length == 0) {
+    return -EINVAL;
+  }
+  if ((t->id = malloc((cfg->length + 4 * n) * sizeof(uint64_t))) == NULL) {
+    return -errno;
+  }
+  t->res_ns = cfg->resolution_us * 1000;
+  t->length = cfg->length;
+  t->energy_uj = t->id + cfg->length;
+  t->covered_ns = t->energy_uj + n;
+  t->min_w = (double*) (void*) (t->covered_ns + n);
+  t->max_w = t->min_w + n;
+  for (i = 0; i < t->length; i++) {
+    t->id[i] = EMPTY;
+  }
+  return 0;
+}
+
+powercap_rollup* powercap_rollup_create(const powercap_rollup_tier* tiers, uint32_t ntiers, uint32_t ncounters,
+                                        const uint64_t* max_energy_range_uj) {
+  powercap_rollup* r;
+  uint32_t i;
+  int err;
+  if (tiers == NULL || ntiers == 0 || ntiers > POWERCAP_ROLLUP_MAX_TIERS || ncounters == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  for (i = 1; i < ntiers; i++) {
+    if (tiers[i].resolution_us < tiers[i - 1].resolution_us) {
+      errno = EINVAL;
+      return NULL;
+    }
+  }
+  if ((r = calloc(1, sizeof(powercap_rollup))) == NULL) {
+    return NULL;
+  }
+  if ((r->max_energy_range_uj = calloc((size_t) ncounters * 5, sizeof(uint64_t))) == NULL) {
+    free(r);
+    return NULL;
+  }
+  r->last_uj = r->max_energy_range_uj + ncounters;
+  r->sample_uj = r->last_uj + ncounters;
+  r->delta_uj = r->sample_uj + ncounters;
+  r->power_w = (double*) (void*) (r->delta_uj + ncounters);
+  if (max_energy_range_uj != NULL) {
+    memcpy(r->max_energy_range_uj, max_energy_range_uj, ncounters * sizeof(uint64_t));
+  }
+  r->ncounters = ncounters;
+  for (i = 0; i < ntiers; i++) {
+    if ((err = tier_init(&r->tiers[i], &tiers[i], ncounters))) {
+      powercap_rollup_destroy(r);
+      errno = -err;
+      return NULL;
+    }
+    r->ntiers++;
+  }
+  return r;
+}
+
+void powercap_rollup_destroy(powercap_rollup* rollup) {
+  uint32_t i;
+  if (rollup != NULL) {
+    for (i = 0; i < rollup->ntiers; i++) {
+      // id is the start of the tier's allocated block
+      free(rollup->tiers[i].id);
+    }
+    free(rollup->max_energy_range_uj);
+    free(rollup);
+  }
+}
+
+static void tier_add(rollup_tier* t, uint32_t ncounters, uint64_t time_ns, uint64_t dt_ns, const uint64_t* delta_uj,
+                     const double* power_w) {
+  const uint64_t id = time_ns / t->res_ns;
+  const uint32_t slot = (uint32_t) (id % t->length);
+  size_t k;
+  uint32_t c;
+  if (t->id[slot] != id) {
+    // recycle the slot
+    t->id[slot] = id;
+    for (c = 0, k = slot; c < ncounters; c++, k += t->length) {
+      t->energy_uj[k] = 0;
+      t->covered_ns[k] = 0;
+    }
+  }
+  for (c = 0, k = slot; c < ncounters; c++, k += t->length) {
+    if (t->covered_ns[k] == 0 || power_w[c] < t->min_w[k]) {
+      t->min_w[k] = power_w[c];
+    }
+    if (t->covered_ns[k] == 0 || power_w[c] > t->max_w[k]) {
+      t->max_w[k] = power_w[c];
+    }
+    t->energy_uj[k] += delta_uj[c];
+    t->covered_ns[k] += dt_ns;
+  }
+}
+
+int powercap_rollup_add(powercap_rollup* rollup, uint64_t time_ns, const uint64_t* energy_uj) {
+  uint64_t dt_ns;
+  uint32_t c;
+  uint32_t i;
+  if (rollup == NULL || energy_uj == NULL || (rollup->started && time_ns < rollup->last_ns)) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (rollup->started && time_ns == rollup->last_ns) {
+    return 0;
+  }
+  if (rollup->started) {
+    dt_ns = time_ns - rollup->last_ns;
+    for (c = 0; c < rollup->ncounters; c++) {
+      rollup->delta_uj[c] = energy_uj[c] - rollup->last_uj[c];
+      if (energy_uj[c] < rollup->last_uj[c]) {
+        rollup->delta_uj[c] += rollup->max_energy_range_uj[c];
+      }
+      // uJ/ns = 1000 W
+      rollup->power_w[c] = (double) rollup->delta_uj[c] * 1000.0 / (double) dt_ns;
+    }
+    for (i = 0; i < rollup->ntiers; i++) {
+      tier_add(&rollup->tiers[i], rollup->ncounters, time_ns, dt_ns, rollup->delta_uj, rollup->power_w);
+    }
+  }
+  memcpy(rollup->last_uj, energy_uj, rollup->ncounters * sizeof(uint64_t));
+  rollup->last_ns = time_ns;
+  rollup->started = 1;
+  return 0;
+}
+
+int powercap_rollup_add_samples(powercap_rollup* rollup, const uint64_t* time_ns, const uint64_t* energy_uj,
+                                uint32_t n, uint32_t stride) {
+  uint32_t c;
+  uint32_t i;
+  int ret;
+  if (rollup == NULL || time_ns == NULL || energy_uj == NULL || stride < n) {
+    errno = EINVAL;
+    return -errno;
+  }
+  for (i = 0; i < n; i++) {
+    for (c = 0; c < rollup->ncounters; c++) {
+      rollup->sample_uj[c] = energy_uj[(size_t) c * stride + i];
+    }
+    if ((ret = powercap_rollup_add(rollup, time_ns[i], rollup->sample_uj))) {
+      return ret;
+    }
+  }
+  return 0;
+}
+
+int powercap_rollup_query(const powercap_rollup* rollup, uint32_t counter, uint64_t start_ns, uint64_t end_ns,
+                          powercap_rollup_result* result) {
+  const rollup_tier* t = NULL;
+  uint64_t latest = 0;
+  uint64_t oldest = 0;
+  uint64_t first;
+  uint64_t last;
+  uint64_t id;
+  size_t k;
+  uint32_t i;
+  int found = 0;
+  if (rollup == NULL || counter >= rollup->ncounters || end_ns <= start_ns || result == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (!rollup->started) {
+    errno = ENODATA;
+    return -errno;
+  }
+  // the finest tier whose oldest bucket is no later than the start time
+  for (i = 0; i < rollup->ntiers; i++) {
+    t = &rollup->tiers[i];
+    latest = rollup->last_ns / t->res_ns;
+    oldest = latest >= t->length ? latest - t->length + 1 : 0;
+    if (start_ns / t->res_ns >= oldest) {
+      break;
+    }
+  }
+  if (i == rollup->ntiers) {
+    i--;
+  }
+  first = start_ns / t->res_ns > oldest ? start_ns / t->res_ns : oldest;
+  last = (end_ns - 1) / t->res_ns < latest ? (end_ns - 1) / t->res_ns : latest;
+  memset(result, 0, sizeof(*result));
+  result->tier = i;
+  for (id = first; id <= last && first <= last; id++) {
+    k = (size_t) counter * t->length + id % t->length;
+    if (t->id[id % t->length] != id || t->covered_ns[k] == 0) {
+      continue;
+    }
+    if (!found || t->min_w[k] < result->min_w) {
+      result->min_w = t->min_w[k];
+    }
+    if (!found || t->max_w[k] > result->max_w) {
+      result->max_w = t->max_w[k];
+    }
+    if (!found) {
+      result->start_ns = id * t->res_ns;
+      found = 1;
+    }
+    result->end_ns = (id + 1) * t->res_ns;
+    result->energy_uj += t->energy_uj[k];
+    result->covered_ns += t->covered_ns[k];
+  }
+  if (!found) {
+    errno = ENODATA;
+    return -errno;
+  }
+  result->mean_w = (double) result->energy_uj * 1000.0 / (double) result->covered_ns;
+  return 0;
+}
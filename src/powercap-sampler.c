@@ -0,0 +1,852 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Background sampling into a lock-free single-producer/single-consumer ring buffer.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "powercap-common.h"
+#include "powercap-periodic.h"
+#include "powercap-rapl.h"
+#include "powercap-sampler.h"
+#include "powercap-snapshot.h"
+
+#define CACHE_LINE_SIZE 64
+/* Sample counts must fit in an int */
+#define MAX_CAPACITY ((uint32_t) 1 << 30)
+/* Adaptive sampling intervals, in sampler periods */
+#define MAX_INTERVAL ((uint32_t) 1 << 30)
+
+/* Adaptive sampling state, written only by the producer */
+typedef struct counter_state {
+  uint64_t next_tick;
+  uint64_t reads;
+  uint64_t skipped;
+  double power_w;
+  /* Sampler periods between reads */
+  uint32_t interval;
+  uint32_t stable;
+  int has_power;
+  /* Whether the counter's energy is attributed to the sampler's overhead */
+  int attributed;
+  /* Whether energy_uj in the counters snapshot is a baseline for attribution in this run */
+  int has_baseline;
+  /* Power and slope for predicates, derived from successful reads in this run */
+  uint64_t read_ns;
+  uint64_t level_ns;
+  double level_w;
+  double slope_w_s;
+  int has_level;
+  int has_slope;
+  /* Whether the counter was read successfully in the current sample */
+  int updated;
+} counter_state;
+
+/* A predicate and its state, written only by the producer */
+typedef struct predicate_state {
+  powercap_sampler_predicate pred;
+  uint64_t duration_ns;
+  /* When the condition started holding */
+  uint64_t since_ns;
+  int holding;
+  int active;
+} predicate_state;
+
+/* Single-producer/single-consumer event queue */
+typedef struct event_queue {
+  /* Written only by the producer */
+  uint64_t head;
+  /* Written only by the consumer */
+  uint64_t tail;
+  powercap_sampler_event* events;
+  uint32_t capacity;
+  int fd;
+} event_queue;
+
+/* Overhead counters, written only by the producer (except for the running time) */
+typedef struct overhead_state {
+  uint64_t cpu_ns;
+  uint64_t syscalls;
+  uint64_t bytes_read;
+  uint64_t wakeups;
+  uint64_t attributed_uj;
+  /* Running time of previous runs, and the start time of the current run (0 if not running) */
+  uint64_t run_ns;
+  uint64_t start_ns;
+} overhead_state;
+
+struct powercap_sampler {
+  /* Written only by the producer */
+  uint64_t head __attribute__((aligned(CACHE_LINE_SIZE)));
+  /* Written by the consumer, and by the producer when it drops the oldest sample */
+  uint64_t tail __attribute__((aligned(CACHE_LINE_SIZE)));
+  /* Statistics, written only by the producer */
+  powercap_sampler_stats stats __attribute__((aligned(CACHE_LINE_SIZE)));
+  overhead_state overhead;
+  /* Ring buffer, where counter c of slot i is at energy_uj[c * capacity + i] */
+  uint64_t* time_ns;
+  uint64_t* energy_uj;
+  uint32_t capacity;
+  uint32_t ncounters;
+  powercap_sampler_overflow overflow;
+  uint64_t period_ns;
+  /* Counter file descriptors, and the producer's last good value for each counter in energy_uj */
+  powercap_snapshot counters;
+  counter_state* state;
+  uint64_t tick;
+  /* An interval of 1 disables adaptive sampling */
+  uint32_t max_interval;
+  uint32_t stable_reads;
+  double change_threshold;
+  periodic timer;
+  long ncpus;
+  pthread_t thread;
+  int running;
+  /* Set when started with powercap_sampler_start_polled, in which case there is no sampler thread */
+  int polled;
+  /* Only set if created with powercap_sampler_create_rapl */
+  powercap_rapl_pkg* pkgs;
+  uint32_t npkgs;
+  predicate_state* predicates;
+  uint32_t npredicates;
+  event_queue events;
+};
+
+static void sampler_adapt(powercap_sampler* s, uint32_t c, uint64_t val, uint64_t now) {
+  counter_state* st = &s->state[c];
+  uint64_t last_ns = s->counters.time_ns[c];
+  uint64_t delta;
+  double power;
+  double change;
+  uint32_t interval = st->interval;
+  if (last_ns > 0 && now > last_ns) {
+    delta = val - s->counters.energy_uj[c] + (val < s->counters.energy_uj[c] ? s->counters.max_energy_range_uj[c] : 0);
+    // uJ/ns = 1000 W
+    power = (double) delta * 1000.0 / (double) (now - last_ns);
+    change = power > st->power_w ? power - st->power_w : st->power_w - power;
+    if (st->has_power && change > s->change_threshold * st->power_w) {
+      interval = 1;
+      st->stable = 0;
+    } else if (++st->stable >= s->stable_reads) {
+      interval = interval < s->max_interval / 2 ? interval * 2 : s->max_interval;
+      st->stable = 0;
+    }
+    st->power_w = power;
+    st->has_power = 1;
+  }
+  s->counters.time_ns[c] = now;
+  st->next_tick = s->tick + interval;
+  __atomic_store_n(&st->interval, interval, __ATOMIC_RELAXED);
+}
+
+static void sampler_update_level(counter_state* st, uint64_t delta, uint64_t now) {
+  double power;
+  if (st->has_baseline && now > st->read_ns) {
+    // uJ/ns = 1000 W
+    power = (double) delta * 1000.0 / (double) (now - st->read_ns);
+    if (st->has_level) {
+      st->slope_w_s = (power - st->level_w) * 1e9 / (double) (now - st->level_ns);
+      st->has_slope = 1;
+    }
+    st->level_w = power;
+    st->level_ns = now;
+    st->has_level = 1;
+    st->updated = 1;
+  }
+  st->read_ns = now;
+}
+
+static int sampler_push_event(powercap_sampler* s, uint32_t predicate, int active, double value, uint64_t now) {
+  event_queue* q = &s->events;
+  const uint64_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+  powercap_sampler_event* e;
+  if (q->head - tail >= q->capacity) {
+    __atomic_fetch_add(&s->stats.dropped_events, 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  e = &q->events[q->head & (q->capacity - 1)];
+  e->time_ns = now;
+  e->value = value;
+  e->predicate = predicate;
+  e->active = active;
+  __atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
+  __atomic_fetch_add(&s->stats.events, 1, __ATOMIC_RELAXED);
+  return 1;
+}
+
+/* Returns the number of events queued */
+static uint32_t sampler_evaluate(powercap_sampler* s, uint64_t now) {
+  predicate_state* ps;
+  const counter_state* st;
+  uint32_t queued = 0;
+  uint32_t i;
+  double value;
+  int above;
+  for (i = 0; i < s->npredicates; i++) {
+    ps = &s->predicates[i];
+    st = &s->state[ps->pred.counter];
+    if (!st->updated) {
+      continue;
+    }
+    switch (ps->pred.type) {
+    case POWERCAP_SAMPLER_PREDICATE_POWER_ABOVE:
+    case POWERCAP_SAMPLER_PREDICATE_POWER_BELOW:
+      value = st->level_w;
+      break;
+    case POWERCAP_SAMPLER_PREDICATE_SLOPE_ABOVE:
+    case POWERCAP_SAMPLER_PREDICATE_SLOPE_BELOW:
+    default:
+      if (!st->has_slope) {
+        continue;
+      }
+      value = st->slope_w_s;
+      break;
+    }
+    above = ps->pred.type == POWERCAP_SAMPLER_PREDICATE_POWER_ABOVE ||
+            ps->pred.type == POWERCAP_SAMPLER_PREDICATE_SLOPE_ABOVE;
+    if (!ps->holding) {
+      if (above ? value >= ps->pred.threshold : value <= ps->pred.threshold) {
+        ps->holding = 1;
+        ps->since_ns = now;
+      }
+    } else if (above ? value < ps->pred.threshold - ps->pred.hysteresis :
+                       value > ps->pred.threshold + ps->pred.hysteresis) {
+      ps->holding = 0;
+      if (ps->active) {
+        ps->active = 0;
+        queued += (uint32_t) sampler_push_event(s, i, 0, value, now);
+      }
+    }
+    if (ps->holding && !ps->active && now - ps->since_ns >= ps->duration_ns) {
+      ps->active = 1;
+      queued += (uint32_t) sampler_push_event(s, i, 1, value, now);
+    }
+  }
+  return queued;
+}
+
+static void sampler_sample(powercap_sampler* s) {
+  uint64_t head = __atomic_load_n(&s->head, __ATOMIC_RELAXED);
+  uint64_t tail = __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE);
+  uint64_t attributed_uj = 0;
+  uint64_t now;
+  uint64_t val;
+  uint64_t delta;
+  const uint64_t one = 1;
+  size_t bytes_read = 0;
+  size_t nread;
+  uint32_t reads = 0;
+  uint32_t slot;
+  uint32_t c;
+  if (head - tail >= s->capacity) {
+    if (s->overflow == POWERCAP_SAMPLER_OVERFLOW_DROP_NEWEST) {
+      __atomic_fetch_add(&s->stats.dropped, 1, __ATOMIC_RELAXED);
+      s->tick++;
+      return;
+    }
+    // claim the oldest slot before overwriting it, so a concurrent read of that slot fails and retries
+    // if the exchange fails, the consumer just freed space
+    if (__atomic_compare_exchange_n(&s->tail, &tail, tail + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      __atomic_fetch_add(&s->stats.dropped, 1, __ATOMIC_RELAXED);
+    }
+  }
+  slot = (uint32_t) (head & (s->capacity - 1));
+  now = get_time_ns();
+  for (c = 0; c < s->ncounters; c++) {
+    s->state[c].updated = 0;
+    if (s->counters.fds[c] <= 0) {
+      val = 0;
+    } else if (s->tick < s->state[c].next_tick) {
+      // not due yet
+      val = s->counters.energy_uj[c];
+      __atomic_store_n(&s->state[c].skipped, s->state[c].skipped + 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&s->stats.skipped, 1, __ATOMIC_RELAXED);
+    } else {
+      __atomic_store_n(&s->state[c].reads, s->state[c].reads + 1, __ATOMIC_RELAXED);
+      reads++;
+      if (read_u64_nread(s->counters.fds[c], &val, &nread)) {
+        val = s->counters.energy_uj[c];
+        __atomic_fetch_add(&s->stats.read_errors, 1, __ATOMIC_RELAXED);
+      } else {
+        delta = val - s->counters.energy_uj[c] +
+                (val < s->counters.energy_uj[c] ? s->counters.max_energy_range_uj[c] : 0);
+        if (s->state[c].attributed && s->state[c].has_baseline) {
+          attributed_uj += delta;
+        }
+        if (s->npredicates > 0) {
+          sampler_update_level(&s->state[c], delta, now);
+        }
+        s->state[c].has_baseline = 1;
+        if (s->max_interval > 1) {
+          sampler_adapt(s, c, val, now);
+        }
+      }
+      bytes_read += nread;
+    }
+    s->counters.energy_uj[c] = val;
+    __atomic_store_n(&s->energy_uj[(size_t) c * s->capacity + slot], val, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&s->time_ns[slot], now, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->head, head + 1, __ATOMIC_RELEASE);
+  __atomic_fetch_add(&s->stats.samples, 1, __ATOMIC_RELAXED);
+  // wake the event consumer once per sample, not per event
+  if (s->npredicates > 0 && sampler_evaluate(s, now) > 0) {
+    if (write(s->events.fd, &one, sizeof(one)) < 0) {
+      LOG(WARN, "powercap-sampler: Failed to signal event consumer: %s\n", strerror(errno));
+    }
+    __atomic_fetch_add(&s->overhead.syscalls, 1, __ATOMIC_RELAXED);
+  }
+  __atomic_fetch_add(&s->overhead.syscalls, reads, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&s->overhead.bytes_read, bytes_read, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&s->overhead.attributed_uj, attributed_uj, __ATOMIC_RELAXED);
+  s->tick++;
+}
+
+static uint64_t get_thread_cpu_ns(void) {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)) {
+    return 0;
+  }
+  return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+static void reset_state(powercap_sampler* s) {
+  counter_state* st;
+  uint32_t c;
+  for (c = 0; c < s->ncounters; c++) {
+    st = &s->state[c];
+    st->next_tick = s->tick;
+    st->reads = 0;
+    st->skipped = 0;
+    st->power_w = 0;
+    st->interval = 1;
+    st->stable = 0;
+    st->has_power = 0;
+    s->counters.time_ns[c] = 0;
+  }
+}
+
+/* Called when starting, so the time between runs isn't attributed */
+static void start_overhead(powercap_sampler* s) {
+  uint32_t c;
+  for (c = 0; c < s->ncounters; c++) {
+    s->state[c].has_baseline = 0;
+  }
+  __atomic_store_n(&s->overhead.start_ns, get_time_ns(), __ATOMIC_RELAXED);
+}
+
+/* Called when starting, so power isn't derived across runs */
+static void reset_predicates(powercap_sampler* s) {
+  uint32_t c;
+  uint32_t i;
+  for (c = 0; c < s->ncounters; c++) {
+    s->state[c].has_level = 0;
+    s->state[c].has_slope = 0;
+    s->state[c].updated = 0;
+  }
+  for (i = 0; i < s->npredicates; i++) {
+    s->predicates[i].holding = 0;
+    s->predicates[i].active = 0;
+  }
+}
+
+static void stop_overhead(powercap_sampler* s) {
+  const uint64_t start_ns = __atomic_load_n(&s->overhead.start_ns, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->overhead.run_ns, s->overhead.run_ns + get_time_ns() - start_ns, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->overhead.start_ns, 0, __ATOMIC_RELAXED);
+}
+
+static void* sampler_thread(void* arg) {
+  powercap_sampler* s = (powercap_sampler*) arg;
+  // a new thread's CPU time starts at 0
+  const uint64_t cpu_ns = s->overhead.cpu_ns;
+  // missed periods are skipped rather than sampled back-to-back
+  for (;;) {
+    sampler_sample(s);
+    // one for the CPU time, which (unlike the monotonic clock) isn't read without a system call
+    __atomic_store_n(&s->overhead.cpu_ns, cpu_ns + get_thread_cpu_ns(), __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->overhead.syscalls, 1, __ATOMIC_RELAXED);
+    if (periodic_wait(&s->timer, NULL)) {
+      break;
+    }
+    // poll and read
+    __atomic_fetch_add(&s->overhead.syscalls, 2, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->overhead.wakeups, 1, __ATOMIC_RELAXED);
+  }
+  return NULL;
+}
+
+static uint32_t round_up_pow2(uint32_t n) {
+  uint32_t p = 1;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+powercap_sampler* powercap_sampler_create(const powercap_snapshot* counters, const powercap_sampler_config* cfg) {
+  powercap_sampler* s;
+  size_t time_size;
+  char* buf;
+  uint32_t i;
+  int err;
+  if (counters == NULL || counters->count == 0 || cfg == NULL || cfg->period_us == 0 || cfg->capacity == 0 ||
+      cfg->capacity > MAX_CAPACITY || ((int) cfg->overflow != POWERCAP_SAMPLER_OVERFLOW_DROP_NEWEST &&
+                                       (int) cfg->overflow != POWERCAP_SAMPLER_OVERFLOW_DROP_OLDEST)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if ((err = posix_memalign((void**) &s, CACHE_LINE_SIZE, sizeof(powercap_sampler)))) {
+    errno = err;
+    return NULL;
+  }
+  memset(s, 0, sizeof(*s));
+  s->capacity = round_up_pow2(cfg->capacity);
+  s->ncounters = counters->count;
+  s->overflow = cfg->overflow;
+  s->period_ns = cfg->period_us * 1000;
+  s->max_interval = 1;
+  s->events.fd = -1;
+  time_size = s->capacity * sizeof(uint64_t);
+  if ((err = posix_memalign((void**) &buf, CACHE_LINE_SIZE, time_size * (1 + (size_t) s->ncounters)))) {
+    free(s);
+    errno = err;
+    return NULL;
+  }
+  memset(buf, 0, time_size * (1 + (size_t) s->ncounters));
+  s->time_ns = (uint64_t*) (void*) buf;
+  s->energy_uj = (uint64_t*) (void*) (buf + time_size);
+  if ((err = powercap_snapshot_init(&s->counters, counters->count))) {
+    free(buf);
+    free(s);
+    errno = -err;
+    return NULL;
+  }
+  memcpy(s->counters.fds, counters->fds, counters->count * sizeof(int));
+  memcpy(s->counters.max_energy_range_uj, counters->max_energy_range_uj, counters->count * sizeof(uint64_t));
+  if ((s->state = calloc(counters->count, sizeof(counter_state))) == NULL) {
+    err = errno;
+    powercap_snapshot_destroy(&s->counters);
+    free(buf);
+    free(s);
+    errno = err;
+    return NULL;
+  }
+  for (i = 0; i < s->ncounters; i++) {
+    s->state[i].attributed = 1;
+  }
+  reset_state(s);
+  if ((s->ncpus = sysconf(_SC_NPROCESSORS_ONLN)) < 1) {
+    s->ncpus = 1;
+  }
+  if ((err = periodic_init(&s->timer))) {
+    free(s->state);
+    powercap_snapshot_destroy(&s->counters);
+    free(buf);
+    free(s);
+    errno = -err;
+    return NULL;
+  }
+  return s;
+}
+
+powercap_sampler* powercap_sampler_create_rapl(const powercap_sampler_config* cfg, int read_only) {
+  powercap_sampler* s;
+  powercap_snapshot snap;
+  powercap_rapl_pkg* pkgs;
+  uint32_t npkgs;
+  uint32_t c;
+  uint32_t i;
+  uint32_t j;
+  int err;
+  if (powercap_rapl_init_all(&pkgs, &npkgs, read_only, 0)) {
+    return NULL;
+  }
+  if (powercap_rapl_snapshot_init(&snap, pkgs, npkgs)) {
+    err = errno;
+    powercap_rapl_destroy_all(pkgs, npkgs);
+    errno = err;
+    return NULL;
+  }
+  s = powercap_sampler_create(&snap, cfg);
+  err = errno;
+  powercap_snapshot_destroy(&snap);
+  if (s == NULL) {
+    powercap_rapl_destroy_all(pkgs, npkgs);
+    errno = err;
+    return NULL;
+  }
+  s->pkgs = pkgs;
+  s->npkgs = npkgs;
+  // counters are ordered like the domains, and only package zones are attributed to the overhead
+  for (i = 0, c = 0; i < npkgs; i++) {
+    for (j = 0; j < pkgs[i].ndomains; j++, c++) {
+      s->state[c].attributed = j == 0 && pkgs[i].domains[j].type == POWERCAP_RAPL_ZONE_PACKAGE;
+    }
+  }
+  return s;
+}
+
+int powercap_sampler_destroy(powercap_sampler* sampler) {
+  int ret = 0;
+  if (sampler == NULL) {
+    return 0;
+  }
+  if (sampler->running) {
+    ret = powercap_sampler_stop(sampler);
+  }
+  if (sampler->pkgs != NULL) {
+    ret |= powercap_rapl_destroy_all(sampler->pkgs, sampler->npkgs);
+  }
+  powercap_snapshot_destroy(&sampler->counters);
+  free(sampler->state);
+  free(sampler->predicates);
+  free(sampler->events.events);
+  if (sampler->events.fd >= 0) {
+    close(sampler->events.fd);
+  }
+  periodic_destroy(&sampler->timer);
+  // time_ns is the start of the ring buffer's allocated block
+  free(sampler->time_ns);
+  free(sampler);
+  return ret;
+}
+
+int powercap_sampler_set_adaptive(powercap_sampler* sampler, const powercap_sampler_adaptive* adaptive) {
+  uint64_t interval;
+  if (sampler == NULL || sampler->running ||
+      (adaptive != NULL && (adaptive->max_period_us < sampler->period_ns / 1000 || !(adaptive->change_threshold >= 0)))) {
+    errno = EINVAL;
+    return -errno;
+  }
+  sampler->max_interval = 1;
+  if (adaptive != NULL) {
+    interval = adaptive->max_period_us * 1000 / sampler->period_ns;
+    sampler->max_interval = interval > MAX_INTERVAL ? MAX_INTERVAL : (uint32_t) interval;
+    sampler->stable_reads = adaptive->stable_reads;
+    sampler->change_threshold = adaptive->change_threshold;
+  }
+  reset_state(sampler);
+  return 0;
+}
+
+int powercap_sampler_start(powercap_sampler* sampler) {
+  int ret;
+  if (sampler == NULL || sampler->running) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if ((ret = periodic_start(&sampler->timer, sampler->period_ns))) {
+    return ret;
+  }
+  start_overhead(sampler);
+  reset_predicates(sampler);
+  if ((ret = pthread_create(&sampler->thread, NULL, sampler_thread, sampler))) {
+    LOG(ERROR, "powercap-sampler: Failed to start sampler thread: %s\n", strerror(ret));
+    stop_overhead(sampler);
+    errno = ret;
+    return -errno;
+  }
+  sampler->running = 1;
+  return 0;
+}
+
+int powercap_sampler_start_polled(powercap_sampler* sampler) {
+  int ret;
+  if (sampler == NULL || sampler->running) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if ((ret = periodic_start(&sampler->timer, sampler->period_ns))) {
+    return ret;
+  }
+  start_overhead(sampler);
+  reset_predicates(sampler);
+  sampler->running = 1;
+  sampler->polled = 1;
+  return 0;
+}
+
+int powercap_sampler_stop(powercap_sampler* sampler) {
+  int ret;
+  if (sampler == NULL || !sampler->running) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if ((ret = periodic_stop(&sampler->timer))) {
+    return ret;
+  }
+  if (!sampler->polled) {
+    pthread_join(sampler->thread, NULL);
+  }
+  stop_overhead(sampler);
+  sampler->running = 0;
+  sampler->polled = 0;
+  return 0;
+}
+
+int powercap_sampler_get_fd(const powercap_sampler* sampler) {
+  if (sampler == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  return sampler->timer.timer_fd;
+}
+
+int powercap_sampler_service(powercap_sampler* sampler, uint64_t* time_ns, uint64_t* energy_uj, uint32_t max) {
+  uint64_t expirations;
+  uint64_t cpu_ns;
+  int ret;
+  if (sampler == NULL || !sampler->polled || time_ns == NULL || energy_uj == NULL || max == 0) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if ((ret = periodic_expirations(&sampler->timer, &expirations))) {
+    return ret;
+  }
+  __atomic_fetch_add(&sampler->overhead.syscalls, 1, __ATOMIC_RELAXED);
+  // like the sampler thread, missed periods are skipped rather than sampled back-to-back
+  if (expirations > 0) {
+    // only the sampling is charged, not the rest of the caller's thread
+    cpu_ns = get_thread_cpu_ns();
+    sampler_sample(sampler);
+    __atomic_fetch_add(&sampler->overhead.cpu_ns, get_thread_cpu_ns() - cpu_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&sampler->overhead.syscalls, 2, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&sampler->overhead.wakeups, 1, __ATOMIC_RELAXED);
+  }
+  return powercap_sampler_read(sampler, time_ns, energy_uj, max);
+}
+
+uint32_t powercap_sampler_get_num_counters(const powercap_sampler* sampler) {
+  return sampler == NULL ? 0 : sampler->ncounters;
+}
+
+const powercap_rapl_pkg* powercap_sampler_get_rapl_pkgs(const powercap_sampler* sampler, uint32_t* count) {
+  if (sampler == NULL || count == NULL || sampler->pkgs == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+  *count = sampler->npkgs;
+  return sampler->pkgs;
+}
+
+int powercap_sampler_read(powercap_sampler* sampler, uint64_t* time_ns, uint64_t* energy_uj, uint32_t max) {
+  uint64_t head;
+  uint64_t tail;
+  uint64_t n;
+  uint32_t slot;
+  uint32_t i;
+  uint32_t c;
+  if (sampler == NULL || time_ns == NULL || energy_uj == NULL || max == 0) {
+    errno = EINVAL;
+    return -errno;
+  }
+  tail = __atomic_load_n(&sampler->tail, __ATOMIC_ACQUIRE);
+  do {
+    head = __atomic_load_n(&sampler->head, __ATOMIC_ACQUIRE);
+    if ((n = head - tail) > max) {
+      n = max;
+    }
+    if (n == 0) {
+      return 0;
+    }
+    for (i = 0; i < n; i++) {
+      slot = (uint32_t) ((tail + i) & (sampler->capacity - 1));
+      time_ns[i] = __atomic_load_n(&sampler->time_ns[slot], __ATOMIC_RELAXED);
+      for (c = 0; c < sampler->ncounters; c++) {
+        energy_uj[(size_t) c * max + i] =
+          __atomic_load_n(&sampler->energy_uj[(size_t) c * sampler->capacity + slot], __ATOMIC_RELAXED);
+      }
+    }
+    if (sampler->overflow == POWERCAP_SAMPLER_OVERFLOW_DROP_NEWEST) {
+      __atomic_store_n(&sampler->tail, tail + n, __ATOMIC_RELEASE);
+      break;
+    }
+    // if the producer claimed the oldest slot while we were copying, the copy may be torn, so try again
+  } while (!__atomic_compare_exchange_n(&sampler->tail, &tail, tail + n, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+  return (int) n;
+}
+
+int powercap_sampler_get_stats(const powercap_sampler* sampler, powercap_sampler_stats* stats) {
+  if (sampler == NULL || stats == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  stats->samples = __atomic_load_n(&sampler->stats.samples, __ATOMIC_RELAXED);
+  stats->dropped = __atomic_load_n(&sampler->stats.dropped, __ATOMIC_RELAXED);
+  stats->read_errors = __atomic_load_n(&sampler->stats.read_errors, __ATOMIC_RELAXED);
+  stats->skipped = __atomic_load_n(&sampler->stats.skipped, __ATOMIC_RELAXED);
+  stats->events = __atomic_load_n(&sampler->stats.events, __ATOMIC_RELAXED);
+  stats->dropped_events = __atomic_load_n(&sampler->stats.dropped_events, __ATOMIC_RELAXED);
+  return 0;
+}
+
+int powercap_sampler_get_counter_stats(const powercap_sampler* sampler, uint32_t counter,
+                                       powercap_sampler_counter_stats* stats) {
+  const counter_state* st;
+  if (sampler == NULL || counter >= sampler->ncounters || stats == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  st = &sampler->state[counter];
+  stats->reads = __atomic_load_n(&st->reads, __ATOMIC_RELAXED);
+  stats->skipped = __atomic_load_n(&st->skipped, __ATOMIC_RELAXED);
+  stats->period_us = __atomic_load_n(&st->interval, __ATOMIC_RELAXED) * sampler->period_ns / 1000;
+  return 0;
+}
+
+int powercap_sampler_get_overhead(const powercap_sampler* sampler, powercap_sampler_overhead* overhead) {
+  const overhead_state* o;
+  uint64_t attributed_uj;
+  uint64_t start_ns;
+  double cpu_share;
+  if (sampler == NULL || overhead == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  o = &sampler->overhead;
+  overhead->elapsed_ns = __atomic_load_n(&o->run_ns, __ATOMIC_RELAXED);
+  if ((start_ns = __atomic_load_n(&o->start_ns, __ATOMIC_RELAXED)) > 0) {
+    overhead->elapsed_ns += get_time_ns() - start_ns;
+  }
+  overhead->cpu_ns = __atomic_load_n(&o->cpu_ns, __ATOMIC_RELAXED);
+  overhead->syscalls = __atomic_load_n(&o->syscalls, __ATOMIC_RELAXED);
+  overhead->bytes_read = __atomic_load_n(&o->bytes_read, __ATOMIC_RELAXED);
+  overhead->wakeups = __atomic_load_n(&o->wakeups, __ATOMIC_RELAXED);
+  overhead->wakeups_per_s = 0;
+  overhead->energy_uj = 0;
+  if (overhead->elapsed_ns > 0) {
+    overhead->wakeups_per_s = (double) overhead->wakeups * 1e9 / (double) overhead->elapsed_ns;
+    cpu_share = (double) overhead->cpu_ns / ((double) overhead->elapsed_ns * (double) sampler->ncpus);
+    attributed_uj = __atomic_load_n(&o->attributed_uj, __ATOMIC_RELAXED);
+    overhead->energy_uj = (double) attributed_uj * cpu_share;
+  }
+  return 0;
+}
+
+int powercap_sampler_set_predicates(powercap_sampler* sampler, const powercap_sampler_predicate* predicates,
+                                    uint32_t count, uint32_t event_capacity) {
+  predicate_state* ps = NULL;
+  powercap_sampler_event* events = NULL;
+  uint32_t capacity = 0;
+  uint32_t i;
+  int fd = -1;
+  int err;
+  if (sampler == NULL || sampler->running || (count > 0 && (predicates == NULL || event_capacity == 0 ||
+                                                            event_capacity > MAX_CAPACITY))) {
+    errno = EINVAL;
+    return -errno;
+  }
+  for (i = 0; i < count; i++) {
+    if (predicates[i].counter >= sampler->ncounters ||
+        ((int) predicates[i].type != POWERCAP_SAMPLER_PREDICATE_POWER_ABOVE &&
+         (int) predicates[i].type != POWERCAP_SAMPLER_PREDICATE_POWER_BELOW &&
+         (int) predicates[i].type != POWERCAP_SAMPLER_PREDICATE_SLOPE_ABOVE &&
+         (int) predicates[i].type != POWERCAP_SAMPLER_PREDICATE_SLOPE_BELOW) ||
+        isnan(predicates[i].threshold) || !(predicates[i].hysteresis >= 0)) {
+      errno = EINVAL;
+      return -errno;
+    }
+  }
+  if (count > 0) {
+    capacity = round_up_pow2(event_capacity);
+    if ((ps = calloc(count, sizeof(predicate_state))) == NULL ||
+        (events = calloc(capacity, sizeof(powercap_sampler_event))) == NULL ||
+        (fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+      err = errno;
+      free(ps);
+      free(events);
+      errno = err;
+      return -errno;
+    }
+    for (i = 0; i < count; i++) {
+      ps[i].pred = predicates[i];
+      ps[i].duration_ns = predicates[i].duration_us * 1000;
+    }
+  }
+  free(sampler->predicates);
+  free(sampler->events.events);
+  if (sampler->events.fd >= 0) {
+    close(sampler->events.fd);
+  }
+  sampler->predicates = ps;
+  sampler->npredicates = count;
+  sampler->events.events = events;
+  sampler->events.capacity = capacity;
+  sampler->events.head = 0;
+  sampler->events.tail = 0;
+  sampler->events.fd = fd;
+  return 0;
+}
+
+int powercap_sampler_get_event_fd(const powercap_sampler* sampler) {
+  if (sampler == NULL || sampler->events.fd < 0) {
+    errno = EINVAL;
+    return -errno;
+  }
+  return sampler->events.fd;
+}
+
+int powercap_sampler_read_events(powercap_sampler* sampler, powercap_sampler_event* events, uint32_t max) {
+  event_queue* q;
+  uint64_t counter;
+  uint64_t head;
+  uint64_t tail;
+  uint64_t n;
+  uint32_t i;
+  if (sampler == NULL || sampler->events.fd < 0 || events == NULL || max == 0) {
+    errno = EINVAL;
+    return -errno;
+  }
+  q = &sampler->events;
+  // clear readiness before draining, so events queued afterward make the descriptor readable again
+  if (read(q->fd, &counter, sizeof(counter)) < 0 && errno != EAGAIN) {
+    return -errno;
+  }
+  tail = q->tail;
+  head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+  if ((n = head - tail) > max) {
+    n = max;
+    // some events remain queued
+    counter = 1;
+    if (write(q->fd, &counter, sizeof(counter)) < 0) {
+      return -errno;
+    }
+  }
+  for (i = 0; i < n; i++) {
+    events[i] = q->events[(tail + i) & (q->capacity - 1)];
+  }
+  __atomic_store_n(&q->tail, tail + n, __ATOMIC_RELEASE);
+  return (int) n;
+}
+
+int powercap_sampler_dispatch_events(powercap_sampler* sampler, powercap_sampler_event_cb callback, void* arg) {
+  powercap_sampler_event events[16];
+  int total = 0;
+  int n;
+  int i;
+  if (callback == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  do {
+    if ((n = powercap_sampler_read_events(sampler, events, sizeof(events) / sizeof(events[0]))) < 0) {
+      return n;
+    }
+    for (i = 0; i < n; i++) {
+      callback(&events[i], arg);
+    }
+    total += n;
+  } while (n == (int) (sizeof(events) / sizeof(events[0])));
+  return total;
+}
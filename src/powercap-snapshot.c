@@ -0,0 +1,178 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Structure-of-arrays energy snapshots.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "powercap.h"
+#include "powercap-common.h"
+#include "powercap-snapshot.h"
+
+#define CACHE_LINE_SIZE 64
+
+/* Round an array's size up to a whole number of cache lines */
+static size_t array_size(size_t elem_size, uint32_t count) {
+  size_t size = elem_size * count;
+  return (size + CACHE_LINE_SIZE - 1) & ~((size_t) CACHE_LINE_SIZE - 1);
+}
+
+/*
+ * The kernels are kept free of calls and data-dependent branches so that compilers can vectorize them.
+ * Unsigned subtraction already gives the right result modulo 2^64, so a wrapped counter only needs its range added.
+ */
+static void delta_kernel(uint32_t n, const uint64_t* restrict e0, const uint64_t* restrict e1,
+                         const uint64_t* restrict range, uint64_t* restrict delta_uj) {
+  uint32_t i;
+  for (i = 0; i < n; i++) {
+    delta_uj[i] = e1[i] - e0[i] + (range[i] & -(uint64_t) (e1[i] < e0[i]));
+  }
+}
+
+/* Integer to floating point conversion is separate since not all vector instruction sets support it */
+static void power_kernel(uint32_t n, const uint64_t* restrict t0, const uint64_t* restrict t1,
+                         const uint64_t* restrict delta_uj, double* restrict power_w) {
+  uint64_t dt;
+  uint64_t valid;
+  uint32_t i;
+  for (i = 0; i < n; i++) {
+    dt = t1[i] - t0[i];
+    valid = dt > 0;
+    // uJ/ns = 1000 W; divide by 1 instead of 0 and scale the result by 0 so there's no branch
+    power_w[i] = ((double) (delta_uj[i] * valid) * 1000.0) / (double) (dt + (1 - valid));
+  }
+}
+
+int powercap_snapshot_init(powercap_snapshot* snap, uint32_t count) {
+  size_t fds_size;
+  size_t u64_size;
+  char* buf;
+  if (snap == NULL || count == 0) {
+    errno = EINVAL;
+    return -errno;
+  }
+  fds_size = array_size(sizeof(int), count);
+  u64_size = array_size(sizeof(uint64_t), count);
+  if ((errno = posix_memalign((void**) &buf, CACHE_LINE_SIZE, fds_size + 3 * u64_size))) {
+    return -errno;
+  }
+  memset(buf, 0, fds_size + 3 * u64_size);
+  snap->fds = (int*) (void*) buf;
+  snap->max_energy_range_uj = (uint64_t*) (void*) (buf + fds_size);
+  snap->energy_uj = (uint64_t*) (void*) (buf + fds_size + u64_size);
+  snap->time_ns = (uint64_t*) (void*) (buf + fds_size + 2 * u64_size);
+  snap->count = count;
+  return 0;
+}
+
+int powercap_snapshot_destroy(powercap_snapshot* snap) {
+  if (snap != NULL) {
+    // fds is the start of the allocated block
+    free(snap->fds);
+    memset(snap, 0, sizeof(*snap));
+  }
+  return 0;
+}
+
+int powercap_snapshot_set_zone(powercap_snapshot* snap, uint32_t idx, const powercap_zone* zone) {
+  uint64_t range = 0;
+  int ret;
+  if (snap == NULL || zone == NULL || idx >= snap->count) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (zone->energy_uj > 0 && zone->max_energy_range_uj > 0 && (ret = read_u64(zone->max_energy_range_uj, &range))) {
+    LOG(ERROR, "powercap-snapshot: Failed to read max_energy_range_uj for counter %"PRIu32"\n", idx);
+    return ret;
+  }
+  snap->fds[idx] = zone->energy_uj;
+  snap->max_energy_range_uj[idx] = range;
+  snap->energy_uj[idx] = 0;
+  snap->time_ns[idx] = 0;
+  return 0;
+}
+
+/* Read counters back-to-back, getting the first and last successful read times (unchanged if none succeed) */
+static int snapshot_read(powercap_snapshot* snap, uint64_t* first_ns, uint64_t* last_ns) {
+  uint64_t val;
+  uint32_t i;
+  int ret = 0;
+  int err;
+  int any = 0;
+  for (i = 0; i < snap->count; i++) {
+    if (snap->fds[i] <= 0) {
+      continue;
+    }
+    if ((err = read_u64(snap->fds[i], &val))) {
+      if (!ret) {
+        ret = err;
+      }
+      continue;
+    }
+    snap->energy_uj[i] = val;
+    snap->time_ns[i] = get_time_ns();
+    if (!any) {
+      *first_ns = snap->time_ns[i];
+      any = 1;
+    }
+    *last_ns = snap->time_ns[i];
+  }
+  if (ret) {
+    errno = -ret;
+  }
+  return ret;
+}
+
+int powercap_snapshot_read(powercap_snapshot* snap) {
+  uint64_t first_ns;
+  uint64_t last_ns;
+  if (snap == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  return snapshot_read(snap, &first_ns, &last_ns);
+}
+
+int powercap_snapshot_read_group(powercap_snapshot* snap, powercap_snapshot_group* group) {
+  uint64_t first_ns = 0;
+  uint64_t last_ns = 0;
+  int ret;
+  if (snap == NULL || group == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  group->begin_ns = get_time_ns();
+  ret = snapshot_read(snap, &first_ns, &last_ns);
+  group->end_ns = get_time_ns();
+  group->skew_ns = last_ns - first_ns;
+  return ret;
+}
+
+int powercap_snapshot_get_offsets(const powercap_snapshot* snap, const powercap_snapshot_group* group,
+                                  uint64_t* offset_ns) {
+  uint32_t i;
+  if (snap == NULL || group == NULL || offset_ns == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  for (i = 0; i < snap->count; i++) {
+    offset_ns[i] = snap->time_ns[i] >= group->begin_ns ? snap->time_ns[i] - group->begin_ns : 0;
+  }
+  return 0;
+}
+
+int powercap_snapshot_delta(const powercap_snapshot* prev, const powercap_snapshot* cur, uint64_t* delta_uj,
+                            double* power_w) {
+  if (prev == NULL || cur == NULL || delta_uj == NULL || power_w == NULL || prev->count != cur->count) {
+    errno = EINVAL;
+    return -errno;
+  }
+  delta_kernel(cur->count, prev->energy_uj, cur->energy_uj, cur->max_energy_range_uj, delta_uj);
+  power_kernel(cur->count, prev->time_ns, cur->time_ns, delta_uj, power_w);
+  return 0;
+}
@@ -0,0 +1,255 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Power limit step response measurement.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "powercap.h"
+#include "powercap-common.h"
+#include "powercap-periodic.h"
+#include "powercap-power-stream.h"
+#include "powercap-step.h"
+
+static int check_config(const powercap_step_config* cfg) {
+  // comparisons with NaN are false, so NaN is rejected
+  return cfg->settle_band >= 0 && cfg->min_step_w >= 0 ? 0 : -EINVAL;
+}
+
+static uint64_t since(uint64_t time_ns, uint64_t start_ns) {
+  return time_ns > start_ns ? time_ns - start_ns : 0;
+}
+
+/* Get the index of the first sample in the last "window_ns" of samples */
+static uint32_t window_start(const uint64_t* time_ns, uint32_t n, uint64_t window_ns) {
+  uint32_t i = n - 1;
+  while (i > 0 && time_ns[n - 1] - time_ns[i - 1] <= window_ns) {
+    i--;
+  }
+  return i;
+}
+
+static double window_mean(const double* power_w, uint32_t first, uint32_t n) {
+  double sum = 0;
+  uint32_t i;
+  for (i = first; i < n; i++) {
+    sum += power_w[i];
+  }
+  return sum / (double) (n - first);
+}
+
+static double settle_band_w(const powercap_step_config* cfg, double delta_w) {
+  return cfg->settle_band * fmax(fabs(delta_w), cfg->min_step_w);
+}
+
+int powercap_step_analyze(const powercap_step_config* cfg, uint64_t step_ns, const uint64_t* time_ns,
+                          const double* power_w, uint32_t n, powercap_step_result* result) {
+  const uint64_t settle_ns = cfg == NULL ? 0 : cfg->settle_us * 1000;
+  double delta_w;
+  double band_w;
+  double progress;
+  uint64_t dead_ns = 0;
+  uint32_t settled_at;
+  uint32_t i;
+  int dead = 0;
+  int risen = 0;
+  if (cfg == NULL || time_ns == NULL || power_w == NULL || n == 0 || result == NULL || check_config(cfg)) {
+    errno = EINVAL;
+    return -errno;
+  }
+  result->samples = n;
+  result->final_w = window_mean(power_w, window_start(time_ns, n, settle_ns), n);
+  delta_w = result->final_w - result->initial_w;
+  result->responded = fabs(delta_w) > 0 && fabs(delta_w) >= cfg->min_step_w;
+  result->dead_time_ns = 0;
+  result->rise_time_ns = 0;
+  result->overshoot_w = 0;
+  result->overshoot = 0;
+  if (result->responded) {
+    for (i = 0; i < n; i++) {
+      progress = (power_w[i] - result->initial_w) / delta_w;
+      if (!dead && progress >= 0.1) {
+        dead = 1;
+        dead_ns = time_ns[i];
+        result->dead_time_ns = since(time_ns[i], step_ns);
+      }
+      if (!risen && progress >= 0.9) {
+        risen = 1;
+        result->rise_time_ns = since(time_ns[i], dead_ns);
+      }
+      // an excursion past the final power in the direction of the step
+      result->overshoot_w = fmax(result->overshoot_w, (progress - 1.0) * fabs(delta_w));
+    }
+    result->overshoot = result->overshoot_w / fabs(delta_w);
+  }
+  // settled at the first sample after the last one outside the band (or the step), if it stayed there long enough
+  band_w = settle_band_w(cfg, delta_w);
+  for (settled_at = n; settled_at > 0 && fabs(power_w[settled_at - 1] - result->final_w) <= band_w; settled_at--);
+  result->settled = settled_at < n &&
+                    since(time_ns[n - 1], settled_at > 0 ? time_ns[settled_at - 1] : step_ns) >= settle_ns;
+  result->settling_time_ns = result->settled ? since(time_ns[settled_at], step_ns) : 0;
+  return 0;
+}
+
+/* Whether power has moved at least "min_step_w" and stayed within the band over the last "settle_us" */
+static int is_settled(const powercap_step_config* cfg, double initial_w, uint64_t step_ns, const uint64_t* time_ns,
+                      const double* power_w, uint32_t n) {
+  const uint64_t settle_ns = cfg->settle_us * 1000;
+  double mean_w;
+  double band_w;
+  uint32_t first;
+  uint32_t i;
+  if (n == 0 || since(time_ns[n - 1], step_ns) < settle_ns) {
+    return 0;
+  }
+  first = window_start(time_ns, n, settle_ns);
+  mean_w = window_mean(power_w, first, n);
+  if (fabs(mean_w - initial_w) < cfg->min_step_w || !(fabs(mean_w - initial_w) > 0)) {
+    return 0;
+  }
+  band_w = settle_band_w(cfg, mean_w - initial_w);
+  for (i = first; i < n; i++) {
+    if (fabs(power_w[i] - mean_w) > band_w) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* Wait for the next period, then sample the zone's energy and power - returns 1 if there isn't a power estimate yet */
+static int sample(periodic* p, const powercap_zone* zone, powercap_power_stream* stream, uint64_t* energy_uj,
+                  uint64_t* time_ns, double* power_w) {
+  int ret;
+  if ((ret = periodic_wait(p, NULL)) != 0) {
+    // never stopped, so a return of 1 isn't expected
+    return ret < 0 ? ret : -EINTR;
+  }
+  if ((ret = powercap_zone_get_energy_uj(zone, energy_uj))) {
+    return ret;
+  }
+  *time_ns = get_time_ns();
+  return powercap_power_stream_update(stream, *energy_uj, *time_ns, power_w);
+}
+
+static int measure(const powercap_zone* zone, const powercap_constraint* constraint, const powercap_step_config* cfg,
+                   powercap_step_result* result, powercap_power_stream* stream, periodic* p, uint64_t* time_ns,
+                   double* power_w, uint32_t capacity, uint64_t* step_ns, uint32_t* n) {
+  const uint64_t baseline_ns = cfg->baseline_us * 1000;
+  const uint64_t timeout_ns = cfg->timeout_us * 1000;
+  // the average over the whole baseline is just its first and last samples, without a filter
+  const powercap_power_stream_config raw_cfg = { POWERCAP_POWER_FILTER_RAW, 0, 0, 0 };
+  powercap_power_stream baseline;
+  uint64_t start_ns = 0;
+  uint64_t now_ns;
+  uint64_t energy_uj;
+  double now_w;
+  int ret;
+  int write_ret;
+
+  // baseline - until there's a power estimate, even if the baseline time is 0
+  powercap_power_stream_init(&baseline, &raw_cfg, stream->max_energy_range_uj);
+  if ((ret = sample(p, zone, stream, &energy_uj, &start_ns, &now_w)) < 0) {
+    return ret;
+  }
+  powercap_power_stream_update(&baseline, energy_uj, start_ns, NULL);
+  do {
+    if ((ret = sample(p, zone, stream, &energy_uj, &now_ns, &now_w)) < 0) {
+      return ret;
+    }
+  } while (ret > 0 || now_ns - start_ns < baseline_ns);
+  powercap_power_stream_update(&baseline, energy_uj, now_ns, &result->initial_w);
+
+  // step
+  *step_ns = get_time_ns();
+  write_ret = powercap_constraint_set_power_limit_uw(constraint, cfg->power_limit_uw);
+  result->write_ns = get_time_ns() - *step_ns;
+  if (write_ret) {
+    return write_ret;
+  }
+
+  // response
+  do {
+    if ((ret = sample(p, zone, stream, &energy_uj, &now_ns, &now_w)) < 0) {
+      return ret;
+    }
+    if (ret == 0) {
+      time_ns[*n] = now_ns;
+      power_w[*n] = now_w;
+      (*n)++;
+    }
+  } while (*n < capacity && now_ns - *step_ns < timeout_ns &&
+           !is_settled(cfg, result->initial_w, *step_ns, time_ns, power_w, *n));
+  return 0;
+}
+
+int powercap_step_response(const powercap_zone* zone, const powercap_constraint* constraint,
+                           const powercap_step_config* cfg, powercap_step_result* result) {
+  powercap_power_stream stream;
+  periodic p;
+  uint64_t original_uw;
+  uint64_t capacity;
+  uint64_t step_ns = 0;
+  uint64_t* time_ns;
+  double* power_w;
+  uint32_t n = 0;
+  int ret;
+  int restore_ret;
+  if (zone == NULL || constraint == NULL || cfg == NULL || result == NULL || constraint->power_limit_uw <= 0 ||
+      cfg->period_us == 0 || cfg->timeout_us == 0 || cfg->settle_us > cfg->timeout_us || check_config(cfg)) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if ((ret = powercap_power_stream_init_zone(&stream, &cfg->filter, zone))) {
+    return ret;
+  }
+  // one sample per period, plus a missed period at either end
+  capacity = cfg->timeout_us / cfg->period_us + 2;
+  if (capacity > UINT32_MAX) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if ((time_ns = malloc(capacity * (sizeof(*time_ns) + sizeof(*power_w)))) == NULL) {
+    return -errno;
+  }
+  power_w = (double*) (time_ns + capacity);
+  memset(result, 0, sizeof(*result));
+  if ((ret = powercap_constraint_get_power_limit_uw(constraint, &original_uw))) {
+    free(time_ns);
+    return ret;
+  }
+  result->original_limit_uw = original_uw;
+  if ((ret = periodic_init(&p))) {
+    free(time_ns);
+    return ret;
+  }
+  if (!(ret = periodic_start(&p, cfg->period_us * 1000))) {
+    ret = measure(zone, constraint, cfg, result, &stream, &p, time_ns, power_w, (uint32_t) capacity, &step_ns, &n);
+  }
+  periodic_destroy(&p);
+  // always restore, even if the step write failed part way
+  if ((restore_ret = powercap_constraint_set_power_limit_uw(constraint, original_uw))) {
+    LOG(ERROR, "powercap-step: Failed to restore power limit to %"PRIu64" uW\n", original_uw);
+    if (!ret) {
+      ret = restore_ret;
+    }
+  }
+  if (!ret) {
+    if (n == 0) {
+      errno = ENODATA;
+      ret = -errno;
+    } else {
+      ret = powercap_step_analyze(cfg, step_ns, time_ns, power_w, n, result);
+    }
+  }
+  free(time_ns);
+  if (ret) {
+    errno = -ret;
+  }
+  return ret;
+}
@@ -0,0 +1,283 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Streaming summary statistics.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include "powercap-power-stream.h"
+#include "powercap-summary.h"
+
+#define NUM_BUCKETS POWERCAP_SUMMARY_NUM_BUCKETS
+
+int powercap_summary_init(powercap_summary* summary, double relative_accuracy) {
+  if (summary == NULL || !(relative_accuracy > 0 && relative_accuracy < 1)) {
+    errno = EINVAL;
+    return -errno;
+  }
+  memset(summary, 0, sizeof(*summary));
+  summary->relative_accuracy = relative_accuracy;
+  // gamma = (1 + a) / (1 - a): every value in bucket k, (gamma^(k-1), gamma^k], is within a of the bucket's estimate
+  summary->log_gamma = log1p(2 * relative_accuracy / (1 - relative_accuracy));
+  return 0;
+}
+
+int powercap_summary_reset(powercap_summary* summary) {
+  if (summary == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  return powercap_summary_init(summary, summary->relative_accuracy);
+}
+
+/* Add "n" values to the bucket for "key", collapsing the lowest buckets if needed to make room */
+static void insert_key(powercap_summary* s, int32_t key, uint64_t n) {
+  uint64_t low = 0;
+  uint32_t shift;
+  uint32_t i;
+  if (s->count == s->zero_count) {
+    // first bucketed value - center the buckets on it
+    s->offset = key - NUM_BUCKETS / 2;
+  }
+  if (key < s->offset) {
+    s->buckets[0] += n;
+    return;
+  }
+  if ((int64_t) key - s->offset >= NUM_BUCKETS) {
+    shift = (uint32_t) ((int64_t) key - s->offset - (NUM_BUCKETS - 1));
+    if (shift > NUM_BUCKETS) {
+      shift = NUM_BUCKETS;
+    }
+    for (i = 0; i < shift; i++) {
+      low += s->buckets[i];
+    }
+    memmove(s->buckets, s->buckets + shift, (NUM_BUCKETS - shift) * sizeof(uint64_t));
+    memset(s->buckets + NUM_BUCKETS - shift, 0, shift * sizeof(uint64_t));
+    s->buckets[0] += low;
+    s->offset = key - (NUM_BUCKETS - 1);
+  }
+  s->buckets[key - s->offset] += n;
+}
+
+static int32_t value_key(const powercap_summary* s, double value) {
+  double key = ceil(log(value) / s->log_gamma);
+  return (int32_t) key;
+}
+
+int powercap_summary_add(powercap_summary* summary, double value) {
+  double delta;
+  if (summary == NULL || !isfinite(value)) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (value > 0) {
+    insert_key(summary, value_key(summary, value), 1);
+  } else {
+    summary->zero_count++;
+  }
+  if (summary->count == 0 || value < summary->min) {
+    summary->min = value;
+  }
+  if (summary->count == 0 || value > summary->max) {
+    summary->max = value;
+  }
+  summary->count++;
+  delta = value - summary->mean;
+  summary->mean += delta / (double) summary->count;
+  summary->m2 += delta * (value - summary->mean);
+  return 0;
+}
+
+int powercap_summary_merge(powercap_summary* dst, const powercap_summary* src) {
+  uint64_t dst_count;
+  double delta;
+  double n;
+  uint32_t i;
+  if (dst == NULL || src == NULL || dst->log_gamma < src->log_gamma || dst->log_gamma > src->log_gamma) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (src->count == 0) {
+    return 0;
+  }
+  dst_count = dst->count;
+  // insert the highest buckets first, so that collapsing (if any) happens at most once
+  for (i = NUM_BUCKETS; i > 0; i--) {
+    if (src->buckets[i - 1] > 0) {
+      insert_key(dst, src->offset + (int32_t) i - 1, src->buckets[i - 1]);
+      // keeps insert_key from re-centering on the next bucket
+      dst->count += src->buckets[i - 1];
+    }
+  }
+  dst->zero_count += src->zero_count;
+  dst->count = dst_count + src->count;
+  if (dst_count == 0) {
+    dst->min = src->min;
+    dst->max = src->max;
+    dst->mean = src->mean;
+    dst->m2 = src->m2;
+    return 0;
+  }
+  if (src->min < dst->min) {
+    dst->min = src->min;
+  }
+  if (src->max > dst->max) {
+    dst->max = src->max;
+  }
+  // Chan et al.'s parallel variance
+  n = (double) dst->count;
+  delta = src->mean - dst->mean;
+  dst->mean += delta * (double) src->count / n;
+  dst->m2 += src->m2 + delta * delta * (double) dst_count * (double) src->count / n;
+  return 0;
+}
+
+uint64_t powercap_summary_get_count(const powercap_summary* summary) {
+  return summary == NULL ? 0 : summary->count;
+}
+
+double powercap_summary_get_min(const powercap_summary* summary) {
+  return summary == NULL ? 0 : summary->min;
+}
+
+double powercap_summary_get_max(const powercap_summary* summary) {
+  return summary == NULL ? 0 : summary->max;
+}
+
+double powercap_summary_get_mean(const powercap_summary* summary) {
+  return summary == NULL ? 0 : summary->mean;
+}
+
+double powercap_summary_get_variance(const powercap_summary* summary) {
+  return (summary == NULL || summary->count == 0) ? 0 : summary->m2 / (double) summary->count;
+}
+
+int powercap_summary_get_quantile(const powercap_summary* summary, double q, double* value) {
+  double rank;
+  double v;
+  uint64_t seen;
+  uint32_t i;
+  if (summary == NULL || value == NULL || summary->count == 0 || !(q >= 0 && q <= 1)) {
+    errno = EINVAL;
+    return -errno;
+  }
+  rank = q * (double) (summary->count - 1);
+  seen = summary->zero_count;
+  if ((double) seen > rank) {
+    *value = summary->min < 0 ? summary->min : 0;
+    return 0;
+  }
+  for (i = 0; i < NUM_BUCKETS - 1; i++) {
+    seen += summary->buckets[i];
+    if ((double) seen > rank) {
+      break;
+    }
+  }
+  // the bucket's midpoint (relative to its bounds), 2 * gamma^k / (gamma + 1)
+  v = 2 * exp((double) (summary->offset + (int32_t) i) * summary->log_gamma) / (exp(summary->log_gamma) + 1);
+  *value = v < summary->min ? summary->min : (v > summary->max ? summary->max : v);
+  return 0;
+}
+
+int powercap_summary_add_samples(powercap_summary* summaries, powercap_power_stream* streams, uint32_t ncounters,
+                                 const uint64_t* time_ns, const uint64_t* energy_uj, uint32_t n, uint32_t stride) {
+  double power;
+  uint32_t c;
+  uint32_t i;
+  int ret;
+  if (summaries == NULL || streams == NULL || time_ns == NULL || energy_uj == NULL || stride < n) {
+    errno = EINVAL;
+    return -errno;
+  }
+  for (c = 0; c < ncounters; c++) {
+    for (i = 0; i < n; i++) {
+      // a repeated timestamp doesn't produce a new measurement
+      if (streams[c].state > 0 && time_ns[i] == streams[c].last_ns) {
+        continue;
+      }
+      if ((ret = powercap_power_stream_update(&streams[c], energy_uj[(size_t) c * stride + i], time_ns[i],
+                                              &power)) < 0) {
+        return ret;
+      }
+      if (ret == 0 && (ret = powercap_summary_add(&summaries[c], power))) {
+        return ret;
+      }
+    }
+  }
+  return 0;
+}
+
+int powercap_summary_window_init(powercap_summary_window* window, powercap_summary* intervals, uint32_t nintervals,
+                                 uint64_t interval_ns, double relative_accuracy) {
+  uint32_t i;
+  int ret;
+  if (window == NULL || intervals == NULL || nintervals == 0 || interval_ns == 0) {
+    errno = EINVAL;
+    return -errno;
+  }
+  for (i = 0; i < nintervals; i++) {
+    if ((ret = powercap_summary_init(&intervals[i], relative_accuracy))) {
+      return ret;
+    }
+  }
+  window->intervals = intervals;
+  window->nintervals = nintervals;
+  window->current = 0;
+  window->interval_ns = interval_ns;
+  window->start_ns = 0;
+  window->started = 0;
+  return 0;
+}
+
+/* Get the number of intervals that have started since the current one */
+static uint64_t intervals_since(const powercap_summary_window* w, uint64_t time_ns) {
+  return (!w->started || time_ns <= w->start_ns) ? 0 : (time_ns - w->start_ns) / w->interval_ns;
+}
+
+int powercap_summary_window_add(powercap_summary_window* window, uint64_t time_ns, double value) {
+  uint64_t elapsed;
+  uint32_t i;
+  if (window == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  if (!window->started) {
+    window->started = 1;
+    window->start_ns = time_ns;
+  }
+  elapsed = intervals_since(window, time_ns);
+  if (elapsed > 0) {
+    // reset the intervals that are reused, at most all of them
+    for (i = 0; i < elapsed && i < window->nintervals; i++) {
+      window->current = (window->current + 1) % window->nintervals;
+      powercap_summary_reset(&window->intervals[window->current]);
+    }
+    window->start_ns += elapsed * window->interval_ns;
+  }
+  return powercap_summary_add(&window->intervals[window->current], value);
+}
+
+int powercap_summary_window_get(const powercap_summary_window* window, uint64_t now_ns, powercap_summary* summary) {
+  uint64_t elapsed;
+  uint32_t age;
+  uint32_t i;
+  int ret;
+  if (window == NULL || summary == NULL ||
+      powercap_summary_init(summary, window->intervals[0].relative_accuracy)) {
+    errno = EINVAL;
+    return -errno;
+  }
+  elapsed = intervals_since(window, now_ns);
+  for (i = 0; i < window->nintervals; i++) {
+    // the number of intervals before the current one, which is 0 for the current interval
+    age = (window->current + window->nintervals - i) % window->nintervals;
+    if (age + elapsed < window->nintervals && (ret = powercap_summary_merge(summary, &window->intervals[i]))) {
+      return ret;
+    }
+  }
+  return 0;
+}
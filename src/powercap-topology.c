@@ -0,0 +1,237 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * CPU topology discovery for RAPL instances.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "powercap-common.h"
+#include "powercap-rapl.h"
+#include "powercap-rapl-topology.h"
+#include "powercap-topology.h"
+
+#define CPU_DIR "devices/system/cpu"
+
+typedef struct cpu_info {
+  /* -1 if the CPU is offline or doesn't exist */
+  int32_t pkg;
+  int32_t die;
+  int32_t node;
+} cpu_info;
+
+/* CPU topology is cached for all instances */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static char cache_root[PATH_MAX] = SYSFS_PATH;
+static cpu_info* cache_cpus;
+static uint32_t cache_ncpus;
+
+int topology_parse_rapl_name(const char* name, int32_t* pkg, int32_t* die) {
+  int32_t p;
+  int32_t d = -1;
+  int n = 0;
+  if (name == NULL || pkg == NULL || die == NULL) {
+    errno = EINVAL;
+    return -errno;
+  }
+  // %n is only set if the complete pattern matches
+  if (sscanf(name, "package-%"SCNd32"-die-%"SCNd32"%n", &p, &d, &n) != 2 || name[n] != '\0') {
+    n = 0;
+    d = -1;
+    if (sscanf(name, "package-%"SCNd32"%n", &p, &n) != 1 || name[n] != '\0') {
+      errno = EINVAL;
+      return -errno;
+    }
+  }
+  if (p < 0 || (d < -1)) {
+    errno = EINVAL;
+    return -errno;
+  }
+  *pkg = p;
+  *die = d;
+  return 0;
+}
+
+/* Return 0 on success, negative error code on failure */
+static int read_cpu_topology_id(const char* root, unsigned long cpu, const char* file, int32_t* val) {
+  char path[PATH_MAX];
+  uint64_t v;
+  int fd;
+  int ret;
+  if (snprintf(path, sizeof(path), "%s/"CPU_DIR"/cpu%lu/topology/%s", root, cpu, file) >= (int) sizeof(path)) {
+    errno = ENAMETOOLONG;
+    return -errno;
+  }
+  if ((fd = open(path, O_RDONLY)) < 0) {
+    return -errno;
+  }
+  // ids are never negative, except for some die_id values on hardware that doesn't support them
+  if ((ret = read_u64(fd, &v)) == 0) {
+    *val = (int32_t) v;
+  }
+  close(fd);
+  return ret;
+}
+
+/* Return the NUMA node from a "nodeN" entry in the CPU's directory, or -1 if there isn't one */
+static int32_t read_cpu_node(const char* root, unsigned long cpu) {
+  char path[PATH_MAX];
+  struct dirent* entry;
+  DIR* dir;
+  int32_t node = -1;
+  int n;
+  if (snprintf(path, sizeof(path), "%s/"CPU_DIR"/cpu%lu", root, cpu) >= (int) sizeof(path) ||
+      (dir = opendir(path)) == NULL) {
+    return -1;
+  }
+  while ((entry = readdir(dir)) != NULL) {
+    n = 0;
+    if (sscanf(entry->d_name, "node%"SCNd32"%n", &node, &n) == 1 && entry->d_name[n] == '\0') {
+      break;
+    }
+    node = -1;
+  }
+  closedir(dir);
+  return node;
+}
+
+/* Must hold cache_lock. Return 0 on success, negative error code on failure */
+static int cache_load(void) {
+  char path[PATH_MAX];
+  struct dirent* entry;
+  DIR* dir;
+  char* end;
+  cpu_info* cpus;
+  cpu_info* tmp;
+  unsigned long cpu;
+  uint32_t ncpus = 0;
+  uint32_t i;
+  int32_t p = 0;
+  int32_t d = 0;
+  if (snprintf(path, sizeof(path), "%s/"CPU_DIR, cache_root) >= (int) sizeof(path)) {
+    errno = ENAMETOOLONG;
+    return -errno;
+  }
+  if ((cpus = calloc(POWERCAP_RAPL_MAX_CPUS, sizeof(cpu_info))) == NULL) {
+    return -errno;
+  }
+  for (i = 0; i < POWERCAP_RAPL_MAX_CPUS; i++) {
+    cpus[i].pkg = -1;
+  }
+  if ((dir = opendir(path)) == NULL) {
+    LOG(ERROR, "powercap-topology: opendir: %s: %s\n", path, strerror(errno));
+    free(cpus);
+    return -errno;
+  }
+  while ((entry = readdir(dir)) != NULL) {
+    if (strncmp(entry->d_name, "cpu", 3) || entry->d_name[3] < '0' || entry->d_name[3] > '9') {
+      continue;
+    }
+    errno = 0;
+    cpu = strtoul(entry->d_name + 3, &end, 10);
+    if (*end != '\0' || errno || cpu >= POWERCAP_RAPL_MAX_CPUS) {
+      continue;
+    }
+    // offline CPUs don't have topology information
+    if (read_cpu_topology_id(cache_root, cpu, "physical_package_id", &p)) {
+      continue;
+    }
+    // kernels without die support have a single die per package
+    if (read_cpu_topology_id(cache_root, cpu, "die_id", &d)) {
+      d = 0;
+    }
+    cpus[cpu].pkg = p;
+    cpus[cpu].die = d;
+    cpus[cpu].node = read_cpu_node(cache_root, cpu);
+    if (cpu >= ncpus) {
+      ncpus = (uint32_t) cpu + 1;
+    }
+  }
+  closedir(dir);
+  // shrink to the highest CPU found
+  if (ncpus > 0 && (tmp = realloc(cpus, ncpus * sizeof(cpu_info))) != NULL) {
+    cpus = tmp;
+  }
+  free(cache_cpus);
+  cache_cpus = cpus;
+  cache_ncpus = ncpus;
+  return 0;
+}
+
+int powercap_rapl_topology_set_root(const char* root) {
+  if (root == NULL) {
+    root = SYSFS_PATH;
+  }
+  if (strlen(root) >= sizeof(cache_root)) {
+    errno = ENAMETOOLONG;
+    return -errno;
+  }
+  pthread_mutex_lock(&cache_lock);
+  snprintf(cache_root, sizeof(cache_root), "%s", root);
+  free(cache_cpus);
+  cache_cpus = NULL;
+  cache_ncpus = 0;
+  pthread_mutex_unlock(&cache_lock);
+  return 0;
+}
+
+int powercap_rapl_get_topology(const powercap_rapl_pkg* pkg, powercap_rapl_topology* topo) {
+  int32_t p;
+  int32_t d;
+  uint32_t i;
+  int ret = 0;
+  if (pkg == NULL || topo == NULL || pkg->ndomains == 0 || topology_parse_rapl_name(pkg->domains[0].name, &p, &d)) {
+    errno = EINVAL;
+    return -errno;
+  }
+  memset(topo, 0, sizeof(*topo));
+  topo->package_id = p;
+  topo->die_id = d;
+  topo->numa_node = -1;
+  pthread_mutex_lock(&cache_lock);
+  if (cache_cpus == NULL && (ret = cache_load())) {
+    pthread_mutex_unlock(&cache_lock);
+    errno = -ret;
+    return ret;
+  }
+  for (i = 0; i < cache_ncpus; i++) {
+    if (cache_cpus[i].pkg != p || (d >= 0 && cache_cpus[i].die != d)) {
+      continue;
+    }
+    topo->cpumask[i / 64] |= (uint64_t) 1 << (i % 64);
+    // a node of -2 records that the instance spans multiple nodes
+    if (topo->ncpus == 0) {
+      topo->numa_node = cache_cpus[i].node;
+    } else if (topo->numa_node != cache_cpus[i].node) {
+      topo->numa_node = -2;
+    }
+    topo->ncpus++;
+  }
+  pthread_mutex_unlock(&cache_lock);
+  if (topo->numa_node < 0) {
+    topo->numa_node = -1;
+  }
+  if (topo->ncpus == 0) {
+    errno = ENOENT;
+    return -errno;
+  }
+  return 0;
+}
+
+int powercap_rapl_topology_has_cpu(const powercap_rapl_topology* topo, uint32_t cpu) {
+  if (topo == NULL || cpu >= POWERCAP_RAPL_MAX_CPUS) {
+    errno = EINVAL;
+    return -errno;
+  }
+  return (topo->cpumask[cpu / 64] >> (cpu % 64)) & 1 ? 1 : 0;
+}
@@ -0,0 +1,37 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * CPU topology discovery for RAPL instances.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#ifndef _POWERCAP_TOPOLOGY_H_
+#define _POWERCAP_TOPOLOGY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#pragma GCC visibility push(hidden)
+
+#ifndef SYSFS_PATH
+  #define SYSFS_PATH "/sys"
+#endif
+
+/*
+ * Parse a top-level RAPL zone name like "package-0" or "package-0-die-1".
+ * The die is set to -1 if the name doesn't have one.
+ * Return 0 on success, negative error code if the name isn't recognized.
+ */
+int topology_parse_rapl_name(const char* name, int32_t* pkg, int32_t* die);
+
+#pragma GCC visibility pop
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
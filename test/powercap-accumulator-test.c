@@ -0,0 +1,171 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Unit tests for the wraparound-safe energy accumulator.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "powercap-accumulator.h"
+
+#define NS_PER_S 1000000000ULL
+
+static void test_bad_args(void) {
+  powercap_accumulator acc;
+  powercap_zone zone = { 0 };
+  assert(powercap_accumulator_init(NULL, 0, 0) == -EINVAL);
+  assert(powercap_accumulator_init_zone(&acc, NULL) == -EINVAL);
+  // no energy_uj file
+  assert(powercap_accumulator_init_zone(&acc, &zone) == -EINVAL);
+  assert(powercap_accumulator_update(NULL, 0, 0) == -EINVAL);
+  assert(powercap_accumulator_get(NULL, NULL, NULL) == -EINVAL);
+  assert(powercap_accumulator_init(&acc, 1000, 0) == 0);
+  assert(powercap_accumulator_update_zone(&acc) == -EINVAL);
+}
+
+static void test_wrap(void) {
+  powercap_accumulator acc;
+  uint64_t total;
+  uint64_t t;
+  // wraps at 1000 uJ, max power 1000 uW, so the counter can wrap at most once per second
+  assert(powercap_accumulator_init(&acc, 1000, 1000) == 0);
+  assert(powercap_accumulator_update(&acc, 900, 0) == 0);
+  assert(powercap_accumulator_get_total_uj(&acc) == 0);
+  // a single wrap within half a second is unambiguous
+  assert(powercap_accumulator_update(&acc, 100, NS_PER_S / 2) == 0);
+  assert(powercap_accumulator_get_total_uj(&acc) == 200);
+  // after 2.5 seconds there may have been 0, 1, or 2 more wraps - last power (400 uW) suggests 1
+  assert(powercap_accumulator_update(&acc, 300, 3 * NS_PER_S) == 1);
+  assert(powercap_accumulator_get_total_uj(&acc) == 1400);
+  assert(powercap_accumulator_get_num_ambiguous(&acc) == 1);
+  assert(powercap_accumulator_get(&acc, &total, &t) == 0);
+  assert(total == 1400);
+  assert(t == 3 * NS_PER_S);
+  // time can't go backward
+  assert(powercap_accumulator_update(&acc, 400, NS_PER_S) == -EINVAL);
+  assert(powercap_accumulator_get_total_uj(&acc) == 1400);
+}
+
+static void test_unknown_limits(void) {
+  powercap_accumulator acc;
+  // without max power, missed wraps can't be detected
+  assert(powercap_accumulator_init(&acc, 1000, 0) == 0);
+  assert(powercap_accumulator_update(&acc, 900, 0) == 0);
+  assert(powercap_accumulator_update(&acc, 100, 3600 * NS_PER_S) == 0);
+  assert(powercap_accumulator_get_total_uj(&acc) == 200);
+  // without max energy range, a counter that goes backward is assumed to restart from 0
+  assert(powercap_accumulator_init(&acc, 0, 0) == 0);
+  assert(powercap_accumulator_update(&acc, 500, 0) == 0);
+  assert(powercap_accumulator_update(&acc, 100, NS_PER_S) == 1);
+  assert(powercap_accumulator_get_total_uj(&acc) == 100);
+  assert(powercap_accumulator_get_num_ambiguous(&acc) == 1);
+}
+
+static void test_seq_wrap(void) {
+  powercap_accumulator_view view;
+  powercap_accumulator acc;
+  uint64_t energy_uj;
+  uint64_t i;
+  // as if the accumulator had already been running for 2^31 updates
+  assert(powercap_accumulator_init(&acc, 1000, 0) == 0);
+  acc.seq = UINT32_MAX - 3;
+  assert(powercap_accumulator_view_init(&view, &acc) == -EAGAIN);
+  assert(powercap_accumulator_update(&acc, 0, 0) == 0);
+  assert(powercap_accumulator_view_init(&view, &acc) == 0);
+  for (i = 1; i <= 4; i++) {
+    assert(powercap_accumulator_update(&acc, 100 * i, i * NS_PER_S) == 0);
+  }
+  // the sequence number wrapped to 0 and past it without losing an interval
+  assert(acc.seq == 6);
+  assert(powercap_accumulator_get_total_uj(&acc) == 400);
+  assert(powercap_accumulator_view_read(&view, &energy_uj, NULL) == 0);
+  assert(energy_uj == 400);
+  assert(powercap_accumulator_view_init(&view, &acc) == 0);
+}
+
+#define CONCURRENT_UPDATES 200000
+
+static void* reader(void* arg) {
+  const powercap_accumulator* acc = (const powercap_accumulator*) arg;
+  uint64_t last = 0;
+  uint64_t total;
+  uint64_t t;
+  do {
+    assert(powercap_accumulator_get(acc, &total, &t) == 0);
+    // every update adds 7 uJ and 1 ns
+    assert(total == 7 * t);
+    assert(total >= last);
+    last = total;
+  } while (t < CONCURRENT_UPDATES);
+  return NULL;
+}
+
+static void test_concurrent(void) {
+  powercap_accumulator acc;
+  pthread_t threads[2];
+  uint64_t i;
+  assert(powercap_accumulator_init(&acc, 1000, 0) == 0);
+  assert(powercap_accumulator_update(&acc, 0, 0) == 0);
+  assert(pthread_create(&threads[0], NULL, reader, &acc) == 0);
+  assert(pthread_create(&threads[1], NULL, reader, &acc) == 0);
+  for (i = 1; i <= CONCURRENT_UPDATES; i++) {
+    assert(powercap_accumulator_update(&acc, (7 * i) % 1000, i) == 0);
+  }
+  pthread_join(threads[0], NULL);
+  pthread_join(threads[1], NULL);
+  assert(powercap_accumulator_get_total_uj(&acc) == 7 * CONCURRENT_UPDATES);
+}
+
+static void test_views(void) {
+  powercap_accumulator acc;
+  powercap_accumulator_view a;
+  powercap_accumulator_view b;
+  uint64_t energy;
+  uint64_t elapsed;
+  assert(powercap_accumulator_init(&acc, 1000, 0) == 0);
+  // not updated yet
+  assert(powercap_accumulator_view_init(&a, &acc) == -EAGAIN);
+  assert(powercap_accumulator_view_init(NULL, &acc) == -EINVAL);
+  assert(powercap_accumulator_update(&acc, 100, 10) == 0);
+  assert(powercap_accumulator_view_init(&a, &acc) == 0);
+  assert(powercap_accumulator_update(&acc, 300, 20) == 0);
+  assert(powercap_accumulator_view_init(&b, &acc) == 0);
+  assert(powercap_accumulator_update(&acc, 600, 30) == 0);
+
+  // each view has its own baseline
+  assert(powercap_accumulator_view_read(&a, &energy, &elapsed) == 0);
+  assert(energy == 500 && elapsed == 20);
+  assert(powercap_accumulator_view_read(&b, &energy, &elapsed) == 0);
+  assert(energy == 300 && elapsed == 10);
+  // resetting one view doesn't affect the other or the accumulator
+  assert(powercap_accumulator_view_reset(&a) == 0);
+  assert(powercap_accumulator_view_read(&a, &energy, NULL) == 0);
+  assert(energy == 0);
+  assert(powercap_accumulator_view_read(&b, &energy, NULL) == 0);
+  assert(energy == 300);
+  assert(powercap_accumulator_get_total_uj(&acc) == 500);
+
+  // laps measure consecutive intervals, across a wrap
+  assert(powercap_accumulator_update(&acc, 100, 40) == 0);
+  assert(powercap_accumulator_view_lap(&b, &energy, &elapsed) == 0);
+  assert(energy == 800 && elapsed == 20);
+  assert(powercap_accumulator_update(&acc, 150, 50) == 0);
+  assert(powercap_accumulator_view_lap(&b, &energy, &elapsed) == 0);
+  assert(energy == 50 && elapsed == 10);
+  assert(powercap_accumulator_view_read(&a, &energy, NULL) == 0);
+  assert(energy == 550);
+}
+
+int main(void) {
+  test_bad_args();
+  test_wrap();
+  test_unknown_limits();
+  test_seq_wrap();
+  test_concurrent();
+  test_views();
+  return 0;
+}
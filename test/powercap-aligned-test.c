@@ -0,0 +1,122 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Unit tests for aligned energy measurements, using a thread that updates a temporary file in place of a sysfs counter.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "powercap.h"
+#include "powercap-aligned.h"
+#include "test-common.h"
+
+#define UPDATE_US 1000
+#define UPDATE_UJ 1000
+#define RANGE_UJ 10000
+/* Long enough that a writer thread delayed by the scheduler doesn't time out a read */
+#define MAX_SPIN_NS 1000000000ULL
+
+typedef struct counter {
+  int fd;
+  int stop;
+  pthread_t thread;
+} counter;
+
+static void write_counter(int fd, uint64_t val) {
+  char buf[32];
+  // fixed width, so a concurrent read never sees a partial number
+  int len = snprintf(buf, sizeof(buf), "%20"PRIu64"\n", val);
+  assert(pwrite(fd, buf, (size_t) len, 0) == len);
+}
+
+static void* counter_thread(void* arg) {
+  counter* c = (counter*) arg;
+  uint64_t val = 0;
+  while (!__atomic_load_n(&c->stop, __ATOMIC_RELAXED)) {
+    usleep(UPDATE_US);
+    val = (val + UPDATE_UJ) % RANGE_UJ;
+    write_counter(c->fd, val);
+  }
+  return NULL;
+}
+
+static void test_bad_args(void) {
+  powercap_aligned_meter meter;
+  powercap_aligned_read r;
+  powercap_zone zone = { 0 };
+  assert(powercap_aligned_read_zone(NULL, 0, &r) == -EINVAL);
+  // no energy_uj file
+  assert(powercap_aligned_read_zone(&zone, 0, &r) == -EINVAL);
+  assert(powercap_aligned_meter_init(&meter, &zone, 0) == -EINVAL);
+  assert(powercap_aligned_meter_init(NULL, &zone, 0) == -EINVAL);
+  assert(powercap_aligned_meter_begin(NULL) == -EINVAL);
+}
+
+static void test_timeout(void) {
+  powercap_aligned_read r;
+  powercap_zone zone = { 0 };
+  zone.energy_uj = make_file(42);
+  // the counter never changes
+  assert(powercap_aligned_read_zone(&zone, 1000000, &r) == 1);
+  assert(r.energy_uj == 42);
+  assert(r.spin_ns >= 1000000);
+  assert(r.polls >= 2);
+  close(zone.energy_uj);
+}
+
+static void test_meter(void) {
+  powercap_aligned_meter meter;
+  powercap_aligned_read r;
+  powercap_zone zone = { 0 };
+  counter c;
+  uint64_t energy_uj;
+  uint64_t duration_ns;
+  uint64_t spin_ns;
+  uint64_t prev;
+  int i;
+  zone.energy_uj = make_file(0);
+  zone.max_energy_range_uj = make_file(RANGE_UJ);
+  c.fd = zone.energy_uj;
+  c.stop = 0;
+  assert(pthread_create(&c.thread, NULL, counter_thread, &c) == 0);
+
+  // an aligned read returns a new value - the writer isn't paced precisely, so it may have updated more than once
+  assert(powercap_aligned_read_zone(&zone, MAX_SPIN_NS, &r) == 0);
+  prev = r.energy_uj;
+  assert(powercap_aligned_read_zone(&zone, MAX_SPIN_NS, &r) == 0);
+  assert(r.energy_uj != prev);
+  assert(r.energy_uj % UPDATE_UJ == 0);
+  assert(r.polls >= 2);
+
+  assert(powercap_aligned_meter_init(&meter, &zone, MAX_SPIN_NS) == 0);
+  assert(meter.max_energy_range_uj == RANGE_UJ);
+  // enough measurements that some of them wrap
+  for (i = 0; i < 8; i++) {
+    assert(powercap_aligned_meter_begin(&meter) == 0);
+    usleep(3 * UPDATE_US);
+    assert(powercap_aligned_meter_end(&meter, &energy_uj, &duration_ns, &spin_ns) == 0);
+    // whole updates, corrected for wraparound
+    assert(energy_uj < RANGE_UJ);
+    assert(energy_uj % UPDATE_UJ == 0);
+    assert(duration_ns >= 3 * UPDATE_US * 1000);
+    assert(spin_ns > 0);
+  }
+
+  __atomic_store_n(&c.stop, 1, __ATOMIC_RELAXED);
+  pthread_join(c.thread, NULL);
+  close(zone.energy_uj);
+  close(zone.max_energy_range_uj);
+}
+
+int main(void) {
+  test_bad_args();
+  test_timeout();
+  test_meter();
+  return 0;
+}
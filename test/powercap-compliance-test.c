@@ -0,0 +1,194 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Unit tests for power limit compliance verification, using temporary files in place of sysfs constraint files.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "powercap.h"
+#include "powercap-compliance.h"
+#include "test-common.h"
+
+#define PERIOD_NS 1000000ULL
+/* 10 W over 10 ms */
+#define LIMIT_UW 10000000ULL
+#define WINDOW_US 10000ULL
+#define MAX_ENERGY_RANGE_UJ 1000000ULL
+
+static void write_file(int fd, uint64_t val) {
+  char buf[32];
+  int len = snprintf(buf, sizeof(buf), "%"PRIu64"\n", val);
+  assert(ftruncate(fd, 0) == 0);
+  assert(pwrite(fd, buf, (size_t) len, 0) == len);
+}
+
+/* Add "n" samples with a counter consuming a constant power, wrapping at MAX_ENERGY_RANGE_UJ */
+static void run(powercap_compliance* c, uint64_t* time_ns, uint64_t* energy_uj, uint64_t watts, uint64_t period_ns,
+                uint32_t n) {
+  uint32_t i;
+  for (i = 0; i < n; i++) {
+    *time_ns += period_ns;
+    // W * ns = 1000 uJ
+    *energy_uj = (*energy_uj + watts * period_ns / 1000) % MAX_ENERGY_RANGE_UJ;
+    assert(powercap_compliance_add(c, *time_ns, energy_uj) == 0);
+  }
+}
+
+static void test_bad_args(void) {
+  powercap_compliance_config cfg = { 1000, 0, 4 };
+  powercap_compliance_target target;
+  powercap_constraint constraint = { 0 };
+  powercap_compliance* c;
+  uint64_t energy_uj = 0;
+  constraint.power_limit_uw = make_file(LIMIT_UW);
+  constraint.time_window_us = make_file(0);
+  target.constraint = &constraint;
+  target.counter = 0;
+  assert(powercap_compliance_create(NULL, 1, 1, NULL, &cfg) == NULL);
+  assert(powercap_compliance_create(&target, 1, 1, NULL, NULL) == NULL);
+  target.counter = 1;
+  assert(powercap_compliance_create(&target, 1, 1, NULL, &cfg) == NULL);
+  target.counter = 0;
+  cfg.tolerance = -1;
+  assert(powercap_compliance_create(&target, 1, 1, NULL, &cfg) == NULL);
+  cfg.tolerance = 0;
+  // time window must not be 0
+  assert(powercap_compliance_create(&target, 1, 1, NULL, &cfg) == NULL);
+  write_file(constraint.time_window_us, WINDOW_US);
+  assert((c = powercap_compliance_create(&target, 1, 1, NULL, &cfg)) != NULL);
+  assert(powercap_compliance_get_num_targets(c) == 1);
+  assert(powercap_compliance_get_target(c, 0)->constraint == &constraint);
+  assert(powercap_compliance_get_target(c, 1) == NULL);
+  assert(powercap_compliance_add(c, 10, &energy_uj) == 0);
+  assert(powercap_compliance_add(c, 9, &energy_uj) == -EINVAL);
+  assert(powercap_compliance_get_status(c, 1, NULL) == -EINVAL);
+  assert(powercap_compliance_read_violations(c, NULL, 1) == -EINVAL);
+  powercap_compliance_destroy(c);
+  powercap_compliance_destroy(NULL);
+  assert(powercap_compliance_create_rapl(NULL, 0, &cfg) == NULL);
+  close(constraint.power_limit_uw);
+  close(constraint.time_window_us);
+}
+
+static void test_violations(void) {
+  const uint64_t max_energy_range_uj = MAX_ENERGY_RANGE_UJ;
+  powercap_compliance_config cfg = { PERIOD_NS / 1000, 0, 4 };
+  powercap_compliance_violation violations[4];
+  powercap_compliance_status status;
+  powercap_compliance_target target;
+  powercap_constraint constraint = { 0 };
+  powercap_compliance* c;
+  // start near the wraparound value
+  uint64_t energy_uj = MAX_ENERGY_RANGE_UJ - 1000;
+  uint64_t time_ns = 0;
+  constraint.power_limit_uw = make_file(LIMIT_UW);
+  constraint.time_window_us = make_file(WINDOW_US);
+  target.constraint = &constraint;
+  target.counter = 0;
+  assert((c = powercap_compliance_create(&target, 1, 1, &max_energy_range_uj, &cfg)) != NULL);
+  assert(powercap_compliance_add(c, time_ns, &energy_uj) == 0);
+
+  // no average until a full window is observed
+  run(c, &time_ns, &energy_uj, 5, PERIOD_NS, 9);
+  assert(powercap_compliance_get_status(c, 0, &status) == 0);
+  assert(!status.has_average);
+  assert(status.power_limit_uw == LIMIT_UW && status.time_window_us == WINDOW_US);
+  run(c, &time_ns, &energy_uj, 5, PERIOD_NS, 41);
+  assert(powercap_compliance_get_status(c, 0, &status) == 0);
+  assert(status.has_average && !status.violating);
+  assert(status.average_w > 4.999 && status.average_w < 5.001);
+  assert(status.verified_ns == 40 * PERIOD_NS);
+
+  // a short burst that keeps the window average under the limit is compliant
+  run(c, &time_ns, &energy_uj, 50, PERIOD_NS, 1);
+  run(c, &time_ns, &energy_uj, 5, PERIOD_NS, 9);
+  assert(powercap_compliance_get_status(c, 0, &status) == 0);
+  assert(status.violations == 0);
+
+  // the average exceeds the limit part way into a sustained excess, then stays there until it drops
+  run(c, &time_ns, &energy_uj, 20, PERIOD_NS, 30);
+  assert(powercap_compliance_get_status(c, 0, &status) == 0);
+  assert(status.violating && status.violations == 1);
+  assert(status.current.start_ns > time_ns - 30 * PERIOD_NS);
+  assert(status.average_w > 19.999 && status.average_w < 20.001);
+  assert(powercap_compliance_read_violations(c, violations, 4) == 0);
+  run(c, &time_ns, &energy_uj, 5, PERIOD_NS, 20);
+  assert(powercap_compliance_get_status(c, 0, &status) == 0);
+  assert(!status.violating);
+  assert(status.violation_ns > 0);
+  assert(powercap_compliance_read_violations(c, violations, 4) == 1);
+  assert(violations[0].target == 0);
+  assert(violations[0].power_limit_uw == LIMIT_UW);
+  assert(violations[0].duration_ns > 20 * PERIOD_NS && violations[0].duration_ns < 40 * PERIOD_NS);
+  assert(violations[0].peak_w > 19.999 && violations[0].peak_w < 20.001);
+  assert(violations[0].excess_uj > 0);
+  assert(powercap_compliance_read_violations(c, violations, 4) == 0);
+
+  // samples faster than the configured period are averaged over the same window
+  run(c, &time_ns, &energy_uj, 5, PERIOD_NS / 10, 300);
+  assert(powercap_compliance_get_status(c, 0, &status) == 0);
+  assert(status.average_w > 4.999 && status.average_w < 5.001);
+
+  // a new time window restarts the window
+  write_file(constraint.time_window_us, WINDOW_US * 2);
+  write_file(constraint.power_limit_uw, LIMIT_UW * 2);
+  assert(powercap_compliance_refresh(c) == 0);
+  assert(powercap_compliance_get_status(c, 0, &status) == 0);
+  assert(status.time_window_us == WINDOW_US * 2 && status.power_limit_uw == LIMIT_UW * 2);
+  assert(!status.has_average);
+  run(c, &time_ns, &energy_uj, 30, PERIOD_NS, 50);
+  assert(powercap_compliance_get_status(c, 0, &status) == 0);
+  assert(status.violating && status.violations == 2);
+  powercap_compliance_destroy(c);
+  close(constraint.power_limit_uw);
+  close(constraint.time_window_us);
+}
+
+static void test_tolerance(void) {
+  const uint64_t max_energy_range_uj = MAX_ENERGY_RANGE_UJ;
+  powercap_compliance_config cfg = { PERIOD_NS / 1000, 1.0, 1 };
+  powercap_compliance_violation violation;
+  powercap_compliance_status status;
+  powercap_compliance_target target;
+  powercap_constraint constraint = { 0 };
+  powercap_compliance* c;
+  uint64_t energy_uj = 0;
+  uint64_t time_ns = 0;
+  constraint.power_limit_uw = make_file(LIMIT_UW);
+  constraint.time_window_us = make_file(WINDOW_US);
+  target.constraint = &constraint;
+  target.counter = 0;
+  assert((c = powercap_compliance_create(&target, 1, 1, &max_energy_range_uj, &cfg)) != NULL);
+  assert(powercap_compliance_add(c, time_ns, &energy_uj) == 0);
+  // twice the limit is within a 100% tolerance
+  run(c, &time_ns, &energy_uj, 20, PERIOD_NS, 50);
+  assert(powercap_compliance_get_status(c, 0, &status) == 0);
+  assert(status.has_average && status.violations == 0);
+  // only the latest violation is kept
+  run(c, &time_ns, &energy_uj, 30, PERIOD_NS, 20);
+  run(c, &time_ns, &energy_uj, 5, PERIOD_NS, 20);
+  run(c, &time_ns, &energy_uj, 40, PERIOD_NS, 20);
+  run(c, &time_ns, &energy_uj, 5, PERIOD_NS, 20);
+  assert(powercap_compliance_get_status(c, 0, &status) == 0);
+  assert(status.violations == 2);
+  assert(powercap_compliance_read_violations(c, &violation, 1) == 1);
+  assert(violation.peak_w > 39.999 && violation.peak_w < 40.001);
+  assert(powercap_compliance_read_violations(c, &violation, 1) == 0);
+  powercap_compliance_destroy(c);
+  close(constraint.power_limit_uw);
+  close(constraint.time_window_us);
+}
+
+int main(void) {
+  test_bad_args();
+  test_violations();
+  test_tolerance();
+  return 0;
+}
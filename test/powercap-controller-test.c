@@ -0,0 +1,345 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Unit tests for closed-loop power control, using temporary files in place of sysfs files and a simulated zone whose
+ * power is its demand or its power limit, whichever is lower.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "powercap.h"
+#include "powercap-controller.h"
+#include "powercap-snapshot.h"
+#include "test-common.h"
+
+#define MAX_ZONES 2
+#define W 1000000ULL
+
+typedef struct plant {
+  powercap_zone zones[MAX_ZONES];
+  powercap_constraint constraints[MAX_ZONES];
+  powercap_snapshot snap;
+  uint64_t demand_uw[MAX_ZONES];
+  uint64_t energy_uj[MAX_ZONES];
+  uint64_t last_ns;
+  uint32_t n;
+} plant;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+static uint64_t get_limit(const plant* p, uint32_t i) {
+  uint64_t limit_uw;
+  assert(powercap_constraint_get_power_limit_uw(&p->constraints[i], &limit_uw) == 0);
+  return limit_uw;
+}
+
+static void plant_init(plant* p, uint32_t n, uint64_t demand_uw, uint64_t limit_uw) {
+  uint32_t i;
+  memset(p, 0, sizeof(*p));
+  p->n = n;
+  assert(powercap_snapshot_init(&p->snap, n) == 0);
+  for (i = 0; i < n; i++) {
+    p->zones[i].energy_uj = make_file_fixed(0, O_RDWR);
+    p->constraints[i].power_limit_uw = make_file_fixed(limit_uw, O_RDWR);
+    p->demand_uw[i] = demand_uw;
+    assert(powercap_snapshot_set_zone(&p->snap, i, &p->zones[i]) == 0);
+  }
+  p->last_ns = now_ns();
+}
+
+static void plant_destroy(plant* p) {
+  uint32_t i;
+  for (i = 0; i < p->n; i++) {
+    close(p->zones[i].energy_uj);
+    close(p->constraints[i].power_limit_uw);
+  }
+  powercap_snapshot_destroy(&p->snap);
+}
+
+/* Consume energy at each zone's power since the last step, then run a control iteration */
+static void step(plant* p, powercap_controller* c) {
+  const struct timespec ts = { 0, 2000000 };
+  char buf[32];
+  uint64_t t;
+  uint64_t power_uw;
+  uint32_t i;
+  int len;
+  nanosleep(&ts, NULL);
+  t = now_ns();
+  for (i = 0; i < p->n; i++) {
+    power_uw = get_limit(p, i) < p->demand_uw[i] ? get_limit(p, i) : p->demand_uw[i];
+    // uW * ns = 1e-9 uJ
+    p->energy_uj[i] += power_uw * (t - p->last_ns) / 1000000000;
+    len = snprintf(buf, sizeof(buf), "%20"PRIu64"\n", p->energy_uj[i]);
+    assert(pwrite(p->zones[i].energy_uj, buf, (size_t) len, 0) == len);
+  }
+  p->last_ns = t;
+  assert(powercap_controller_update(c) == 0);
+}
+
+/* Run "n" iterations and get the mean measured power, which is less sensitive to scheduling than a single sample */
+static double run_mean(plant* p, powercap_controller* c, uint32_t n) {
+  powercap_controller_status status;
+  double sum_w = 0;
+  uint32_t i;
+  for (i = 0; i < n; i++) {
+    step(p, c);
+    assert(powercap_controller_get_status(c, 0, &status) == 0);
+    sum_w += status.power_w;
+  }
+  return sum_w / n;
+}
+
+static powercap_controller_loop make_loop(const plant* p, const uint32_t* counters, uint64_t target_uw) {
+  powercap_controller_loop loop;
+  memset(&loop, 0, sizeof(loop));
+  loop.counters = counters;
+  loop.ncounters = p->n;
+  loop.constraints = p->constraints;
+  loop.nconstraints = p->n;
+  loop.target_uw = target_uw;
+  loop.kp = 0.3;
+  loop.ki = 20;
+  loop.min_limit_uw = 1 * W;
+  loop.max_limit_uw = 50 * W;
+  return loop;
+}
+
+static void test_bad_args(void) {
+  const powercap_controller_config cfg = { 2000, 0, 0, -1 };
+  const uint32_t counters[] = { 0 };
+  const uint32_t bad_counters[] = { 1 };
+  powercap_controller_loop loop;
+  powercap_controller_status status;
+  powercap_controller_stats stats;
+  powercap_controller* c;
+  plant p;
+  plant_init(&p, 1, 30 * W, 40 * W);
+  loop = make_loop(&p, counters, 20 * W);
+  assert(powercap_controller_create(NULL, &loop, 1, &cfg) == NULL);
+  assert(powercap_controller_create(&p.snap, &loop, 0, &cfg) == NULL);
+  assert(powercap_controller_create(&p.snap, &loop, 1, NULL) == NULL);
+  loop.counters = bad_counters;
+  assert(powercap_controller_create(&p.snap, &loop, 1, &cfg) == NULL);
+  assert(errno == EINVAL);
+  loop.counters = counters;
+  loop.kp = -1;
+  assert(powercap_controller_create(&p.snap, &loop, 1, &cfg) == NULL);
+  loop.kp = 0.3;
+  // no upper bound
+  loop.max_limit_uw = 0;
+  assert(powercap_controller_create(&p.snap, &loop, 1, &cfg) == NULL);
+  loop.max_limit_uw = 50 * W;
+  // min_power_uw is above the upper bound
+  p.constraints[0].min_power_uw = make_file_fixed(60 * W, O_RDWR);
+  assert(powercap_controller_create(&p.snap, &loop, 1, &cfg) == NULL);
+  close(p.constraints[0].min_power_uw);
+  p.constraints[0].min_power_uw = 0;
+
+  assert((c = powercap_controller_create(&p.snap, &loop, 1, &cfg)) != NULL);
+  assert(powercap_controller_set_target(c, 1, 10 * W) == -EINVAL);
+  assert(powercap_controller_get_status(c, 1, &status) == -EINVAL);
+  assert(powercap_controller_get_status(c, 0, NULL) == -EINVAL);
+  assert(powercap_controller_get_stats(c, NULL) == -EINVAL);
+  assert(powercap_controller_stop(c) == -EINVAL);
+  // the first update only reads the current state
+  assert(powercap_controller_update(c) == 0);
+  assert(powercap_controller_get_stats(c, &stats) == 0);
+  assert(stats.iterations == 0);
+  assert(powercap_controller_get_status(c, 0, &status) == 0);
+  assert(status.target_uw == 20 * W);
+  assert(status.output_w > 39.999 && status.output_w < 40.001);
+  assert(powercap_controller_destroy(c) == 0);
+  assert(powercap_controller_destroy(NULL) == 0);
+  plant_destroy(&p);
+}
+
+static void test_tracking(void) {
+  // skip writes that change the limit by no more than 0.1 W
+  const powercap_controller_config cfg = { 2000, W / 10, 0, -1 };
+  const uint32_t counters[] = { 0 };
+  powercap_controller_loop loop;
+  powercap_controller_status status;
+  powercap_controller_stats stats;
+  powercap_controller* c;
+  double mean_w;
+  plant p;
+  uint32_t i;
+  plant_init(&p, 1, 30 * W, 40 * W);
+  loop = make_loop(&p, counters, 20 * W);
+  assert((c = powercap_controller_create(&p.snap, &loop, 1, &cfg)) != NULL);
+  assert(powercap_controller_update(c) == 0);
+  for (i = 0; i < 300; i++) {
+    step(&p, c);
+  }
+  mean_w = run_mean(&p, c, 100);
+  assert(mean_w > 19 && mean_w < 21);
+  assert(powercap_controller_get_status(c, 0, &status) == 0);
+  assert(!status.saturated);
+  assert(powercap_controller_get_stats(c, &stats) == 0);
+  assert(stats.iterations == 400);
+  assert(stats.writes > 0 && stats.skipped_writes > 0);
+  assert(stats.writes + stats.skipped_writes == 400);
+  assert(stats.read_errors == 0 && stats.write_errors == 0);
+  assert(powercap_controller_destroy(c) == 0);
+  plant_destroy(&p);
+}
+
+static void test_anti_windup(void) {
+  const powercap_controller_config cfg = { 2000, 0, 0, -1 };
+  const uint32_t counters[] = { 0 };
+  powercap_controller_loop loop;
+  powercap_controller_status status;
+  powercap_controller_stats before;
+  powercap_controller_stats stats;
+  powercap_controller* c;
+  plant p;
+  uint32_t i;
+  // the target is unreachable, so the output saturates at the upper bound
+  plant_init(&p, 1, 1 * W, 20 * W);
+  loop = make_loop(&p, counters, 45 * W);
+  loop.ki = 100;
+  assert((c = powercap_controller_create(&p.snap, &loop, 1, &cfg)) != NULL);
+  assert(powercap_controller_update(c) == 0);
+  for (i = 0; i < 100; i++) {
+    step(&p, c);
+  }
+  assert(powercap_controller_get_status(c, 0, &status) == 0);
+  assert(status.saturated);
+  assert(status.output_w > 49.999 && status.output_w < 50.001);
+  assert(get_limit(&p, 0) == 50 * W);
+  // once clamped, the limit doesn't change, so it isn't written again
+  assert(powercap_controller_get_stats(c, &before) == 0);
+  for (i = 0; i < 20; i++) {
+    step(&p, c);
+  }
+  assert(powercap_controller_get_stats(c, &stats) == 0);
+  assert(stats.writes == before.writes && stats.skipped_writes == before.skipped_writes + 20);
+
+  // without anti-windup, over a hundred iterations would be needed to unwind the integral
+  p.demand_uw[0] = 60 * W;
+  assert(powercap_controller_set_target(c, 0, 5 * W) == 0);
+  for (i = 0; i < 60 && get_limit(&p, 0) >= 10 * W; i++) {
+    step(&p, c);
+  }
+  assert(get_limit(&p, 0) < 10 * W);
+  assert(powercap_controller_get_status(c, 0, &status) == 0);
+  assert(status.target_uw == 5 * W);
+  assert(powercap_controller_destroy(c) == 0);
+  plant_destroy(&p);
+}
+
+static void test_node(void) {
+  const powercap_controller_config cfg = { 2000, 0, 0, -1 };
+  const uint32_t counters[] = { 0, 1 };
+  powercap_controller_loop loop;
+  powercap_controller_status status;
+  powercap_controller* c;
+  double mean_w;
+  plant p;
+  uint32_t i;
+  // one target for the total of two zones, split equally between their constraints
+  plant_init(&p, 2, 25 * W, 40 * W);
+  loop = make_loop(&p, counters, 30 * W);
+  assert((c = powercap_controller_create(&p.snap, &loop, 1, &cfg)) != NULL);
+  assert(powercap_controller_update(c) == 0);
+  assert(powercap_controller_get_status(c, 0, &status) == 0);
+  assert(status.output_w > 79.999 && status.output_w < 80.001);
+  for (i = 0; i < 300; i++) {
+    step(&p, c);
+  }
+  mean_w = run_mean(&p, c, 100);
+  assert(mean_w > 28 && mean_w < 32);
+  assert(get_limit(&p, 0) == get_limit(&p, 1));
+  assert(powercap_controller_destroy(c) == 0);
+  plant_destroy(&p);
+}
+
+static void test_uneven_bounds(void) {
+  const powercap_controller_config cfg = { 2000, 0, 0, -1 };
+  const uint32_t counters[] = { 0, 1 };
+  powercap_controller_loop loop;
+  powercap_controller_status status;
+  powercap_controller* c;
+  double mean_w;
+  plant p;
+  uint32_t i;
+  // the second constraint can't take an equal share, so the first one takes the rest
+  plant_init(&p, 2, 100 * W, 5 * W);
+  p.constraints[1].max_power_uw = make_file_fixed(10 * W, O_RDONLY);
+  loop = make_loop(&p, counters, 40 * W);
+  assert((c = powercap_controller_create(&p.snap, &loop, 1, &cfg)) != NULL);
+  assert(powercap_controller_update(c) == 0);
+  for (i = 0; i < 300; i++) {
+    step(&p, c);
+  }
+  mean_w = run_mean(&p, c, 100);
+  assert(mean_w > 38 && mean_w < 42);
+  assert(powercap_controller_get_status(c, 0, &status) == 0);
+  assert(!status.saturated);
+  // the output is what was actually applied
+  assert(status.output_w > 35 && status.output_w < 45);
+  assert(get_limit(&p, 1) == 10 * W);
+  assert(get_limit(&p, 0) > 25 * W);
+
+  // the output saturates at the sum of the constraints' upper bounds
+  assert(powercap_controller_set_target(c, 0, 100 * W) == 0);
+  for (i = 0; i < 100; i++) {
+    step(&p, c);
+  }
+  assert(powercap_controller_get_status(c, 0, &status) == 0);
+  assert(status.saturated);
+  assert(status.output_w > 59.999 && status.output_w < 60.001);
+  assert(get_limit(&p, 0) == 50 * W && get_limit(&p, 1) == 10 * W);
+  assert(powercap_controller_destroy(c) == 0);
+  close(p.constraints[1].max_power_uw);
+  plant_destroy(&p);
+}
+
+static void test_thread(void) {
+  // the thread runs without real-time priority or pinning if they aren't permitted
+  const powercap_controller_config cfg = { 1000, 0, 1, 0 };
+  const struct timespec ts = { 0, 50000000 };
+  const uint32_t counters[] = { 0 };
+  powercap_controller_loop loop;
+  powercap_controller_stats stats;
+  powercap_controller* c;
+  plant p;
+  plant_init(&p, 1, 30 * W, 40 * W);
+  loop = make_loop(&p, counters, 20 * W);
+  assert((c = powercap_controller_create(&p.snap, &loop, 1, &cfg)) != NULL);
+  assert(powercap_controller_start(c) == 0);
+  assert(powercap_controller_start(c) == -EINVAL);
+  assert(powercap_controller_update(c) == -EINVAL);
+  nanosleep(&ts, NULL);
+  assert(powercap_controller_stop(c) == 0);
+  assert(powercap_controller_get_stats(c, &stats) == 0);
+  assert(stats.iterations > 0);
+  assert(stats.max_latency_ns > 0 && stats.total_latency_ns >= stats.max_latency_ns);
+  // restarting reads the current limits again
+  assert(powercap_controller_start(c) == 0);
+  assert(powercap_controller_destroy(c) == 0);
+  plant_destroy(&p);
+}
+
+int main(void) {
+  test_bad_args();
+  test_tracking();
+  test_anti_windup();
+  test_node();
+  test_uneven_bounds();
+  test_thread();
+  return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Unit tests for persistent energy accumulators.
+ */
+// force assertions
+#undef NDEBUG
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "powercap.h"
+#include "powercap-accumulator.h"
+#include "powercap-persistent.h"
+#include "test-common.h"
+
+static void set_file(int fd, uint64_t val) {
+  char buf[32];
+  int len = snprintf(buf, sizeof(buf), "%"PRIu64"\n", val);
+  assert(ftruncate(fd, 0) == 0);
+  assert(pwrite(fd, buf, (size_t) len, 0) == len);
+}
+
+static void test_bad_args(void) {
+  powercap_zone zone = { 0 };
+  assert(powercap_persistent_open(NULL, &zone, NULL) == NULL);
+  assert(errno == EINVAL);
+  // no energy_uj file
+  assert(powercap_persistent_open("/tmp/unused", &zone, NULL) == NULL);
+  assert(errno == EINVAL);
+  assert(powercap_persistent_get_accumulator(NULL) == NULL);
+  assert(powercap_persistent_update(NULL) == -EINVAL);
+  assert(powercap_persistent_sync(NULL) == -EINVAL);
+  assert(powercap_persistent_close(NULL) == -EINVAL);
+}
+
+/* Change the saved boot id, as if the state was saved before a reboot - returns 0 if the boot id is unknown */
+static int change_boot_id(const char* path) {
+  char boot_id[64] = { 0 };
+  char state[4096];
+  ssize_t len;
+  ssize_t n;
+  char* found;
+  int fd;
+  if ((fd = open("/proc/sys/kernel/random/boot_id", O_RDONLY)) < 0) {
+    return 0;
+  }
+  n = read(fd, boot_id, sizeof(boot_id) - 1);
+  close(fd);
+  if (n < 2) {
+    return 0;
+  }
+  assert((fd = open(path, O_RDWR)) >= 0);
+  assert((len = pread(fd, state, sizeof(state), 0)) > 0);
+  // without the trailing newline
+  assert((found = memmem(state, (size_t) len, boot_id, (size_t) n - 1)) != NULL);
+  found[0] = found[0] == '0' ? '1' : '0';
+  assert(pwrite(fd, state, (size_t) len, 0) == len);
+  close(fd);
+  return 1;
+}
+
+static void test_persistent(void) {
+  char path[] = "/tmp/powercap-persistent-test-state-XXXXXX";
+  powercap_persistent_status status;
+  powercap_persistent* p;
+  const powercap_accumulator* acc;
+  powercap_zone zone = { 0 };
+  uint64_t total;
+  int fd;
+  // wraps at 1000 uJ, and can wrap at most once per second
+  zone.energy_uj = make_file(500);
+  zone.max_energy_range_uj = make_file(1000);
+  zone.max_power_range_uw = make_file(1000);
+  assert((fd = mkstemp(path)) > 0);
+  close(fd);
+
+  // an empty file has no saved state
+  assert((p = powercap_persistent_open(path, &zone, &status)) != NULL);
+  assert(status == POWERCAP_PERSISTENT_NEW);
+  assert((acc = powercap_persistent_get_accumulator(p)) != NULL);
+  set_file(zone.energy_uj, 900);
+  assert(powercap_persistent_update(p) == 0);
+  assert(powercap_accumulator_get_total_uj(acc) == 400);
+  // only one process may have it open
+  assert(powercap_persistent_open(path, &zone, NULL) == NULL);
+  assert(errno == EWOULDBLOCK);
+  assert(powercap_persistent_sync(p) == 0);
+  assert(powercap_persistent_close(p) == 0);
+
+  // energy consumed while closed is included, even across a wrap
+  set_file(zone.energy_uj, 100);
+  assert((p = powercap_persistent_open(path, &zone, &status)) != NULL);
+  assert(status == POWERCAP_PERSISTENT_RESUMED);
+  acc = powercap_persistent_get_accumulator(p);
+  assert(powercap_accumulator_get_total_uj(acc) == 600);
+  assert(powercap_persistent_get_num_gaps(p) == 0);
+  assert(powercap_persistent_close(p) == 0);
+
+  // with a much higher max power, there may have been missed wraps
+  set_file(zone.max_power_range_uw, 1000000000000ULL);
+  set_file(zone.energy_uj, 200);
+  assert((p = powercap_persistent_open(path, &zone, &status)) != NULL);
+  assert(status == POWERCAP_PERSISTENT_GAP);
+  assert(powercap_persistent_get_num_gaps(p) == 1);
+  // the estimate is still included
+  total = powercap_accumulator_get_total_uj(powercap_persistent_get_accumulator(p));
+  assert(total >= 700);
+  assert(powercap_persistent_close(p) == 0);
+  set_file(zone.max_power_range_uw, 1000);
+
+  // energy consumed across a reboot is unknown, but the total is kept
+  if (change_boot_id(path)) {
+    assert((p = powercap_persistent_open(path, &zone, &status)) != NULL);
+    acc = powercap_persistent_get_accumulator(p);
+    assert(status == POWERCAP_PERSISTENT_GAP);
+    assert(powercap_persistent_get_num_gaps(p) == 2);
+    assert(powercap_accumulator_get_total_uj(acc) == total);
+    // the new baseline is the current counter value
+    set_file(zone.energy_uj, 250);
+    assert(powercap_persistent_update(p) == 0);
+    assert(powercap_accumulator_get_total_uj(acc) == total + 50);
+    assert(powercap_persistent_close(p) == 0);
+  }
+
+  // state saved for a different counter is discarded
+  set_file(zone.max_energy_range_uj, 2000);
+  assert((p = powercap_persistent_open(path, &zone, &status)) != NULL);
+  assert(status == POWERCAP_PERSISTENT_NEW);
+  assert(powercap_accumulator_get_total_uj(powercap_persistent_get_accumulator(p)) == 0);
+  assert(powercap_persistent_get_num_gaps(p) == 0);
+  assert(powercap_persistent_close(p) == 0);
+  set_file(zone.max_energy_range_uj, 1000);
+
+  // corrupt or truncated state is discarded
+  assert((fd = open(path, O_RDWR)) >= 0);
+  assert(pwrite(fd, "garbage", 7, 0) == 7);
+  assert((p = powercap_persistent_open(path, &zone, &status)) != NULL);
+  assert(status == POWERCAP_PERSISTENT_NEW);
+  assert(powercap_accumulator_get_total_uj(powercap_persistent_get_accumulator(p)) == 0);
+  assert(powercap_persistent_close(p) == 0);
+  assert(ftruncate(fd, 16) == 0);
+  assert((p = powercap_persistent_open(path, &zone, &status)) != NULL);
+  assert(status == POWERCAP_PERSISTENT_NEW);
+  assert(powercap_persistent_get_num_gaps(p) == 0);
+  assert(powercap_persistent_close(p) == 0);
+  close(fd);
+
+  unlink(path);
+  close(zone.energy_uj);
+  close(zone.max_energy_range_uj);
+  close(zone.max_power_range_uw);
+}
+
+int main(void) {
+  test_bad_args();
+  test_persistent();
+  return 0;
+}
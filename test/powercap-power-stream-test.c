@@ -0,0 +1,133 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Unit tests for derived power streams.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "powercap.h"
+#include "powercap-power-stream.h"
+#include "powercap-snapshot.h"
+#include "test-common.h"
+
+#define NS_PER_MS 1000000ULL
+
+static int near(double a, double b) {
+  return a - b < 1e-9 && b - a < 1e-9;
+}
+
+static void test_bad_args(void) {
+  powercap_power_stream_config cfg = { POWERCAP_POWER_FILTER_EWMA, 0, 0, 0 };
+  powercap_power_stream stream;
+  powercap_zone zone = { 0 };
+  assert(powercap_power_stream_init(NULL, &cfg, 0) == -EINVAL);
+  assert(powercap_power_stream_init(&stream, NULL, 0) == -EINVAL);
+  // no half-life
+  assert(powercap_power_stream_init(&stream, &cfg, 0) == -EINVAL);
+  cfg.filter = POWERCAP_POWER_FILTER_KALMAN;
+  assert(powercap_power_stream_init(&stream, &cfg, 0) == -EINVAL);
+  cfg.filter = (powercap_power_filter) 42;
+  assert(powercap_power_stream_init(&stream, &cfg, 0) == -EINVAL);
+  cfg.filter = POWERCAP_POWER_FILTER_RAW;
+  // no energy_uj file
+  assert(powercap_power_stream_init_zone(&stream, &cfg, &zone) == -EINVAL);
+  assert(powercap_power_stream_update(NULL, 0, 0, NULL) == -EINVAL);
+}
+
+static void test_raw(void) {
+  powercap_power_stream_config cfg = { POWERCAP_POWER_FILTER_RAW, 0, 0, 0 };
+  powercap_power_stream stream;
+  double power;
+  assert(powercap_power_stream_init(&stream, &cfg, 1000) == 0);
+  assert(powercap_power_stream_update(&stream, 0, NS_PER_MS, &power) == 1);
+  assert(!(power > 0.0));
+  // 1 mJ in 1 ms
+  assert(powercap_power_stream_update(&stream, 1000, 2 * NS_PER_MS, &power) == 0);
+  assert(near(power, 1.0));
+  // the same time is ignored
+  assert(powercap_power_stream_update(&stream, 1500, 2 * NS_PER_MS, &power) == 0);
+  assert(near(power, 1.0));
+  // wraps at 1000 uJ: 1000 -> 0 -> 100 is 100 uJ
+  assert(powercap_power_stream_update(&stream, 100, 3 * NS_PER_MS, &power) == 0);
+  assert(near(power, 0.1));
+  assert(powercap_power_stream_update(&stream, 200, 0, &power) == -EINVAL);
+  assert(near(powercap_power_stream_get_power_w(&stream), 0.1));
+  assert(powercap_power_stream_reset(&stream) == 0);
+  assert(powercap_power_stream_update(&stream, 200, 0, NULL) == 1);
+}
+
+static void test_ewma(void) {
+  powercap_power_stream_config cfg = { POWERCAP_POWER_FILTER_EWMA, 1000, 0, 0 };
+  powercap_power_stream stream;
+  double power;
+  assert(powercap_power_stream_init(&stream, &cfg, 0) == 0);
+  assert(powercap_power_stream_update(&stream, 0, 0, &power) == 1);
+  // the first measurement initializes the average
+  assert(powercap_power_stream_update(&stream, 1000, NS_PER_MS, &power) == 0);
+  assert(near(power, 1.0));
+  // after one half-life, a 3 W measurement moves the average halfway
+  assert(powercap_power_stream_update(&stream, 4000, 2 * NS_PER_MS, &power) == 0);
+  assert(near(power, 2.0));
+  // after two half-lives, three quarters of the way
+  assert(powercap_power_stream_update(&stream, 16000, 4 * NS_PER_MS, &power) == 0);
+  assert(near(power, 5.0));
+}
+
+static void test_kalman(void) {
+  powercap_power_stream_config cfg = { POWERCAP_POWER_FILTER_KALMAN, 0, 1.0, 1.0 };
+  powercap_power_stream stream;
+  double power = 0;
+  uint64_t energy = 0;
+  uint64_t t;
+  assert(powercap_power_stream_init(&stream, &cfg, 0) == 0);
+  assert(powercap_power_stream_update(&stream, energy, 0, NULL) == 1);
+  // alternating 4 W and 6 W measurements are smoothed toward 5 W
+  for (t = 1; t <= 100; t++) {
+    energy += t % 2 ? 4000 : 6000;
+    assert(powercap_power_stream_update(&stream, energy, t * NS_PER_MS, &power) == 0);
+  }
+  assert(power > 4.8 && power < 5.2);
+  assert(stream.variance < cfg.measurement_noise);
+}
+
+static void test_snapshot(void) {
+  powercap_power_stream_config cfg = { POWERCAP_POWER_FILTER_RAW, 0, 0, 0 };
+  powercap_power_stream streams[2];
+  powercap_snapshot snap;
+  powercap_zone zone = { 0 };
+  double power[2];
+  assert(powercap_snapshot_init(&snap, 2) == 0);
+  zone.energy_uj = make_file(0);
+  zone.max_energy_range_uj = make_file(1000);
+  // counter 1 is unsupported
+  assert(powercap_snapshot_set_zone(&snap, 0, &zone) == 0);
+  assert(powercap_power_stream_init_zone(&streams[0], &cfg, &zone) == 0);
+  assert(streams[0].max_energy_range_uj == 1000);
+  assert(powercap_power_stream_init(&streams[1], &cfg, 0) == 0);
+  snap.energy_uj[0] = 900;
+  snap.time_ns[0] = NS_PER_MS;
+  assert(powercap_power_stream_update_snapshot(streams, &snap, power) == 1);
+  snap.energy_uj[0] = 100;
+  snap.time_ns[0] = 2 * NS_PER_MS;
+  assert(powercap_power_stream_update_snapshot(streams, &snap, power) == 0);
+  assert(near(power[0], 0.2));
+  assert(!(power[1] > 0.0));
+  powercap_snapshot_destroy(&snap);
+  close(zone.energy_uj);
+  close(zone.max_energy_range_uj);
+}
+
+int main(void) {
+  test_bad_args();
+  test_raw();
+  test_ewma();
+  test_kalman();
+  test_snapshot();
+  return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Unit tests for the energy profiler, using a temporary file in place of a sysfs energy counter.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "powercap.h"
+#include "powercap-profiler.h"
+#include "powercap-snapshot.h"
+#include "test-common.h"
+
+#define BURN_NS 200000000ULL
+
+static uint64_t cpu_ns(void) {
+  struct timespec ts;
+  assert(clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) == 0);
+  return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+/* Exported (the test is linked with -rdynamic) so the profiler can name it */
+__attribute__((noinline)) uint64_t powercap_profiler_test_burn(int fd);
+__attribute__((noinline)) uint64_t powercap_profiler_test_burn(int fd) {
+  const uint64_t end = cpu_ns() + BURN_NS;
+  volatile uint64_t x = 0;
+  char buf[32];
+  uint64_t energy_uj = 1000;
+  int len;
+  while (cpu_ns() < end) {
+    for (len = 0; len < 100000; len++) {
+      x = x + (uint64_t) len;
+    }
+    // the counter consumes energy while the process runs
+    energy_uj += 1000;
+    len = snprintf(buf, sizeof(buf), "%"PRIu64"\n", energy_uj);
+    assert(pwrite(fd, buf, (size_t) len, 0) == len);
+  }
+  return x;
+}
+
+static void test_bad_args(void) {
+  powercap_profiler_config cfg = { 1000, 10000, 16, 64 };
+  powercap_zone zone = { 0 };
+  powercap_snapshot snap;
+  powercap_profiler* p;
+  zone.energy_uj = make_file(0);
+  assert(powercap_snapshot_init(&snap, 1) == 0);
+  assert(powercap_snapshot_set_zone(&snap, 0, &zone) == 0);
+  assert(powercap_profiler_create(NULL, &cfg) == NULL);
+  assert(powercap_profiler_create(&snap, NULL) == NULL);
+  cfg.max_frames = POWERCAP_PROFILER_MAX_FRAMES + 1;
+  assert(powercap_profiler_create(&snap, &cfg) == NULL);
+  cfg.max_frames = 16;
+  cfg.frequency_hz = 0;
+  assert(powercap_profiler_create(&snap, &cfg) == NULL);
+  cfg.frequency_hz = 1000;
+  assert((p = powercap_profiler_create(&snap, &cfg)) != NULL);
+  assert(powercap_profiler_stop(p) == -EINVAL);
+  assert(powercap_profiler_write_folded(p, NULL, POWERCAP_PROFILER_WEIGHT_ENERGY) == -EINVAL);
+  assert(powercap_profiler_write_folded(p, stdout, (powercap_profiler_weight) 42) == -EINVAL);
+  assert(powercap_profiler_destroy(p) == 0);
+  assert(powercap_profiler_destroy(NULL) == 0);
+  powercap_snapshot_destroy(&snap);
+  close(zone.energy_uj);
+}
+
+static void test_profile(void) {
+  powercap_profiler_config cfg = { 1000, 10000, 32, 4096 };
+  powercap_profiler_stats stats;
+  powercap_zone zone = { 0 };
+  powercap_snapshot snap;
+  powercap_profiler* p;
+  powercap_profiler* p2;
+  char line[8192];
+  char* value;
+  uint64_t samples = 0;
+  int found = 0;
+  FILE* f;
+  zone.energy_uj = make_file(1000);
+  assert(powercap_snapshot_init(&snap, 1) == 0);
+  assert(powercap_snapshot_set_zone(&snap, 0, &zone) == 0);
+  assert((p = powercap_profiler_create(&snap, &cfg)) != NULL);
+  assert((p2 = powercap_profiler_create(&snap, &cfg)) != NULL);
+  powercap_snapshot_destroy(&snap);
+
+  assert(powercap_profiler_start(p) == 0);
+  // only one profiler may run at a time
+  assert(powercap_profiler_start(p2) == -EBUSY);
+  assert(powercap_profiler_write_folded(p, stdout, POWERCAP_PROFILER_WEIGHT_SAMPLES) == -EBUSY);
+  powercap_profiler_test_burn(zone.energy_uj);
+  assert(powercap_profiler_stop(p) == 0);
+  assert(powercap_profiler_get_stats(p, &stats) == 0);
+  assert(stats.samples > 0);
+  assert(stats.stacks > 0);
+  assert(stats.total_energy_uj > 0);
+  assert(stats.attributed_energy_uj > 0);
+  assert(!(stats.attributed_energy_uj > (double) stats.total_energy_uj));
+
+  // every sample is in exactly one stack
+  assert((f = tmpfile()) != NULL);
+  assert(powercap_profiler_write_folded(p, f, POWERCAP_PROFILER_WEIGHT_SAMPLES) == 0);
+  rewind(f);
+  while (fgets(line, sizeof(line), f) != NULL) {
+    assert((value = strrchr(line, ' ')) != NULL);
+    samples += strtoull(value + 1, NULL, 0);
+    if (strstr(line, "powercap_profiler_test_burn") != NULL) {
+      found = 1;
+    }
+  }
+  fclose(f);
+  assert(samples == stats.samples);
+  assert(found);
+  assert((f = tmpfile()) != NULL);
+  assert(powercap_profiler_write_folded(p, f, POWERCAP_PROFILER_WEIGHT_ENERGY) == 0);
+  assert(ftell(f) > 0);
+  fclose(f);
+
+  // the other profiler can run now
+  assert(powercap_profiler_start(p2) == 0);
+  assert(powercap_profiler_destroy(p2) == 0);
+  assert(powercap_profiler_destroy(p) == 0);
+  close(zone.energy_uj);
+}
+
+int main(void) {
+  test_bad_args();
+  test_profile();
+  return 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Benchmark RAPL initialization - compares initializing instances one at a time with powercap_rapl_init_all, and with
+ * a copy of the original initialization algorithm (fixed zone fields, probing each file and name through sysfs paths).
+ * Requires a real system.
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "powercap.h"
+#include "powercap-common.h"
+#include "powercap-rapl.h"
+#include "powercap-sysfs.h"
+
+#define CONTROL_TYPE "intel-rapl"
+#define MAX_NAME_SIZE 64
+
+/* The original fixed layout - one set of files per zone type, with long and short term constraints only */
+typedef struct baseline_zone_files {
+  powercap_zone zone;
+  powercap_constraint constraint_long;
+  powercap_constraint constraint_short;
+} baseline_zone_files;
+
+typedef struct baseline_pkg {
+  baseline_zone_files pkg;
+  baseline_zone_files core;
+  baseline_zone_files uncore;
+  baseline_zone_files dram;
+  baseline_zone_files psys;
+} baseline_pkg;
+
+static powercap_constraint* baseline_get_constraint(baseline_zone_files* fds, const uint32_t* zones, uint32_t depth,
+                                                    uint32_t constraint) {
+  char name[MAX_NAME_SIZE];
+  if (powercap_sysfs_constraint_get_name(CONTROL_TYPE, zones, depth, constraint, name, sizeof(name)) < 0) {
+    return NULL;
+  }
+  if (!strncmp(name, "long_term", sizeof("long_term"))) {
+    return &fds->constraint_long;
+  } else if (!strncmp(name, "short_term", sizeof("short_term"))) {
+    return &fds->constraint_short;
+  }
+  errno = EINVAL;
+  return NULL;
+}
+
+static int baseline_open_all(const uint32_t* zones, uint32_t depth, baseline_zone_files* fds, int ro) {
+  char buf[PATH_MAX] = { 0 };
+  powercap_constraint* pc;
+  uint32_t i = 0;
+  if (powercap_zone_open(&fds->zone, buf, sizeof(buf), CONTROL_TYPE, zones, depth, ro)) {
+    return -errno;
+  }
+  while (!powercap_sysfs_constraint_exists(CONTROL_TYPE, zones, depth, i)) {
+    if ((pc = baseline_get_constraint(fds, zones, depth, i)) == NULL) {
+      return -errno;
+    }
+    if (pc->power_limit_uw) {
+      errno = EINVAL;
+      return -errno;
+    }
+    buf[0] = '\0';
+    if (powercap_constraint_open(pc, buf, sizeof(buf), CONTROL_TYPE, zones, depth, i, ro)) {
+      return -errno;
+    }
+    i++;
+  }
+  return 0;
+}
+
+static baseline_zone_files* baseline_get_files(baseline_pkg* pkg, const uint32_t* zones, uint32_t depth) {
+  char name[MAX_NAME_SIZE];
+  if (powercap_sysfs_zone_get_name(CONTROL_TYPE, zones, depth, name, sizeof(name)) < 0) {
+    return NULL;
+  }
+  if (!strncmp(name, "package", sizeof("package") - 1)) {
+    return &pkg->pkg;
+  } else if (!strncmp(name, "core", sizeof("core"))) {
+    return &pkg->core;
+  } else if (!strncmp(name, "uncore", sizeof("uncore"))) {
+    return &pkg->uncore;
+  } else if (!strncmp(name, "dram", sizeof("dram"))) {
+    return &pkg->dram;
+  } else if (!strncmp(name, "psys", sizeof("psys"))) {
+    return &pkg->psys;
+  }
+  errno = EINVAL;
+  return NULL;
+}
+
+static void baseline_destroy_files(baseline_zone_files* files) {
+  powercap_zone_close(&files->zone);
+  powercap_constraint_close(&files->constraint_long);
+  powercap_constraint_close(&files->constraint_short);
+}
+
+static void baseline_destroy(baseline_pkg* pkg) {
+  baseline_destroy_files(&pkg->pkg);
+  baseline_destroy_files(&pkg->core);
+  baseline_destroy_files(&pkg->uncore);
+  baseline_destroy_files(&pkg->dram);
+  baseline_destroy_files(&pkg->psys);
+}
+
+static int baseline_init(uint32_t id, baseline_pkg* pkg, int ro) {
+  uint32_t zones[2] = { id, 0 };
+  baseline_zone_files* files;
+  int ret;
+  if ((files = baseline_get_files(pkg, zones, 1)) == NULL) {
+    return -errno;
+  }
+  memset(pkg, 0, sizeof(baseline_pkg));
+  if (!(ret = baseline_open_all(zones, 1, files, ro))) {
+    while (!powercap_sysfs_zone_exists(CONTROL_TYPE, zones, 2) && !ret) {
+      if ((files = baseline_get_files(pkg, zones, 2)) == NULL) {
+        ret = -errno;
+      } else if (files->zone.name) {
+        errno = EBUSY;
+        ret = -errno;
+      } else {
+        ret = baseline_open_all(zones, 2, files, ro);
+        zones[1]++;
+      }
+    }
+  }
+  if (ret) {
+    baseline_destroy(pkg);
+  }
+  return ret;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+static uint32_t baseline_get_num_instances(void) {
+  uint32_t n = 0;
+  while (!powercap_sysfs_zone_exists(CONTROL_TYPE, &n, 1)) {
+    n++;
+  }
+  return n;
+}
+
+static int bench_baseline(int ro) {
+  baseline_pkg* pkgs;
+  uint32_t n = baseline_get_num_instances();
+  uint32_t i;
+  int ret = 0;
+  if (n == 0) {
+    fprintf(stderr, "No RAPL instances found\n");
+    return -1;
+  }
+  if ((pkgs = malloc(n * sizeof(baseline_pkg))) == NULL) {
+    perror("malloc");
+    return -1;
+  }
+  for (i = 0; i < n; i++) {
+    if (baseline_init(i, &pkgs[i], ro)) {
+      perror("baseline_init");
+      ret = -1;
+      break;
+    }
+  }
+  n = i;
+  for (i = 0; i < n; i++) {
+    baseline_destroy(&pkgs[i]);
+  }
+  free(pkgs);
+  return ret;
+}
+
+static int bench_loop(int ro) {
+  powercap_rapl_pkg* pkgs;
+  uint32_t n = powercap_rapl_get_num_instances();
+  uint32_t i;
+  int ret = 0;
+  if (n == 0) {
+    perror("powercap_rapl_get_num_instances");
+    return -1;
+  }
+  if ((pkgs = malloc(n * sizeof(powercap_rapl_pkg))) == NULL) {
+    perror("malloc");
+    return -1;
+  }
+  for (i = 0; i < n; i++) {
+    if (powercap_rapl_init(i, &pkgs[i], ro)) {
+      perror("powercap_rapl_init");
+      ret = -1;
+      break;
+    }
+  }
+  n = i;
+  for (i = 0; i < n; i++) {
+    powercap_rapl_destroy(&pkgs[i]);
+  }
+  free(pkgs);
+  return ret;
+}
+
+static int bench_init_all(int ro, int parallel) {
+  powercap_rapl_pkg* pkgs;
+  uint32_t n;
+  if (powercap_rapl_init_all(&pkgs, &n, ro, parallel)) {
+    perror("powercap_rapl_init_all");
+    return -1;
+  }
+  powercap_rapl_destroy_all(pkgs, n);
+  return 0;
+}
+
+// optional parameters - number of iterations, boolean to enable read/write
+int main(int argc, char** argv) {
+  uint32_t iters = 100;
+  uint32_t i;
+  uint64_t start;
+  uint64_t elapsed[4];
+  int ro = 1;
+  if (argc > 1) {
+    iters = (uint32_t) strtoul(argv[1], NULL, 0);
+  }
+  if (argc > 2) {
+    // a value other than 0 enables read/write
+    ro = !atoi(argv[2]);
+  }
+  if (iters == 0) {
+    fprintf(stderr, "Iterations must be > 0\n");
+    return EXIT_FAILURE;
+  }
+
+  start = now_ns();
+  for (i = 0; i < iters; i++) {
+    if (bench_baseline(ro)) {
+      return EXIT_FAILURE;
+    }
+  }
+  elapsed[3] = now_ns() - start;
+
+  start = now_ns();
+  for (i = 0; i < iters; i++) {
+    if (bench_loop(ro)) {
+      return EXIT_FAILURE;
+    }
+  }
+  elapsed[0] = now_ns() - start;
+
+  start = now_ns();
+  for (i = 0; i < iters; i++) {
+    if (bench_init_all(ro, 0)) {
+      return EXIT_FAILURE;
+    }
+  }
+  elapsed[1] = now_ns() - start;
+
+  start = now_ns();
+  for (i = 0; i < iters; i++) {
+    if (bench_init_all(ro, 1)) {
+      return EXIT_FAILURE;
+    }
+  }
+  elapsed[2] = now_ns() - start;
+
+  printf("Iterations: %"PRIu32"\n", iters);
+  printf("original init loop (baseline):       %"PRIu64" us/iter\n", elapsed[3] / iters / 1000);
+  printf("powercap_rapl_init loop:             %"PRIu64" us/iter\n", elapsed[0] / iters / 1000);
+  printf("powercap_rapl_init_all (serial):     %"PRIu64" us/iter\n", elapsed[1] / iters / 1000);
+  printf("powercap_rapl_init_all (parallel):   %"PRIu64" us/iter\n", elapsed[2] / iters / 1000);
+  return EXIT_SUCCESS;
+}
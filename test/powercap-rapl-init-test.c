@@ -0,0 +1,209 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Unit tests for RAPL initialization, using a fake sysfs tree at POWERCAP_PATH (set by the build).
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "powercap-rapl.h"
+
+static void make_dir(const char* fmt, ...) {
+  char path[PATH_MAX];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(path, sizeof(path), fmt, args);
+  va_end(args);
+  assert(mkdir(path, 0755) == 0);
+}
+
+static void make_file(const char* dir, const char* file, const char* val) {
+  char path[PATH_MAX];
+  FILE* f;
+  snprintf(path, sizeof(path), "%s/%s", dir, file);
+  assert((f = fopen(path, "w")) != NULL);
+  fprintf(f, "%s\n", val);
+  fclose(f);
+}
+
+/* A zone directory with a name, energy counter, and constraints with the given names */
+static void make_zone(const char* dir, const char* name, const char* const* constraints, uint32_t nconstraints) {
+  char file[64];
+  uint32_t i;
+  make_dir("%s", dir);
+  make_file(dir, "name", name);
+  make_file(dir, "energy_uj", "1000");
+  make_file(dir, "max_energy_range_uj", "262143328850");
+  for (i = 0; i < nconstraints; i++) {
+    snprintf(file, sizeof(file), "constraint_%"PRIu32"_name", i);
+    make_file(dir, file, constraints[i]);
+    snprintf(file, sizeof(file), "constraint_%"PRIu32"_power_limit_uw", i);
+    make_file(dir, file, "10000000");
+  }
+}
+
+static void remove_tree(void) {
+  char cmd[PATH_MAX + 16];
+  snprintf(cmd, sizeof(cmd), "rm -rf '%s'", POWERCAP_PATH);
+  assert(system(cmd) == 0);
+}
+
+static void make_msr_tree(void) {
+  // unrecognized and duplicate constraint names are kept as other constraints
+  static const char* const pkg_constraints[] = { "long_term", "short_term", "peak_power", "mystery", "long_term" };
+  static const char* const long_term[] = { "long_term" };
+  make_dir("%s/intel-rapl", POWERCAP_PATH);
+  make_zone(POWERCAP_PATH"/intel-rapl/intel-rapl:0", "package-0", pkg_constraints, 5);
+  make_zone(POWERCAP_PATH"/intel-rapl/intel-rapl:0/intel-rapl:0:0", "core", long_term, 1);
+  make_zone(POWERCAP_PATH"/intel-rapl/intel-rapl:0/intel-rapl:0:1", "dram", long_term, 1);
+  // an unrecognized zone name, and a duplicate one
+  make_zone(POWERCAP_PATH"/intel-rapl/intel-rapl:0/intel-rapl:0:2", "gpu", NULL, 0);
+  make_zone(POWERCAP_PATH"/intel-rapl/intel-rapl:0/intel-rapl:0:3", "dram", NULL, 0);
+  make_zone(POWERCAP_PATH"/intel-rapl/intel-rapl:1", "package-1", long_term, 1);
+}
+
+static void make_mmio_tree(void) {
+  static const char* const long_term[] = { "long_term" };
+  make_dir("%s/intel-rapl-mmio", POWERCAP_PATH);
+  make_zone(POWERCAP_PATH"/intel-rapl-mmio/intel-rapl-mmio:0", "package-0", long_term, 1);
+  make_zone(POWERCAP_PATH"/intel-rapl-mmio/intel-rapl-mmio:0/intel-rapl-mmio:0:0", "dram", long_term, 1);
+  make_zone(POWERCAP_PATH"/intel-rapl-mmio/intel-rapl-mmio:0/intel-rapl-mmio:0:1", "uncore", NULL, 0);
+  make_zone(POWERCAP_PATH"/intel-rapl-mmio/intel-rapl-mmio:0/intel-rapl-mmio:0:2", "dram", NULL, 0);
+  // doesn't match any MSR instance
+  make_zone(POWERCAP_PATH"/intel-rapl-mmio/intel-rapl-mmio:1", "package-5", NULL, 0);
+}
+
+static void test_msr_only(void) {
+  powercap_rapl_pkg pkg;
+  const powercap_rapl_domain* d;
+  uint64_t val;
+  make_dir("%s", POWERCAP_PATH);
+  make_msr_tree();
+  assert(powercap_rapl_get_num_instances() == 2);
+  assert(powercap_rapl_init(0, &pkg, 1) == 0);
+  assert(powercap_rapl_get_num_domains(&pkg) == 5);
+  assert((d = powercap_rapl_get_domain(&pkg, 0)) != NULL);
+  assert(d->type == POWERCAP_RAPL_ZONE_PACKAGE);
+  assert(d->depth[POWERCAP_RAPL_INTERFACE_MSR] == 1 && d->depth[POWERCAP_RAPL_INTERFACE_MMIO] == 0);
+  assert(powercap_rapl_get_energy_uj(&pkg, POWERCAP_RAPL_ZONE_PACKAGE, &val) == 0 && val == 1000);
+
+  // long, short, and peak constraints, then the others in sysfs order
+  assert(powercap_rapl_is_constraint_supported(&pkg, POWERCAP_RAPL_ZONE_PACKAGE, POWERCAP_RAPL_CONSTRAINT_LONG) == 1);
+  assert(powercap_rapl_is_constraint_supported(&pkg, POWERCAP_RAPL_ZONE_PACKAGE, POWERCAP_RAPL_CONSTRAINT_SHORT) == 1);
+  assert(powercap_rapl_is_constraint_supported(&pkg, POWERCAP_RAPL_ZONE_PACKAGE, POWERCAP_RAPL_CONSTRAINT_PEAK) == 1);
+  assert(powercap_rapl_get_num_other_constraints(&pkg, POWERCAP_RAPL_ZONE_PACKAGE) == 2);
+  assert(d->files[POWERCAP_RAPL_INTERFACE_MSR].nconstraint_other == 2);
+  assert(powercap_rapl_is_constraint_supported(&pkg, POWERCAP_RAPL_ZONE_PACKAGE,
+                                               (powercap_rapl_constraint) (POWERCAP_RAPL_CONSTRAINT_OTHER + 1)) == 1);
+  assert(powercap_rapl_is_constraint_supported(&pkg, POWERCAP_RAPL_ZONE_PACKAGE,
+                                               (powercap_rapl_constraint) (POWERCAP_RAPL_CONSTRAINT_OTHER + 2)) == 0);
+  assert(powercap_rapl_get_power_limit_uw(&pkg, POWERCAP_RAPL_ZONE_PACKAGE, POWERCAP_RAPL_CONSTRAINT_PEAK, &val) == 0);
+  assert(val == 10000000);
+  assert(powercap_rapl_is_constraint_supported(&pkg, POWERCAP_RAPL_ZONE_CORE, POWERCAP_RAPL_CONSTRAINT_LONG) == 1);
+  assert(powercap_rapl_is_constraint_supported(&pkg, POWERCAP_RAPL_ZONE_CORE, POWERCAP_RAPL_CONSTRAINT_SHORT) == 0);
+  assert(powercap_rapl_is_constraint_supported(&pkg, POWERCAP_RAPL_ZONE_CORE, POWERCAP_RAPL_CONSTRAINT_PEAK) == 0);
+
+  // subzones in sysfs order, including unrecognized and duplicate names
+  assert(powercap_rapl_get_domain(&pkg, 1)->type == POWERCAP_RAPL_ZONE_CORE);
+  assert(powercap_rapl_get_domain(&pkg, 2)->type == POWERCAP_RAPL_ZONE_DRAM);
+  d = powercap_rapl_get_domain(&pkg, 3);
+  assert(d->type == POWERCAP_RAPL_ZONE_OTHER && !strcmp(d->name, "gpu"));
+  d = powercap_rapl_get_domain(&pkg, 4);
+  assert(d->type == POWERCAP_RAPL_ZONE_DRAM && d->zones[POWERCAP_RAPL_INTERFACE_MSR][1] == 3);
+  assert(powercap_rapl_get_domain(&pkg, 5) == NULL);
+  assert(powercap_rapl_is_zone_supported(&pkg, POWERCAP_RAPL_ZONE_UNCORE) == 0);
+  assert(powercap_rapl_destroy(&pkg) == 0);
+  remove_tree();
+}
+
+static void test_msr_mmio(void) {
+  powercap_rapl_pkg* pkgs;
+  const powercap_rapl_domain* d;
+  uint32_t n;
+  make_dir("%s", POWERCAP_PATH);
+  make_msr_tree();
+  make_mmio_tree();
+  // instances are enumerated from MSR
+  assert(powercap_rapl_get_num_instances() == 2);
+  assert(powercap_rapl_init_all(&pkgs, &n, 1, 1) == 0);
+  assert(n == 2);
+
+  // MMIO zones are matched by name, where unmatched ones are appended
+  assert(powercap_rapl_get_num_domains(&pkgs[0]) == 6);
+  d = powercap_rapl_get_domain(&pkgs[0], 0);
+  assert(d->depth[POWERCAP_RAPL_INTERFACE_MSR] == 1 && d->depth[POWERCAP_RAPL_INTERFACE_MMIO] == 1);
+  assert(d->zones[POWERCAP_RAPL_INTERFACE_MMIO][0] == 0);
+  assert(powercap_rapl_get_domain(&pkgs[0], 1)->depth[POWERCAP_RAPL_INTERFACE_MMIO] == 0);
+  // duplicate names match in order
+  d = powercap_rapl_get_domain(&pkgs[0], 2);
+  assert(d->type == POWERCAP_RAPL_ZONE_DRAM && d->depth[POWERCAP_RAPL_INTERFACE_MMIO] == 2);
+  assert(d->zones[POWERCAP_RAPL_INTERFACE_MMIO][1] == 0);
+  assert(d->files[POWERCAP_RAPL_INTERFACE_MMIO].constraint_long.power_limit_uw > 0);
+  d = powercap_rapl_get_domain(&pkgs[0], 4);
+  assert(d->type == POWERCAP_RAPL_ZONE_DRAM && d->depth[POWERCAP_RAPL_INTERFACE_MMIO] == 2);
+  assert(d->zones[POWERCAP_RAPL_INTERFACE_MMIO][1] == 2);
+  d = powercap_rapl_get_domain(&pkgs[0], 5);
+  assert(d->type == POWERCAP_RAPL_ZONE_UNCORE);
+  assert(d->depth[POWERCAP_RAPL_INTERFACE_MSR] == 0 && d->depth[POWERCAP_RAPL_INTERFACE_MMIO] == 2);
+  assert(powercap_rapl_is_interface_supported(&pkgs[0], POWERCAP_RAPL_ZONE_UNCORE, POWERCAP_RAPL_INTERFACE_MSR) == 0);
+  assert(powercap_rapl_is_interface_supported(&pkgs[0], POWERCAP_RAPL_ZONE_UNCORE, POWERCAP_RAPL_INTERFACE_MMIO) == 1);
+  assert(powercap_rapl_is_interface_supported(&pkgs[0], POWERCAP_RAPL_ZONE_CORE, POWERCAP_RAPL_INTERFACE_MMIO) == 0);
+
+  // no MMIO zone has the same name as package-1
+  assert(powercap_rapl_get_num_domains(&pkgs[1]) == 1);
+  assert(powercap_rapl_get_domain(&pkgs[1], 0)->depth[POWERCAP_RAPL_INTERFACE_MMIO] == 0);
+  assert(powercap_rapl_destroy_all(pkgs, n) == 0);
+  remove_tree();
+}
+
+static void test_mmio_only(void) {
+  powercap_rapl_pkg pkg;
+  const powercap_rapl_domain* d;
+  uint32_t i;
+  make_dir("%s", POWERCAP_PATH);
+  make_mmio_tree();
+  // instances are enumerated from MMIO when there's no MSR control type
+  assert(powercap_rapl_get_num_instances() == 2);
+  assert(powercap_rapl_init(0, &pkg, 1) == 0);
+  assert(powercap_rapl_get_num_domains(&pkg) == 4);
+  for (i = 0; i < 4; i++) {
+    d = powercap_rapl_get_domain(&pkg, i);
+    assert(d->depth[POWERCAP_RAPL_INTERFACE_MSR] == 0 && d->depth[POWERCAP_RAPL_INTERFACE_MMIO] == (i ? 2 : 1));
+  }
+  assert(powercap_rapl_get_domain(&pkg, 2)->type == POWERCAP_RAPL_ZONE_UNCORE);
+  assert(powercap_rapl_is_interface_supported(&pkg, POWERCAP_RAPL_ZONE_PACKAGE, POWERCAP_RAPL_INTERFACE_MSR) == 0);
+  assert(powercap_rapl_is_constraint_supported(&pkg, POWERCAP_RAPL_ZONE_DRAM, POWERCAP_RAPL_CONSTRAINT_LONG) == 1);
+  assert(powercap_rapl_destroy(&pkg) == 0);
+  remove_tree();
+}
+
+static void test_missing_name(void) {
+  powercap_rapl_pkg pkg;
+  make_dir("%s", POWERCAP_PATH);
+  make_msr_tree();
+  // a subzone without a name can't be identified
+  remove(POWERCAP_PATH"/intel-rapl/intel-rapl:0/intel-rapl:0:2/name");
+  assert(powercap_rapl_init(0, &pkg, 1) == -ENOENT);
+  assert(powercap_rapl_init(1, &pkg, 1) == 0);
+  assert(powercap_rapl_destroy(&pkg) == 0);
+  remove_tree();
+}
+
+int main(void) {
+  // in case a previous run failed
+  remove_tree();
+  test_msr_only();
+  test_msr_mmio();
+  test_mmio_only();
+  test_missing_name();
+  return 0;
+}
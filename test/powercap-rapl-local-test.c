@@ -0,0 +1,109 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Unit tests for socket-local readers, using temporary files in place of sysfs energy counters.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "powercap-rapl.h"
+#include "powercap-rapl-local.h"
+#include "powercap-snapshot.h"
+#include "test-common.h"
+
+#define PERIOD_US 1000
+
+static void set_file(int fd, uint64_t val) {
+  char buf[24];
+  int len = snprintf(buf, sizeof(buf), "%"PRIu64"\n", val);
+  assert(ftruncate(fd, 0) == 0);
+  assert(pwrite(fd, buf, (size_t) len, 0) == len);
+}
+
+static void wait_ready(const powercap_rapl_local* local, uint32_t id, uint64_t* energy_uj, uint64_t* time_ns) {
+  while (powercap_rapl_local_read(local, id, energy_uj, time_ns)) {
+    assert(errno == EAGAIN);
+    usleep(PERIOD_US);
+  }
+}
+
+static void test_bad_args(void) {
+  powercap_rapl_pkg pkg;
+  memset(&pkg, 0, sizeof(pkg));
+  assert(powercap_rapl_local_start(NULL, 1, PERIOD_US, NULL) == NULL);
+  assert(powercap_rapl_local_start(&pkg, 0, PERIOD_US, NULL) == NULL);
+  assert(powercap_rapl_local_start(&pkg, 1, 0, NULL) == NULL);
+  assert(powercap_rapl_local_stop(NULL) == -EINVAL);
+}
+
+static void test_read(void) {
+  powercap_rapl_domain domains[3];
+  powercap_rapl_pkg pkgs[2];
+  powercap_rapl_local* local;
+  powercap_snapshot snap;
+  uint64_t energy[2];
+  uint64_t t0;
+  uint64_t t1;
+  int cpus[2] = { -1, -1 };
+  memset(domains, 0, sizeof(domains));
+  // first instance has a package zone and a subzone without an energy counter, second instance uses the MMIO interface
+  snprintf(domains[0].name, sizeof(domains[0].name), "package-0");
+  domains[0].files[POWERCAP_RAPL_INTERFACE_MSR].zone.energy_uj = make_file(100);
+  snprintf(domains[1].name, sizeof(domains[1].name), "dram");
+  snprintf(domains[2].name, sizeof(domains[2].name), "not-a-package");
+  domains[2].files[POWERCAP_RAPL_INTERFACE_MMIO].zone.energy_uj = make_file(200);
+  pkgs[0].domains = &domains[0];
+  pkgs[0].ndomains = 2;
+  pkgs[1].domains = &domains[2];
+  pkgs[1].ndomains = 1;
+
+  assert((local = powercap_rapl_local_start(pkgs, 2, PERIOD_US, cpus)) != NULL);
+  // can't determine the second instance's CPUs from its name
+  assert(powercap_rapl_local_get_cpu(local, 1) == -1);
+  assert(powercap_rapl_local_get_cpu(local, 2) == -EINVAL);
+  assert(powercap_rapl_local_read(local, 2, energy, NULL) == -EINVAL);
+
+  wait_ready(local, 0, energy, &t0);
+  assert(energy[0] == 100);
+  assert(energy[1] == 0);
+  wait_ready(local, 1, energy, NULL);
+  assert(energy[0] == 200);
+
+  // readers pick up new values
+  set_file(domains[0].files[POWERCAP_RAPL_INTERFACE_MSR].zone.energy_uj, 150);
+  do {
+    usleep(PERIOD_US);
+    assert(powercap_rapl_local_read(local, 0, energy, &t1) == 0);
+  } while (energy[0] != 150);
+  assert(t1 > t0);
+
+  // snapshots are laid out the same as powercap_rapl_snapshot_init
+  assert(powercap_snapshot_init(&snap, 2) == 0);
+  assert(powercap_rapl_local_snapshot(local, &snap) == -EINVAL);
+  powercap_snapshot_destroy(&snap);
+  assert(powercap_rapl_snapshot_init(&snap, pkgs, 2) == 0);
+  assert(snap.count == 3);
+  assert(powercap_rapl_local_snapshot(local, &snap) == 0);
+  assert(snap.energy_uj[0] == 150);
+  assert(snap.energy_uj[1] == 0);
+  assert(snap.energy_uj[2] == 200);
+  assert(snap.time_ns[0] == snap.time_ns[1]);
+  assert(snap.time_ns[2] > 0);
+  powercap_snapshot_destroy(&snap);
+
+  assert(powercap_rapl_local_stop(local) == 0);
+  close(domains[0].files[POWERCAP_RAPL_INTERFACE_MSR].zone.energy_uj);
+  close(domains[2].files[POWERCAP_RAPL_INTERFACE_MMIO].zone.energy_uj);
+}
+
+int main(void) {
+  test_bad_args();
+  test_read();
+  return 0;
+}
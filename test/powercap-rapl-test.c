@@ -12,8 +12,9 @@
 static const powercap_rapl_zone ZONES[] = { POWERCAP_RAPL_ZONE_PACKAGE, POWERCAP_RAPL_ZONE_CORE, POWERCAP_RAPL_ZONE_UNCORE, POWERCAP_RAPL_ZONE_DRAM, POWERCAP_RAPL_ZONE_PSYS };
 static const uint32_t NZONES = 5;
 static const char* const ZONE_NAMES[] = { "Package", "Core", "Uncore", "DRAM", "PSys" };
-static const powercap_rapl_constraint CONSTRAINTS[] = { POWERCAP_RAPL_CONSTRAINT_LONG, POWERCAP_RAPL_CONSTRAINT_SHORT };
-static const uint32_t NCONSTRAINTS = 2;
+static const powercap_rapl_constraint CONSTRAINTS[] = { POWERCAP_RAPL_CONSTRAINT_LONG, POWERCAP_RAPL_CONSTRAINT_SHORT, POWERCAP_RAPL_CONSTRAINT_PEAK };
+static const uint32_t NCONSTRAINTS = 3;
+static const char* const CONSTRAINT_NAMES[] = { "long", "short", "peak" };
 
 static int test_root(int ro) {
   int enabled;
@@ -49,6 +50,16 @@ static int test_pkg(const powercap_rapl_pkg* p, int ro) {
   int enabled;
   uint64_t val;
   int ret = 0;
+  const powercap_rapl_domain* d;
+
+  for (i = 0; i < powercap_rapl_get_num_domains(p); i++) {
+    if ((d = powercap_rapl_get_domain(p, i)) == NULL) {
+      perror("powercap_rapl_get_domain");
+      return -1;
+    }
+    printf("Domain %"PRIu32": %s (type=%d, msr=%s, mmio=%s)\n", i, d->name, d->type,
+           d->depth[POWERCAP_RAPL_INTERFACE_MSR] ? "yes" : "no", d->depth[POWERCAP_RAPL_INTERFACE_MMIO] ? "yes" : "no");
+  }
 
   for (i = 0; i < NZONES; i++) {
     supported = powercap_rapl_is_zone_supported(p, ZONES[i]);
@@ -151,9 +162,11 @@ static int test_pkg(const powercap_rapl_pkg* p, int ro) {
       printf("%s power_uw: %"PRIu64"\n", ZONE_NAMES[i], val);
     }
 
-    // test long and short term constraint properties
+    printf("%s other constraints: %"PRIu32"\n", ZONE_NAMES[i], powercap_rapl_get_num_other_constraints(p, ZONES[i]));
+
+    // test long term, short term, and peak power constraint properties
     for (j = 0; j < NCONSTRAINTS; j++) {
-      const char* const cnst = CONSTRAINTS[j] == POWERCAP_RAPL_CONSTRAINT_LONG ? "long" : "short";
+      const char* const cnst = CONSTRAINT_NAMES[j];
 
       supported = powercap_rapl_is_constraint_supported(p, ZONES[i], CONSTRAINTS[j]);
       if (supported < 0) {
@@ -0,0 +1,145 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Unit tests for RAPL instance topology, using a fake sysfs tree.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "powercap-rapl.h"
+#include "powercap-rapl-topology.h"
+
+static char root[] = "/tmp/powercap-rapl-topology-test-XXXXXX";
+
+static void make_cpu_dir(int cpu, const char* subdir) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d%s", root, cpu, subdir);
+  assert(mkdir(path, 0755) == 0);
+}
+
+static void make_id_file(int cpu, const char* file, int val) {
+  char path[PATH_MAX];
+  FILE* f;
+  snprintf(path, sizeof(path), "%s/devices/system/cpu/cpu%d/topology/%s", root, cpu, file);
+  assert((f = fopen(path, "w")) != NULL);
+  fprintf(f, "%d\n", val);
+  fclose(f);
+}
+
+/* A negative package means the CPU is offline (has no topology directory) */
+static void make_cpu(int cpu, int pkg, int die, int node) {
+  char node_dir[16];
+  make_cpu_dir(cpu, "");
+  if (pkg < 0) {
+    return;
+  }
+  make_cpu_dir(cpu, "/topology");
+  make_id_file(cpu, "physical_package_id", pkg);
+  if (die >= 0) {
+    make_id_file(cpu, "die_id", die);
+  }
+  if (node >= 0) {
+    snprintf(node_dir, sizeof(node_dir), "/node%d", node);
+    make_cpu_dir(cpu, node_dir);
+  }
+}
+
+static void make_tree(void) {
+  char path[PATH_MAX];
+  assert(mkdtemp(root) != NULL);
+  snprintf(path, sizeof(path), "%s/devices", root);
+  assert(mkdir(path, 0755) == 0);
+  snprintf(path, sizeof(path), "%s/devices/system", root);
+  assert(mkdir(path, 0755) == 0);
+  snprintf(path, sizeof(path), "%s/devices/system/cpu", root);
+  assert(mkdir(path, 0755) == 0);
+  // package 0 has two dies on one node, package 1 spans two nodes, cpu5 is offline, cpu70 has no die_id
+  make_cpu(0, 0, 0, 0);
+  make_cpu(1, 0, 0, 0);
+  make_cpu(2, 0, 1, 0);
+  make_cpu(3, 1, 0, 1);
+  make_cpu(4, 1, 0, 2);
+  make_cpu(5, -1, -1, -1);
+  make_cpu(70, 2, -1, -1);
+}
+
+static void remove_tree(void) {
+  char cmd[PATH_MAX + 16];
+  snprintf(cmd, sizeof(cmd), "rm -rf '%s'", root);
+  assert(system(cmd) == 0);
+}
+
+static void get_topology(const char* name, powercap_rapl_topology* topo, int expected) {
+  powercap_rapl_domain domain;
+  powercap_rapl_pkg pkg;
+  memset(&domain, 0, sizeof(domain));
+  snprintf(domain.name, sizeof(domain.name), "%s", name);
+  pkg.domains = &domain;
+  pkg.ndomains = 1;
+  assert(powercap_rapl_get_topology(&pkg, topo) == expected);
+}
+
+static void test_topology(void) {
+  powercap_rapl_topology topo;
+
+  get_topology("package-0", &topo, 0);
+  assert(topo.package_id == 0);
+  assert(topo.die_id == -1);
+  assert(topo.numa_node == 0);
+  assert(topo.ncpus == 3);
+  assert(topo.cpumask[0] == 0x7);
+  assert(powercap_rapl_topology_has_cpu(&topo, 2) == 1);
+  assert(powercap_rapl_topology_has_cpu(&topo, 3) == 0);
+  assert(powercap_rapl_topology_has_cpu(&topo, POWERCAP_RAPL_MAX_CPUS) == -EINVAL);
+
+  get_topology("package-0-die-1", &topo, 0);
+  assert(topo.package_id == 0);
+  assert(topo.die_id == 1);
+  assert(topo.ncpus == 1);
+  assert(topo.cpumask[0] == 0x4);
+
+  get_topology("package-1", &topo, 0);
+  assert(topo.numa_node == -1);
+  assert(topo.cpumask[0] == 0x18);
+
+  // missing die_id is treated as die 0
+  get_topology("package-2-die-0", &topo, 0);
+  assert(topo.ncpus == 1);
+  assert(topo.cpumask[1] == (uint64_t) 1 << 6);
+  assert(topo.numa_node == -1);
+
+  get_topology("package-3", &topo, -ENOENT);
+  get_topology("psys", &topo, -EINVAL);
+  get_topology("package-0-", &topo, -EINVAL);
+  assert(powercap_rapl_get_topology(NULL, &topo) == -EINVAL);
+}
+
+static void test_cache(void) {
+  powercap_rapl_topology topo;
+  get_topology("package-1", &topo, 0);
+  assert(topo.ncpus == 2);
+  // cached until the root is set again
+  make_cpu(6, 1, 0, 1);
+  get_topology("package-1", &topo, 0);
+  assert(topo.ncpus == 2);
+  assert(powercap_rapl_topology_set_root(root) == 0);
+  get_topology("package-1", &topo, 0);
+  assert(topo.ncpus == 3);
+}
+
+int main(void) {
+  make_tree();
+  assert(powercap_rapl_topology_set_root(root) == 0);
+  test_topology();
+  test_cache();
+  assert(powercap_rapl_topology_set_root(NULL) == 0);
+  remove_tree();
+  return 0;
+}
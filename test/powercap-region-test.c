@@ -0,0 +1,216 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Unit tests for per-region energy attribution.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "powercap-accumulator.h"
+#include "powercap-region.h"
+
+#define NCOUNTERS 2
+#define NTHREADS 4
+#define ITERATIONS 10000
+
+static void test_bad_args(void) {
+  powercap_accumulator accs[NCOUNTERS];
+  powercap_region_registry* r;
+  char name[POWERCAP_REGION_NAME_MAX + 1];
+  assert(powercap_region_registry_create(NULL, 1, 1) == NULL);
+  assert(powercap_region_registry_create(accs, 0, 1) == NULL);
+  assert(powercap_region_registry_create(accs, POWERCAP_REGION_MAX_COUNTERS + 1, 1) == NULL);
+  assert(powercap_region_registry_create(accs, 1, 0) == NULL);
+  assert((r = powercap_region_registry_create(accs, 1, 2)) != NULL);
+  assert(powercap_region_register(r, NULL) == -EINVAL);
+  assert(powercap_region_register(r, "") == -EINVAL);
+  memset(name, 'a', POWERCAP_REGION_NAME_MAX);
+  name[POWERCAP_REGION_NAME_MAX] = '\0';
+  assert(powercap_region_register(r, name) == -EINVAL);
+  assert(powercap_region_register(r, "a") == 0);
+  assert(powercap_region_register(r, "b") == 1);
+  // existing names get the same id
+  assert(powercap_region_register(r, "a") == 0);
+  assert(powercap_region_register(r, "c") == -ENOSPC);
+  assert(powercap_region_get_num_regions(r) == 2);
+  assert(strcmp(powercap_region_get_name(r, 1), "b") == 0);
+  assert(powercap_region_get_name(r, 2) == NULL);
+  assert(powercap_region_begin(r, 2) == -EINVAL);
+  assert(powercap_region_end(r, 0) == -EINVAL);
+  assert(powercap_region_get_stats(r, 2, NULL, NULL) == -EINVAL);
+  assert(powercap_region_dump(r, NULL) == -EINVAL);
+  assert(powercap_region_update(NULL, NULL, NULL, 0, 0) == -EINVAL);
+  assert(powercap_region_update(r, NULL, NULL, 0, 0) == -EINVAL);
+  powercap_region_registry_destroy(r);
+  powercap_region_registry_destroy(NULL);
+}
+
+static void test_nesting(void) {
+  powercap_accumulator accs[NCOUNTERS];
+  powercap_region_registry* r;
+  powercap_region_stats stats;
+  uint64_t energy_uj[NCOUNTERS];
+  int outer;
+  int inner;
+  int i;
+  assert(powercap_accumulator_init(&accs[0], 0, 0) == 0);
+  assert(powercap_accumulator_init(&accs[1], 0, 0) == 0);
+  assert(powercap_accumulator_update(&accs[0], 1000, 1) == 0);
+  assert(powercap_accumulator_update(&accs[1], 2000, 1) == 0);
+  assert((r = powercap_region_registry_create(accs, NCOUNTERS, 4)) != NULL);
+  assert((outer = powercap_region_register(r, "outer")) >= 0);
+  assert((inner = powercap_region_register(r, "inner")) >= 0);
+
+  assert(powercap_region_begin(r, (uint32_t) outer) == 0);
+  assert(powercap_accumulator_update(&accs[0], 1100, 2) == 0);
+  assert(powercap_region_begin(r, (uint32_t) inner) == 0);
+  assert(powercap_accumulator_update(&accs[0], 1150, 3) == 0);
+  assert(powercap_accumulator_update(&accs[1], 2010, 3) == 0);
+  // only the innermost region can end
+  assert(powercap_region_end(r, (uint32_t) outer) == -EINVAL);
+  assert(powercap_region_end(r, (uint32_t) inner) == 0);
+  assert(powercap_accumulator_update(&accs[0], 1175, 4) == 0);
+  assert(powercap_region_end(r, (uint32_t) outer) == 0);
+  assert(powercap_region_end(r, (uint32_t) outer) == -EINVAL);
+
+  assert(powercap_region_get_stats(r, (uint32_t) inner, &stats, energy_uj) == 0);
+  assert(stats.count == 1);
+  assert(energy_uj[0] == 50 && energy_uj[1] == 10);
+  // a region's totals include its children
+  assert(powercap_region_get_stats(r, (uint32_t) outer, &stats, energy_uj) == 0);
+  assert(stats.count == 1);
+  assert(energy_uj[0] == 175 && energy_uj[1] == 10);
+
+  // stacks are bounded
+  for (i = 0; i < POWERCAP_REGION_MAX_DEPTH; i++) {
+    assert(powercap_region_begin(r, (uint32_t) inner) == 0);
+  }
+  assert(powercap_region_begin(r, (uint32_t) inner) == -ENOSPC);
+  for (i = 0; i < POWERCAP_REGION_MAX_DEPTH; i++) {
+    assert(powercap_region_end(r, (uint32_t) inner) == 0);
+  }
+  assert(powercap_region_get_stats(r, (uint32_t) inner, &stats, NULL) == 0);
+  assert(stats.count == 1 + POWERCAP_REGION_MAX_DEPTH);
+  powercap_region_registry_destroy(r);
+}
+
+static void test_update(void) {
+  powercap_accumulator accs[NCOUNTERS];
+  powercap_region_registry* r;
+  // a batch of 3 samples read with max = 4, where counter c of sample i is at (c * 4 + i)
+  const uint64_t time_ns[4] = { 1, 2, 3, 0 };
+  const uint64_t energy_uj[2 * 4] = { 100, 150, 175, 0, 1000, 1010, 1030, 0 };
+  uint64_t region_uj[NCOUNTERS];
+  int region;
+  assert(powercap_accumulator_init(&accs[0], 0, 0) == 0);
+  assert(powercap_accumulator_init(&accs[1], 0, 0) == 0);
+  assert((r = powercap_region_registry_create(accs, NCOUNTERS, 1)) != NULL);
+  assert((region = powercap_region_register(r, "batch")) >= 0);
+  assert(powercap_region_update(r, time_ns, energy_uj, 5, 4) == -EINVAL);
+  // the first sample is the baseline
+  assert(powercap_region_update(r, time_ns, energy_uj, 1, 4) == 0);
+  assert(powercap_region_begin(r, (uint32_t) region) == 0);
+  assert(powercap_region_update(r, &time_ns[1], &energy_uj[1], 2, 4) == 0);
+  assert(powercap_region_end(r, (uint32_t) region) == 0);
+  assert(powercap_accumulator_get_total_uj(&accs[0]) == 75);
+  assert(powercap_accumulator_get_total_uj(&accs[1]) == 30);
+  assert(powercap_region_get_stats(r, (uint32_t) region, NULL, region_uj) == 0);
+  assert(region_uj[0] == 75 && region_uj[1] == 30);
+  powercap_region_registry_destroy(r);
+}
+
+static void test_dump_escape(void) {
+  powercap_accumulator accs[1];
+  powercap_region_registry* r;
+  char buf[128];
+  FILE* f;
+  assert(powercap_accumulator_init(&accs[0], 0, 0) == 0);
+  assert((r = powercap_region_registry_create(accs, 1, 3)) != NULL);
+  assert(powercap_region_register(r, "plain") == 0);
+  assert(powercap_region_register(r, "a,b") == 1);
+  assert(powercap_region_register(r, "say \"hi\"\n") == 2);
+  assert((f = tmpfile()) != NULL);
+  assert(powercap_region_dump(r, f) == 0);
+  rewind(f);
+  assert(fgets(buf, sizeof(buf), f) != NULL);
+  assert(fgets(buf, sizeof(buf), f) != NULL);
+  assert(strcmp(buf, "plain,0,0,0\n") == 0);
+  assert(fgets(buf, sizeof(buf), f) != NULL);
+  assert(strcmp(buf, "\"a,b\",0,0,0\n") == 0);
+  // the quoted line break continues the record on the next line
+  assert(fgets(buf, sizeof(buf), f) != NULL);
+  assert(strcmp(buf, "\"say \"\"hi\"\"\n") == 0);
+  assert(fgets(buf, sizeof(buf), f) != NULL);
+  assert(strcmp(buf, "\",0,0,0\n") == 0);
+  assert(fgets(buf, sizeof(buf), f) == NULL);
+  fclose(f);
+  powercap_region_registry_destroy(r);
+}
+
+typedef struct thread_arg {
+  powercap_region_registry* r;
+  uint32_t region;
+} thread_arg;
+
+static void* marker_thread(void* arg) {
+  const thread_arg* ta = (const thread_arg*) arg;
+  int i;
+  // the main thread's open region isn't on this thread's stack
+  assert(powercap_region_end(ta->r, ta->region) == -EINVAL);
+  for (i = 0; i < ITERATIONS; i++) {
+    assert(powercap_region_begin(ta->r, ta->region) == 0);
+    assert(powercap_region_end(ta->r, ta->region) == 0);
+  }
+  return NULL;
+}
+
+static void test_threads(void) {
+  powercap_accumulator accs[1];
+  powercap_region_stats stats;
+  pthread_t threads[NTHREADS];
+  thread_arg ta;
+  char buf[128];
+  FILE* f;
+  int i;
+  assert(powercap_accumulator_init(&accs[0], 0, 0) == 0);
+  assert((ta.r = powercap_region_registry_create(accs, 1, 1)) != NULL);
+  assert(powercap_region_register(ta.r, "step") == 0);
+  ta.region = 0;
+  assert(powercap_region_begin(ta.r, 0) == 0);
+  for (i = 0; i < NTHREADS; i++) {
+    assert(pthread_create(&threads[i], NULL, marker_thread, &ta) == 0);
+  }
+  for (i = 0; i < NTHREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  assert(powercap_region_end(ta.r, 0) == 0);
+  assert(powercap_region_get_stats(ta.r, 0, &stats, NULL) == 0);
+  assert(stats.count == NTHREADS * ITERATIONS + 1);
+  assert(stats.time_ns > 0);
+
+  assert((f = tmpfile()) != NULL);
+  assert(powercap_region_dump(ta.r, f) == 0);
+  rewind(f);
+  assert(fgets(buf, sizeof(buf), f) != NULL);
+  assert(strcmp(buf, "name,count,time_ns,energy_uj_0\n") == 0);
+  assert(fgets(buf, sizeof(buf), f) != NULL);
+  assert(strncmp(buf, "step,40001,", 11) == 0);
+  assert(fgets(buf, sizeof(buf), f) == NULL);
+  fclose(f);
+  powercap_region_registry_destroy(ta.r);
+}
+
+int main(void) {
+  test_bad_args();
+  test_nesting();
+  test_update();
+  test_dump_escape();
+  test_threads();
+  return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Unit tests for multi-resolution rollups.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "powercap-rollup.h"
+
+#define NS_PER_MS 1000000ULL
+#define RANGE_UJ 10000
+#define BATCH 4
+
+static int near(double a, double b) {
+  return a - b < 1e-9 && b - a < 1e-9;
+}
+
+static void test_bad_args(void) {
+  powercap_rollup_tier tiers[2] = { { 1000, 10 }, { 100, 10 } };
+  powercap_rollup_result result;
+  powercap_rollup* r;
+  uint64_t energy_uj[1] = { 0 };
+  assert(powercap_rollup_create(NULL, 1, 1, NULL) == NULL);
+  assert(powercap_rollup_create(tiers, 0, 1, NULL) == NULL);
+  assert(powercap_rollup_create(tiers, 1, 0, NULL) == NULL);
+  // tiers out of order
+  assert(powercap_rollup_create(tiers, 2, 1, NULL) == NULL);
+  tiers[0].length = 0;
+  assert(powercap_rollup_create(tiers, 1, 1, NULL) == NULL);
+  tiers[0].length = 10;
+  assert((r = powercap_rollup_create(tiers, 1, 1, NULL)) != NULL);
+  assert(powercap_rollup_query(r, 0, 0, 1, &result) == -ENODATA);
+  assert(powercap_rollup_add(r, 10, energy_uj) == 0);
+  assert(powercap_rollup_add(r, 9, energy_uj) == -EINVAL);
+  assert(powercap_rollup_query(r, 1, 0, 1, &result) == -EINVAL);
+  assert(powercap_rollup_query(r, 0, 1, 1, &result) == -EINVAL);
+  powercap_rollup_destroy(r);
+  powercap_rollup_destroy(NULL);
+}
+
+static void test_tiers(void) {
+  // 10 ms at 1 ms, 100 ms at 10 ms, 1 s at 100 ms
+  const powercap_rollup_tier tiers[3] = { { 1000, 10 }, { 10000, 10 }, { 100000, 10 } };
+  const uint64_t ranges[2] = { 0, RANGE_UJ };
+  powercap_rollup_result result;
+  powercap_rollup* r;
+  uint64_t time_ns[BATCH];
+  uint64_t energy_uj[2 * BATCH];
+  uint64_t t;
+  uint32_t i;
+  assert((r = powercap_rollup_create(tiers, 3, 2, ranges)) != NULL);
+  // 1 W and 2 W (which wraps), sampled every 1 ms for 300 ms
+  for (t = 0; t <= 300; ) {
+    for (i = 0; i < BATCH && t <= 300; i++, t++) {
+      time_ns[i] = t * NS_PER_MS;
+      energy_uj[i] = 1000 * t;
+      energy_uj[BATCH + i] = (2000 * t) % RANGE_UJ;
+    }
+    assert(powercap_rollup_add_samples(r, time_ns, energy_uj, i, BATCH) == 0);
+  }
+
+  // recent history comes from the finest tier
+  assert(powercap_rollup_query(r, 0, 296 * NS_PER_MS, 301 * NS_PER_MS, &result) == 0);
+  assert(result.tier == 0);
+  assert(result.start_ns == 296 * NS_PER_MS);
+  assert(result.end_ns == 301 * NS_PER_MS);
+  assert(result.energy_uj == 5000);
+  assert(result.covered_ns == 5 * NS_PER_MS);
+  assert(near(result.mean_w, 1));
+  assert(near(result.min_w, 1));
+  assert(near(result.max_w, 1));
+  assert(powercap_rollup_query(r, 1, 296 * NS_PER_MS, 301 * NS_PER_MS, &result) == 0);
+  assert(result.energy_uj == 10000);
+  assert(near(result.mean_w, 2));
+
+  // older history comes from coarser tiers
+  assert(powercap_rollup_query(r, 0, 250 * NS_PER_MS, 300 * NS_PER_MS, &result) == 0);
+  assert(result.tier == 1);
+  assert(result.start_ns == 250 * NS_PER_MS);
+  assert(result.end_ns == 300 * NS_PER_MS);
+  assert(result.energy_uj == 50000);
+  assert(powercap_rollup_query(r, 1, 0, 400 * NS_PER_MS, &result) == 0);
+  assert(result.tier == 2);
+  // the first sample is a baseline
+  assert(result.energy_uj == 600000);
+  assert(result.covered_ns == 300 * NS_PER_MS);
+  assert(near(result.mean_w, 2));
+
+  // nothing in the future
+  assert(powercap_rollup_query(r, 0, 1000 * NS_PER_MS, 2000 * NS_PER_MS, &result) == -ENODATA);
+  powercap_rollup_destroy(r);
+}
+
+int main(void) {
+  test_bad_args();
+  test_tiers();
+  return 0;
+}
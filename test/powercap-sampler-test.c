@@ -0,0 +1,464 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Unit tests for the background sampler, using temporary files in place of sysfs energy counters.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "powercap.h"
+#include "powercap-sampler.h"
+#include "powercap-snapshot.h"
+#include "test-common.h"
+
+#define PERIOD_US 500
+#define NCOUNTERS 2
+#define BATCH 64
+
+static void make_counters(powercap_snapshot* snap, powercap_zone* zones) {
+  memset(zones, 0, NCOUNTERS * sizeof(powercap_zone));
+  zones[0].energy_uj = make_file(100);
+  zones[1].energy_uj = make_file(200);
+  assert(powercap_snapshot_init(snap, NCOUNTERS) == 0);
+  assert(powercap_snapshot_set_zone(snap, 0, &zones[0]) == 0);
+  assert(powercap_snapshot_set_zone(snap, 1, &zones[1]) == 0);
+}
+
+static void wait_samples(const powercap_sampler* s, uint64_t n) {
+  powercap_sampler_stats stats;
+  do {
+    usleep(PERIOD_US);
+    assert(powercap_sampler_get_stats(s, &stats) == 0);
+  } while (stats.samples + stats.dropped < n);
+}
+
+static void test_bad_args(void) {
+  powercap_sampler_config cfg = { PERIOD_US, 4, POWERCAP_SAMPLER_OVERFLOW_DROP_NEWEST };
+  powercap_zone zones[NCOUNTERS];
+  powercap_snapshot snap;
+  make_counters(&snap, zones);
+  assert(powercap_sampler_create(NULL, &cfg) == NULL);
+  assert(powercap_sampler_create(&snap, NULL) == NULL);
+  cfg.capacity = 0;
+  assert(powercap_sampler_create(&snap, &cfg) == NULL);
+  cfg.capacity = 4;
+  cfg.period_us = 0;
+  assert(powercap_sampler_create(&snap, &cfg) == NULL);
+  assert(powercap_sampler_start(NULL) == -EINVAL);
+  assert(powercap_sampler_destroy(NULL) == 0);
+  powercap_snapshot_destroy(&snap);
+  close(zones[0].energy_uj);
+  close(zones[1].energy_uj);
+}
+
+static void test_drop_newest(void) {
+  powercap_sampler_config cfg = { PERIOD_US, 5, POWERCAP_SAMPLER_OVERFLOW_DROP_NEWEST };
+  powercap_zone zones[NCOUNTERS];
+  powercap_snapshot snap;
+  powercap_sampler* s;
+  powercap_sampler_stats stats;
+  uint64_t time_ns[BATCH];
+  uint64_t energy_uj[BATCH * NCOUNTERS];
+  uint32_t count;
+  int n;
+  int i;
+  make_counters(&snap, zones);
+  assert((s = powercap_sampler_create(&snap, &cfg)) != NULL);
+  // the sampler has its own copy
+  powercap_snapshot_destroy(&snap);
+  assert(powercap_sampler_get_num_counters(s) == NCOUNTERS);
+  assert(powercap_sampler_get_rapl_pkgs(s, &count) == NULL);
+  assert(powercap_sampler_read(s, time_ns, energy_uj, BATCH) == 0);
+
+  assert(powercap_sampler_start(s) == 0);
+  assert(powercap_sampler_start(s) == -EINVAL);
+  // capacity is rounded up to 8
+  wait_samples(s, 12);
+  assert(powercap_sampler_stop(s) == 0);
+  assert(powercap_sampler_get_stats(s, &stats) == 0);
+  assert(stats.samples == 8);
+  assert(stats.dropped >= 4);
+  assert(stats.read_errors == 0);
+
+  // the oldest samples are kept, in order
+  assert((n = powercap_sampler_read(s, time_ns, energy_uj, 3)) == 3);
+  for (i = 0; i < n; i++) {
+    assert(energy_uj[i] == 100);
+    assert(energy_uj[3 + i] == 200);
+  }
+  assert(time_ns[0] < time_ns[1] && time_ns[1] < time_ns[2]);
+  assert((n = powercap_sampler_read(s, time_ns + 3, energy_uj, BATCH)) == 5);
+  assert(time_ns[2] < time_ns[3]);
+  assert(energy_uj[BATCH + 4] == 200);
+  assert(powercap_sampler_read(s, time_ns, energy_uj, BATCH) == 0);
+
+  // can restart after draining
+  assert(powercap_sampler_start(s) == 0);
+  wait_samples(s, stats.samples + stats.dropped + 1);
+  assert(powercap_sampler_destroy(s) == 0);
+  close(zones[0].energy_uj);
+  close(zones[1].energy_uj);
+}
+
+static void test_drop_oldest(void) {
+  powercap_sampler_config cfg = { PERIOD_US, 8, POWERCAP_SAMPLER_OVERFLOW_DROP_OLDEST };
+  powercap_zone zones[NCOUNTERS];
+  powercap_snapshot snap;
+  powercap_sampler* s;
+  powercap_sampler_stats stats;
+  uint64_t time_ns[BATCH];
+  uint64_t energy_uj[BATCH * NCOUNTERS];
+  uint64_t last = 0;
+  uint64_t total = 0;
+  int n;
+  int i;
+  make_counters(&snap, zones);
+  assert((s = powercap_sampler_create(&snap, &cfg)) != NULL);
+  powercap_snapshot_destroy(&snap);
+  assert(powercap_sampler_start(s) == 0);
+  // overflow first, then consume concurrently
+  wait_samples(s, 12);
+  while (total < 50) {
+    usleep(PERIOD_US * 3);
+    assert((n = powercap_sampler_read(s, time_ns, energy_uj, 4)) >= 0);
+    for (i = 0; i < n; i++) {
+      assert(time_ns[i] > last);
+      last = time_ns[i];
+      assert(energy_uj[i] == 100);
+      assert(energy_uj[4 + i] == 200);
+    }
+    total += (uint64_t) n;
+  }
+  assert(powercap_sampler_stop(s) == 0);
+  assert(powercap_sampler_get_stats(s, &stats) == 0);
+  assert(stats.dropped > 0);
+  // every sample was either read, dropped, or is still unread
+  assert((n = powercap_sampler_read(s, time_ns, energy_uj, BATCH)) >= 0);
+  assert(total + (uint64_t) n + stats.dropped == stats.samples);
+  assert(powercap_sampler_destroy(s) == 0);
+  close(zones[0].energy_uj);
+  close(zones[1].energy_uj);
+}
+
+static void test_polled(void) {
+  powercap_sampler_config cfg = { PERIOD_US, 8, POWERCAP_SAMPLER_OVERFLOW_DROP_NEWEST };
+  powercap_zone zones[NCOUNTERS];
+  powercap_snapshot snap;
+  powercap_sampler* s;
+  powercap_sampler_stats stats;
+  struct pollfd pfd;
+  uint64_t time_ns[BATCH];
+  uint64_t energy_uj[BATCH * NCOUNTERS];
+  uint64_t last = 0;
+  uint64_t total = 0;
+  int n;
+  make_counters(&snap, zones);
+  assert((s = powercap_sampler_create(&snap, &cfg)) != NULL);
+  powercap_snapshot_destroy(&snap);
+  assert(powercap_sampler_service(s, time_ns, energy_uj, BATCH) == -EINVAL);
+  assert((pfd.fd = powercap_sampler_get_fd(s)) >= 0);
+  pfd.events = POLLIN;
+  assert(powercap_sampler_start_polled(s) == 0);
+  assert(powercap_sampler_start(s) == -EINVAL);
+  assert(powercap_sampler_start_polled(s) == -EINVAL);
+  while (total < 10) {
+    assert(poll(&pfd, 1, -1) == 1);
+    assert((n = powercap_sampler_service(s, time_ns, energy_uj, BATCH)) == 1);
+    assert(time_ns[0] > last);
+    last = time_ns[0];
+    assert(energy_uj[0] == 100);
+    assert(energy_uj[BATCH] == 200);
+    total++;
+  }
+  // nothing is due immediately after servicing
+  assert(powercap_sampler_service(s, time_ns, energy_uj, BATCH) == 0);
+  assert(powercap_sampler_stop(s) == 0);
+  assert(powercap_sampler_service(s, time_ns, energy_uj, BATCH) == -EINVAL);
+  assert(poll(&pfd, 1, (int) (PERIOD_US * 4 / 1000)) == 0);
+  assert(powercap_sampler_get_stats(s, &stats) == 0);
+  assert(stats.samples == total);
+  assert(stats.dropped == 0);
+
+  // can switch to the threaded mode
+  assert(powercap_sampler_start(s) == 0);
+  wait_samples(s, total + 1);
+  assert(powercap_sampler_destroy(s) == 0);
+  close(zones[0].energy_uj);
+  close(zones[1].energy_uj);
+}
+
+static int service_one(powercap_sampler* s, uint64_t* time_ns, uint64_t* energy_uj) {
+  struct pollfd pfd;
+  pfd.fd = powercap_sampler_get_fd(s);
+  pfd.events = POLLIN;
+  assert(poll(&pfd, 1, -1) == 1);
+  return powercap_sampler_service(s, time_ns, energy_uj, BATCH);
+}
+
+static void test_adaptive(void) {
+  powercap_sampler_config cfg = { PERIOD_US, 8, POWERCAP_SAMPLER_OVERFLOW_DROP_NEWEST };
+  powercap_sampler_adaptive adaptive = { PERIOD_US * 4, 0.5, 1 };
+  powercap_zone zones[NCOUNTERS];
+  powercap_snapshot snap;
+  powercap_sampler* s;
+  powercap_sampler_stats stats;
+  powercap_sampler_counter_stats cstats[NCOUNTERS];
+  uint64_t time_ns[BATCH];
+  uint64_t energy_uj[BATCH * NCOUNTERS];
+  uint64_t reads;
+  uint32_t c;
+  int i;
+  make_counters(&snap, zones);
+  assert((s = powercap_sampler_create(&snap, &cfg)) != NULL);
+  powercap_snapshot_destroy(&snap);
+  adaptive.max_period_us = PERIOD_US - 1;
+  assert(powercap_sampler_set_adaptive(s, &adaptive) == -EINVAL);
+  adaptive.max_period_us = PERIOD_US * 4;
+  assert(powercap_sampler_set_adaptive(s, &adaptive) == 0);
+  assert(powercap_sampler_get_counter_stats(s, NCOUNTERS, &cstats[0]) == -EINVAL);
+  assert(powercap_sampler_start_polled(s) == 0);
+  assert(powercap_sampler_set_adaptive(s, NULL) == -EINVAL);
+
+  // flat counters back off to the maximum period, but every sample still has their values
+  for (i = 0; i < 20; i++) {
+    assert(service_one(s, time_ns, energy_uj) == 1);
+    assert(energy_uj[0] == 100);
+    assert(energy_uj[BATCH] == 200);
+  }
+  for (c = 0; c < NCOUNTERS; c++) {
+    assert(powercap_sampler_get_counter_stats(s, c, &cstats[c]) == 0);
+    assert(cstats[c].period_us == PERIOD_US * 4);
+    assert(cstats[c].skipped > 0);
+    assert(cstats[c].reads + cstats[c].skipped == 20);
+  }
+  assert(powercap_sampler_get_stats(s, &stats) == 0);
+  assert(stats.skipped == cstats[0].skipped + cstats[1].skipped);
+
+  // a change in power speeds up only the counter that changed
+  assert(pwrite(zones[1].energy_uj, "5000\n", 5, 0) == 5);
+  reads = cstats[1].reads;
+  do {
+    assert(service_one(s, time_ns, energy_uj) == 1);
+    assert(powercap_sampler_get_counter_stats(s, 1, &cstats[1]) == 0);
+  } while (cstats[1].reads == reads);
+  assert(energy_uj[BATCH] == 5000);
+  assert(cstats[1].period_us == PERIOD_US);
+  assert(powercap_sampler_get_counter_stats(s, 0, &cstats[0]) == 0);
+  assert(cstats[0].period_us == PERIOD_US * 4);
+
+  // disabling reads every counter every period
+  assert(powercap_sampler_stop(s) == 0);
+  assert(powercap_sampler_set_adaptive(s, NULL) == 0);
+  assert(powercap_sampler_start_polled(s) == 0);
+  for (i = 0; i < 4; i++) {
+    assert(service_one(s, time_ns, energy_uj) == 1);
+  }
+  assert(powercap_sampler_get_counter_stats(s, 0, &cstats[0]) == 0);
+  assert(cstats[0].reads == 4 && cstats[0].skipped == 0);
+  assert(cstats[0].period_us == PERIOD_US);
+  assert(powercap_sampler_destroy(s) == 0);
+  close(zones[0].energy_uj);
+  close(zones[1].energy_uj);
+}
+
+static void test_overhead(void) {
+  powercap_sampler_config cfg = { PERIOD_US, 8, POWERCAP_SAMPLER_OVERFLOW_DROP_NEWEST };
+  powercap_zone zones[NCOUNTERS];
+  powercap_snapshot snap;
+  powercap_sampler* s;
+  powercap_sampler_overhead overhead;
+  powercap_sampler_stats stats;
+  uint64_t time_ns[BATCH];
+  uint64_t energy_uj[BATCH * NCOUNTERS];
+  uint64_t wakeups;
+  char buf[8];
+  int i;
+  make_counters(&snap, zones);
+  assert((s = powercap_sampler_create(&snap, &cfg)) != NULL);
+  powercap_snapshot_destroy(&snap);
+  assert(powercap_sampler_get_overhead(NULL, &overhead) == -EINVAL);
+  assert(powercap_sampler_get_overhead(s, &overhead) == 0);
+  assert(overhead.elapsed_ns == 0 && overhead.wakeups == 0 && overhead.syscalls == 0);
+
+  // polled: every counter read is a system call, and each file read is "100\n" or "200\n"
+  assert(powercap_sampler_start_polled(s) == 0);
+  for (i = 0; i < 4; i++) {
+    assert(service_one(s, time_ns, energy_uj) == 1);
+    // have a counter consume energy
+    assert(snprintf(buf, sizeof(buf), "%d\n", 200 + i) == 4);
+    assert(pwrite(zones[0].energy_uj, buf, 4, 0) == 4);
+  }
+  assert(powercap_sampler_stop(s) == 0);
+  assert(powercap_sampler_get_overhead(s, &overhead) == 0);
+  assert(overhead.wakeups == 4);
+  assert(overhead.bytes_read == 4 * 2 * 4);
+  assert(overhead.syscalls >= 4 * NCOUNTERS);
+  assert(overhead.elapsed_ns >= 4 * PERIOD_US * 1000);
+  assert(overhead.wakeups_per_s > 0);
+  assert(!(overhead.energy_uj < 0));
+
+  // threaded: the thread's CPU time is charged too, and accumulates across runs
+  wakeups = overhead.wakeups;
+  assert(powercap_sampler_start(s) == 0);
+  wait_samples(s, 10);
+  assert(powercap_sampler_stop(s) == 0);
+  assert(powercap_sampler_get_stats(s, &stats) == 0);
+  assert(powercap_sampler_get_overhead(s, &overhead) == 0);
+  // the first sample in each run is taken without a wakeup
+  assert(overhead.wakeups == wakeups + stats.samples - 5);
+  assert(overhead.bytes_read >= stats.samples * 2 * 4);
+  assert(overhead.cpu_ns > 0);
+  assert(powercap_sampler_destroy(s) == 0);
+  close(zones[0].energy_uj);
+  close(zones[1].energy_uj);
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  assert(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+  return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+typedef struct event_log {
+  powercap_sampler_event events[BATCH];
+  uint32_t n;
+} event_log;
+
+static void log_event(const powercap_sampler_event* event, void* arg) {
+  event_log* log = (event_log*) arg;
+  assert(log->n < BATCH);
+  log->events[log->n++] = *event;
+}
+
+/* Service samples for a duration, with a counter consuming a constant power */
+static void run_power(powercap_sampler* s, int fd, uint64_t duration_ns, uint64_t watts, uint64_t* energy_uj,
+                      uint64_t* last_ns) {
+  uint64_t time_ns[BATCH];
+  uint64_t samples[BATCH * NCOUNTERS];
+  const uint64_t end = now_ns() + duration_ns;
+  struct pollfd pfd;
+  uint64_t now;
+  char buf[32];
+  int len;
+  pfd.fd = powercap_sampler_get_fd(s);
+  pfd.events = POLLIN;
+  do {
+    assert(poll(&pfd, 1, -1) == 1);
+    // the counter reflects the time just before it's read, so the measured power is close to exact
+    now = now_ns();
+    *energy_uj += watts * (now - *last_ns) / 1000;
+    *last_ns = now;
+    len = snprintf(buf, sizeof(buf), "%"PRIu64"\n", *energy_uj);
+    assert(pwrite(fd, buf, (size_t) len, 0) == len);
+    assert(powercap_sampler_service(s, time_ns, samples, BATCH) >= 0);
+  } while (now < end);
+}
+
+static void test_predicates(void) {
+  powercap_sampler_config cfg = { 1000, 64, POWERCAP_SAMPLER_OVERFLOW_DROP_NEWEST };
+  powercap_sampler_predicate preds[] = {
+    { POWERCAP_SAMPLER_PREDICATE_POWER_ABOVE, 0, 10, 4, 20000 },
+    // never holds for long enough
+    { POWERCAP_SAMPLER_PREDICATE_POWER_ABOVE, 0, 10, 4, 10000000 },
+    { POWERCAP_SAMPLER_PREDICATE_SLOPE_ABOVE, 0, 5000, 0, 0 },
+    { POWERCAP_SAMPLER_PREDICATE_SLOPE_BELOW, 0, -5000, 0, 0 },
+    // the other counter is flat
+    { POWERCAP_SAMPLER_PREDICATE_POWER_BELOW, 1, 1, 0, 0 },
+  };
+  const uint32_t npreds = sizeof(preds) / sizeof(preds[0]);
+  powercap_zone zones[NCOUNTERS];
+  powercap_snapshot snap;
+  powercap_sampler* s;
+  powercap_sampler_stats stats;
+  powercap_sampler_event events[BATCH];
+  event_log log = { 0 };
+  struct pollfd pfd;
+  uint64_t energy_uj = 100;
+  uint64_t last_ns;
+  uint32_t seen[5] = { 0 };
+  uint32_t i;
+  int n;
+  int j;
+  make_counters(&snap, zones);
+  assert((s = powercap_sampler_create(&snap, &cfg)) != NULL);
+  powercap_snapshot_destroy(&snap);
+  assert(powercap_sampler_get_event_fd(s) == -EINVAL);
+  assert(powercap_sampler_read_events(s, events, BATCH) == -EINVAL);
+  preds[0].counter = NCOUNTERS;
+  assert(powercap_sampler_set_predicates(s, preds, npreds, BATCH) == -EINVAL);
+  preds[0].counter = 0;
+  preds[0].hysteresis = -1;
+  assert(powercap_sampler_set_predicates(s, preds, npreds, BATCH) == -EINVAL);
+  preds[0].hysteresis = 4;
+  assert(powercap_sampler_set_predicates(s, preds, npreds, 0) == -EINVAL);
+  assert(powercap_sampler_set_predicates(s, preds, npreds, BATCH) == 0);
+  assert((pfd.fd = powercap_sampler_get_event_fd(s)) >= 0);
+  pfd.events = POLLIN;
+  assert(powercap_sampler_dispatch_events(s, NULL, NULL) == -EINVAL);
+  assert(powercap_sampler_start_polled(s) == 0);
+  assert(powercap_sampler_set_predicates(s, NULL, 0, 0) == -EINVAL);
+
+  // 2 W, then 20 W for long enough to activate, then 2 W again
+  // (timing noise may cause extra slope events, but not level events with this much hysteresis)
+  last_ns = now_ns();
+  run_power(s, zones[0].energy_uj, 50000000, 2, &energy_uj, &last_ns);
+  assert(poll(&pfd, 1, 0) == 1);
+  assert((n = powercap_sampler_read_events(s, events, BATCH)) > 0);
+  for (j = 0; j < n && events[j].predicate != 4; j++);
+  assert(j < n && events[j].active == 1);
+  log.n = (uint32_t) n;
+  memcpy(log.events, events, (size_t) n * sizeof(events[0]));
+  assert(poll(&pfd, 1, 0) == 0);
+  run_power(s, zones[0].energy_uj, 50000000, 20, &energy_uj, &last_ns);
+  run_power(s, zones[0].energy_uj, 50000000, 2, &energy_uj, &last_ns);
+  assert(powercap_sampler_stop(s) == 0);
+  assert(poll(&pfd, 1, 0) == 1);
+  // a short read leaves the descriptor readable
+  assert(powercap_sampler_read_events(s, events, 1) == 1);
+  log.events[log.n++] = events[0];
+  assert(poll(&pfd, 1, 0) == 1);
+  assert((n = powercap_sampler_dispatch_events(s, log_event, &log)) > 0);
+  assert(poll(&pfd, 1, 0) == 0);
+  assert(powercap_sampler_get_stats(s, &stats) == 0);
+  assert(stats.events == log.n && stats.dropped_events == 0);
+  for (i = 0; i < log.n; i++) {
+    assert(log.events[i].predicate < npreds);
+    // events alternate between active and inactive
+    assert(log.events[i].active == !(seen[log.events[i].predicate] % 2));
+    seen[log.events[i].predicate]++;
+    if (log.events[i].predicate == 0 && log.events[i].active) {
+      assert(log.events[i].value >= 10);
+    }
+  }
+  assert(seen[0] == 2);
+  assert(seen[1] == 0);
+  assert(seen[2] >= 2);
+  assert(seen[3] >= 2);
+  assert(seen[4] == 1);
+
+  // predicates are removed
+  assert(powercap_sampler_set_predicates(s, NULL, 0, 0) == 0);
+  assert(powercap_sampler_get_event_fd(s) == -EINVAL);
+  assert(powercap_sampler_destroy(s) == 0);
+  close(zones[0].energy_uj);
+  close(zones[1].energy_uj);
+}
+
+int main(void) {
+  test_bad_args();
+  test_drop_newest();
+  test_drop_oldest();
+  test_polled();
+  test_adaptive();
+  test_overhead();
+  test_predicates();
+  return 0;
+}
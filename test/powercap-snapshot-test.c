@@ -0,0 +1,161 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Unit tests for snapshots, using temporary files in place of sysfs energy counters.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "powercap.h"
+#include "powercap-snapshot.h"
+#include "test-common.h"
+
+static void set_file(int fd, uint64_t val) {
+  char buf[24];
+  int len = snprintf(buf, sizeof(buf), "%"PRIu64"\n", val);
+  assert(ftruncate(fd, 0) == 0);
+  assert(pwrite(fd, buf, (size_t) len, 0) == len);
+}
+
+static void test_init_destroy(void) {
+  powercap_snapshot snap;
+  uint32_t i;
+  assert(powercap_snapshot_init(NULL, 1) == -EINVAL);
+  assert(powercap_snapshot_init(&snap, 0) == -EINVAL);
+  assert(powercap_snapshot_init(&snap, 5) == 0);
+  assert(snap.count == 5);
+  assert(((uintptr_t) snap.fds) % 64 == 0);
+  assert(((uintptr_t) snap.max_energy_range_uj) % 64 == 0);
+  assert(((uintptr_t) snap.energy_uj) % 64 == 0);
+  assert(((uintptr_t) snap.time_ns) % 64 == 0);
+  for (i = 0; i < snap.count; i++) {
+    assert(snap.fds[i] == 0);
+    assert(snap.energy_uj[i] == 0);
+  }
+  // reading only unsupported counters does nothing
+  assert(powercap_snapshot_read(&snap) == 0);
+  assert(snap.time_ns[0] == 0);
+  assert(powercap_snapshot_destroy(&snap) == 0);
+  assert(snap.fds == NULL);
+  assert(powercap_snapshot_destroy(NULL) == 0);
+}
+
+static void test_read_delta(void) {
+  powercap_snapshot prev;
+  powercap_snapshot cur;
+  powercap_zone zones[3];
+  uint64_t delta[3];
+  double power[3];
+  uint32_t i;
+  memset(zones, 0, sizeof(zones));
+  zones[0].energy_uj = make_file(1000);
+  zones[0].max_energy_range_uj = make_file(262143328850);
+  zones[1].energy_uj = make_file(262143328000);
+  zones[1].max_energy_range_uj = make_file(262143328850);
+  // zones[2] has no energy_uj file
+
+  assert(powercap_snapshot_init(&prev, 3) == 0);
+  assert(powercap_snapshot_init(&cur, 3) == 0);
+  for (i = 0; i < 3; i++) {
+    assert(powercap_snapshot_set_zone(&prev, i, &zones[i]) == 0);
+    assert(powercap_snapshot_set_zone(&cur, i, &zones[i]) == 0);
+  }
+  assert(powercap_snapshot_set_zone(&cur, 3, &zones[0]) == -EINVAL);
+  assert(cur.max_energy_range_uj[0] == 262143328850);
+  assert(cur.max_energy_range_uj[2] == 0);
+
+  assert(powercap_snapshot_read(&prev) == 0);
+  assert(prev.energy_uj[0] == 1000);
+  assert(prev.energy_uj[1] == 262143328000);
+  assert(prev.time_ns[0] > 0);
+  assert(prev.time_ns[2] == 0);
+
+  // counter 1 wraps
+  set_file(zones[0].energy_uj, 3000);
+  set_file(zones[1].energy_uj, 150);
+  usleep(1000);
+  assert(powercap_snapshot_read(&cur) == 0);
+  assert(powercap_snapshot_delta(&prev, &cur, delta, power) == 0);
+  assert(delta[0] == 2000);
+  assert(delta[1] == 1000);
+  assert(delta[2] == 0);
+  assert(power[0] > 0.0);
+  assert(power[1] > 0.0);
+  assert(!(power[2] > 0.0));
+
+  // power is computed from per-counter timestamps
+  cur.time_ns[0] = prev.time_ns[0] + 1000000;
+  cur.time_ns[1] = prev.time_ns[1];
+  assert(powercap_snapshot_delta(&prev, &cur, delta, power) == 0);
+  assert(power[0] > 1.999 && power[0] < 2.001);
+  assert(!(power[1] > 0.0));
+
+  assert(powercap_snapshot_delta(&prev, NULL, delta, power) == -EINVAL);
+  assert(powercap_snapshot_delta(&prev, &cur, NULL, power) == -EINVAL);
+
+  // a failed read keeps the previous value and reports an error
+  close(zones[1].energy_uj);
+  assert(powercap_snapshot_read(&cur) < 0);
+  assert(cur.energy_uj[0] == 3000);
+  assert(cur.energy_uj[1] == 150);
+
+  powercap_snapshot_destroy(&prev);
+  powercap_snapshot_destroy(&cur);
+  close(zones[0].energy_uj);
+  close(zones[0].max_energy_range_uj);
+  close(zones[1].max_energy_range_uj);
+}
+
+static void test_read_group(void) {
+  powercap_snapshot snap;
+  powercap_snapshot_group group;
+  powercap_zone zone = { 0 };
+  uint64_t offset_ns[3];
+  int fds[2];
+  assert(powercap_snapshot_init(&snap, 3) == 0);
+  assert(powercap_snapshot_read_group(NULL, &group) == -EINVAL);
+  assert(powercap_snapshot_read_group(&snap, NULL) == -EINVAL);
+  fds[0] = make_file(10);
+  fds[1] = make_file(20);
+  zone.energy_uj = fds[0];
+  assert(powercap_snapshot_set_zone(&snap, 0, &zone) == 0);
+  // counter 1 is unsupported
+  zone.energy_uj = fds[1];
+  assert(powercap_snapshot_set_zone(&snap, 2, &zone) == 0);
+
+  assert(powercap_snapshot_read_group(&snap, &group) == 0);
+  assert(snap.energy_uj[0] == 10);
+  assert(snap.energy_uj[2] == 20);
+  assert(group.begin_ns <= snap.time_ns[0]);
+  assert(snap.time_ns[0] <= snap.time_ns[2]);
+  assert(snap.time_ns[2] <= group.end_ns);
+  assert(group.skew_ns == snap.time_ns[2] - snap.time_ns[0]);
+  assert(group.skew_ns <= group.end_ns - group.begin_ns);
+  assert(powercap_snapshot_get_offsets(&snap, &group, offset_ns) == 0);
+  assert(offset_ns[0] == snap.time_ns[0] - group.begin_ns);
+  assert(offset_ns[1] == 0);
+  assert(offset_ns[2] == snap.time_ns[2] - group.begin_ns);
+
+  // a failed read doesn't count toward skew and has no offset in the new group
+  close(fds[1]);
+  assert(powercap_snapshot_read_group(&snap, &group) == -EBADF);
+  assert(group.skew_ns == 0);
+  assert(powercap_snapshot_get_offsets(&snap, &group, offset_ns) == 0);
+  assert(offset_ns[2] == 0);
+  close(fds[0]);
+  powercap_snapshot_destroy(&snap);
+}
+
+int main(void) {
+  test_init_destroy();
+  test_read_delta();
+  test_read_group();
+  return 0;
+}
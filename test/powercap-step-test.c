@@ -0,0 +1,191 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Unit tests for step response measurement, using synthetic traces and temporary files in place of sysfs files.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "powercap.h"
+#include "powercap-step.h"
+#include "test-common.h"
+
+#define MS 1000000ULL
+#define NSAMPLES 300
+#define LIMIT_UW 50000000ULL
+#define STEP_LIMIT_UW 10000000ULL
+/* The power a simulated zone would consume without a limit */
+#define DEMAND_W 30
+
+static powercap_step_config make_config(void) {
+  powercap_step_config cfg;
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.period_us = 1000;
+  cfg.baseline_us = 20000;
+  cfg.timeout_us = 2000000;
+  cfg.settle_us = 100000;
+  cfg.settle_band = 0.05;
+  cfg.min_step_w = 0.5;
+  cfg.filter.filter = POWERCAP_POWER_FILTER_RAW;
+  return cfg;
+}
+
+/* Power as a function of time since the step: dead time, a ramp from 40 to 20 W, an overshoot, then 20 W */
+static double trace_power(uint64_t t_ns) {
+  if (t_ns <= 5 * MS) {
+    return 40;
+  }
+  if (t_ns <= 15 * MS) {
+    return 40 - 2 * (double) (t_ns - 5 * MS) / MS;
+  }
+  return t_ns == 16 * MS ? 18 : 20;
+}
+
+static void test_analyze(void) {
+  const powercap_step_config cfg = make_config();
+  powercap_step_result result;
+  uint64_t time_ns[NSAMPLES];
+  double power_w[NSAMPLES];
+  uint32_t i;
+  for (i = 0; i < NSAMPLES; i++) {
+    time_ns[i] = (i + 1) * MS;
+    power_w[i] = trace_power(time_ns[i]);
+  }
+  memset(&result, 0, sizeof(result));
+  assert(powercap_step_analyze(NULL, 0, time_ns, power_w, NSAMPLES, &result) == -EINVAL);
+  assert(powercap_step_analyze(&cfg, 0, time_ns, power_w, 0, &result) == -EINVAL);
+
+  result.initial_w = 40;
+  assert(powercap_step_analyze(&cfg, 0, time_ns, power_w, NSAMPLES, &result) == 0);
+  assert(result.samples == NSAMPLES);
+  assert(result.final_w > 19.999 && result.final_w < 20.001);
+  assert(result.responded);
+  // 10% of the way is 38 W, 90% is 22 W
+  assert(result.dead_time_ns == 6 * MS);
+  assert(result.rise_time_ns == 8 * MS);
+  assert(result.overshoot_w > 1.999 && result.overshoot_w < 2.001);
+  assert(result.overshoot > 0.0999 && result.overshoot < 0.1001);
+  assert(result.settled);
+  assert(result.settling_time_ns == 17 * MS);
+
+  // an oscillation outside the band near the end never settles
+  for (i = NSAMPLES - 50; i < NSAMPLES; i++) {
+    power_w[i] = i % 2 ? 17 : 23;
+  }
+  assert(powercap_step_analyze(&cfg, 0, time_ns, power_w, NSAMPLES, &result) == 0);
+  assert(result.responded && !result.settled && result.settling_time_ns == 0);
+
+  // no response
+  for (i = 0; i < NSAMPLES; i++) {
+    power_w[i] = 40.1;
+  }
+  assert(powercap_step_analyze(&cfg, 0, time_ns, power_w, NSAMPLES, &result) == 0);
+  assert(!result.responded);
+  assert(result.dead_time_ns == 0 && result.rise_time_ns == 0);
+}
+
+typedef struct plant {
+  powercap_zone zone;
+  powercap_constraint constraint;
+  volatile int started;
+  volatile int stop;
+} plant;
+
+/* Simulate a zone that consumes its demand, or its power limit if lower */
+static void* plant_thread(void* arg) {
+  const struct timespec ts = { 0, 100000 };
+  plant* p = (plant*) arg;
+  char buf[32];
+  uint64_t energy_uj = 0;
+  uint64_t limit_uw;
+  uint64_t last_ns;
+  uint64_t now_ns;
+  struct timespec now;
+  int len;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  last_ns = (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+  while (!p->stop) {
+    nanosleep(&ts, NULL);
+    assert(powercap_constraint_get_power_limit_uw(&p->constraint, &limit_uw) == 0);
+    if (limit_uw > DEMAND_W * 1000000) {
+      limit_uw = DEMAND_W * 1000000;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    now_ns = (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+    // uW * ns = 1e-9 uJ
+    energy_uj += limit_uw * (now_ns - last_ns) / 1000000000;
+    last_ns = now_ns;
+    // fixed width, so a concurrent read never sees a partial value
+    len = snprintf(buf, sizeof(buf), "%20"PRIu64"\n", energy_uj);
+    assert(pwrite(p->zone.energy_uj, buf, (size_t) len, 0) == len);
+    p->started = 1;
+  }
+  return NULL;
+}
+
+static void test_response(void) {
+  powercap_step_config cfg = make_config();
+  powercap_step_result result;
+  powercap_constraint readonly = { 0 };
+  pthread_t thread;
+  plant p;
+  uint64_t limit_uw;
+  memset(&p, 0, sizeof(p));
+  p.zone.energy_uj = make_file_fixed(0, O_RDWR);
+  p.constraint.power_limit_uw = make_file_fixed(LIMIT_UW, O_RDWR);
+  readonly.power_limit_uw = make_file_fixed(LIMIT_UW, O_RDONLY);
+
+  assert(powercap_step_response(NULL, &p.constraint, &cfg, &result) == -EINVAL);
+  cfg.period_us = 0;
+  assert(powercap_step_response(&p.zone, &p.constraint, &cfg, &result) == -EINVAL);
+  cfg = make_config();
+  cfg.settle_us = cfg.timeout_us + 1;
+  assert(powercap_step_response(&p.zone, &p.constraint, &cfg, &result) == -EINVAL);
+  cfg = make_config();
+  cfg.power_limit_uw = STEP_LIMIT_UW;
+  // the simulated counter updates at irregular intervals, so smooth it and allow a wider band
+  cfg.filter.filter = POWERCAP_POWER_FILTER_EWMA;
+  cfg.filter.half_life_us = 1000;
+  cfg.settle_band = 0.2;
+  cfg.baseline_us = 50000;
+
+  // the step fails if the limit can't be written
+  assert(powercap_step_response(&p.zone, &readonly, &cfg, &result) < 0);
+
+  assert(pthread_create(&thread, NULL, plant_thread, &p) == 0);
+  while (!p.started) {
+    sched_yield();
+  }
+  assert(powercap_step_response(&p.zone, &p.constraint, &cfg, &result) == 0);
+  p.stop = 1;
+  pthread_join(thread, NULL);
+  assert(result.original_limit_uw == LIMIT_UW);
+  // the simulated counter may lag when the plant thread isn't scheduled
+  assert(result.initial_w > DEMAND_W * 0.8 && result.initial_w < DEMAND_W * 1.2);
+  assert(result.final_w > 8 && result.final_w < 12);
+  assert(result.responded && result.settled);
+  assert(result.settling_time_ns >= result.dead_time_ns);
+  assert(result.samples > 0);
+  // the original limit is restored
+  assert(powercap_constraint_get_power_limit_uw(&p.constraint, &limit_uw) == 0);
+  assert(limit_uw == LIMIT_UW);
+  close(p.zone.energy_uj);
+  close(p.constraint.power_limit_uw);
+  close(readonly.power_limit_uw);
+}
+
+int main(void) {
+  test_analyze();
+  test_response();
+  return 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Unit tests for streaming summary statistics.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "powercap-power-stream.h"
+#include "powercap-summary.h"
+
+#define ACCURACY 0.01
+#define NS_PER_MS 1000000ULL
+
+static int within(double a, double b, double rel) {
+  double d = a > b ? a - b : b - a;
+  return d <= rel * (b > 0 ? b : -b);
+}
+
+static void test_bad_args(void) {
+  powercap_summary s;
+  powercap_summary s2;
+  double v;
+  assert(powercap_summary_init(NULL, ACCURACY) == -EINVAL);
+  assert(powercap_summary_init(&s, 0) == -EINVAL);
+  assert(powercap_summary_init(&s, 1) == -EINVAL);
+  assert(powercap_summary_init(&s, ACCURACY) == 0);
+  assert(powercap_summary_init(&s2, ACCURACY * 2) == 0);
+  assert(powercap_summary_merge(&s, &s2) == -EINVAL);
+  // empty
+  assert(powercap_summary_get_quantile(&s, 0.5, &v) == -EINVAL);
+  assert(powercap_summary_add(&s, 1.0 / 0.0) == -EINVAL);
+  assert(powercap_summary_add(&s, 1.0) == 0);
+  assert(powercap_summary_get_quantile(&s, 1.5, &v) == -EINVAL);
+  assert(powercap_summary_get_quantile(&s, 0.5, NULL) == -EINVAL);
+}
+
+static void test_stats(void) {
+  powercap_summary all;
+  powercap_summary lo;
+  powercap_summary hi;
+  double q[] = { 0, 0.5, 0.95, 0.99, 1 };
+  double expect[] = { 1, 500, 950, 990, 1000 };
+  double v;
+  double v2;
+  uint32_t i;
+  assert(powercap_summary_init(&all, ACCURACY) == 0);
+  assert(powercap_summary_init(&lo, ACCURACY) == 0);
+  assert(powercap_summary_init(&hi, ACCURACY) == 0);
+  // add in a scrambled order
+  for (i = 0; i < 1000; i++) {
+    v = (double) ((i * 7919) % 1000 + 1);
+    assert(powercap_summary_add(&all, v) == 0);
+    assert(powercap_summary_add(v <= 500 ? &lo : &hi, v) == 0);
+  }
+  assert(powercap_summary_get_count(&all) == 1000);
+  assert(within(powercap_summary_get_min(&all), 1, 0));
+  assert(within(powercap_summary_get_max(&all), 1000, 0));
+  assert(within(powercap_summary_get_mean(&all), 500.5, 1e-12));
+  // (n^2 - 1) / 12
+  assert(within(powercap_summary_get_variance(&all), 83333.25, 1e-12));
+  for (i = 0; i < sizeof(q) / sizeof(q[0]); i++) {
+    assert(powercap_summary_get_quantile(&all, q[i], &v) == 0);
+    assert(within(v, expect[i], ACCURACY));
+  }
+
+  // merging gives the same result as adding everything to one summary
+  assert(powercap_summary_merge(&lo, &hi) == 0);
+  assert(powercap_summary_get_count(&lo) == 1000);
+  assert(within(powercap_summary_get_min(&lo), 1, 0));
+  assert(within(powercap_summary_get_max(&lo), 1000, 0));
+  assert(within(powercap_summary_get_mean(&lo), 500.5, 1e-12));
+  assert(within(powercap_summary_get_variance(&lo), 83333.25, 1e-9));
+  for (i = 0; i < sizeof(q) / sizeof(q[0]); i++) {
+    assert(powercap_summary_get_quantile(&all, q[i], &v) == 0);
+    assert(powercap_summary_get_quantile(&lo, q[i], &v2) == 0);
+    assert(within(v, v2, 1e-12));
+  }
+  // merging into an empty summary copies
+  assert(powercap_summary_reset(&hi) == 0);
+  assert(powercap_summary_get_count(&hi) == 0);
+  assert(powercap_summary_merge(&hi, &all) == 0);
+  assert(within(powercap_summary_get_variance(&hi), 83333.25, 1e-12));
+}
+
+static void test_range(void) {
+  powercap_summary s;
+  double v;
+  assert(powercap_summary_init(&s, ACCURACY) == 0);
+  // zero and negative values
+  assert(powercap_summary_add(&s, 0) == 0);
+  assert(powercap_summary_add(&s, -1) == 0);
+  assert(powercap_summary_get_quantile(&s, 0, &v) == 0);
+  assert(within(v, -1, 0));
+  // values spanning more than the buckets can cover collapse the lowest values
+  assert(powercap_summary_add(&s, 1e-20) == 0);
+  assert(powercap_summary_add(&s, 1e20) == 0);
+  assert(powercap_summary_add(&s, 1e19) == 0);
+  assert(powercap_summary_get_count(&s) == 5);
+  assert(powercap_summary_get_quantile(&s, 1, &v) == 0);
+  assert(within(v, 1e20, ACCURACY));
+  assert(powercap_summary_get_quantile(&s, 0.75, &v) == 0);
+  assert(within(v, 1e19, ACCURACY));
+  assert(powercap_summary_get_quantile(&s, 0.5, &v) == 0);
+  assert(v > 0 && v < 1e19);
+}
+
+static void test_add_samples(void) {
+  powercap_power_stream_config cfg = { POWERCAP_POWER_FILTER_RAW, 0, 0, 0 };
+  powercap_power_stream streams[2];
+  powercap_summary summaries[2];
+  // stride of 4, as if read from a sampler with a batch size of 4
+  uint64_t time_ns[4] = { NS_PER_MS, 2 * NS_PER_MS, 3 * NS_PER_MS, 0 };
+  uint64_t energy_uj[8] = { 0, 1000, 2000, 0, 0, 2000, 4000, 0 };
+  uint32_t c;
+  for (c = 0; c < 2; c++) {
+    assert(powercap_power_stream_init(&streams[c], &cfg, 0) == 0);
+    assert(powercap_summary_init(&summaries[c], ACCURACY) == 0);
+  }
+  assert(powercap_summary_add_samples(summaries, streams, 2, time_ns, energy_uj, 4, 3) == -EINVAL);
+  assert(powercap_summary_add_samples(summaries, streams, 2, time_ns, energy_uj, 3, 4) == 0);
+  // the first sample is a baseline
+  assert(powercap_summary_get_count(&summaries[0]) == 2);
+  assert(within(powercap_summary_get_mean(&summaries[0]), 1, 1e-12));
+  assert(within(powercap_summary_get_mean(&summaries[1]), 2, 1e-12));
+  // a repeated sample is ignored
+  assert(powercap_summary_add_samples(summaries, streams, 2, &time_ns[2], &energy_uj[2], 1, 4) == 0);
+  assert(powercap_summary_get_count(&summaries[0]) == 2);
+}
+
+static void test_window(void) {
+  const uint64_t interval_ns = 10 * NS_PER_MS;
+  powercap_summary intervals[4];
+  powercap_summary_window w;
+  powercap_summary s;
+  uint32_t i;
+  assert(powercap_summary_window_init(&w, intervals, 0, interval_ns, ACCURACY) == -EINVAL);
+  assert(powercap_summary_window_init(&w, intervals, 4, 0, ACCURACY) == -EINVAL);
+  assert(powercap_summary_window_init(&w, intervals, 4, interval_ns, 0) == -EINVAL);
+  assert(powercap_summary_window_init(&w, intervals, 4, interval_ns, ACCURACY) == 0);
+  assert(powercap_summary_window_get(&w, 0, NULL) == -EINVAL);
+  assert(powercap_summary_window_get(&w, 0, &s) == 0);
+  assert(powercap_summary_get_count(&s) == 0);
+
+  // one value per interval, starting at 1 ms
+  for (i = 0; i < 4; i++) {
+    assert(powercap_summary_window_add(&w, NS_PER_MS + i * interval_ns, i + 1) == 0);
+  }
+  assert(powercap_summary_window_get(&w, 35 * NS_PER_MS, &s) == 0);
+  assert(powercap_summary_get_count(&s) == 4);
+  assert(within(powercap_summary_get_mean(&s), 2.5, 1e-12));
+  // the first interval leaves the window, even before another value is added
+  assert(powercap_summary_window_get(&w, 45 * NS_PER_MS, &s) == 0);
+  assert(powercap_summary_get_count(&s) == 3);
+  assert(within(powercap_summary_get_min(&s), 2, 1e-12));
+  // the next value reuses the first interval
+  assert(powercap_summary_window_add(&w, 45 * NS_PER_MS, 5) == 0);
+  // an earlier value is added to the current interval
+  assert(powercap_summary_window_add(&w, 0, 6) == 0);
+  assert(powercap_summary_window_get(&w, 45 * NS_PER_MS, &s) == 0);
+  assert(powercap_summary_get_count(&s) == 5);
+  assert(within(powercap_summary_get_min(&s), 2, 1e-12) && within(powercap_summary_get_max(&s), 6, 1e-12));
+  // all intervals have left the window
+  assert(powercap_summary_window_get(&w, 100 * NS_PER_MS, &s) == 0);
+  assert(powercap_summary_get_count(&s) == 0);
+  assert(powercap_summary_window_add(&w, 1000 * NS_PER_MS, 7) == 0);
+  assert(powercap_summary_window_get(&w, 1000 * NS_PER_MS, &s) == 0);
+  assert(powercap_summary_get_count(&s) == 1);
+  assert(within(powercap_summary_get_mean(&s), 7, 1e-12));
+}
+
+int main(void) {
+  test_bad_args();
+  test_stats();
+  test_range();
+  test_add_samples();
+  test_window();
+  return 0;
+}
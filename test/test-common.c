@@ -0,0 +1,35 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Helpers shared by unit tests.
+ */
+// force assertions
+#undef NDEBUG
+#include <assert.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "test-common.h"
+
+int make_file(uint64_t val) {
+  char path[] = "/tmp/powercap-test-XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd > 0);
+  unlink(path);
+  assert(dprintf(fd, "%"PRIu64"\n", val) > 0);
+  return fd;
+}
+
+int make_file_fixed(uint64_t val, int flags) {
+  char path[] = "/tmp/powercap-test-XXXXXX";
+  int fd = mkstemp(path);
+  int ret;
+  assert(fd > 0);
+  assert(dprintf(fd, "%20"PRIu64"\n", val) > 0);
+  assert((ret = open(path, flags)) > 0);
+  close(fd);
+  unlink(path);
+  return ret;
+}
@@ -0,0 +1,20 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Helpers shared by unit tests that use temporary files in place of sysfs files.
+ */
+#ifndef _TEST_COMMON_H_
+#define _TEST_COMMON_H_
+
+#include <stdint.h>
+
+/* Create an unlinked temporary file containing "val" (formatted like sysfs), open for reading and writing */
+int make_file(uint64_t val);
+
+/*
+ * Create an unlinked temporary file containing "val" at a fixed width, opened with "flags", e.g., O_RDONLY.
+ * Rewriting a fixed-width value in place means a concurrent read never sees part of another value.
+ */
+int make_file_fixed(uint64_t val, int flags);
+
+#endif
@@ -0,0 +1,36 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Environment variables that powercap-prof uses to configure its preloaded module.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+
+#ifndef _POWERCAP_PROF_ENV_H
+#define _POWERCAP_PROF_ENV_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POWERCAP_PROF_ENV_FREQUENCY "POWERCAP_PROF_FREQUENCY"
+#define POWERCAP_PROF_ENV_INTERVAL "POWERCAP_PROF_INTERVAL"
+#define POWERCAP_PROF_ENV_MAX_FRAMES "POWERCAP_PROF_MAX_FRAMES"
+/* A powercap_profiler_weight value */
+#define POWERCAP_PROF_ENV_WEIGHT "POWERCAP_PROF_WEIGHT"
+#define POWERCAP_PROF_ENV_OUTPUT "POWERCAP_PROF_OUTPUT"
+/* The LD_PRELOAD value to restore for the profiled program's children */
+#define POWERCAP_PROF_ENV_LD_PRELOAD "POWERCAP_PROF_LD_PRELOAD"
+
+#define POWERCAP_PROF_DEFAULT_FREQUENCY 997
+#define POWERCAP_PROF_DEFAULT_INTERVAL 10000
+#define POWERCAP_PROF_DEFAULT_MAX_FRAMES 64
+#define POWERCAP_PROF_DEFAULT_CAPACITY 65536
+#define POWERCAP_PROF_DEFAULT_OUTPUT "powercap-prof.folded"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Preloaded by powercap-prof to profile a program from its start to its exit.
+ * Configured with environment variables set by powercap-prof, which are cleared (and the original LD_PRELOAD restored)
+ * so the program's children aren't profiled too.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "powercap-profiler.h"
+#include "powercap-rapl.h"
+#include "powercap-snapshot.h"
+#include "powercap-prof-env.h"
+
+static powercap_rapl_pkg* pkgs;
+static uint32_t npkgs;
+static powercap_profiler* profiler;
+static powercap_profiler_weight weight;
+static char output[4096];
+
+static uint32_t getenv_u32(const char* name, uint32_t dflt) {
+  const char* val = getenv(name);
+  return val == NULL ? dflt : (uint32_t) strtoul(val, NULL, 0);
+}
+
+static int init_snapshot(powercap_snapshot* snap) {
+  const powercap_rapl_domain* d;
+  uint32_t n = 0;
+  uint32_t i;
+  uint32_t k;
+  int ret;
+  // only package zones - their subzones overlap them, and psys includes them
+  for (i = 0; i < npkgs; i++) {
+    n += pkgs[i].ndomains > 0 && pkgs[i].domains[0].type == POWERCAP_RAPL_ZONE_PACKAGE;
+  }
+  if (n == 0) {
+    errno = ENODEV;
+    return -errno;
+  }
+  if ((ret = powercap_snapshot_init(snap, n))) {
+    return ret;
+  }
+  for (i = 0, n = 0; i < npkgs; i++) {
+    if (pkgs[i].ndomains > 0 && pkgs[i].domains[0].type == POWERCAP_RAPL_ZONE_PACKAGE) {
+      d = &pkgs[i].domains[0];
+      for (k = 0; k < POWERCAP_RAPL_NUM_INTERFACES && d->files[k].zone.energy_uj <= 0; k++);
+      if (k < POWERCAP_RAPL_NUM_INTERFACES && (ret = powercap_snapshot_set_zone(snap, n, &d->files[k].zone))) {
+        powercap_snapshot_destroy(snap);
+        return ret;
+      }
+      n++;
+    }
+  }
+  return 0;
+}
+
+__attribute__((constructor))
+static void powercap_prof_init(void) {
+  powercap_profiler_config cfg;
+  powercap_snapshot snap;
+  const char* val;
+  cfg.frequency_hz = getenv_u32(POWERCAP_PROF_ENV_FREQUENCY, POWERCAP_PROF_DEFAULT_FREQUENCY);
+  cfg.interval_us = getenv_u32(POWERCAP_PROF_ENV_INTERVAL, POWERCAP_PROF_DEFAULT_INTERVAL);
+  cfg.max_frames = getenv_u32(POWERCAP_PROF_ENV_MAX_FRAMES, POWERCAP_PROF_DEFAULT_MAX_FRAMES);
+  cfg.capacity = POWERCAP_PROF_DEFAULT_CAPACITY;
+  weight = getenv_u32(POWERCAP_PROF_ENV_WEIGHT, POWERCAP_PROFILER_WEIGHT_ENERGY) == POWERCAP_PROFILER_WEIGHT_SAMPLES ?
+           POWERCAP_PROFILER_WEIGHT_SAMPLES : POWERCAP_PROFILER_WEIGHT_ENERGY;
+  val = getenv(POWERCAP_PROF_ENV_OUTPUT);
+  snprintf(output, sizeof(output), "%s", val == NULL ? POWERCAP_PROF_DEFAULT_OUTPUT : val);
+  if ((val = getenv(POWERCAP_PROF_ENV_LD_PRELOAD)) == NULL) {
+    unsetenv("LD_PRELOAD");
+  } else {
+    setenv("LD_PRELOAD", val, 1);
+  }
+  unsetenv(POWERCAP_PROF_ENV_LD_PRELOAD);
+  unsetenv(POWERCAP_PROF_ENV_FREQUENCY);
+  unsetenv(POWERCAP_PROF_ENV_INTERVAL);
+  unsetenv(POWERCAP_PROF_ENV_MAX_FRAMES);
+  unsetenv(POWERCAP_PROF_ENV_WEIGHT);
+  unsetenv(POWERCAP_PROF_ENV_OUTPUT);
+
+  if (powercap_rapl_init_all(&pkgs, &npkgs, 1, 0)) {
+    perror("powercap-prof: Failed to initialize RAPL");
+    return;
+  }
+  if (init_snapshot(&snap)) {
+    perror("powercap-prof: Failed to find RAPL package zones");
+  } else {
+    if ((profiler = powercap_profiler_create(&snap, &cfg)) == NULL) {
+      perror("powercap-prof: Failed to create profiler");
+    } else if (powercap_profiler_start(profiler)) {
+      perror("powercap-prof: Failed to start profiler");
+      powercap_profiler_destroy(profiler);
+      profiler = NULL;
+    }
+    powercap_snapshot_destroy(&snap);
+  }
+  if (profiler == NULL) {
+    powercap_rapl_destroy_all(pkgs, npkgs);
+    pkgs = NULL;
+  }
+}
+
+__attribute__((destructor))
+static void powercap_prof_fini(void) {
+  powercap_profiler_stats stats;
+  FILE* f;
+  if (profiler == NULL) {
+    return;
+  }
+  if (powercap_profiler_stop(profiler)) {
+    perror("powercap-prof: Failed to stop profiler");
+  } else if ((f = fopen(output, "w")) == NULL) {
+    perror("powercap-prof: Failed to open output file");
+  } else {
+    if (powercap_profiler_write_folded(profiler, f, weight)) {
+      perror("powercap-prof: Failed to write folded stacks");
+    }
+    if (fclose(f)) {
+      perror("powercap-prof: Failed to close output file");
+    }
+    powercap_profiler_get_stats(profiler, &stats);
+    fprintf(stderr, "powercap-prof: %"PRIu64" samples (%"PRIu64" dropped) in %"PRIu64" stacks, "
+            "%.6f of %.6f J attributed, written to %s\n",
+            stats.samples, stats.dropped, stats.stacks, stats.attributed_energy_uj / 1000000.0,
+            (double) stats.total_energy_uj / 1000000.0, output);
+  }
+  powercap_profiler_destroy(profiler);
+  profiler = NULL;
+  powercap_rapl_destroy_all(pkgs, npkgs);
+  pkgs = NULL;
+}
@@ -0,0 +1,206 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Profile a program's energy by call stack.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "powercap-profiler.h"
+#include "powercap-prof-env.h"
+#include "util-common.h"
+
+#define PRELOAD_NAME "powercap-prof-preload.so"
+
+static const char short_options[] = "+ho:F:i:d:w:p:";
+
+static const struct option long_options[] = {
+  {"help",                no_argument,        NULL, 'h'},
+  {"output",              required_argument,  NULL, 'o'},
+  {"frequency",           required_argument,  NULL, 'F'},
+  {"interval",            required_argument,  NULL, 'i'},
+  {"max-frames",          required_argument,  NULL, 'd'},
+  {"weight",              required_argument,  NULL, 'w'},
+  {"preload",             required_argument,  NULL, 'p'},
+  {0, 0, 0, 0}
+};
+
+static void print_usage(void) {
+  printf("Usage: powercap-prof [OPTION]... COMMAND [ARG]...\n\n");
+  printf("Runs a command and attributes the energy consumed by RAPL packages to the\n");
+  printf("command's call stacks, in proportion to its share of CPU time.\n");
+  printf("Writes folded stacks for flame graph tools when the command exits.\n\n");
+  printf("Options:\n");
+  printf("  -h, --help                   Print this message and exit\n");
+  printf("  -o, --output=FILE            The output file (default: %s)\n", POWERCAP_PROF_DEFAULT_OUTPUT);
+  printf("  -F, --frequency=HZ           Stack samples per second of CPU time\n");
+  printf("                               (default: %d)\n", POWERCAP_PROF_DEFAULT_FREQUENCY);
+  printf("  -i, --interval=US            How often energy is read and attributed\n");
+  printf("                               (default: %d)\n", POWERCAP_PROF_DEFAULT_INTERVAL);
+  printf("  -d, --max-frames=N           Frames recorded per stack, at most %d\n", POWERCAP_PROFILER_MAX_FRAMES);
+  printf("                               (default: %d)\n", POWERCAP_PROF_DEFAULT_MAX_FRAMES);
+  printf("  -w, --weight=energy|samples  Write attributed energy in microjoules, or the\n");
+  printf("                               number of samples (default: energy)\n");
+  printf("  -p, --preload=PATH           The profiler module to preload\n");
+  printf("\nTime units: microseconds (us)\n");
+}
+
+static void print_common_help(void) {
+  printf("Considerations for common errors:\n");
+  printf("- Ensure that the intel_rapl_common kernel module is loaded\n");
+  printf("- Reading energy counters may require administrative (super-user) privileges\n");
+  printf("- Only dynamically linked programs can be profiled\n");
+  printf("- Only exported symbols are named - link programs with -rdynamic to export theirs\n");
+}
+
+static const char* find_preload(char* buf, size_t len) {
+  char* slash;
+  ssize_t n;
+  // prefer a module next to this executable, e.g., in a build tree
+  if ((n = readlink("/proc/self/exe", buf, len)) > 0 && (size_t) n < len) {
+    buf[n] = '\0';
+    if ((slash = strrchr(buf, '/')) != NULL &&
+        (size_t) (slash - buf) + sizeof("/"PRELOAD_NAME) <= len) {
+      strcpy(slash + 1, PRELOAD_NAME);
+      if (!access(buf, R_OK)) {
+        return buf;
+      }
+    }
+  }
+  return POWERCAP_PROF_PRELOAD;
+}
+
+static int set_env_u32(const char* name, const u32_param* p) {
+  char buf[16];
+  if (!p->set) {
+    return 0;
+  }
+  snprintf(buf, sizeof(buf), "%"PRIu32, p->val);
+  return setenv(name, buf, 1);
+}
+
+int main(int argc, char** argv) {
+  char exe[PATH_MAX];
+  char* ld_preload;
+  const char* preload = NULL;
+  const char* output = NULL;
+  const char* old_preload;
+  u32_param frequency = {0, 0};
+  u32_param interval = {0, 0};
+  u32_param max_frames = {0, 0};
+  u32_param weight = {0, 0};
+  size_t len;
+  int c;
+  int cont = 1;
+  int ret = 0;
+
+  /* Parse command-line arguments */
+  while (cont) {
+    c = getopt_long(argc, argv, short_options, long_options, NULL);
+    switch (c) {
+    case -1:
+      cont = 0;
+      break;
+    case 'h':
+      print_usage();
+      return EXIT_SUCCESS;
+    case 'o':
+      output = optarg;
+      break;
+    case 'F':
+      ret = set_u32_param(&frequency, optarg, &cont);
+      break;
+    case 'i':
+      ret = set_u32_param(&interval, optarg, &cont);
+      break;
+    case 'd':
+      ret = set_u32_param(&max_frames, optarg, &cont);
+      break;
+    case 'w':
+      if (weight.set) {
+        cont = 0;
+        ret = -EINVAL;
+      } else if (!strcmp(optarg, "energy")) {
+        weight.val = POWERCAP_PROFILER_WEIGHT_ENERGY;
+      } else if (!strcmp(optarg, "samples")) {
+        weight.val = POWERCAP_PROFILER_WEIGHT_SAMPLES;
+      } else {
+        cont = 0;
+        ret = -EINVAL;
+      }
+      weight.set = 1;
+      break;
+    case 'p':
+      preload = optarg;
+      break;
+    case '?':
+    default:
+      cont = 0;
+      ret = -EINVAL;
+      break;
+    }
+  }
+
+  /* Verify arguments */
+  if (ret) {
+    fprintf(stderr, "Invalid arguments\n");
+  } else if (optind >= argc) {
+    fprintf(stderr, "Must specify COMMAND\n");
+    ret = -EINVAL;
+  } else if ((frequency.set && (frequency.val == 0 || frequency.val > 1000000)) ||
+             (interval.set && interval.val == 0) ||
+             (max_frames.set && (max_frames.val == 0 || max_frames.val > POWERCAP_PROFILER_MAX_FRAMES))) {
+    fprintf(stderr, "Frequency, interval, and max frames must be in range\n");
+    ret = -EINVAL;
+  }
+  if (ret) {
+    print_usage();
+    return EXIT_FAILURE;
+  }
+
+  /* Configure the preloaded module */
+  if (preload == NULL) {
+    preload = find_preload(exe, sizeof(exe));
+  }
+  if (access(preload, R_OK)) {
+    fprintf(stderr, "Cannot access profiler module: %s\n", preload);
+    return EXIT_FAILURE;
+  }
+  // append to an existing preload list so it still applies to the command
+  old_preload = getenv("LD_PRELOAD");
+  len = strlen(preload) + (old_preload == NULL ? 0 : strlen(old_preload) + 1) + 1;
+  if ((ld_preload = malloc(len)) == NULL) {
+    perror("malloc");
+    return EXIT_FAILURE;
+  }
+  if (old_preload == NULL || old_preload[0] == '\0') {
+    snprintf(ld_preload, len, "%s", preload);
+  } else {
+    snprintf(ld_preload, len, "%s:%s", old_preload, preload);
+  }
+  if ((old_preload != NULL && setenv(POWERCAP_PROF_ENV_LD_PRELOAD, old_preload, 1)) ||
+      setenv("LD_PRELOAD", ld_preload, 1) ||
+      set_env_u32(POWERCAP_PROF_ENV_FREQUENCY, &frequency) ||
+      set_env_u32(POWERCAP_PROF_ENV_INTERVAL, &interval) ||
+      set_env_u32(POWERCAP_PROF_ENV_MAX_FRAMES, &max_frames) ||
+      set_env_u32(POWERCAP_PROF_ENV_WEIGHT, &weight) ||
+      (output != NULL && setenv(POWERCAP_PROF_ENV_OUTPUT, output, 1))) {
+    perror("setenv");
+    free(ld_preload);
+    return EXIT_FAILURE;
+  }
+  free(ld_preload);
+
+  execvp(argv[optind], &argv[optind]);
+  perror("Failed to execute command");
+  print_common_help();
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,340 @@
+/*
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Measure the power response to a step change in a powercap power limit.
+ *
+ * @author Connor Imes
+ * @date 2026-10-18
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "powercap.h"
+#include "powercap-step.h"
+#include "powercap-sysfs.h"
+#include "util-common.h"
+
+static const char short_options[] = "-hz:c:l:f:P:b:t:s:B:m:e:";
+
+static const struct option long_options[] = {
+  {"help",                no_argument,        NULL, 'h'},
+  {"zone",                required_argument,  NULL, 'z'},
+  {"constraint",          required_argument,  NULL, 'c'},
+  {"power-limit",         required_argument,  NULL, 'l'},
+  {"fraction",            required_argument,  NULL, 'f'},
+  {"period",              required_argument,  NULL, 'P'},
+  {"baseline",            required_argument,  NULL, 'b'},
+  {"timeout",             required_argument,  NULL, 't'},
+  {"settle",              required_argument,  NULL, 's'},
+  {"band",                required_argument,  NULL, 'B'},
+  {"min-step",            required_argument,  NULL, 'm'},
+  {"half-life",           required_argument,  NULL, 'e'},
+  {0, 0, 0, 0}
+};
+
+static void print_usage(void) {
+  printf("Usage: powercap-step NAME -z ZONE(S) (-l UW | -f FRACTION) [OPTION]...\n\n");
+  printf("Measures how a zone's power responds to a step change in a constraint's power limit, then restores the\n");
+  printf("original limit.\n");
+  printf("The control type NAME must not be empty or contain a '.' or '/'.\n\n");
+  printf("Options:\n");
+  printf("  -h, --help                   Print this message and exit\n");
+  printf("  -z, --zone=ZONE(S)           The zone/subzone numbers in the control type's\n");
+  printf("                               powercap tree (required)\n");
+  printf("                               Separate zones/subzones with a colon\n");
+  printf("                               E.g., for zone 0, subzone 2: \"-z 0:2\"\n");
+  printf("  -c, --constraint=CONSTRAINT  The constraint number (all constraints in turn\n");
+  printf("                               by default)\n");
+  printf("  -l, --power-limit=UW         The power limit to step to\n");
+  printf("  -f, --fraction=FRACTION      Step to a fraction of each constraint's current\n");
+  printf("                               power limit, in (0, 1], e.g., 0.5\n");
+  printf("  -P, --period=US              Time between energy samples (default: 1000)\n");
+  printf("  -b, --baseline=US            Time to measure power before the step\n");
+  printf("                               (default: 1000000)\n");
+  printf("  -t, --timeout=US             Maximum time to wait for power to settle\n");
+  printf("                               (default: 5000000)\n");
+  printf("  -s, --settle=US              Time power must stay within the settling band\n");
+  printf("                               (default: 200000)\n");
+  printf("  -B, --band=FRACTION          Settling band half-width, relative to the step\n");
+  printf("                               size (default: 0.05)\n");
+  printf("  -m, --min-step=W             Smaller changes in power are considered no\n");
+  printf("                               response (default: 0.5)\n");
+  printf("  -e, --half-life=US           Smooth power with an exponentially weighted\n");
+  printf("                               moving average (default: 0, unfiltered)\n");
+  printf("\nPower units: microwatts (uW) unless otherwise stated\n");
+  printf("Time units: microseconds (us)\n");
+}
+
+static void print_common_help(void) {
+  printf("Considerations for common errors:\n");
+  printf("- Ensure that the control type exists, which may require loading a kernel module\n");
+  printf("- Ensure that you run with administrative (super-user) privileges\n");
+  printf("- Not all zones have an energy counter\n");
+  printf("- Power only responds to a limit that's binding, so run a workload that consumes more power than the limit\n");
+}
+
+static int set_double_param(double* val, const char* optarg, int* cont) {
+  char* end;
+  errno = 0;
+  *val = strtod(optarg, &end);
+  if (errno || end == optarg || *end != '\0' || !(*val >= 0)) {
+    *cont = 0;
+    return -EINVAL;
+  }
+  return 0;
+}
+
+static void close_fd(int fd) {
+  if (fd > 0) {
+    close(fd);
+  }
+}
+
+static void print_result(const char* zones_str, uint32_t constraint, const char* name, uint64_t limit_uw,
+                         const powercap_step_result* r) {
+  printf("zone %s constraint %"PRIu32" (%s)\n", zones_str, constraint, name);
+  printf("  power_limit_uw: %"PRIu64" -> %"PRIu64" (write took %"PRIu64" ns)\n",
+         r->original_limit_uw, limit_uw, r->write_ns);
+  printf("  initial_power_w: %.3f\n", r->initial_w);
+  printf("  final_power_w: %.3f\n", r->final_w);
+  if (r->responded) {
+    printf("  dead_time_us: %.1f\n", (double) r->dead_time_ns / 1000.0);
+    printf("  rise_time_us: %.1f\n", (double) r->rise_time_ns / 1000.0);
+    printf("  overshoot_w: %.3f (%.1f%%)\n", r->overshoot_w, r->overshoot * 100.0);
+  } else {
+    printf("  no response\n");
+  }
+  if (r->settled) {
+    printf("  settling_time_us: %.1f\n", (double) r->settling_time_ns / 1000.0);
+  } else {
+    printf("  not settled\n");
+  }
+  printf("  samples: %"PRIu32"\n", r->samples);
+}
+
+static int step_constraint(const char* control_type, const uint32_t* zones, uint32_t depth, const char* zones_str,
+                           uint32_t constraint_num, const powercap_zone* zone, const u64_param* power_limit,
+                           double fraction, powercap_step_config* cfg) {
+  powercap_constraint constraint = { 0 };
+  powercap_step_result result;
+  sigset_t set;
+  sigset_t old_set;
+  char name[64] = "";
+  uint64_t original_uw;
+  int ret = 0;
+  if (powercap_constraint_file_open(&constraint, POWERCAP_CONSTRAINT_FILE_POWER_LIMIT_UW, control_type, zones, depth,
+                                    constraint_num, O_RDWR) < 0) {
+    ret = -errno;
+    perror("Error opening constraint power limit");
+    return ret;
+  }
+  if (powercap_constraint_file_open(&constraint, POWERCAP_CONSTRAINT_FILE_NAME, control_type, zones, depth,
+                                    constraint_num, O_RDONLY) < 0 ||
+      powercap_constraint_get_name(&constraint, name, sizeof(name)) < 0) {
+    snprintf(name, sizeof(name), "unknown");
+  }
+  if (power_limit->set) {
+    cfg->power_limit_uw = power_limit->val;
+  } else if ((ret = powercap_constraint_get_power_limit_uw(&constraint, &original_uw))) {
+    perror("Error getting constraint power limit");
+  } else {
+    cfg->power_limit_uw = (uint64_t) ((double) original_uw * fraction);
+  }
+  if (!ret) {
+    // defer termination signals until the original limit is restored, then they're delivered when unblocked
+    sigemptyset(&set);
+    sigaddset(&set, SIGHUP);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGQUIT);
+    sigaddset(&set, SIGTERM);
+    sigprocmask(SIG_BLOCK, &set, &old_set);
+    if ((ret = powercap_step_response(zone, &constraint, cfg, &result))) {
+      perror("Error measuring step response");
+    } else {
+      print_result(zones_str, constraint_num, name, cfg->power_limit_uw, &result);
+    }
+    sigprocmask(SIG_SETMASK, &old_set, NULL);
+  }
+  close_fd(constraint.power_limit_uw);
+  close_fd(constraint.name);
+  return ret;
+}
+
+int main(int argc, char** argv) {
+  const char* control_type = NULL;
+  const char* zones_str = NULL;
+  uint32_t zones[MAX_ZONE_DEPTH] = { 0 };
+  uint32_t depth = 0;
+  u32_param constraint = {0, 0};
+  u64_param power_limit = {0, 0};
+  u64_param period = {0, 0};
+  u64_param baseline = {0, 0};
+  u64_param timeout = {0, 0};
+  u64_param settle = {0, 0};
+  u64_param half_life = {0, 0};
+  double fraction = 0;
+  int is_set_fraction = 0;
+  double band = 0.05;
+  double min_step = 0.5;
+  powercap_step_config cfg;
+  powercap_zone zone = { 0 };
+  uint32_t i;
+  int c;
+  int cont = 1;
+  int ret = 0;
+  int err;
+
+  /* Parse command-line arguments */
+  while (cont) {
+    c = getopt_long(argc, argv, short_options, long_options, NULL);
+    switch (c) {
+    case -1:
+      cont = 0;
+      break;
+    case 'h':
+      print_usage();
+      return EXIT_SUCCESS;
+    case 1:
+      if (control_type) {
+        cont = 0;
+        ret = -EINVAL;
+      }
+      control_type = optarg;
+      break;
+    case 'z':
+      ret = parse_zones(optarg, zones, MAX_ZONE_DEPTH, &depth, &cont);
+      zones_str = optarg;
+      break;
+    case 'c':
+      ret = set_u32_param(&constraint, optarg, &cont);
+      break;
+    case 'l':
+      ret = set_u64_param(&power_limit, optarg, &cont);
+      break;
+    case 'f':
+      if (is_set_fraction) {
+        cont = 0;
+        ret = -EINVAL;
+      } else {
+        ret = set_double_param(&fraction, optarg, &cont);
+      }
+      is_set_fraction = 1;
+      break;
+    case 'P':
+      ret = set_u64_param(&period, optarg, &cont);
+      break;
+    case 'b':
+      ret = set_u64_param(&baseline, optarg, &cont);
+      break;
+    case 't':
+      ret = set_u64_param(&timeout, optarg, &cont);
+      break;
+    case 's':
+      ret = set_u64_param(&settle, optarg, &cont);
+      break;
+    case 'B':
+      ret = set_double_param(&band, optarg, &cont);
+      break;
+    case 'm':
+      ret = set_double_param(&min_step, optarg, &cont);
+      break;
+    case 'e':
+      ret = set_u64_param(&half_life, optarg, &cont);
+      break;
+    case '?':
+    default:
+      cont = 0;
+      ret = -EINVAL;
+      break;
+    }
+  }
+
+  /* Verify argument combinations */
+  cfg.power_limit_uw = 0;
+  cfg.period_us = period.set ? period.val : 1000;
+  cfg.baseline_us = baseline.set ? baseline.val : 1000000;
+  cfg.timeout_us = timeout.set ? timeout.val : 5000000;
+  cfg.settle_us = settle.set ? settle.val : 200000;
+  cfg.settle_band = band;
+  cfg.min_step_w = min_step;
+  memset(&cfg.filter, 0, sizeof(cfg.filter));
+  cfg.filter.filter = half_life.val > 0 ? POWERCAP_POWER_FILTER_EWMA : POWERCAP_POWER_FILTER_RAW;
+  cfg.filter.half_life_us = half_life.val;
+  if (ret) {
+    fprintf(stderr, "Invalid arguments\n");
+  } else if (!is_valid_powercap_control_type(control_type)) {
+    fprintf(stderr, "Must specify control type NAME; value must not be empty or contain any '.' or '/' characters\n");
+    ret = -EINVAL;
+  } else if (!depth) {
+    fprintf(stderr, "Must specify -z/--zone\n");
+    ret = -EINVAL;
+  } else if (power_limit.set == is_set_fraction) {
+    fprintf(stderr, "Must specify exactly one of -l/--power-limit or -f/--fraction\n");
+    ret = -EINVAL;
+  } else if (is_set_fraction && !(fraction > 0 && fraction <= 1)) {
+    fprintf(stderr, "Fraction must be > 0 and <= 1\n");
+    ret = -EINVAL;
+  } else if (cfg.period_us == 0 || cfg.timeout_us == 0) {
+    fprintf(stderr, "Period and timeout must be > 0\n");
+    ret = -EINVAL;
+  } else if (cfg.settle_us > cfg.timeout_us) {
+    fprintf(stderr, "Settle time must not exceed timeout\n");
+    ret = -EINVAL;
+  }
+  if (ret) {
+    print_usage();
+    return EXIT_FAILURE;
+  }
+
+  /* Check if control type/zones/constraint exist */
+  if (powercap_sysfs_control_type_exists(control_type)) {
+    fprintf(stderr, "Control type does not exist\n");
+    ret = -EINVAL;
+  } else if (powercap_sysfs_zone_exists(control_type, zones, depth)) {
+    fprintf(stderr, "Zone does not exist\n");
+    ret = -EINVAL;
+  } else if (constraint.set && powercap_sysfs_constraint_exists(control_type, zones, depth, constraint.val)) {
+    fprintf(stderr, "Constraint does not exist\n");
+    ret = -EINVAL;
+  } else if (!constraint.set && powercap_sysfs_constraint_exists(control_type, zones, depth, 0)) {
+    fprintf(stderr, "Zone has no constraints\n");
+    ret = -EINVAL;
+  }
+  if (ret) {
+    print_common_help();
+    return EXIT_FAILURE;
+  }
+
+  /* Measure each constraint's step response */
+  if (powercap_zone_file_open(&zone, POWERCAP_ZONE_FILE_ENERGY_UJ, control_type, zones, depth, O_RDONLY) < 0) {
+    perror("Error opening zone energy counter");
+    print_common_help();
+    return EXIT_FAILURE;
+  }
+  // optional, but without it a counter wraparound during the measurement is misinterpreted
+  powercap_zone_file_open(&zone, POWERCAP_ZONE_FILE_MAX_ENERGY_RANGE_UJ, control_type, zones, depth, O_RDONLY);
+  if (constraint.set) {
+    ret = step_constraint(control_type, zones, depth, zones_str, constraint.val, &zone, &power_limit, fraction, &cfg);
+  } else {
+    for (i = 0; !powercap_sysfs_constraint_exists(control_type, zones, depth, i); i++) {
+      // keep going, but report the first error
+      if ((err = step_constraint(control_type, zones, depth, zones_str, i, &zone, &power_limit, fraction, &cfg)) &&
+          !ret) {
+        ret = err;
+      }
+    }
+  }
+  close_fd(zone.energy_uj);
+  close_fd(zone.max_energy_range_uj);
+  if (ret) {
+    print_common_help();
+  }
+
+  return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}